@@ -6,12 +6,20 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/secondary_cache.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/table.h"
+#include "leveldb/table_builder.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
+#include "table/merger.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -30,11 +38,20 @@
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
+//      multireadrandom -- read N times in random order, --multiget_batch_size
+//                         keys per MultiGet() call
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
+//      mergescan     -- scan N entries spread over --l0_files overlapping
+//                       tables through one merging iterator
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
+//      filterprobe   -- look up N missing keys in a filter over N keys built
+//                       with the --filter_policy filter policy
+//      cachelookup   -- look up N random keys among N in the block cache,
+//                       inserting the missing ones with a charge of
+//                       --block_size
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
@@ -93,6 +110,25 @@ static int FLAGS_block_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Kind of cache of --cache_size bytes: "lru" or "clock".
+static const char* FLAGS_cache_type = "lru";
+
+// Fraction of an LRU cache reserved for entries of high priority and for
+// entries read more than once.  0 means plain LRU.
+static double FLAGS_cache_high_pri_pool_ratio = 0.5;
+
+// If true, an LRU cache turns away new entries whose key was read less
+// often than that of the entry they would evict.
+static bool FLAGS_cache_admission_filter = false;
+
+// Number of bytes of a compressed secondary cache below the block cache.
+// Zero means no secondary cache.
+static int FLAGS_secondary_cache_size = 0;
+
+// If set, the secondary cache holds the blocks in the files of this
+// directory instead of in memory, and keeps them across runs.
+static const char* FLAGS_persistent_cache_dir = nullptr;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -100,6 +136,32 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// Kind of filter built with --bloom_bits bits per key: "bloom",
+// "blocked_bloom" or "binary_fuse".  For binary fuse filters, --bloom_bits is
+// the size of a bloom filter with the same false positive rate.
+static const char* FLAGS_filter_policy = "bloom";
+
+// Layout of the filters: 0 for block-based, 1 for full, 2 for partitioned
+// (see FilterBlockType).
+static int FLAGS_filter_block_type = 0;
+
+// Index of the data blocks: 0 for binary search, 1 for binary search and
+// a hash index (see DataBlockIndexType).
+static int FLAGS_data_block_index_type = 0;
+
+// Approximate size of index partitions.  0 means a single index block.
+static int FLAGS_index_partition_size = 0;
+
+// If true, keep index blocks and filters in the block cache, pinning those
+// of level 0 if --pin_l0_filter_and_index_blocks_in_cache is set.
+static bool FLAGS_cache_index_and_filter_blocks = false;
+static bool FLAGS_pin_l0_filter_and_index_blocks_in_cache = false;
+
+// If positive, the first --prefix_size bytes of the keys are added to the
+// filters, and seekrandom only iterates over the keys with the prefix of
+// its target (ReadOptions::prefix_same_as_start).
+static int FLAGS_prefix_size = 0;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -108,6 +170,40 @@ static bool FLAGS_use_existing_db = false;
 // If true, reuse existing log/MANIFEST files when re-opening a database.
 static bool FLAGS_reuse_logs = false;
 
+// If true, overlap log writes of one write group with the memtable
+// inserts of the previous one.
+static bool FLAGS_enable_pipelined_write = false;
+
+// If true, the writers of a write group insert into the memtable in
+// parallel.
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
+// Number of keys looked up per MultiGet() call by "multireadrandom".
+static int FLAGS_multiget_batch_size = 16;
+
+// Number of write buffers held in memory, and the number of full ones
+// flushed together.
+static int FLAGS_max_write_buffer_number = 2;
+static int FLAGS_min_write_buffer_number_to_merge = 1;
+
+// Number of overlapping tables read by the "mergescan" benchmark.
+static int FLAGS_l0_files = 8;
+
+// Maximum number of major compactions that may run at the same time.
+static int FLAGS_max_background_compactions = 1;
+
+// Maximum number of threads that a single compaction is split across.
+static int FLAGS_max_subcompactions = 1;
+
+// Number of level-0 files at which writes are slowed down and stopped.
+// Negative means use the default settings.
+static int FLAGS_level0_slowdown_writes_trigger = -1;
+static int FLAGS_level0_stop_writes_trigger = -1;
+
+// Rate in bytes per second at which slowed down writes are admitted.
+// Negative means use the default setting.
+static int FLAGS_delayed_write_rate = -1;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -310,7 +406,9 @@ struct ThreadState {
 class Benchmark {
  private:
   Cache* cache_;
+  SecondaryCache* secondary_cache_;
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
   DB* db_;
   int num_;
   int value_size_;
@@ -319,6 +417,55 @@ class Benchmark {
   int reads_;
   int heap_counter_;
 
+  static Cache* NewCache() {
+    if (FLAGS_cache_size < 0) {
+      return nullptr;
+    }
+    const Slice kind = FLAGS_cache_type;
+    if (kind == Slice("lru")) {
+      return NewLRUCache(FLAGS_cache_size, FLAGS_cache_high_pri_pool_ratio,
+                         FLAGS_cache_admission_filter);
+    } else if (kind == Slice("clock")) {
+      return NewClockCache(FLAGS_cache_size, FLAGS_block_size);
+    }
+    fprintf(stderr, "unknown cache type '%s'\n", FLAGS_cache_type);
+    exit(1);
+  }
+
+  static SecondaryCache* NewSecondaryCache() {
+    if (FLAGS_secondary_cache_size <= 0) {
+      return nullptr;
+    }
+    if (FLAGS_persistent_cache_dir == nullptr) {
+      return NewCompressedSecondaryCache(FLAGS_secondary_cache_size);
+    }
+    SecondaryCache* cache;
+    Status s = NewPersistentSecondaryCache(g_env, FLAGS_persistent_cache_dir,
+                                           FLAGS_secondary_cache_size, &cache);
+    if (!s.ok()) {
+      fprintf(stderr, "open persistent cache error: %s\n",
+              s.ToString().c_str());
+      exit(1);
+    }
+    return cache;
+  }
+
+  static const FilterPolicy* NewFilterPolicy() {
+    if (FLAGS_bloom_bits < 0) {
+      return nullptr;
+    }
+    const Slice kind = FLAGS_filter_policy;
+    if (kind == Slice("bloom")) {
+      return NewBloomFilterPolicy(FLAGS_bloom_bits);
+    } else if (kind == Slice("blocked_bloom")) {
+      return NewBlockedBloomFilterPolicy(FLAGS_bloom_bits);
+    } else if (kind == Slice("binary_fuse")) {
+      return NewBinaryFuseFilterPolicy(FLAGS_bloom_bits);
+    }
+    fprintf(stderr, "unknown filter policy '%s'\n", FLAGS_filter_policy);
+    exit(1);
+  }
+
   void PrintHeader() {
     const int kKeySize = 16;
     PrintEnvironment();
@@ -395,10 +542,12 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
-        filter_policy_(FLAGS_bloom_bits >= 0
-                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                           : nullptr),
+      : cache_(NewCache()),
+        secondary_cache_(NewSecondaryCache()),
+        filter_policy_(NewFilterPolicy()),
+        prefix_extractor_(FLAGS_prefix_size > 0
+                              ? NewFixedPrefixTransform(FLAGS_prefix_size)
+                              : nullptr),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -420,7 +569,9 @@ class Benchmark {
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete secondary_cache_;
     delete filter_policy_;
+    delete prefix_extractor_;
   }
 
   void Run() {
@@ -483,10 +634,14 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
         method = &Benchmark::SeekRandom;
+      } else if (name == Slice("mergescan")) {
+        method = &Benchmark::MergeScan;
       } else if (name == Slice("readhot")) {
         method = &Benchmark::ReadHot;
       } else if (name == Slice("readrandomsmall")) {
@@ -503,6 +658,10 @@ class Benchmark {
         method = &Benchmark::Compact;
       } else if (name == Slice("crc32c")) {
         method = &Benchmark::Crc32c;
+      } else if (name == Slice("filterprobe")) {
+        method = &Benchmark::FilterProbe;
+      } else if (name == Slice("cachelookup")) {
+        method = &Benchmark::CacheLookup;
       } else if (name == Slice("snappycomp")) {
         method = &Benchmark::SnappyCompress;
       } else if (name == Slice("snappyuncomp")) {
@@ -630,6 +789,68 @@ class Benchmark {
     thread->stats.AddMessage(label);
   }
 
+  void FilterProbe(ThreadState* thread) {
+    if (filter_policy_ == nullptr) {
+      thread->stats.AddMessage("(no filter policy, set --bloom_bits)");
+      return;
+    }
+    char key[100];
+    std::vector<std::string> keys;
+    for (int i = 0; i < num_; i++) {
+      snprintf(key, sizeof(key), "%016d", i);
+      keys.push_back(key);
+    }
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::string filter;
+    const uint64_t build_start = g_env->NowMicros();
+    filter_policy_->CreateFilter(key_slices.data(), num_, &filter);
+    const uint64_t build_micros = g_env->NowMicros() - build_start;
+
+    // Do not count the time spent building the filter
+    thread->stats.Start();
+    int matches = 0;
+    for (int i = 0; i < reads_; i++) {
+      const int k = thread->rand.Next() % num_;
+      snprintf(key, sizeof(key), "%016d.", k);  // Not among the keys
+      if (filter_policy_->KeyMayMatch(key, filter)) {
+        matches++;
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg),
+             "(%.2f%% false positives, %.1f bits/key, build %.1f ns/key)",
+             matches * 100.0 / reads_, filter.size() * 8.0 / num_,
+             build_micros * 1000.0 / num_);
+    thread->stats.AddMessage(msg);
+  }
+
+  static void NoopDeleter(const Slice& key, void* value) {}
+
+  void CacheLookup(ThreadState* thread) {
+    if (cache_ == nullptr) {
+      thread->stats.AddMessage("(no block cache, set --cache_size)");
+      return;
+    }
+    char key[100];
+    int hits = 0;
+    for (int i = 0; i < reads_; i++) {
+      const int k = thread->rand.Next() % num_;
+      snprintf(key, sizeof(key), "cachelookup%016d", k);
+      Cache::Handle* handle = cache_->Lookup(key);
+      if (handle != nullptr) {
+        hits++;
+      } else {
+        handle = cache_->Insert(key, nullptr, FLAGS_block_size, &NoopDeleter);
+      }
+      cache_->Release(handle);
+      thread->stats.FinishedSingleOp();
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d hit)", hits, reads_);
+    thread->stats.AddMessage(msg);
+  }
+
   void SnappyCompress(ThreadState* thread) {
     RandomGenerator gen;
     Slice input = gen.Generate(Options().block_size);
@@ -683,12 +904,40 @@ class Benchmark {
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.secondary_cache = secondary_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.max_write_buffer_number = FLAGS_max_write_buffer_number;
+    options.min_write_buffer_number_to_merge =
+        FLAGS_min_write_buffer_number_to_merge;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.filter_block_type =
+        static_cast<FilterBlockType>(FLAGS_filter_block_type);
+    options.data_block_index_type =
+        static_cast<DataBlockIndexType>(FLAGS_data_block_index_type);
+    options.index_partition_size = FLAGS_index_partition_size;
+    options.cache_index_and_filter_blocks = FLAGS_cache_index_and_filter_blocks;
+    options.pin_l0_filter_and_index_blocks_in_cache =
+        FLAGS_pin_l0_filter_and_index_blocks_in_cache;
+    options.prefix_extractor = prefix_extractor_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.enable_pipelined_write = FLAGS_enable_pipelined_write;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.max_subcompactions = FLAGS_max_subcompactions;
+    if (FLAGS_level0_slowdown_writes_trigger >= 0) {
+      options.level0_slowdown_writes_trigger =
+          FLAGS_level0_slowdown_writes_trigger;
+    }
+    if (FLAGS_level0_stop_writes_trigger >= 0) {
+      options.level0_stop_writes_trigger = FLAGS_level0_stop_writes_trigger;
+    }
+    if (FLAGS_delayed_write_rate >= 0) {
+      options.delayed_write_rate = FLAGS_delayed_write_rate;
+    }
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -764,6 +1013,88 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  // Write FLAGS_l0_files tables whose key ranges all overlap, like the
+  // files in level-0, and time a full scan over a merging iterator.
+  void MergeScan(ThreadState* thread) {
+    const int n = FLAGS_l0_files;
+    Options options;
+    options.block_size = FLAGS_block_size;
+    options.block_cache = cache_;
+    std::vector<std::string> fnames;
+    std::vector<RandomAccessFile*> files;
+    std::vector<Table*> tables;
+    std::vector<Iterator*> list;
+    RandomGenerator gen;
+    Status s;
+    for (int f = 0; f < n && s.ok(); f++) {
+      char fname[100];
+      snprintf(fname, sizeof(fname), "%s/mergescan-%d-%04d.ldb", FLAGS_db,
+               thread->tid, f);
+      fnames.push_back(fname);
+      WritableFile* file;
+      s = g_env->NewWritableFile(fname, &file);
+      if (!s.ok()) {
+        break;
+      }
+      TableBuilder builder(options, file);
+      for (int i = f; i < num_; i += n) {
+        char key[100];
+        snprintf(key, sizeof(key), "%016d", i);
+        builder.Add(key, gen.Generate(value_size_));
+      }
+      s = builder.Finish();
+      if (s.ok()) {
+        s = file->Close();
+      }
+      delete file;
+      uint64_t size;
+      if (s.ok()) {
+        s = g_env->GetFileSize(fname, &size);
+      }
+      RandomAccessFile* raf = nullptr;
+      if (s.ok()) {
+        s = g_env->NewRandomAccessFile(fname, &raf);
+      }
+      Table* table = nullptr;
+      if (s.ok()) {
+        files.push_back(raf);
+        s = Table::Open(options, raf, size, &table);
+      }
+      if (s.ok()) {
+        tables.push_back(table);
+        list.push_back(table->NewIterator(ReadOptions()));
+      }
+    }
+    if (!s.ok()) {
+      fprintf(stderr, "mergescan error: %s\n", s.ToString().c_str());
+      exit(1);
+    }
+
+    // Do not count the time spent building the tables
+    thread->stats.Start();
+    Iterator* iter = NewMergingIterator(options.comparator, list.data(),
+                                        static_cast<int>(list.size()));
+    int i = 0;
+    int64_t bytes = 0;
+    for (iter->SeekToFirst(); i < reads_ && iter->Valid(); iter->Next()) {
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+      ++i;
+    }
+    delete iter;
+    thread->stats.AddBytes(bytes);
+
+    for (size_t f = 0; f < tables.size(); f++) {
+      delete tables[f];
+    }
+    for (size_t f = 0; f < files.size(); f++) {
+      delete files[f];
+    }
+    for (size_t f = 0; f < fnames.size(); f++) {
+      g_env->DeleteFile(fnames[f]);
+    }
+  }
+
   void ReadRandom(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -782,6 +1113,36 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    const int batch_size = FLAGS_multiget_batch_size;
+    std::vector<std::string> key_data(batch_size);
+    std::vector<Slice> keys(batch_size);
+    std::vector<std::string> values(batch_size);
+    std::vector<Status> statuses(batch_size);
+    int found = 0;
+    for (int i = 0; i < reads_; i += batch_size) {
+      const int n = std::min(batch_size, reads_ - i);
+      for (int j = 0; j < n; j++) {
+        char key[100];
+        const int k = thread->rand.Next() % FLAGS_num;
+        snprintf(key, sizeof(key), "%016d", k);
+        key_data[j] = key;
+        keys[j] = key_data[j];
+      }
+      db_->MultiGet(options, n, keys.data(), values.data(), statuses.data());
+      for (int j = 0; j < n; j++) {
+        if (statuses[j].ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -809,6 +1170,7 @@ class Benchmark {
 
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
+    options.prefix_same_as_start = (prefix_extractor_ != nullptr);
     int found = 0;
     for (int i = 0; i < reads_; i++) {
       Iterator* iter = db_->NewIterator(options);
@@ -938,6 +1300,14 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--enable_pipelined_write=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_enable_pipelined_write = n;
+    } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -954,10 +1324,78 @@ int main(int argc, char** argv) {
       FLAGS_block_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (strncmp(argv[i], "--cache_type=", 13) == 0) {
+      FLAGS_cache_type = argv[i] + 13;
+    } else if (sscanf(argv[i], "--cache_high_pri_pool_ratio=%lf%c", &d,
+                      &junk) == 1 &&
+               d >= 0 && d <= 1) {
+      FLAGS_cache_high_pri_pool_ratio = d;
+    } else if (sscanf(argv[i], "--secondary_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_secondary_cache_size = n;
+    } else if (strncmp(argv[i], "--persistent_cache_dir=", 23) == 0) {
+      FLAGS_persistent_cache_dir = argv[i] + 23;
+    } else if (sscanf(argv[i], "--cache_admission_filter=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cache_admission_filter = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (strncmp(argv[i], "--filter_policy=", 16) == 0) {
+      FLAGS_filter_policy = argv[i] + 16;
+    } else if (sscanf(argv[i], "--filter_block_type=%d%c", &n, &junk) == 1 &&
+               n >= 0 && n <= 2) {
+      FLAGS_filter_block_type = n;
+    } else if (sscanf(argv[i], "--data_block_index_type=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_data_block_index_type = n;
+    } else if (sscanf(argv[i], "--index_partition_size=%d%c", &n, &junk) ==
+                   1 &&
+               n >= 0) {
+      FLAGS_index_partition_size = n;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (sscanf(argv[i],
+                      "--pin_l0_filter_and_index_blocks_in_cache=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pin_l0_filter_and_index_blocks_in_cache = n;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_prefix_size = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
+    } else if (sscanf(argv[i], "--multiget_batch_size=%d%c", &n, &junk) ==
+                   1 &&
+               n > 0) {
+      FLAGS_multiget_batch_size = n;
+    } else if (sscanf(argv[i], "--max_write_buffer_number=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_max_write_buffer_number = n;
+    } else if (sscanf(argv[i], "--min_write_buffer_number_to_merge=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_min_write_buffer_number_to_merge = n;
+    } else if (sscanf(argv[i], "--l0_files=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_l0_files = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c", &n,
+                      &junk) == 1 &&
+               n > 0) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_max_subcompactions = n;
+    } else if (sscanf(argv[i], "--level0_slowdown_writes_trigger=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_level0_slowdown_writes_trigger = n;
+    } else if (sscanf(argv[i], "--level0_stop_writes_trigger=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_level0_stop_writes_trigger = n;
+    } else if (sscanf(argv[i], "--delayed_write_rate=%d%c", &n, &junk) == 1) {
+      FLAGS_delayed_write_rate = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
     } else {
@@ -967,6 +1405,8 @@ int main(int argc, char** argv) {
   }
 
   leveldb::g_env = leveldb::Env::Default();
+  leveldb::g_env->SetBackgroundThreads(FLAGS_max_background_compactions,
+                                       leveldb::Env::LOW);
 
   // Choose a location for the test database if none given with --db=<path>
   if (FLAGS_db == nullptr) {
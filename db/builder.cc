@@ -4,8 +4,11 @@
 
 #include "db/builder.h"
 
+#include <algorithm>
+
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
@@ -15,13 +18,21 @@
 namespace leveldb {
 
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  RangeTombstoneList* range_del, FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->largest_seqno = 0;
+  meta->has_range_tombstones = false;
   iter->SeekToFirst();
 
+  std::vector<RangeTombstone> tombstones;
+  if (range_del != nullptr) {
+    range_del->GetFragments(nullptr, nullptr, 0, &tombstones);
+  }
+
   std::string fname = TableFileName(dbname, meta->number);
-  if (iter->Valid()) {
+  if (iter->Valid() || !tombstones.empty()) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
@@ -30,12 +41,20 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
 
     // 将immutable memtable中的记录，逐条写入sstable。
     TableBuilder* builder = new TableBuilder(options, file);
-    meta->smallest.DecodeFrom(iter->key());
+    if (iter->Valid()) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
+    bool has_entries = false;
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
+      meta->largest_seqno =
+          std::max(meta->largest_seqno, ExtractSequenceNumber(key));
       builder->Add(key, iter->value());
+      has_entries = true;
     }
+    AddRangeTombstonesToTable(options.comparator, tombstones, has_entries,
+                              builder, meta);
 
     // Finish and check for builder errors
     s = builder->Finish();
@@ -56,12 +75,16 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     file = nullptr;
 
     if (s.ok()) {
-      // Verify that the table is usable
+      // Verify that the table is usable.  Flushed tables mostly go to
+      // level 0, so open it as a table of level 0.
       Iterator* it = table_cache->NewIterator(ReadOptions(), meta->number,
-                                              meta->file_size);
+                                              meta->file_size, nullptr, 0, 0);
       s = it->status();
       delete it;
     }
+    if (s.ok()) {
+      table_cache->LoadFileStats(meta);
+    }
   }
 
   // Check for input iterator errors
@@ -77,4 +100,37 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
   return s;
 }
 
+void AddRangeTombstonesToTable(const Comparator* icmp,
+                               const std::vector<RangeTombstone>& tombstones,
+                               bool has_entries, TableBuilder* builder,
+                               FileMetaData* meta) {
+  if (tombstones.empty()) {
+    return;
+  }
+  std::string largest_end;
+  for (const RangeTombstone& t : tombstones) {
+    InternalKey key(t.start, t.seq, kTypeRangeDeletion);
+    if (builder != nullptr) {
+      builder->AddRangeTombstone(key.Encode(), t.end);
+    }
+    meta->largest_seqno = std::max(meta->largest_seqno, t.seq);
+    largest_end = t.end;  // Fragments are sorted and disjoint
+  }
+  meta->has_range_tombstones = true;
+
+  // The tombstones reach up to, but do not include, largest_end.  An
+  // internal key that sorts before every entry for it stands in for it.
+  InternalKey smallest(tombstones.front().start, tombstones.front().seq,
+                       kTypeRangeDeletion);
+  InternalKey largest(largest_end, kMaxSequenceNumber, kTypeRangeDeletion);
+  if (!has_entries || icmp->Compare(smallest.Encode(),
+                                    meta->smallest.Encode()) < 0) {
+    meta->smallest = smallest;
+  }
+  if (!has_entries ||
+      icmp->Compare(largest.Encode(), meta->largest.Encode()) > 0) {
+    meta->largest = largest;
+  }
+}
+
 }  // namespace leveldb
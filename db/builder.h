@@ -5,26 +5,43 @@
 #ifndef STORAGE_LEVELDB_DB_BUILDER_H_
 #define STORAGE_LEVELDB_DB_BUILDER_H_
 
+#include <vector>
+
 #include "leveldb/status.h"
 
 namespace leveldb {
 
 struct Options;
 struct FileMetaData;
+struct RangeTombstone;
 
+class Comparator;
 class Env;
 class Iterator;
+class RangeTombstoneList;
+class TableBuilder;
 class TableCache;
 class VersionEdit;
 
-// Build a Table file from the contents of *iter.  The generated file
-// will be named according to meta->number.  On success, the rest of
-// *meta will be filled with metadata about the generated table.
-// If no data is present in *iter, meta->file_size will be set to
-// zero, and no Table file will be produced.
-// 将immutable memtable格式化成sstable文件
+// Build a Table file from the contents of *iter and the range tombstones
+// in *range_del, which may be null.  The generated file will be named
+// according to meta->number.  On success, the rest of *meta will be filled
+// with metadata about the generated table.  If neither *iter nor *range_del
+// has any data, meta->file_size will be set to zero, and no Table file will
+// be produced.
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter,
+                  RangeTombstoneList* range_del, FileMetaData* meta);
+
+// Add "tombstones", as returned by RangeTombstoneList::GetFragments(), to
+// the table built by *builder, and widen the key range and sequence number
+// of *meta to cover them.  The key range of *meta is taken from the
+// tombstones alone if "has_entries" is false.  "icmp" must be the internal
+// key comparator.  Only *meta is updated if "builder" is null.
+void AddRangeTombstonesToTable(const Comparator* icmp,
+                               const std::vector<RangeTombstone>& tombstones,
+                               bool has_entries, TableBuilder* builder,
+                               FileMetaData* meta);
 
 }  // namespace leveldb
 
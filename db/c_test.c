@@ -244,6 +244,26 @@ int main(int argc, char** argv) {
     leveldb_writebatch_destroy(wb);
   }
 
+  StartPhase("multiget");
+  {
+    const char* keys[3] = { "box", "foo", "notfound" };
+    const size_t keys_sizes[3] = { 3, 3, 8 };
+    char* vals[3];
+    size_t vals_sizes[3];
+    char* errs[3];
+    leveldb_multi_get(db, roptions, 3, keys, keys_sizes, vals, vals_sizes, errs);
+    int i;
+    for (i = 0; i < 3; i++) {
+      CheckNoError(errs[i]);
+    }
+    CheckEqual("c", vals[0], vals_sizes[0]);
+    CheckEqual("hello", vals[1], vals_sizes[1]);
+    CheckEqual(NULL, vals[2], vals_sizes[2]);
+    for (i = 0; i < 3; i++) {
+      Free(&vals[i]);
+    }
+  }
+
   StartPhase("iter");
   {
     leveldb_iterator_t* iter = leveldb_create_iterator(db, roptions);
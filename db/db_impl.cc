@@ -20,9 +20,12 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/status.h"
@@ -40,34 +43,71 @@ namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
 
+// Writes are never slowed down below this rate, in bytes per second.
+static const uint64_t kMinDelayedWriteRate = 16 << 10;
+
+// Longest time a single write sleeps for.  The rest of its delay is
+// carried over to the writes that follow.
+static const uint64_t kMaxWriteDelayMicros = 1000000;
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        done(false),
+        exclusive(false),
+        cv(mu),
+        last_sequence(0),
+        insert_into(nullptr),
+        insert_sequence(0),
+        leader(nullptr),
+        pending_inserts(0) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  bool exclusive;  // Never part of a batch group; stops writes while first
   port::CondVar cv;
+
+  // Set on the leader of a batch group once its log record has been
+  // written: the other members of the group and the last sequence number
+  // assigned to the group.
+  std::vector<Writer*> followers;
+  SequenceNumber last_sequence;
+
+  // Concurrent memtable writes only.  A follower whose insert_into is set
+  // applies its own batch to that memtable, numbering its entries from
+  // insert_sequence, and then reports to leader.
+  MemTable* insert_into;
+  SequenceNumber insert_sequence;
+  Writer* leader;
+
+  // Leader only: followers that have not finished inserting yet, and the
+  // first error any of them reported.
+  int pending_inserts;
+  Status insert_status;
 };
 
 struct DBImpl::CompactionState {
   // Files produced by compaction
-  struct Output {
-    uint64_t number;
-    uint64_t file_size;
-    InternalKey smallest, largest;
-  };
+  typedef FileMetaData Output;
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
 
-  explicit CompactionState(Compaction* c)
+  CompactionState(Compaction* c, const Comparator* user_comparator)
       : compaction(c),
         smallest_snapshot(0),
+        newest_snapshot(0),
+        begin(nullptr),
+        end(nullptr),
+        range_del(user_comparator),
+        has_tombstone_lower(false),
         outfile(nullptr),
         builder(nullptr),
-        total_bytes(0) {}
+        total_bytes(0),
+        imm_micros(0) {}
 
   Compaction* const compaction;
 
@@ -78,6 +118,25 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Entries with sequence numbers > newest_snapshot are not visible to any
+  // snapshot, so the compaction filter may change them.  Zero if there
+  // are no snapshots.
+  SequenceNumber newest_snapshot;
+
+  // Only user keys in [*begin, *end) are compacted by this state.  A null
+  // bound means the range is unbounded on that side.  Bounds are set for
+  // the subcompactions of a compaction that is split across threads.
+  const std::string* begin;
+  const std::string* end;
+
+  // Range tombstones of the input files
+  RangeTombstoneList range_del;
+
+  // The tombstones in [tombstone_lower, ...) have not been written to an
+  // output file yet.  Unbounded below if !has_tombstone_lower.
+  std::string tombstone_lower;
+  bool has_tombstone_lower;
+
   std::vector<Output> outputs;
 
   // State kept for output being generated
@@ -85,6 +144,7 @@ struct DBImpl::CompactionState {
   TableBuilder* builder;
 
   uint64_t total_bytes;
+  uint64_t imm_micros;  // Micros spent flushing memtables meanwhile
 };
 
 // Fix user-supplied options to be reasonable
@@ -96,14 +156,31 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalTablePropertiesCollectorFactory* ifactory,
+                        const InternalSliceTransform* iprefix,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  result.prefix_extractor =
+      (src.prefix_extractor != nullptr) ? iprefix : nullptr;
+  result.table_properties_collector_factory = ifactory;
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
+  ClipToRange(&result.max_write_buffer_number, 2, 64);
+  ClipToRange(&result.min_write_buffer_number_to_merge, 1,
+              result.max_write_buffer_number - 1);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_background_compactions, 1, 64);
+  ClipToRange(&result.max_subcompactions, 1, 64);
+  ClipToRange(&result.level0_file_num_compaction_trigger, 1, 1000);
+  ClipToRange(&result.level0_slowdown_writes_trigger,
+              result.level0_file_num_compaction_trigger, 1000);
+  ClipToRange(&result.level0_stop_writes_trigger,
+              result.level0_slowdown_writes_trigger, 1000);
+  ClipToRange(&result.delayed_write_rate, kMinDelayedWriteRate,
+              uint64_t{1} << 40);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -129,8 +206,13 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
+      internal_collector_factory_(
+          raw_options.table_properties_collector_factory),
+      internal_prefix_extractor_(raw_options.prefix_extractor),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_,
+                               &internal_collector_factory_,
+                               &internal_prefix_extractor_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
@@ -139,23 +221,30 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       shutting_down_(false),
       background_work_finished_signal_(&mutex_),
       mem_(nullptr),
-      imm_(nullptr),
       has_imm_(false),
+      flush_requested_(false),
       logfile_(nullptr),
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      background_compactions_scheduled_(0),
+      background_flush_scheduled_(false),
+      flush_in_progress_(false),
+      flush_has_own_pool_(env_->HasPriorityPools()),
+      table_may_skip_level0_(false),
+      manifest_write_in_progress_(false),
       manual_compaction_(nullptr),
+      file_stats_pending_(false),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)),
+      write_stall_micros_(0) {}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 || background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
@@ -166,7 +255,9 @@ DBImpl::~DBImpl() {
 
   delete versions_;
   if (mem_ != nullptr) mem_->Unref();
-  if (imm_ != nullptr) imm_->Unref();
+  for (size_t i = 0; i < imm_.size(); i++) {
+    imm_[i].mem->Unref();
+  }
   delete tmp_batch_;
   delete log_;
   delete logfile_;
@@ -319,6 +410,8 @@ Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
   if (!s.ok()) {
     return s;
   }
+  file_stats_pending_ = options_.deletion_compaction_ratio > 0 &&
+                        versions_->HasFilesWithoutStats();
   SequenceNumber max_sequence(0);
 
   // Recover from all newer log files than the ones named in the
@@ -449,7 +542,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      status = WriteMemTableToLevel0(mem, edit);
       mem->Unref();
       mem = nullptr;
       if (!status.ok()) {
@@ -488,7 +581,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      status = WriteMemTableToLevel0(mem, edit);
     }
     mem->Unref();
   }
@@ -496,14 +589,35 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
   return status;
 }
 
-Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+// Add the range tombstones of "mem" to *range_del.
+static Status AddMemTableRangeTombstones(MemTable* mem,
+                                         RangeTombstoneList* range_del) {
+  Iterator* iter = mem->NewRangeTombstoneIterator();
+  if (iter == nullptr) {
+    return Status::OK();
+  }
+  Status s = range_del->AddAll(iter);
+  delete iter;
+  return s;
+}
+
+Status DBImpl::WriteMemTableToLevel0(MemTable* mem, VersionEdit* edit) {
+  RangeTombstoneList range_del(user_comparator());
+  Status s = AddMemTableRangeTombstones(mem, &range_del);
+  if (s.ok()) {
+    s = WriteLevel0Table(mem->NewIterator(), &range_del, edit, nullptr);
+  }
+  return s;
+}
+
+Status DBImpl::WriteLevel0Table(Iterator* iter, RangeTombstoneList* range_del,
+                                VersionEdit* edit, Version* base,
+                                uint64_t* pending_number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
-  Iterator* iter = mem->NewIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
@@ -511,7 +625,8 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   {
     mutex_.Unlock();
     // 根据iter中的内容，新建一个table file
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, range_del,
+                   &meta);
     mutex_.Lock();
   }
 
@@ -519,7 +634,11 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
+  if (pending_number != nullptr) {
+    *pending_number = meta.number;
+  } else {
+    pending_outputs_.erase(meta.number);
+  }
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -530,8 +649,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
     if (base != nullptr) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
-    edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+    edit->AddFile(level, meta);
   }
 
   CompactionStats stats;
@@ -544,31 +662,72 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
 // 将immutable memtable中的内容存储到磁盘中，
 void DBImpl::CompactMemTable() {
   mutex_.AssertHeld();
-  assert(imm_ != nullptr);
+  assert(!imm_.empty());
+
+  // Flush all of the immutable memtables that exist now; more may be
+  // added while the mutex is released.
+  const size_t n = imm_.size();
+  flush_requested_ = false;
+  Iterator* iter;
+  RangeTombstoneList range_del(user_comparator());
+  Status s;
+  for (size_t i = 0; i < n && s.ok(); i++) {
+    s = AddMemTableRangeTombstones(imm_[i].mem, &range_del);
+  }
+  if (n == 1) {
+    iter = imm_[0].mem->NewIterator();
+  } else {
+    std::vector<Iterator*> list(n);
+    for (size_t i = 0; i < n; i++) {
+      list[i] = imm_[i].mem->NewIterator();
+    }
+    iter = NewMergingIterator(&internal_comparator_, &list[0],
+                              static_cast<int>(n));
+  }
 
-  // Save the contents of the memtable as a new Table
+  // Save the contents of the memtables as a new Table.  It may only be
+  // placed below level-0 if no major compaction can run until it is
+  // installed, and no ingestion is placing a table below level-0.
   VersionEdit edit;
-  Version* base = versions_->current();
-  base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
-  base->Unref();
+  Version* base = nullptr;
+  if (background_compactions_scheduled_ == 0 && !table_may_skip_level0_) {
+    base = versions_->current();
+    base->Ref();
+    table_may_skip_level0_ = true;
+  }
+  uint64_t file_number = 0;
+  if (s.ok()) {
+    s = WriteLevel0Table(iter, &range_del, &edit, base, &file_number);
+  } else {
+    delete iter;
+  }
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
     s = Status::IOError("Deleting DB during memtable compaction");
   }
 
-  // Replace immutable memtable with the generated Table
+  // Replace immutable memtables with the generated Table
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
-    edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    // Earlier logs no longer needed
+    edit.SetLogNumber(n < imm_.size() ? imm_[n].log_number : logfile_number_);
+    s = LogAndApply(&edit);
+  }
+  pending_outputs_.erase(file_number);
+
+  if (base != nullptr) {
+    base->Unref();
+    table_may_skip_level0_ = false;
+    background_work_finished_signal_.SignalAll();
   }
 
   if (s.ok()) {
     // Commit to the new state
-    imm_->Unref();
-    imm_ = nullptr;
-    has_imm_.store(false, std::memory_order_release);
+    for (size_t i = 0; i < n; i++) {
+      imm_[i].mem->Unref();
+    }
+    imm_.erase(imm_.begin(), imm_.begin() + n);
+    has_imm_.store(FlushNeeded(), std::memory_order_release);
     DeleteObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -643,10 +802,10 @@ Status DBImpl::TEST_CompactMemTable() {
   if (s.ok()) {
     // Wait until the compaction completes
     MutexLock l(&mutex_);
-    while (imm_ != nullptr && bg_error_.ok()) {
+    while (!imm_.empty() && bg_error_.ok()) {
       background_work_finished_signal_.Wait();
     }
-    if (imm_ != nullptr) {
+    if (!imm_.empty()) {
       s = bg_error_;
     }
   }
@@ -661,22 +820,79 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  while (manifest_write_in_progress_) {
+    background_work_finished_signal_.Wait();
+  }
+  manifest_write_in_progress_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  manifest_write_in_progress_ = false;
+  // The shape of the tree drives the delayed write rate
+  UpdateWriteRate();
+  background_work_finished_signal_.SignalAll();
+  return s;
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  // 如果有后台compaction线程已经被调度了，或者正在执行，那么不做任何事情
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
+    return;
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
+    return;
+  }
+
+  if (FlushNeeded() && !background_flush_scheduled_) {
+    background_flush_scheduled_ = true;
+    env_->Schedule(&DBImpl::BGFlushWork, this, Env::HIGH);
+  }
+
+  // 如果有后台compaction线程已经被调度了，或者正在执行，那么不做任何事情
+  if (background_compactions_scheduled_ >=
+      options_.max_background_compactions) {
+    // Already scheduled
+  } else if (manual_compaction_ == nullptr && !versions_->NeedsCompaction() &&
+             !file_stats_pending_) {
     // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    background_compactions_scheduled_++;
+    env_->Schedule(&DBImpl::BGWork, this, Env::LOW);
+  }
+}
+
+bool DBImpl::FlushNeeded() const {
+  // Waiting for several immutable memtables lets a flush merge them into
+  // a single level-0 table.
+  return !imm_.empty() &&
+         (flush_requested_ || imm_.size() >= static_cast<size_t>(
+                                  options_.min_write_buffer_number_to_merge));
+}
+
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (FlushNeeded() && !flush_in_progress_) {
+    flush_in_progress_ = true;
+    CompactMemTable();
+    flush_in_progress_ = false;
   }
+
+  background_flush_scheduled_ = false;
+
+  // The new level-0 file may call for a compaction.
+  MaybeScheduleCompaction();
+  // Wake up MakeRoomForWrite() if necessary.
+  background_work_finished_signal_.SignalAll();
 }
 
 void DBImpl::BGWork(void* db) {
@@ -685,39 +901,53 @@ void DBImpl::BGWork(void* db) {
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool did_work = false;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    if (file_stats_pending_) {
+      // Done here rather than in Recover(), so that opening the database
+      // does not wait for every table to be read.
+      file_stats_pending_ = false;
+      versions_->LoadFileStats(&mutex_);
+    }
+    did_work = BackgroundCompaction();
   }
 
-  // 后台compaction执行完毕，需要重新设置background_compaction_scheduled
-  background_compaction_scheduled_ = false;
+  // 后台compaction执行完毕，需要重新设置background_compactions_scheduled
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
+  // so reschedule another compaction if needed.  A call that found
+  // nothing to do leaves this to the compactions that are still running.
   // 后台compaction完成后，可能某level上的size太大而触发新的size compaction
-  MaybeScheduleCompaction();
+  if (did_work || background_compactions_scheduled_ == 0) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
 // compaction优先级为minor compaction > manual compaction > size compaction > seek compaction
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();// 操作memtable时必须加上互斥锁
 
-  //如果immutable不为空，需要将immutable dump到level 0
-  if (imm_ != nullptr) {
-    CompactMemTable();
-    return;
+  // Let a flush that may place its output below level-0 install it before
+  // picking the next compaction.
+  while (table_may_skip_level0_) {
+    background_work_finished_signal_.Wait();
   }
 
   Compaction* c;
   bool is_manual = (manual_compaction_ != nullptr);
   InternalKey manual_end;
-  if (is_manual) {  //Manual Compaction
+  if (is_manual && background_compactions_scheduled_ > 1) {
+    // A manual compaction runs alone.  The last of the running compactions
+    // to finish schedules it.
+    return false;
+  } else if (is_manual) {  //Manual Compaction
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == nullptr);
@@ -731,6 +961,12 @@ void DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();  //选取压缩方式，Size/Seek Compaction
+    if (c == nullptr) {
+      // Nothing to do, or every candidate is busy
+      return false;
+    }
+    // Another compaction may be able to run on files that "c" does not use.
+    MaybeScheduleCompaction();
   }
 
   Status status;
@@ -742,9 +978,8 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);// 第level层上要compaction的文件数为1时，才可能是trivial move
     FileMetaData* f = c->input(0, 0);
     c->edit()->DeleteFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_); //写入version
+    c->edit()->AddFile(c->level() + 1, *f);
+    status = LogAndApply(c->edit()); //写入version
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
@@ -754,7 +989,7 @@ void DBImpl::BackgroundCompaction() {
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
   } else {
-    CompactionState* compact = new CompactionState(c);
+    CompactionState* compact = new CompactionState(c, user_comparator());
     status = DoCompactionWork(compact);  // 真正进行compaction的地方
     if (!status.ok()) {
       RecordBackgroundError(status);
@@ -787,6 +1022,7 @@ void DBImpl::BackgroundCompaction() {
     }
     manual_compaction_ = nullptr;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -818,6 +1054,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.largest_seqno = 0;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -831,8 +1068,28 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   return s;
 }
 
+void DBImpl::GetOutputTombstones(CompactionState* compact,
+                                 const Slice* upper,
+                                 std::vector<RangeTombstone>* result) {
+  std::vector<RangeTombstone> fragments;
+  const Slice lower(compact->tombstone_lower);
+  compact->range_del.GetFragments(
+      compact->has_tombstone_lower ? &lower : nullptr, upper,
+      compact->smallest_snapshot, &fragments);
+  for (const RangeTombstone& t : fragments) {
+    if (t.seq <= compact->smallest_snapshot &&
+        compact->compaction->IsBaseLevelForRange(t.start, t.end)) {
+      // Every snapshot sees the tombstone and no older data it could
+      // delete is left below this compaction, so it is obsolete.
+      continue;
+    }
+    result->push_back(t);
+  }
+}
+
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
-                                          Iterator* input) {
+                                          Iterator* input,
+                                          const Slice* next_user_key) {
   assert(compact != nullptr);
   assert(compact->outfile != nullptr);
   assert(compact->builder != nullptr);
@@ -843,6 +1100,25 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   // Check for iterator errors
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
+  if (s.ok() && !compact->range_del.empty()) {
+    // The file holds the tombstones up to the first key of the next file,
+    // or up to the end of the range of the compaction.
+    Slice end_key;
+    const Slice* upper = next_user_key;
+    if (upper == nullptr && compact->end != nullptr) {
+      end_key = *compact->end;
+      upper = &end_key;
+    }
+    std::vector<RangeTombstone> tombstones;
+    GetOutputTombstones(compact, upper, &tombstones);
+    AddRangeTombstonesToTable(&internal_comparator_, tombstones,
+                              current_entries > 0, compact->builder,
+                              compact->current_output());
+    if (upper != nullptr) {
+      compact->tombstone_lower = upper->ToString();
+      compact->has_tombstone_lower = true;
+    }
+  }
   if (s.ok()) {
     s = compact->builder->Finish();
   } else {
@@ -877,6 +1153,9 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
           (unsigned long long)current_bytes);
     }
   }
+  if (s.ok()) {
+    table_cache_->LoadFileStats(compact->current_output());
+  }
   return s;
 }
 
@@ -894,18 +1173,76 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   // 将新生成的sst文件加入到VersionEdit的new_files_中
   const int level = compact->compaction->level();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
-    const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+    compact->compaction->edit()->AddFile(level + 1, compact->outputs[i]);
   }
 
   // LogAndApply会根据VerionEdit中deleted_files_和new_files_生成一个新的Version
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
+}
+
+// The subcompactions of a compaction besides its first one.  One run of
+// BGSubcompactionWork() per subcompaction is scheduled on the LOW pool, and
+// each run, like the compaction's own thread once it is done with the first
+// subcompaction, takes the next subcompaction nobody has taken yet.  So a
+// compaction never waits for pool threads that are busy, e.g. with this
+// very compaction.  The group is deleted by whoever drops the last
+// reference: the compaction's own, or that of a scheduled run.
+struct DBImpl::SubcompactionGroup {
+  struct Task {
+    CompactionState* compact;
+    Iterator* input;
+    Status status;
+  };
+
+  SubcompactionGroup(DBImpl* db, int refs)
+      : db(db), done_cv(&mu), next(0), running(0), refs(refs) {}
+
+  DBImpl* const db;
+  std::vector<Task> tasks;  // Not resized once runs are scheduled
+
+  port::Mutex mu;
+  port::CondVar done_cv GUARDED_BY(mu);  // Signalled when running drops
+  size_t next GUARDED_BY(mu);            // First task not taken yet
+  int running GUARDED_BY(mu);            // Tasks taken but not finished
+  int refs GUARDED_BY(mu);
+};
+
+bool DBImpl::RunNextSubcompaction(SubcompactionGroup* group) {
+  group->mu.Lock();
+  if (group->next == group->tasks.size()) {
+    group->mu.Unlock();
+    return false;
+  }
+  SubcompactionGroup::Task* task = &group->tasks[group->next++];
+  group->running++;
+  group->mu.Unlock();
+
+  task->status = group->db->ProcessCompactionInput(task->compact, task->input);
+
+  MutexLock l(&group->mu);
+  if (--group->running == 0) {
+    group->done_cv.SignalAll();
+  }
+  return true;
+}
+
+void DBImpl::UnrefSubcompactionGroup(SubcompactionGroup* group) {
+  group->mu.Lock();
+  const bool last = --group->refs == 0;
+  group->mu.Unlock();
+  if (last) {
+    delete group;
+  }
+}
+
+void DBImpl::BGSubcompactionWork(void* arg) {
+  SubcompactionGroup* group = reinterpret_cast<SubcompactionGroup*>(arg);
+  RunNextSubcompaction(group);
+  UnrefSubcompactionGroup(group);
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
@@ -919,47 +1256,190 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   // 将snapshot相关的内容记录到compact信息中
   if (snapshots_.empty()) {
     compact->smallest_snapshot = versions_->LastSequence();
+    compact->newest_snapshot = 0;
   } else {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+    compact->newest_snapshot = snapshots_.newest()->sequence_number();
+  }
+
+  mutex_.Unlock();
+  // Input files whose every entry is deleted by a range tombstone are not
+  // read; they are dropped along with the other inputs.
+  Status status =
+      versions_->AddRangeTombstones(compact->compaction, &compact->range_del);
+  if (status.ok() && !compact->range_del.empty()) {
+    const int skipped = compact->compaction->SkipCoveredInputs(
+        &compact->range_del, compact->smallest_snapshot);
+    if (skipped > 0) {
+      Log(options_.info_log, "Dropping %d files deleted by range tombstones",
+          skipped);
+    }
+  }
+
+  // Split a large compaction into key ranges that are compacted by
+  // separate threads.  Ranges start at user key boundaries, so all the
+  // entries for a user key are handled by the same subcompaction.
+  std::vector<std::string> boundaries;
+  if (status.ok() && options_.max_subcompactions > 1) {
+    compact->compaction->GetSubcompactionBoundaries(
+        options_.max_subcompactions, &boundaries);
+  }
+  mutex_.Lock();
+  if (!status.ok()) {
+    return status;
+  }
+  std::vector<CompactionState*> shards(1, compact);
+  for (size_t i = 0; i < boundaries.size(); i++) {
+    CompactionState* shard = new CompactionState(
+        compact->compaction->NewSubcompaction(), user_comparator());
+    shard->smallest_snapshot = compact->smallest_snapshot;
+    shard->newest_snapshot = compact->newest_snapshot;
+    shard->range_del = compact->range_del;
+    shards.back()->end = &boundaries[i];
+    shard->begin = &boundaries[i];
+    shards.push_back(shard);
+  }
+  if (shards.size() > 1) {
+    Log(options_.info_log, "Compacting in %d subcompactions",
+        static_cast<int>(shards.size()));
   }
 
   // 这里生成一个MergingIterator，相当于在遍历要合并的sst文件时，同时进行多路归并排序
   // MergingIterator内部维护了n个Iterator，每个Iterator指向一个sst，进行迭代时，MergingIterator
   // 会找所有Iterators所指key中的最小那个，这样就完成了多路归并排序
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  std::vector<Iterator*> inputs;
+  for (size_t i = 0; i < shards.size(); i++) {
+    inputs.push_back(versions_->MakeInputIterator(compact->compaction));
+  }
 
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  input->SeekToFirst();
+  // Shards other than the first also run on the LOW pool.
+  const int scheduled = static_cast<int>(shards.size()) - 1;
+  SubcompactionGroup* group = new SubcompactionGroup(this, scheduled + 1);
+  for (size_t i = 1; i < shards.size(); i++) {
+    group->tasks.push_back({shards[i], inputs[i], Status()});
+  }
+  for (int i = 0; i < scheduled; i++) {
+    env_->Schedule(&DBImpl::BGSubcompactionWork, group, Env::LOW);
+  }
+  status = ProcessCompactionInput(compact, inputs[0]);
+  while (RunNextSubcompaction(group)) {
+  }
+  std::vector<Status> shard_status(1);
+  {
+    MutexLock l(&group->mu);
+    while (group->running > 0) {
+      group->done_cv.Wait();
+    }
+    for (const SubcompactionGroup::Task& task : group->tasks) {
+      shard_status.push_back(task.status);
+    }
+  }
+  UnrefSubcompactionGroup(group);
+  for (size_t i = 0; i < inputs.size(); i++) {
+    delete inputs[i];
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - compact->imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+
+  mutex_.Lock();
+
+  // Gather the outputs of all subcompactions, in key order.
+  for (size_t i = 1; i < shards.size(); i++) {
+    CompactionState* shard = shards[i];
+    if (status.ok()) {
+      status = shard_status[i];
+    }
+    compact->outputs.insert(compact->outputs.end(), shard->outputs.begin(),
+                            shard->outputs.end());
+    compact->total_bytes += shard->total_bytes;
+    shard->outputs.clear();
+    Compaction* subcompaction = shard->compaction;
+    CleanupCompaction(shard);
+    delete subcompaction;
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+  stats_[compact->compaction->level() + 1].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);   // 将新生成的sst 加入到Version中
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+Status DBImpl::ProcessCompactionInput(CompactionState* compact,
+                                      Iterator* input) {
+  if (compact->begin != nullptr) {
+    InternalKey start(*compact->begin, kMaxSequenceNumber, kValueTypeForSeek);
+    input->Seek(start.Encode());
+    compact->tombstone_lower = *compact->begin;
+    compact->has_tombstone_lower = true;
+  } else {
+    input->SeekToFirst();
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  // An output file that should be closed is only closed once the user key
+  // changes, so that all the entries for a user key, and the range
+  // tombstones that cover them, end up in the same file.
+  bool close_output = false;
+  std::string filtered_key, filtered_value;  // Rewritten by compaction_filter
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
     // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
+    if (!flush_has_own_pool_ && has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
-      if (imm_ != nullptr) {
+      if (FlushNeeded() && !flush_in_progress_ && bg_error_.ok()) {
+        flush_in_progress_ = true;
         CompactMemTable();
+        flush_in_progress_ = false;
         // Wake up MakeRoomForWrite() if necessary.
         background_work_finished_signal_.SignalAll();
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      compact->imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
+    Slice value = input->value();
+    if (compact->end != nullptr && key.size() >= 8 &&
+        user_comparator()->Compare(ExtractUserKey(key), *compact->end) >= 0) {
+      // The rest of the input belongs to the next subcompaction
+      break;
+    }
     if (compact->compaction->ShouldStopBefore(key) &&
         compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
-      if (!status.ok()) {
-        break;
+      close_output = true;
+    }
+    if (close_output) {
+      const Slice user_key = key.size() >= 8 ? ExtractUserKey(key) : key;
+      if (user_comparator()->Compare(
+              user_key, compact->current_output()->largest.user_key()) != 0) {
+        close_output = false;
+        status = FinishCompactionOutputFile(compact, input, &user_key);
+        if (!status.ok()) {
+          break;
+        }
       }
     }
-
     // Handle key/value, add to state, etc.
     bool drop = false;
     if (!ParseInternalKey(key, &ikey)) {
@@ -991,9 +1471,67 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (!compact->range_del.empty() &&
+                 compact->range_del.ShouldDelete(ikey,
+                                                 compact->smallest_snapshot)) {
+        // Deleted by a range tombstone that every snapshot sees
+        drop = true;
       }
 
       last_sequence_for_key = ikey.sequence;
+
+      if (!drop && ikey.type == kTypeMerge &&
+          ikey.sequence <= compact->smallest_snapshot &&
+          options_.merge_operator != nullptr) {
+        std::vector<std::string> merged_keys, merged_values;
+        status = MergeCompactionOperands(compact, input, &merged_keys,
+                                         &merged_values,
+                                         &last_sequence_for_key);
+        for (size_t i = 0; i < merged_keys.size() && status.ok(); i++) {
+          status = AddToCompactionOutput(compact, merged_keys[i],
+                                         merged_values[i]);
+        }
+        if (!status.ok()) {
+          break;
+        }
+        if (compact->builder != nullptr &&
+            compact->builder->FileSize() >=
+                compact->compaction->MaxOutputFileSize()) {
+          close_output = true;
+        }
+        continue;  // "input" is past the operands
+      }
+
+      if (!drop && ikey.type == kTypeValue &&
+          ikey.sequence > compact->newest_snapshot &&
+          options_.compaction_filter != nullptr) {
+        filtered_value.clear();
+        switch (options_.compaction_filter->Filter(
+            compact->compaction->level(), ikey.user_key, value,
+            &filtered_value)) {
+          case CompactionFilter::kKeep:
+            break;
+          case CompactionFilter::kChangeValue:
+            value = filtered_value;
+            break;
+          case CompactionFilter::kRemove:
+            if (ikey.sequence <= compact->smallest_snapshot &&
+                compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+              // Older entries are dropped by rule (A), as for a deletion
+              drop = true;
+            } else {
+              // Older values of the key may live in deeper levels, or be
+              // visible to snapshots
+              filtered_key.clear();
+              AppendInternalKey(&filtered_key,
+                                ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                                  kTypeDeletion));
+              key = filtered_key;
+              value = Slice();
+            }
+            break;
+        }
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -1006,26 +1544,15 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
 #endif
 
     if (!drop) {
-      // Open output file if necessary
-      if (compact->builder == nullptr) {
-        status = OpenCompactionOutputFile(compact);
-        if (!status.ok()) {
-          break;
-        }
-      }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+      status = AddToCompactionOutput(compact, key, value);
+      if (!status.ok()) {
+        break;
       }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
 
       // Close output file if it is big enough
       if (compact->builder->FileSize() >=
           compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
-        }
+        close_output = true;
       }
     }
 
@@ -1035,38 +1562,126 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok() && compact->builder == nullptr &&
+      !compact->range_del.empty()) {
+    // Range tombstones that are left over need a file of their own
+    std::vector<RangeTombstone> tombstones;
+    const Slice end_key = compact->end != nullptr ? Slice(*compact->end) : "";
+    GetOutputTombstones(compact, compact->end != nullptr ? &end_key : nullptr,
+                        &tombstones);
+    if (!tombstones.empty()) {
+      status = OpenCompactionOutputFile(compact);
+    }
+  }
   if (status.ok() && compact->builder != nullptr) {
-    status = FinishCompactionOutputFile(compact, input);
+    status = FinishCompactionOutputFile(compact, input, nullptr);
   }
   if (status.ok()) {
     status = input->status();
   }
-  delete input;
-  input = nullptr;
+  return status;
+}
 
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+Status DBImpl::AddToCompactionOutput(CompactionState* compact,
+                                     const Slice& key, const Slice& value) {
+  // Open output file if necessary
+  if (compact->builder == nullptr) {
+    Status s = OpenCompactionOutputFile(compact);
+    if (!s.ok()) {
+      return s;
     }
   }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
+  if (compact->builder->NumEntries() == 0) {
+    compact->current_output()->smallest.DecodeFrom(key);
   }
+  compact->current_output()->largest.DecodeFrom(key);
+  compact->current_output()->largest_seqno =
+      key.size() >= 8 ? std::max(compact->current_output()->largest_seqno,
+                                 ExtractSequenceNumber(key))
+                      : kMaxSequenceNumber;
+  compact->builder->Add(key, value);
+  return Status::OK();
+}
 
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
+Status DBImpl::MergeCompactionOperands(CompactionState* compact,
+                                       Iterator* input,
+                                       std::vector<std::string>* keys,
+                                       std::vector<std::string>* values,
+                                       SequenceNumber* oldest_seq) {
+  const Comparator* ucmp = user_comparator();
+  const MergeOperator* merge_operator = options_.merge_operator;
+  ParsedInternalKey ikey;
+  ParseInternalKey(input->key(), &ikey);
+  const std::string user_key = ikey.user_key.ToString();
+  const SequenceNumber newest_seq = ikey.sequence;
+
+  // Gather the operands, newest first, up to the entry they apply to
+  std::vector<std::string> operand_keys, operands;
+  bool key_ended = false;   // Consumed all the input entries for the key
+  bool found_base = false;  // Found a value, or an entry that hides older ones
+  std::string base;
+  bool has_base = false;
+  for (; !found_base; input->Next()) {
+    if (!input->Valid()) {
+      key_ended = true;
+      break;
+    }
+    if (!ParseInternalKey(input->key(), &ikey)) {
+      break;
+    }
+    if (ucmp->Compare(ikey.user_key, user_key) != 0) {
+      key_ended = true;
+      break;
+    }
+    const bool deleted =
+        !compact->range_del.empty() &&
+        compact->range_del.ShouldDelete(ikey, compact->smallest_snapshot);
+    if (ikey.type == kTypeMerge && !deleted) {
+      operand_keys.push_back(input->key().ToString());
+      operands.push_back(input->value().ToString());
+      *oldest_seq = ikey.sequence;
+    } else {
+      found_base = true;
+      if (ikey.type == kTypeValue && !deleted) {
+        base = input->value().ToString();
+        has_base = true;
+      }
+    }
+  }
 
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);   // 将新生成的sst 加入到Version中
+  if (found_base ||
+      (key_ended && compact->compaction->IsBaseLevelForKey(user_key))) {
+    // Everything the operands apply to is known: turn them into a value
+    const Slice base_value(base);
+    std::string merged;
+    Status s = FullMerge(merge_operator, user_key,
+                         has_base ? &base_value : nullptr, operands, &merged);
+    if (s.ok()) {
+      InternalKey key(user_key, newest_seq, kTypeValue);
+      keys->push_back(key.Encode().ToString());
+      values->push_back(merged);
+    }
+    return s;
   }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
+
+  // The operands apply to entries that are not part of this compaction.
+  // Fold them into one if the merge operator can.
+  std::string merged = operands.back();
+  bool folded = true;
+  for (size_t i = operands.size() - 1; i > 0 && folded; i--) {
+    std::string combined;
+    folded = merge_operator->PartialMerge(user_key, merged, operands[i - 1],
+                                          &combined);
+    merged.swap(combined);
   }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
-  return status;
+  if (folded) {
+    keys->push_back(operand_keys.front());
+    values->push_back(merged);
+  } else {
+    keys->swap(operand_keys);
+    values->swap(operands);
+  }
+  return Status::OK();
 }
 
 namespace {
@@ -1075,9 +1690,10 @@ struct IterState {
   port::Mutex* const mu;
   Version* const version GUARDED_BY(mu);
   MemTable* const mem GUARDED_BY(mu);
-  MemTable* const imm GUARDED_BY(mu);
+  const std::vector<MemTable*> imm GUARDED_BY(mu);
 
-  IterState(port::Mutex* mutex, MemTable* mem, MemTable* imm, Version* version)
+  IterState(port::Mutex* mutex, MemTable* mem,
+            const std::vector<MemTable*>& imm, Version* version)
       : mu(mutex), version(version), mem(mem), imm(imm) {}
 };
 
@@ -1085,7 +1701,9 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
   IterState* state = reinterpret_cast<IterState*>(arg1);
   state->mu->Lock();
   state->mem->Unref();
-  if (state->imm != nullptr) state->imm->Unref();
+  for (MemTable* imm : state->imm) {
+    imm->Unref();
+  }
   state->version->Unref();
   state->mu->Unlock();
   delete state;
@@ -1095,7 +1713,8 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
                                       SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+                                      uint32_t* seed,
+                                      RangeTombstoneList* range_del) {
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
 
@@ -1103,27 +1722,66 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
   std::vector<Iterator*> list;
   list.push_back(mem_->NewIterator());
   mem_->Ref();
-  if (imm_ != nullptr) {
-    list.push_back(imm_->NewIterator());
-    imm_->Ref();
+  std::vector<MemTable*> imm = ImmutableMemTables();
+  for (MemTable* m : imm) {
+    list.push_back(m->NewIterator());
   }
   versions_->current()->AddIterators(options, &list);
+  Version* current = versions_->current();
+  current->Ref();
+  MemTable* mem = mem_;
+  *seed = ++seed_;
+  mutex_.Unlock();
+
+  // The memtables and the version are referenced until the iterator is
+  // deleted, so their range tombstones can be read without the mutex.
+  if (range_del != nullptr) {
+    Status s = AddMemTableRangeTombstones(mem, range_del);
+    for (size_t i = 0; i < imm.size() && s.ok(); i++) {
+      s = AddMemTableRangeTombstones(imm[i], range_del);
+    }
+    if (s.ok()) {
+      s = current->AddRangeTombstones(range_del);
+    }
+    if (!s.ok()) {
+      list.push_back(NewErrorIterator(s));
+    }
+  }
+
   Iterator* internal_iter =
       NewMergingIterator(&internal_comparator_, &list[0], list.size());
-  versions_->current()->Ref();
-
-  IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
+  IterState* cleanup = new IterState(&mutex_, mem, imm, current);
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
-
-  *seed = ++seed_;
-  mutex_.Unlock();
   return internal_iter;
 }
 
-Iterator* DBImpl::TEST_NewInternalIterator() {
-  SequenceNumber ignored;
-  uint32_t ignored_seed;
-  return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed);
+std::vector<MemTable*> DBImpl::ImmutableMemTables() {
+  mutex_.AssertHeld();
+  std::vector<MemTable*> result;
+  result.reserve(imm_.size());
+  for (size_t i = imm_.size(); i-- > 0;) {
+    imm_[i].mem->Ref();
+    result.push_back(imm_[i].mem);
+  }
+  return result;
+}
+
+// Look up "key" in "mems", which are ordered from newest to oldest.
+static bool GetFromMemTables(const std::vector<MemTable*>& mems,
+                             const LookupKey& key, std::string* value,
+                             Status* s, MergeContext* merge) {
+  for (MemTable* mem : mems) {
+    if (mem->Get(key, value, s, merge)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Iterator* DBImpl::TEST_NewInternalIterator() {
+  SequenceNumber ignored;
+  uint32_t ignored_seed;
+  return NewInternalIterator(ReadOptions(), &ignored, &ignored_seed);
 }
 
 int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
@@ -1150,11 +1808,10 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   // MemTable， Immutable Memtable 和 Current Version 增加引用计数，避免在读取过程中被后台线程进行 Compaction 时“垃圾回收”了。
   // Version 主要用来维护 SST 文件的版本信息。
   MemTable* mem = mem_;
-  MemTable* imm = imm_;
+  std::vector<MemTable*> imm = ImmutableMemTables();
   Version* current = versions_->current();
   // 增加引用计数，防止在读取的时候并发线程释放掉memtable
   mem->Ref();
-  if (imm != nullptr) imm->Ref();
   current->Ref();
 
   bool have_stat_update = false;
@@ -1171,12 +1828,12 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
     // 3、从 SSTable 文件查找。
     // LookupKey是对key和序列号的封装
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
+    MergeContext merge(options_.merge_operator);
+    if (mem->Get(lkey, value, &s, &merge) ||
+        GetFromMemTables(imm, lkey, value, &s, &merge)) {
       // Done
     } else {
-      s = current->Get(options, lkey, value, &stats);
+      s = current->Get(options, lkey, value, &stats, &merge);
       have_stat_update = true;
     }
     //获取互斥锁
@@ -1189,23 +1846,125 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   }
   // MemTable, Immutable Memtable 和 Current Version 减少引用计数。
   mem->Unref();
-  if (imm != nullptr) imm->Unref();
+  for (MemTable* m : imm) {
+    m->Unref();
+  }
   current->Unref();
 
   // 释放锁（由析构函数完成），返回结果。
   return s;
 }
 
+void DBImpl::MultiGet(const ReadOptions& options, int n, const Slice* keys,
+                      std::string* values, Status* statuses) {
+  // Visit the keys in sorted order so that keys stored in the same table
+  // file, and the same blocks of it, are looked up together.
+  std::vector<int> order(n);
+  for (int i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  const Comparator* ucmp = user_comparator();
+  std::sort(order.begin(), order.end(), [ucmp, keys](int a, int b) {
+    return ucmp->Compare(keys[a], keys[b]) < 0;
+  });
+
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  std::vector<MemTable*> imm = ImmutableMemTables();
+  Version* current = versions_->current();
+  mem->Ref();
+  current->Ref();
+
+  bool have_stat_update = false;
+  Version::GetStats stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    std::vector<LookupKey*> lkeys;
+    std::vector<MergeContext*> merges;
+    lkeys.reserve(n);
+    merges.reserve(n);
+    // Keys not found in the memtables, still in sorted order
+    std::vector<int> pending;
+    for (int j = 0; j < n; j++) {
+      const int i = order[j];
+      LookupKey* lkey = new LookupKey(keys[i], snapshot);
+      MergeContext* merge = new MergeContext(options_.merge_operator);
+      lkeys.push_back(lkey);
+      merges.push_back(merge);
+      if (mem->Get(*lkey, &values[i], &statuses[i], merge) ||
+          GetFromMemTables(imm, *lkey, &values[i], &statuses[i], merge)) {
+        // Done
+      } else {
+        pending.push_back(j);
+      }
+    }
+
+    if (!pending.empty()) {
+      const int m = static_cast<int>(pending.size());
+      std::vector<const LookupKey*> pending_keys(m);
+      std::vector<std::string*> pending_values(m);
+      std::vector<MergeContext*> pending_merges(m);
+      std::vector<Status> pending_statuses(m);
+      for (int p = 0; p < m; p++) {
+        pending_keys[p] = lkeys[pending[p]];
+        pending_values[p] = &values[order[pending[p]]];
+        pending_merges[p] = merges[pending[p]];
+      }
+      current->MultiGet(options, m, pending_keys.data(), pending_values.data(),
+                        pending_merges.data(), pending_statuses.data(),
+                        &stats);
+      for (int p = 0; p < m; p++) {
+        statuses[order[pending[p]]] = pending_statuses[p];
+      }
+      have_stat_update = true;
+    }
+
+    for (int j = 0; j < n; j++) {
+      delete lkeys[j];
+      delete merges[j];
+    }
+    mutex_.Lock();
+  }
+
+  if (have_stat_update && current->UpdateStats(stats)) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  for (MemTable* m : imm) {
+    m->Unref();
+  }
+  current->Unref();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  RangeTombstoneList* range_del = new RangeTombstoneList(user_comparator());
+  Iterator* iter =
+      NewInternalIterator(options, &latest_snapshot, &seed, range_del);
+  if (range_del->empty()) {
+    delete range_del;
+    range_del = nullptr;
+  }
   return NewDBIterator(this, user_comparator(), iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, range_del, options_.merge_operator,
+                       options.prefix_same_as_start
+                           ? internal_prefix_extractor_.user_transform()
+                           : nullptr);
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1234,6 +1993,313 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  if (options_.merge_operator == nullptr) {
+    return Status::NotSupported("Merge() requires a merge operator");
+  }
+  return DB::Merge(options, key, value);
+}
+
+Status DBImpl::DeleteRange(const WriteOptions& options, const Slice& begin,
+                           const Slice& end) {
+  if (user_comparator()->Compare(begin, end) > 0) {
+    return Status::InvalidArgument("DeleteRange end is before begin");
+  }
+  return DB::DeleteRange(options, begin, end);
+}
+
+// Copy the file "src" to "dst" and sync the copy.
+static Status CopyFile(Env* env, const std::string& src,
+                       const std::string& dst) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(dst, &out);
+  if (!s.ok()) {
+    delete in;
+    return s;
+  }
+  const size_t kBufferSize = 1 << 20;
+  char* buffer = new char[kBufferSize];
+  while (true) {
+    Slice fragment;
+    s = in->Read(kBufferSize, &fragment, buffer);
+    if (!s.ok() || fragment.empty()) {
+      break;
+    }
+    s = out->Append(fragment);
+    if (!s.ok()) {
+      break;
+    }
+  }
+  delete[] buffer;
+  delete in;
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  if (!s.ok()) {
+    env->DeleteFile(dst);
+  }
+  return s;
+}
+
+// Does "mem" hold an entry or a range tombstone for a key in
+// [smallest,largest]?
+static bool MemTableOverlaps(MemTable* mem, const Comparator* ucmp,
+                             const Slice& smallest, const Slice& largest) {
+  InternalKey start(smallest, kMaxSequenceNumber, kValueTypeForSeek);
+  Iterator* iter = mem->NewIterator();
+  iter->Seek(start.Encode());
+  bool overlap = iter->Valid() &&
+                 ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0;
+  delete iter;
+  iter = mem->NewRangeTombstoneIterator();
+  if (iter != nullptr) {
+    for (iter->SeekToFirst(); !overlap && iter->Valid(); iter->Next()) {
+      overlap = ucmp->Compare(ExtractUserKey(iter->key()), largest) <= 0 &&
+                ucmp->Compare(iter->value(), smallest) > 0;
+    }
+    delete iter;
+  }
+  return overlap;
+}
+
+Status DBImpl::ReadExternalFile(const std::string& fname,
+                                FileMetaData* meta) {
+  Status s = env_->GetFileSize(fname, &meta->file_size);
+  RandomAccessFile* file = nullptr;
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &file);
+  }
+  Table* table = nullptr;
+  if (s.ok()) {
+    s = Table::Open(options_, file, meta->file_size, &table);
+  }
+  if (s.ok()) {
+    ReadOptions options;
+    options.fill_cache = false;
+    Iterator* iter = table->NewIterator(options);
+    ParsedInternalKey ikey;
+    iter->SeekToFirst();
+    if (iter->Valid()) {
+      meta->smallest.DecodeFrom(iter->key());
+      iter->SeekToLast();
+    }
+    if (!iter->Valid()) {
+      s = iter->status();
+      if (s.ok()) {
+        s = Status::InvalidArgument(fname, "has no entries");
+      }
+    } else if (!ParseInternalKey(meta->smallest.Encode(), &ikey) ||
+               ikey.sequence != 0 ||
+               !ParseInternalKey(iter->key(), &ikey) || ikey.sequence != 0) {
+      s = Status::InvalidArgument(fname, "was not written by SstFileWriter");
+    } else {
+      meta->largest.DecodeFrom(iter->key());
+    }
+    delete iter;
+    const TableProperties* props = table->GetProperties();
+    if (props != nullptr) {
+      meta->num_entries = props->num_entries;
+      meta->num_deletions = props->num_deletions;
+    }
+  }
+  delete table;
+  delete file;
+  return s;
+}
+
+Status DBImpl::IngestExternalFile(const std::vector<std::string>& files,
+                                  const IngestExternalFileOptions& options) {
+  if (files.empty()) {
+    return Status::InvalidArgument("no files to ingest");
+  }
+  std::vector<FileMetaData> metas(files.size());
+  Status s;
+  for (size_t i = 0; i < files.size() && s.ok(); i++) {
+    s = ReadExternalFile(files[i], &metas[i]);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+
+  // All the entries get the same sequence number, so two files may not
+  // hold the same key.
+  const Comparator* ucmp = user_comparator();
+  std::vector<const FileMetaData*> sorted;
+  for (const FileMetaData& f : metas) {
+    sorted.push_back(&f);
+  }
+  std::sort(sorted.begin(), sorted.end(),
+            [ucmp](const FileMetaData* a, const FileMetaData* b) {
+              return ucmp->Compare(a->smallest.user_key(),
+                                   b->smallest.user_key()) < 0;
+            });
+  for (size_t i = 1; i < sorted.size(); i++) {
+    if (ucmp->Compare(sorted[i - 1]->largest.user_key(),
+                      sorted[i]->smallest.user_key()) >= 0) {
+      return Status::InvalidArgument("external files overlap");
+    }
+  }
+
+  // Bring the files into the database directory
+  {
+    MutexLock l(&mutex_);
+    for (FileMetaData& f : metas) {
+      f.number = versions_->NewFileNumber();
+      pending_outputs_.insert(f.number);
+    }
+  }
+  std::vector<bool> moved(files.size(), false);
+  size_t added = 0;
+  for (; added < files.size(); added++) {
+    const std::string fname = TableFileName(dbname_, metas[added].number);
+    if (options.move_files && env_->RenameFile(files[added], fname).ok()) {
+      moved[added] = true;
+    } else {
+      s = CopyFile(env_, files[added], fname);
+      if (!s.ok()) {
+        break;
+      }
+    }
+  }
+
+  MutexLock l(&mutex_);
+  if (s.ok()) {
+    s = InstallExternalFiles(&metas);
+  }
+  if (!s.ok()) {
+    // Leave the database directory and the moved files as they were
+    for (size_t i = 0; i < added; i++) {
+      const std::string fname = TableFileName(dbname_, metas[i].number);
+      if (moved[i]) {
+        env_->RenameFile(fname, files[i]);
+      } else {
+        env_->DeleteFile(fname);
+      }
+    }
+  }
+  for (const FileMetaData& f : metas) {
+    pending_outputs_.erase(f.number);
+  }
+  return s;
+}
+
+Status DBImpl::InstallExternalFiles(std::vector<FileMetaData>* files) {
+  mutex_.AssertHeld();
+
+  // Stop writes, and wait for the groups still in the pipeline to reach
+  // the memtable.
+  Writer w(&mutex_);
+  w.exclusive = true;
+  writers_.push_back(&w);
+  while (&w != writers_.front()) {
+    w.cv.Wait();
+  }
+  while (!memtable_writers_.empty()) {
+    background_work_finished_signal_.Wait();
+  }
+
+  // Memtable entries for the keys of the files are older than the ingested
+  // ones, but would be read first.  Flush them.
+  const Comparator* ucmp = user_comparator();
+  bool overlap = false;
+  for (const FileMetaData& f : *files) {
+    const Slice smallest = f.smallest.user_key();
+    const Slice largest = f.largest.user_key();
+    overlap = overlap || MemTableOverlaps(mem_, ucmp, smallest, largest);
+    for (size_t i = 0; !overlap && i < imm_.size(); i++) {
+      overlap = MemTableOverlaps(imm_[i].mem, ucmp, smallest, largest);
+    }
+  }
+  Status s;
+  if (overlap) {
+    s = MakeRoomForWrite(true);
+    while (s.ok() && !imm_.empty()) {
+      if (!bg_error_.ok()) {
+        s = bg_error_;
+      } else {
+        background_work_finished_signal_.Wait();
+      }
+    }
+  }
+
+  // Level-0 tables are ordered by file number.  Give the files numbers
+  // above those of the tables flushed meanwhile.
+  for (size_t i = 0; i < files->size() && s.ok(); i++) {
+    FileMetaData* f = &(*files)[i];
+    const uint64_t number = versions_->NewFileNumber();
+    pending_outputs_.insert(number);
+    mutex_.Unlock();
+    s = env_->RenameFile(TableFileName(dbname_, f->number),
+                         TableFileName(dbname_, number));
+    mutex_.Lock();
+    if (s.ok()) {
+      pending_outputs_.erase(f->number);
+      f->number = number;
+    } else {
+      pending_outputs_.erase(number);
+    }
+  }
+
+  // The files were renamed or copied into the database directory.  Make
+  // their names durable before the manifest refers to them.
+  if (s.ok()) {
+    mutex_.Unlock();
+    s = env_->SyncDir(dbname_);
+    mutex_.Lock();
+  }
+
+  // A flush placing its table below level-0 could pick a level that
+  // overlaps the files.  Let it finish, and keep others from starting.
+  while (s.ok() && table_may_skip_level0_) {
+    background_work_finished_signal_.Wait();
+  }
+  if (s.ok()) {
+    const SequenceNumber seq = versions_->LastSequence() + 1;
+    Version* current = versions_->current();
+    VersionEdit edit;
+    for (FileMetaData& f : *files) {
+      ParsedInternalKey smallest, largest;
+      ParseInternalKey(f.smallest.Encode(), &smallest);
+      ParseInternalKey(f.largest.Encode(), &largest);
+      const int level = current->PickLevelForExternalFile(smallest.user_key,
+                                                          largest.user_key);
+      const std::string smallest_key = smallest.user_key.ToString();
+      const std::string largest_key = largest.user_key.ToString();
+      f.smallest = InternalKey(smallest_key, seq, smallest.type);
+      f.largest = InternalKey(largest_key, seq, largest.type);
+      f.largest_seqno = seq;
+      f.global_seqno = seq;
+      edit.AddFile(level, f);
+      Log(options_.info_log, "Ingest table #%llu: %lld bytes at level-%d",
+          (unsigned long long)f.number, (long long)f.file_size, level);
+    }
+    versions_->SetLastSequence(seq);
+    table_may_skip_level0_ = true;
+    s = LogAndApply(&edit);
+    table_may_skip_level0_ = false;
+    background_work_finished_signal_.SignalAll();
+    if (s.ok()) {
+      MaybeScheduleCompaction();
+    }
+  }
+
+  writers_.pop_front();
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+  return s;
+}
+
 // 处理过程
 // 1. 队列化请求
 //     mutex l上锁之后, 到了"w.cv.Wait()"的时候, 会先释放锁等待, 然后收到signal时再次上锁. 
@@ -1244,6 +2310,10 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
 // 4. 写入log文件和memtable
 // 5. 唤醒队列的其他人去干活，自己返回
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  if (options_.enable_pipelined_write) {
+    return PipelinedWrite(options, updates);
+  }
+
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1253,9 +2323,13 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   MutexLock l(&mutex_);
   writers_.push_back(&w);
   // 如果任务没完成，并且任务没在队首，那么任务就需要在队列中等待
-  while (!w.done && &w != writers_.front()) {
+  while (!w.done && w.insert_into == nullptr && &w != writers_.front()) {
     w.cv.Wait();
   }
+  if (w.insert_into != nullptr) {
+    // The leader handed our batch back to us to apply in parallel.
+    InsertFollowerBatch(&w);
+  }
 
   //writer的任务被其他writer帮忙执行了，则返回。BuildBatchGroup会有合并写的操作。
   if (w.done) {
@@ -1265,14 +2339,18 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   // May temporarily unlock and wait.
   // 写入前的各种检查。是否该停写,是否该切换memtable,是否该compact
   Status status = MakeRoomForWrite(updates == nullptr);
-  
-  // 获取本次写入的版本号,其实就是个uint64
-  uint64_t last_sequence = versions_->LastSequence();
+
   Writer* last_writer = &w;
   //这里writer还是队列中第一个,由于队列中第一个writer后面的writers也可能合并起来,所以last_writer指针会指向被合并的最后一个writer
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* updates = BuildBatchGroup(&last_writer); //这里会把writers队列中的其他适合的写操作一起执行
+    WriteBatch* updates = BuildBatchGroup(&last_writer, tmp_batch_); //这里会把writers队列中的其他适合的写操作一起执行
+    DelayWrite(WriteBatchInternal::ByteSize(updates));
+    // 获取本次写入的版本号,其实就是个uint64
+    uint64_t last_sequence = versions_->LastSequence();
     WriteBatchInternal::SetSequence(updates, last_sequence + 1); //把版本号写入batch中
+    const SequenceNumber first_sequence = last_sequence + 1;
+    const bool parallel =
+        options_.allow_concurrent_memtable_write && last_writer != &w;
     last_sequence += WriteBatchInternal::Count(updates); //updates如果合并了n条操作,版本号也会跳跃n
 
     // Add to log and apply to memtable.  We can release the lock
@@ -1289,7 +2367,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
+      if (status.ok() && !parallel) {
         status = WriteBatchInternal::InsertInto(updates, mem_); //插入memtable了
       }
       mutex_.Lock();
@@ -1300,6 +2378,15 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         RecordBackgroundError(status);
       }
     }
+    if (status.ok() && parallel) {
+      for (Writer* follower : writers_) {
+        if (follower != &w) {
+          w.followers.push_back(follower);
+        }
+        if (follower == last_writer) break;
+      }
+      status = InsertBatchGroupConcurrently(&w, first_sequence, mem_);
+    }
     if (updates == tmp_batch_) tmp_batch_->Clear();
 
     versions_->SetLastSequence(last_sequence);
@@ -1325,15 +2412,195 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+// The pipelined write path splits Write() into two stages that are each
+// serialized on their own queue:
+//   1. The front of writers_ builds a batch group, assigns its sequence
+//      numbers and appends it to the log.  It then removes the group from
+//      writers_ so that the next group can start logging.
+//   2. The group leader waits in memtable_writers_ until every earlier
+//      group has been applied, inserts its batch into mem_ and publishes
+//      the group's last sequence number.
+// Publishing in queue order guarantees that readers never observe a gap
+// in the sequence space.  MakeRoomForWrite() waits for memtable_writers_
+// to drain before it switches memtables, so a group is always applied to
+// the memtable that matches the log file it was written to.
+Status DBImpl::PipelinedWrite(const WriteOptions& options,
+                              WriteBatch* updates) {
+  Writer w(&mutex_);
+  w.batch = updates;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  // Followers leave writers_ before their group is applied, so the queue
+  // may be empty while we wait.
+  while (!w.done && w.insert_into == nullptr &&
+         (writers_.empty() || &w != writers_.front())) {
+    w.cv.Wait();
+  }
+  if (w.insert_into != nullptr) {
+    InsertFollowerBatch(&w);
+  }
+  if (w.done) {
+    return w.status;
+  }
+
+  // May temporarily unlock and wait.
+  Status status = MakeRoomForWrite(updates == nullptr);
+  Writer* last_writer = &w;
+  WriteBatch group_batch;
+  WriteBatch* write_batch = nullptr;
+  if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
+    write_batch = BuildBatchGroup(&last_writer, &group_batch);
+    DelayWrite(WriteBatchInternal::ByteSize(write_batch));
+    // Sequence numbers continue from the last group still in the pipeline,
+    // which may not have been published yet.
+    SequenceNumber last_sequence = memtable_writers_.empty()
+                                       ? versions_->LastSequence()
+                                       : memtable_writers_.back()->last_sequence;
+    WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
+    w.last_sequence = last_sequence + WriteBatchInternal::Count(write_batch);
+
+    // &w is at the front of writers_, so it is the only thread touching
+    // the log.  The memtable is left to the memtable_writers_ queue.
+    mutex_.Unlock();
+    status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+    bool sync_error = false;
+    if (status.ok() && options.sync) {
+      status = logfile_->Sync();
+      if (!status.ok()) {
+        sync_error = true;
+      }
+    }
+    mutex_.Lock();
+    if (sync_error) {
+      // The state of the log file is indeterminate, see Write().
+      RecordBackgroundError(status);
+    }
+  }
+
+  // Hand the log over to the next group.
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    if (ready != &w) {
+      w.followers.push_back(ready);
+    }
+    if (ready == last_writer) break;
+  }
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  if (status.ok() && write_batch != nullptr) {
+    memtable_writers_.push_back(&w);
+    while (&w != memtable_writers_.front()) {
+      w.cv.Wait();
+    }
+
+    // mem_ cannot be switched while this group is queued, and only the
+    // front of memtable_writers_ inserts into it.
+    MemTable* mem = mem_;
+    if (options_.allow_concurrent_memtable_write && !w.followers.empty()) {
+      status = InsertBatchGroupConcurrently(
+          &w, WriteBatchInternal::Sequence(write_batch), mem);
+    } else {
+      mutex_.Unlock();
+      status = WriteBatchInternal::InsertInto(write_batch, mem);
+      mutex_.Lock();
+    }
+    versions_->SetLastSequence(w.last_sequence);
+
+    memtable_writers_.pop_front();
+    if (!memtable_writers_.empty()) {
+      memtable_writers_.front()->cv.Signal();
+    } else {
+      // Wake up MakeRoomForWrite() if it is waiting for the pipeline.
+      background_work_finished_signal_.SignalAll();
+    }
+  }
+
+  for (Writer* follower : w.followers) {
+    follower->status = status;
+    follower->done = true;
+    follower->cv.Signal();
+  }
+  return status;
+}
+
+// With options_.allow_concurrent_memtable_write, the writers of a batch
+// group apply their own batches to the memtable in parallel instead of
+// the leader applying the merged batch alone.  The leader assigns each
+// batch the sequence numbers it has in the merged log record, wakes the
+// followers and waits until all of them are done.  The batches belong to
+// the callers, so their headers are left alone.  The caller publishes
+// the group's sequence numbers afterwards, so readers only observe the
+// group once every batch is in the memtable.
+Status DBImpl::InsertBatchGroupConcurrently(Writer* leader,
+                                            SequenceNumber first_sequence,
+                                            MemTable* mem) {
+  mutex_.AssertHeld();
+  SequenceNumber sequence =
+      first_sequence + WriteBatchInternal::Count(leader->batch);
+  for (Writer* follower : leader->followers) {
+    if (follower->batch == nullptr) {
+      continue;
+    }
+    follower->insert_sequence = sequence;
+    sequence += WriteBatchInternal::Count(follower->batch);
+    follower->leader = leader;
+    follower->insert_into = mem;
+    leader->pending_inserts++;
+    follower->cv.Signal();
+  }
+
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(leader->batch,
+                                                        first_sequence, mem);
+  mutex_.Lock();
+  while (leader->pending_inserts > 0) {
+    leader->cv.Wait();
+  }
+  if (s.ok()) {
+    s = leader->insert_status;
+  }
+  return s;
+}
+
+void DBImpl::InsertFollowerBatch(Writer* w) {
+  mutex_.AssertHeld();
+  MemTable* mem = w->insert_into;
+  const SequenceNumber sequence = w->insert_sequence;
+  mutex_.Unlock();
+  Status s = WriteBatchInternal::InsertIntoConcurrently(w->batch, sequence,
+                                                        mem);
+  mutex_.Lock();
+  w->insert_into = nullptr;
+  Writer* leader = w->leader;
+  if (!s.ok() && leader->insert_status.ok()) {
+    leader->insert_status = s;
+  }
+  if (--leader->pending_inserts == 0) {
+    leader->cv.Signal();
+  }
+  // The leader marks us done once the whole group is visible.
+  while (!w->done) {
+    w->cv.Wait();
+  }
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
+// REQUIRES: tmp_batch is empty and not in use by another batch group
 
 // 作用：writer会被队列化，而只有排在第一位的writer才会往下执行。而writer有可能会把排在它后面的writer的活也拿过来一起干了。
 // 机制：遍历队列后面的writer们，一直到遇到帮不了忙的writer就返回了。那么帮不帮忙的标准是啥？两个标准：
 //  1.sync类型是否一样（我不需要马上flush到磁盘而你要，你的活还是自己干吧）
 //  2.写入的数据量是不是过大了？（避免单次写入数据量太大）
 // 只要没有符合这两个限制条件，就可以帮忙，合并多条write操作为一条操作
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* tmp_batch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1356,6 +2623,9 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
   ++iter;  // Advance past "first"
   for (; iter != writers_.end(); ++iter) {
     Writer* w = *iter;
+    if (w->exclusive) {
+      break;
+    }
     if (w->sync && !first->sync) {  //sync类型不同,你的活我不帮你了
       // Do not include a sync write into a batch handled by a non-sync write.
       break;
@@ -1372,7 +2642,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       // 先将第一个writer的batch追加到result中，再将后面的writer的batch追加到result中
       if (result == first->batch) {
         // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
+        result = tmp_batch;
         assert(WriteBatchInternal::Count(result) == 0);
         WriteBatchInternal::Append(result, first->batch); 
       }
@@ -1391,44 +2661,112 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
 // 4. 到达4说明memtable已经满了，这时候需要切换为Imuable memtable。所以这时候需要等待旧的Imuable memtable compact到level 0，进入等待
 // 5. 到达5说明旧的Imuable memtable已经compact到level 0了，这时候假如level 0的文件数目到达了12个，也需要等待
 // 6. 到达6说明旧的Imuable memtable已经compact到磁盘了，level 0的文件数目也符合要求，这时候当前的memtable可以转换成Imuable memtable，并启动后台compact。同时生成新的memtable、log用于数据的写入。
+void DBImpl::UpdateWriteRate() {
+  mutex_.AssertHeld();
+
+  // Count the steps by which writes have to be slowed down.
+  int steps = 0;
+  const int level0_files = versions_->NumLevelFiles(0);
+  if (level0_files >= options_.level0_slowdown_writes_trigger) {
+    steps = level0_files - options_.level0_slowdown_writes_trigger + 1;
+  }
+  const uint64_t soft_limit = options_.soft_pending_compaction_bytes_limit;
+  const uint64_t hard_limit = options_.hard_pending_compaction_bytes_limit;
+  const uint64_t pending_bytes = versions_->EstimatedPendingCompactionBytes();
+  if (soft_limit > 0 && pending_bytes >= soft_limit) {
+    int pending_steps = 1;
+    if (hard_limit > soft_limit) {
+      pending_steps += static_cast<int>(4 * (pending_bytes - soft_limit) /
+                                        (hard_limit - soft_limit));
+    }
+    steps = std::max(steps, pending_steps);
+  }
+  if (imm_.size() + 1 >=
+          static_cast<size_t>(options_.max_write_buffer_number) &&
+      mem_->ApproximateMemoryUsage() > options_.write_buffer_size / 2) {
+    // The memtable is filling up faster than the previous ones are flushed.
+    steps = std::max(steps, 1);
+  }
+
+  uint64_t rate = 0;
+  if (steps > 0) {
+    rate = options_.delayed_write_rate;
+    for (int i = 1; i < steps && rate > kMinDelayedWriteRate; i++) {
+      rate -= rate / 5;
+    }
+    rate = std::max(rate, kMinDelayedWriteRate);
+  }
+  write_controller_.SetDelayedWriteRate(rate);
+}
+
+void DBImpl::WaitForBackgroundWork() {
+  mutex_.AssertHeld();
+  const uint64_t start_micros = env_->NowMicros();
+  background_work_finished_signal_.Wait();
+  write_stall_micros_ += env_->NowMicros() - start_micros;
+}
+
+// 写入速度超过compaction的速度时，按write_controller_的速率延迟写入，
+// 同时写入writer线程向压缩线程转让cpu。
+void DBImpl::DelayWrite(size_t bytes) {
+  mutex_.AssertHeld();
+  if (!write_controller_.IsDelayed()) {
+    return;
+  }
+  // We are getting close to hitting a hard limit.  Rather than delaying a
+  // single write by several seconds when we hit the hard limit, admit
+  // writes at a rate that drops as the limit gets closer, to reduce
+  // latency variance.  Also, this delay hands over some CPU to the
+  // compaction thread in case it is sharing the same core as the writer.
+  const uint64_t delay =
+      std::min(write_controller_.GetDelay(env_->NowMicros(), bytes),
+               kMaxWriteDelayMicros);
+  if (delay > 0) {
+    mutex_.Unlock();
+    env_->SleepForMicroseconds(static_cast<int>(delay));
+    mutex_.Lock();
+    write_stall_micros_ += delay;
+  }
+}
+
 Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
-  bool allow_delay = !force;  //allow_delay代表compaction可以延后，如果updates为空则不能延后
   Status s;
   while (true) {// 会一直等到mutable memtable有空闲的缓存空间才退出
+    UpdateWriteRate();
     if (!bg_error_.ok()) {
       // Yield previous error 如果后台任务已经出错,直接返回错误
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
-      // level0的文件数限制超过8,睡眠1ms,简单等待后台任务执行。写入writer线程向压缩线程转让cpu。
-      // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
-      allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
       // 当前memtable，还有空间继续写入
       break;
-    } else if (imm_ != nullptr) {
+    } else if (!memtable_writers_.empty()) {
+      // Pipelined writes that are already in the log still have to be
+      // applied to the current memtable before it can be switched out.
+      background_work_finished_signal_.Wait();
+    } else if (imm_.size() + 1 >=
+               static_cast<size_t>(options_.max_write_buffer_number)) {
       // We have filled up the current memtable, but the previous
-      // one is still being compacted, so we wait.
+      // ones are still being compacted, so we wait.
       // 等待之前的imuable memtable完成compact到level0
       Log(options_.info_log, "Current memtable full; waiting...\n");
-      background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+      WaitForBackgroundWork();
+    } else if (versions_->NumLevelFiles(0) >=
+               options_.level0_stop_writes_trigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
-      background_work_finished_signal_.Wait();
+      WaitForBackgroundWork();
+    } else if (options_.hard_pending_compaction_bytes_limit > 0 &&
+               versions_->EstimatedPendingCompactionBytes() >=
+                   options_.hard_pending_compaction_bytes_limit) {
+      // Compactions are too far behind.
+      Log(options_.info_log,
+          "Too many pending compaction bytes; waiting...\n");
+      WaitForBackgroundWork();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       // 当前compaction没有负载过重，可以切换到新的memtable并触发旧的进行compaction
@@ -1443,11 +2781,16 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       }
       delete log_; //删除旧的log对象分配新的
       delete logfile_;
+      const uint64_t old_log_number = logfile_number_;
       logfile_ = lfile;
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
-      imm_ = mem_; //切换memtable到Imuable memtable
-      has_imm_.store(true, std::memory_order_release);
+      //切换memtable到Imuable memtable
+      imm_.push_back(ImmutableMemTable{mem_, old_log_number});
+      if (force) {
+        flush_requested_ = true;
+      }
+      has_imm_.store(FlushNeeded(), std::memory_order_release);
       mem_ = new MemTable(internal_comparator_);
       mem_->Ref();
       force = false;  // Do not force another compaction if have room
@@ -1506,14 +2849,34 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     if (mem_) {
       total_usage += mem_->ApproximateMemoryUsage();
     }
-    if (imm_) {
-      total_usage += imm_->ApproximateMemoryUsage();
+    for (size_t i = 0; i < imm_.size(); i++) {
+      total_usage += imm_[i].mem->ApproximateMemoryUsage();
     }
     char buf[50];
     snprintf(buf, sizeof(buf), "%llu",
              static_cast<unsigned long long>(total_usage));
     value->append(buf);
     return true;
+  } else if (in == "estimate-pending-compaction-bytes") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(
+                 versions_->EstimatedPendingCompactionBytes()));
+    value->append(buf);
+    return true;
+  } else if (in == "actual-delayed-write-rate") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(
+                 write_controller_.delayed_write_rate()));
+    value->append(buf);
+    return true;
+  } else if (in == "write-stall-micros") {
+    char buf[50];
+    snprintf(buf, sizeof(buf), "%llu",
+             static_cast<unsigned long long>(write_stall_micros_));
+    value->append(buf);
+    return true;
   }
 
   return false;
@@ -1537,6 +2900,21 @@ void DBImpl::GetApproximateSizes(const Range* range, int n, uint64_t* sizes) {
   v->Unref();
 }
 
+Status DBImpl::GetPropertiesOfAllTables(TablePropertiesCollection* props) {
+  mutex_.Lock();
+  Version* v = versions_->current();
+  v->Ref();
+  mutex_.Unlock();
+
+  props->clear();
+  Status s = v->GetPropertiesOfAllTables(props);
+
+  mutex_.Lock();
+  v->Unref();
+  mutex_.Unlock();
+  return s;
+}
+
 // Default implementations of convenience methods that subclasses of DB
 // can call if they wish
 Status DB::Put(const WriteOptions& opt, const Slice& key, const Slice& value) {
@@ -1551,6 +2929,46 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin,
+                       const Slice& end) {
+  WriteBatch batch;
+  batch.DeleteRange(begin, end);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::IngestExternalFile(const std::vector<std::string>& files,
+                              const IngestExternalFileOptions& options) {
+  return Status::NotSupported("IngestExternalFile");
+}
+
+Status DB::GetPropertiesOfAllTables(TablePropertiesCollection* props) {
+  return Status::NotSupported("GetPropertiesOfAllTables");
+}
+
+void DB::MultiGet(const ReadOptions& options, int n, const Slice* keys,
+                  std::string* values, Status* statuses) {
+  // Read every key from the same snapshot
+  ReadOptions opt = options;
+  const Snapshot* snapshot = nullptr;
+  if (opt.snapshot == nullptr) {
+    snapshot = GetSnapshot();
+    opt.snapshot = snapshot;
+  }
+  for (int i = 0; i < n; i++) {
+    statuses[i] = Get(opt, keys[i], &values[i]);
+  }
+  if (snapshot != nullptr) {
+    ReleaseSnapshot(snapshot);
+  }
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1585,6 +3003,7 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
   if (s.ok()) {
     impl->DeleteObsoleteFiles();
     impl->MaybeScheduleCompaction();
+    impl->UpdateWriteRate();
   }
   impl->mutex_.Unlock();
   if (s.ok()) {
@@ -9,10 +9,12 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -20,7 +22,10 @@
 
 namespace leveldb {
 
+struct FileMetaData;
 class MemTable;
+class RangeTombstoneList;
+struct RangeTombstone;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -40,15 +45,24 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status DeleteRange(const WriteOptions&, const Slice& begin,
+                     const Slice& end) override;
+  Status Merge(const WriteOptions&, const Slice& key,
+               const Slice& value) override;
   // 将updates写入log文件和memtable中
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
+  Status IngestExternalFile(const std::vector<std::string>& files,
+                            const IngestExternalFileOptions& options) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  void MultiGet(const ReadOptions& options, int n, const Slice* keys,
+                std::string* values, Status* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
+  Status GetPropertiesOfAllTables(TablePropertiesCollection* props) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
 
   // Extra methods (for testing) that are not in the public DB interface
@@ -76,6 +90,7 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct SubcompactionGroup;
   struct Writer;
 
   // Information for a manual compaction
@@ -103,9 +118,16 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
+  // If "range_del" is non-null, the range tombstones of the memtables and
+  // tables that the iterator reads are added to it.
   Iterator* NewInternalIterator(const ReadOptions&,
                                 SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+                                uint32_t* seed,
+                                RangeTombstoneList* range_del = nullptr);
+
+  // Return the immutable memtables, newest first.  Each of them is
+  // referenced on behalf of the caller, who must Unref() it.
+  std::vector<MemTable*> ImmutableMemTables() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status NewDB();
 
@@ -120,22 +142,74 @@ class DBImpl : public DB {
   // Delete any unneeded files and stale in-memory entries.
   void DeleteObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  // Compact the in-memory write buffer to disk.  Switches to a new
-  // log-file/memtable and writes a new descriptor iff successful.
+  // Compact the immutable memtables to disk, merged into a single table.
+  // Writes a new descriptor and drops the memtables iff successful.
   // Errors are recorded in bg_error_.
   void CompactMemTable() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Are there immutable memtables that should be flushed now?
+  bool FlushNeeded() const EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status RecoverLogFile(uint64_t log_number, bool last_log, bool* save_manifest,
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Write the contents of "iter", which must iterate over memtables, and
+  // the range tombstones in *range_del to a new table.  Takes ownership of
+  // "iter" but not of "range_del".
+  //
+  // If "pending_number" is non-null, the new table's number is stored in
+  // *pending_number and left in pending_outputs_ so that the file is not
+  // deleted before *edit is installed; the caller must then erase it.
+  Status WriteLevel0Table(Iterator* iter, RangeTombstoneList* range_del,
+                          VersionEdit* edit, Version* base,
+                          uint64_t* pending_number = nullptr)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Write the contents of "mem" to a new level-0 table during recovery.
+  Status WriteMemTableToLevel0(MemTable* mem, VersionEdit* edit)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+
+  // Charge a batch group of "bytes", followers included, against
+  // write_controller_ and sleep for the delay it asks for, if writes are
+  // slowed down.
+  void DelayWrite(size_t bytes) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Set the rate of write_controller_ from the number of level-0 files,
+  // the estimated pending compaction bytes and the memtable state.  Done
+  // before each write and after each change to the version.
+  void UpdateWriteRate() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Wait for background work while writes are stopped, and account the
+  // time in write_stall_micros_.
+  void WaitForBackgroundWork() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* tmp_batch)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Read the key range of the external table "fname" into *meta.
+  Status ReadExternalFile(const std::string& fname, FileMetaData* meta);
+
+  // Add the external tables described by *files, which are already in the
+  // database directory, to the current version.  Writes are stopped while
+  // this runs.  May renumber the files.
+  Status InstallExternalFiles(std::vector<FileMetaData>* files)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Write path used when options_.enable_pipelined_write is set.  The log
+  // record of a batch group is appended while earlier groups are still
+  // being applied to mem_.
+  Status PipelinedWrite(const WriteOptions& options, WriteBatch* updates);
+
+  // Apply the batches of a group's leader and followers to "mem" from all
+  // of their threads at once (options_.allow_concurrent_memtable_write).
+  Status InsertBatchGroupConcurrently(Writer* leader,
+                                      SequenceNumber first_sequence,
+                                      MemTable* mem)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void InsertFollowerBatch(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
@@ -148,17 +222,62 @@ class DBImpl : public DB {
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Memtable flushes run in the Env's HIGH priority thread pool so that
+  // they never wait behind a long major compaction.
+  static void BGFlushWork(void* db);
+  void BackgroundFlushCall();
+  // Run one compaction.  Returns false if there was nothing this call
+  // could do, e.g. because every candidate is used by running compactions.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Merge the entries of "input" that fall in the key range of "compact"
+  // into new output tables.  Runs on one of the threads of a compaction
+  // that is split into subcompactions.
+  Status ProcessCompactionInput(CompactionState* compact, Iterator* input)
+      LOCKS_EXCLUDED(mutex_);
+  // "input" is at a merge operand that every snapshot sees together with
+  // the older entries for its user key.  Combine them into as few entries
+  // as possible, which are stored newest first in *keys and *values, and
+  // advance "input" past the operands.  The entries that are left for the
+  // key are hidden by the result.  Sets *oldest_seq to the sequence number
+  // of the oldest operand.
+  Status MergeCompactionOperands(CompactionState* compact, Iterator* input,
+                                 std::vector<std::string>* keys,
+                                 std::vector<std::string>* values,
+                                 SequenceNumber* oldest_seq)
+      LOCKS_EXCLUDED(mutex_);
+  // Add an entry to the current output file of "compact", opening one if
+  // there is none.
+  Status AddToCompactionOutput(CompactionState* compact, const Slice& key,
+                               const Slice& value);
+  // Run the next subcompaction of "group" that nobody has taken yet, if
+  // any, and return whether there was one.  Static, as a run scheduled on
+  // the LOW pool may find nothing left after the DB is gone.
+  static bool RunNextSubcompaction(SubcompactionGroup* group);
+  static void UnrefSubcompactionGroup(SubcompactionGroup* group);
+  static void BGSubcompactionWork(void* group);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
-  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
+  // Finish the current output file.  It is given the range tombstones up to
+  // *next_user_key, the first key of the next output file, or up to the end
+  // of the range of "compact" if "next_user_key" is null.
+  Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input,
+                                    const Slice* next_user_key);
+  // Store in *result the range tombstones that the output file which ends
+  // before *upper must keep.
+  void GetOutputTombstones(CompactionState* compact, const Slice* upper,
+                           std::vector<RangeTombstone>* result);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Apply *edit to the current version with VersionSet::LogAndApply(),
+  // which releases mutex_ while writing the MANIFEST.  Flushes and
+  // compactions finish concurrently, so calls are serialized here.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   const Comparator* user_comparator() const {
     return internal_comparator_.user_comparator();
   }
@@ -167,6 +286,8 @@ class DBImpl : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const InternalTablePropertiesCollectorFactory internal_collector_factory_;
+  const InternalSliceTransform internal_prefix_extractor_;
   const Options options_;  // options_.comparator == &internal_comparator_
   const bool owns_info_log_;
   const bool owns_cache_;
@@ -183,8 +304,16 @@ class DBImpl : public DB {
   std::atomic<bool> shutting_down_;
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
   MemTable* mem_;
-  MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
-  std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
+  // Immutable memtables waiting to be flushed, oldest first.  At most
+  // options_.max_write_buffer_number - 1 of them.
+  struct ImmutableMemTable {
+    MemTable* mem;
+    uint64_t log_number;  // Log file that holds the contents of mem
+  };
+  std::vector<ImmutableMemTable> imm_ GUARDED_BY(mutex_);
+  std::atomic<bool> has_imm_;  // So bg thread can detect a pending flush
+  // Flush every immutable memtable, however few there are.
+  bool flush_requested_ GUARDED_BY(mutex_);
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
@@ -194,23 +323,60 @@ class DBImpl : public DB {
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // Leaders of batch groups whose log records have been written but that
+  // have not yet been applied to mem_.  Groups are applied, and their
+  // sequence numbers published, in queue order.  Only used when
+  // options_.enable_pipelined_write is set.
+  std::deque<Writer*> memtable_writers_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Number of background compactions scheduled or running.  At most
+  // options_.max_background_compactions.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Has a memtable flush been scheduled or is running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+
+  // Is CompactMemTable() running?
+  bool flush_in_progress_ GUARDED_BY(mutex_);
+
+  // True if env_ runs flushes apart from compactions.  Else a scheduled
+  // flush may wait for a whole compaction, so compactions flush the
+  // immutable memtables themselves as they go.
+  const bool flush_has_own_pool_;
+
+  // True while a flush or an ingestion that may place its table below
+  // level-0 is running.  Such a flush and a major compaction never run at
+  // the same time, since the compaction's outputs could overlap the table.
+  bool table_may_skip_level0_ GUARDED_BY(mutex_);
+
+  // Is a LogAndApply() call writing to the MANIFEST?
+  bool manifest_write_in_progress_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
+  // Should the entry counts that the MANIFEST lacks for some files be read
+  // from their tables?  Done once, by a background compaction thread.
+  bool file_stats_pending_ GUARDED_BY(mutex_);
+
   VersionSet* const versions_ GUARDED_BY(mutex_);
 
   // Have we encountered a background error in paranoid mode?
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+
+  // Paces writes while compactions fall behind.
+  WriteController write_controller_ GUARDED_BY(mutex_);
+
+  // Total time writers have spent delayed by DelayWrite() or stopped by
+  // MakeRoomForWrite().
+  uint64_t write_stall_micros_ GUARDED_BY(mutex_);
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
@@ -218,6 +384,8 @@ class DBImpl : public DB {
 Options SanitizeOptions(const std::string& db,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalTablePropertiesCollectorFactory* ifactory,
+                        const InternalSliceTransform* iprefix,
                         const Options& src);
 
 }  // namespace leveldb
@@ -4,11 +4,17 @@
 
 #include "db/db_iter.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/merge_helper.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "leveldb/slice_transform.h"
 #include "port/port.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -46,28 +52,40 @@ class DBIter : public Iterator {
   enum Direction { kForward, kReverse };
 
   DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+         uint32_t seed, RangeTombstoneList* range_del,
+         const MergeOperator* merge_operator,
+         const SliceTransform* prefix_extractor)
       : db_(db),
         user_comparator_(cmp),
         iter_(iter),
+        range_del_(range_del),
+        merge_operator_(merge_operator),
+        prefix_extractor_(prefix_extractor),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        merged_(false),
+        prefix_bounded_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
 
-  ~DBIter() override { delete iter_; }
+  ~DBIter() override {
+    delete iter_;
+    delete range_del_;
+  }
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : saved_key_;
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    return (direction_ == kForward && !merged_) ? iter_->value()
+                                                : saved_value_;
   }
   Status status() const override {
     if (status_.ok()) {
@@ -88,6 +106,28 @@ class DBIter : public Iterator {
   void FindPrevUserEntry();
   bool ParseKey(ParsedInternalKey* key);
 
+  // iter_ is at the newest visible merge operand "key" for its user key.
+  // Apply it and the older operands to the value they are based on, and
+  // make the result the current entry.
+  void MergeValuesNewToOld(const ParsedInternalKey& key);
+
+  // Is the entry "key" deleted by a range tombstone?
+  bool IsRangeDeleted(const ParsedInternalKey& key) {
+    return range_del_ != nullptr && range_del_->ShouldDelete(key, sequence_);
+  }
+
+  // Reverse iteration is not supported in prefix mode: the internal
+  // iterators skip the tables and blocks without keys of the prefix, after
+  // which they cannot be moved back.
+  void ReverseNotSupported() {
+    status_ = Status::NotSupported(
+        "reverse iteration with ReadOptions::prefix_same_as_start");
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+    direction_ = kForward;
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -109,12 +149,23 @@ class DBIter : public Iterator {
   DBImpl* db_;
   const Comparator* const user_comparator_;
   Iterator* const iter_;
+  RangeTombstoneList* const range_del_;  // Null if there are no tombstones
+  const MergeOperator* const merge_operator_;
+  const SliceTransform* const prefix_extractor_;  // Null unless prefix mode
   SequenceNumber const sequence_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  // When moving forward, the current entry is the result of a merge and
+  // is held in saved_key_ and saved_value_.  The internal iterator is
+  // positioned past the entries it was built from.
+  bool merged_;
+  // Set by a Seek() to a key with a prefix: iteration ends at the first
+  // key without prefix_.
+  bool prefix_bounded_;
+  std::string prefix_;
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -157,6 +208,15 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // saved_key_ already contains the key to skip past, and iter_ is past
+    // the entries it was built from.
+    if (!iter_->Valid()) {
+      valid_ = false;
+      merged_ = false;
+      saved_key_.clear();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -178,7 +238,12 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   // Loop until we hit an acceptable entry to yield
   assert(iter_->Valid());
   assert(direction_ == kForward);
+  merged_ = false;
   do {
+    if (prefix_bounded_ &&
+        !ExtractUserKey(iter_->key()).starts_with(prefix_)) {
+      break;  // Past the keys with the prefix of the Seek() target
+    }
     ParsedInternalKey ikey;
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
       switch (ikey.type) {
@@ -189,15 +254,25 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           skipping = true;
           break;
         case kTypeValue:
+        case kTypeMerge:
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+          } else if (IsRangeDeleted(ikey)) {
+            // Hidden by a range tombstone, and so are the older entries
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
+          } else if (ikey.type == kTypeMerge) {
+            MergeValuesNewToOld(ikey);
+            return;
           } else {
             valid_ = true;
             saved_key_.clear();
             return;
           }
           break;
+        default:
+          break;
       }
     }
     iter_->Next();
@@ -206,14 +281,63 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+void DBIter::MergeValuesNewToOld(const ParsedInternalKey& key) {
+  SaveKey(key.user_key, &saved_key_);
+  std::vector<std::string> operands;  // Newest first
+  operands.push_back(iter_->value().ToString());
+  bool has_base = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey)) {
+      continue;
+    }
+    if (user_comparator_->Compare(ikey.user_key, saved_key_) != 0 ||
+        ikey.type == kTypeDeletion || IsRangeDeleted(ikey)) {
+      break;
+    }
+    if (ikey.type == kTypeValue) {
+      Slice raw_value = iter_->value();
+      saved_value_.assign(raw_value.data(), raw_value.size());
+      has_base = true;
+      break;
+    }
+    operands.push_back(iter_->value().ToString());
+  }
+
+  const Slice base(saved_value_);
+  Status s = FullMerge(merge_operator_, saved_key_,
+                       has_base ? &base : nullptr, operands, &saved_value_);
+  if (s.ok()) {
+    valid_ = true;
+    merged_ = true;
+  } else {
+    status_ = s;
+    valid_ = false;
+    saved_key_.clear();
+    ClearSavedValue();
+  }
+}
+
 void DBIter::Prev() {
   assert(valid_);
+  if (prefix_extractor_ != nullptr) {
+    ReverseNotSupported();
+    return;
+  }
 
   if (direction_ == kForward) {  // Switch directions?
-    // iter_ is pointing at the current entry.  Scan backwards until
-    // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    // iter_ is pointing at the current entry, or past the entries of a
+    // merged one.  Scan backwards until the key changes so we can use the
+    // normal reverse scanning code.
+    if (merged_) {
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -237,6 +361,10 @@ void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
   ValueType value_type = kTypeDeletion;
+  // Merge operands that apply to saved_value_ (if has_base) or to nothing,
+  // oldest first
+  std::vector<std::string> operands;
+  bool has_base = false;
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
@@ -246,10 +374,18 @@ void DBIter::FindPrevUserEntry() {
           // We encountered a non-deleted value in entries for previous keys,
           break;
         }
-        value_type = ikey.type;
+        const ValueType older_type = value_type;
+        value_type = IsRangeDeleted(ikey) ? kTypeDeletion : ikey.type;
         if (value_type == kTypeDeletion) {
           saved_key_.clear();
           ClearSavedValue();
+          operands.clear();
+        } else if (value_type == kTypeMerge) {
+          if (operands.empty()) {
+            has_base = (older_type == kTypeValue);
+          }
+          SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+          operands.push_back(iter_->value().ToString());
         } else {
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
@@ -258,12 +394,24 @@ void DBIter::FindPrevUserEntry() {
           }
           SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
           saved_value_.assign(raw_value.data(), raw_value.size());
+          operands.clear();
         }
       }
       iter_->Prev();
     } while (iter_->Valid());
   }
 
+  if (value_type == kTypeMerge) {
+    std::reverse(operands.begin(), operands.end());
+    const Slice base(saved_value_);
+    Status s = FullMerge(merge_operator_, saved_key_,
+                         has_base ? &base : nullptr, operands, &saved_value_);
+    if (!s.ok()) {
+      status_ = s;
+      value_type = kTypeDeletion;
+    }
+  }
+
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -277,7 +425,14 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
+  prefix_bounded_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (prefix_bounded_) {
+    const Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+  }
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
                     ParsedInternalKey(target, sequence_, kValueTypeForSeek));
@@ -291,6 +446,8 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
+  prefix_bounded_ = false;
   ClearSavedValue();
   iter_->SeekToFirst();
   if (iter_->Valid()) {
@@ -301,7 +458,12 @@ void DBIter::SeekToFirst() {
 }
 
 void DBIter::SeekToLast() {
+  if (prefix_extractor_ != nullptr) {
+    ReverseNotSupported();
+    return;
+  }
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
   iter_->SeekToLast();
   FindPrevUserEntry();
@@ -311,8 +473,11 @@ void DBIter::SeekToLast() {
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        uint32_t seed, RangeTombstoneList* range_del,
+                        const MergeOperator* merge_operator,
+                        const SliceTransform* prefix_extractor) {
+  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed,
+                    range_del, merge_operator, prefix_extractor);
 }
 
 }  // namespace leveldb
@@ -13,13 +13,23 @@
 namespace leveldb {
 
 class DBImpl;
+class MergeOperator;
+class RangeTombstoneList;
+class SliceTransform;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  Entries deleted by the range tombstones in
+// "*range_del" are skipped.  Takes ownership of "range_del", which may be
+// null if there are no tombstones.  Merge operands are combined with
+// "merge_operator".  If "prefix_extractor" is non-null, a Seek() to a key
+// in its domain only yields the keys with the prefix of the target, and
+// Prev() and SeekToLast() are not supported.
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
                         Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        uint32_t seed, RangeTombstoneList* range_del,
+                        const MergeOperator* merge_operator,
+                        const SliceTransform* prefix_extractor);
 
 }  // namespace leveldb
 
@@ -11,10 +11,17 @@
 #include "db/filename.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "helpers/memenv/memenv.h"
 #include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/secondary_cache.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/sst_file_writer.h"
 #include "leveldb/table.h"
+#include "leveldb/table_properties.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
 #include "util/hash.h"
@@ -64,6 +71,32 @@ class AtomicCounter {
 void DelayMilliseconds(int millis) {
   Env::Default()->SleepForMicroseconds(millis * 1000);
 }
+
+// Occupies a background thread until Release() is called.
+class BlockingBackgroundTask {
+ public:
+  BlockingBackgroundTask() : cv_(&mu_), released_(false) {}
+
+  static void Run(void* arg) {
+    BlockingBackgroundTask* task =
+        reinterpret_cast<BlockingBackgroundTask*>(arg);
+    MutexLock l(&task->mu_);
+    while (!task->released_) {
+      task->cv_.Wait();
+    }
+  }
+
+  void Release() LOCKS_EXCLUDED(mu_) {
+    MutexLock l(&mu_);
+    released_ = true;
+    cv_.SignalAll();
+  }
+
+ private:
+  port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  bool released_ GUARDED_BY(mu_);
+};
 }  // namespace
 
 // Test Env to override default Env behavior for testing.
@@ -120,6 +153,12 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  AtomicCounter dir_sync_counter_;
+
+  // Pools resized through this Env.  The pools are shared by the whole
+  // process, so RestoreBackgroundThreads() puts them back to one thread.
+  bool resized_pools_[2];
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -128,7 +167,27 @@ class SpecialEnv : public EnvWrapper {
         non_writable_(false),
         manifest_sync_error_(false),
         manifest_write_error_(false),
-        count_random_reads_(false) {}
+        count_random_reads_(false),
+        resized_pools_{false, false} {}
+
+  void SetBackgroundThreads(int number, Priority pri) override {
+    resized_pools_[pri] = true;
+    target()->SetBackgroundThreads(number, pri);
+  }
+
+  Status SyncDir(const std::string& d) override {
+    dir_sync_counter_.Increment();
+    return target()->SyncDir(d);
+  }
+
+  void RestoreBackgroundThreads() {
+    for (Priority pri : {LOW, HIGH}) {
+      if (resized_pools_[pri]) {
+        target()->SetBackgroundThreads(1, pri);
+        resized_pools_[pri] = false;
+      }
+    }
+  }
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
@@ -245,6 +304,7 @@ class DBTest {
   ~DBTest() {
     delete db_;
     DestroyDB(dbname_, Options());
+    env_->RestoreBackgroundThreads();
     delete env_;
     delete filter_policy_;
   }
@@ -256,6 +316,7 @@ class DBTest {
     if (option_config_ >= kEnd) {
       return false;
     } else {
+      env_->RestoreBackgroundThreads();
       DestroyAndReopen();
       return true;
     }
@@ -275,6 +336,27 @@ class DBTest {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kConcurrentCompactions:
+        options.max_background_compactions = 4;
+        env_->SetBackgroundThreads(4, Env::LOW);
+        break;
+      case kMultipleWriteBuffers:
+        options.max_write_buffer_number = 4;
+        options.min_write_buffer_number_to_merge = 2;
+        break;
+      case kPartitionedIndex:
+        // Small blocks and partitions, so that tables have several
+        options.block_size = 256;
+        options.index_partition_size = 64;
+        options.filter_policy = filter_policy_;
+        options.filter_block_type = kPartitionedFilter;
+        break;
       default:
         break;
     }
@@ -331,6 +413,28 @@ class DBTest {
     return result;
   }
 
+  // Look up all of "keys" with one MultiGet() call.  Each result is
+  // formatted like the result of Get().
+  std::vector<std::string> MultiGet(const std::vector<std::string>& keys,
+                                    const Snapshot* snapshot = nullptr) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    const int n = keys.size();
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> results(n);
+    std::vector<Status> statuses(n);
+    db_->MultiGet(options, n, key_slices.data(), results.data(),
+                  statuses.data());
+    for (int i = 0; i < n; i++) {
+      if (statuses[i].IsNotFound()) {
+        results[i] = "NOT_FOUND";
+      } else if (!statuses[i].ok()) {
+        results[i] = statuses[i].ToString();
+      }
+    }
+    return results;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -387,6 +491,11 @@ class DBTest {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeMerge:
+              result += "MERGE(" + iter->value().ToString() + ")";
+              break;
+            default:
+              break;
           }
         }
         iter->Next();
@@ -529,7 +638,18 @@ class DBTest {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kConcurrentCompactions,
+    kMultipleWriteBuffers,
+    kPartitionedIndex,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
   int option_config_;
@@ -604,6 +724,49 @@ TEST(DBTest, GetFromImmutableLayer) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, GetFromMultipleImmutableLayers) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_write_buffer_number = 4;
+  options.min_write_buffer_number_to_merge = 1;
+  Reopen(&options);
+
+  // Keep flushes from running.
+  BlockingBackgroundTask blocker;
+  env_->Schedule(&BlockingBackgroundTask::Run, &blocker, Env::HIGH);
+
+  // Every write fills a memtable, so three immutable memtables and the
+  // current one hold a key each.  None of the writes has to wait.
+  ASSERT_OK(Put("k1", std::string(100000, '1')));
+  ASSERT_OK(Put("k2", std::string(100000, '2')));
+  ASSERT_OK(Put("k3", std::string(100000, '3')));
+  ASSERT_OK(Put("k1", std::string(100000, '4')));
+  ASSERT_EQ(TotalTableFiles(), 0);
+  ASSERT_EQ(std::string(100000, '4'), Get("k1"));
+  ASSERT_EQ(std::string(100000, '2'), Get("k2"));
+  ASSERT_EQ(std::string(100000, '3'), Get("k3"));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(count, 3);
+  delete iter;
+
+  // The immutable memtables are flushed together into one table.
+  blocker.Release();
+  for (int i = 0; i < 1000 && TotalTableFiles() == 0; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ(TotalTableFiles(), 1);
+  ASSERT_EQ(std::string(100000, '4'), Get("k1"));
+  ASSERT_EQ(std::string(100000, '2'), Get("k2"));
+
+  Reopen(&options);
+  ASSERT_EQ(std::string(100000, '4'), Get("k1"));
+  ASSERT_EQ(std::string(100000, '3'), Get("k3"));
+}
+
 TEST(DBTest, GetFromVersions) {
   do {
     ASSERT_OK(Put("foo", "v1"));
@@ -1024,6 +1187,55 @@ static std::string Key(int i) {
   return std::string(buf);
 }
 
+TEST(DBTest, MultiGet) {
+  do {
+    const int kNumKeys = 60;
+    // Oldest values end up in level-1, newer ones in level-0 and the
+    // memtable, with some keys deleted at each step.
+    for (int i = 0; i < kNumKeys; i++) {
+      ASSERT_OK(Put(Key(i), "v1-" + Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+    for (int i = 0; i < kNumKeys; i += 2) {
+      ASSERT_OK(Put(Key(i), "v2-" + Key(i)));
+    }
+    for (int i = 0; i < kNumKeys; i += 3) {
+      ASSERT_OK(Delete(Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    for (int i = 0; i < kNumKeys; i += 5) {
+      ASSERT_OK(Put(Key(i), "v3-" + Key(i)));
+    }
+    for (int i = 0; i < kNumKeys; i += 7) {
+      ASSERT_OK(Delete(Key(i)));
+    }
+
+    // Unsorted keys, with duplicates and keys that were never written
+    std::vector<std::string> keys;
+    for (int i = kNumKeys + 5; i >= -5; i--) {
+      keys.push_back(Key(i));
+    }
+    keys.push_back(Key(4));
+    keys.push_back(Key(kNumKeys / 2));
+    keys.push_back("");
+
+    std::vector<std::string> results = MultiGet(keys);
+    std::vector<std::string> snapshot_results = MultiGet(keys, snapshot);
+    ASSERT_EQ(keys.size(), results.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_EQ(Get(keys[i]), results[i]) << keys[i];
+      ASSERT_EQ(Get(keys[i], snapshot), snapshot_results[i]) << keys[i];
+    }
+    ASSERT_EQ("v3-" + Key(5), results[kNumKeys + 5 - 5]);
+    ASSERT_EQ("v1-" + Key(5), snapshot_results[kNumKeys + 5 - 5]);
+    db_->ReleaseSnapshot(snapshot);
+
+    ASSERT_TRUE(MultiGet(std::vector<std::string>()).empty());
+  } while (ChangeOptions());
+}
+
 TEST(DBTest, MinorCompactionsHappen) {
   Options options = CurrentOptions();
   options.write_buffer_size = 10000;
@@ -1099,6 +1311,39 @@ TEST(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000000;  // Large write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  // Write overlapping tables of 30 values, each 100K, where later tables
+  // overwrite or delete some of the keys of earlier ones.
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int file = 0; file < 4; file++) {
+    for (int i = file * 20; i < file * 20 + 30; i++) {
+      const std::string key = Key(i);
+      if (i % 7 == 0 && model.count(key) > 0) {
+        ASSERT_OK(Delete(key));
+        model.erase(key);
+      } else {
+        model[key] = RandomString(&rnd, 100000);
+        ASSERT_OK(Put(key, model[key]));
+      }
+    }
+    dbfull()->TEST_CompactMemTable();
+  }
+
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  for (int i = 0; i < 90; i++) {
+    const std::string key = Key(i);
+    auto it = model.find(key);
+    ASSERT_EQ(it == model.end() ? "NOT_FOUND" : it->second, Get(key));
+  }
+}
+
 TEST(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1106,8 +1351,8 @@ TEST(DBTest, RepeatedWritesToSameKey) {
   Reopen(&options);
 
   // We must have at most one file per level except for level-0,
-  // which may have up to kL0_StopWritesTrigger files.
-  const int kMaxFiles = config::kNumLevels + config::kL0_StopWritesTrigger;
+  // which may have up to level0_stop_writes_trigger files.
+  const int kMaxFiles = config::kNumLevels + options.level0_stop_writes_trigger;
 
   Random rnd(301);
   std::string value = RandomString(&rnd, 2 * options.write_buffer_size);
@@ -1118,6 +1363,134 @@ TEST(DBTest, RepeatedWritesToSameKey) {
   }
 }
 
+namespace {
+
+// Writes kWrites values of kValueSize bytes from its own thread
+struct DelayedWriter {
+  static const int kWrites = 5;
+  static const int kValueSize = 20000;
+
+  DB* db;
+  int id;
+  std::atomic<bool> done;
+};
+
+static void DelayedWriterBody(void* arg) {
+  DelayedWriter* writer = reinterpret_cast<DelayedWriter*>(arg);
+  for (int i = 0; i < DelayedWriter::kWrites; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "w%d.%d", writer->id, i);
+    ASSERT_OK(writer->db->Put(WriteOptions(), key,
+                              std::string(DelayedWriter::kValueSize, 'w')));
+  }
+  writer->done.store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST(DBTest, WriteRateController) {
+  Options options = CurrentOptions();
+  options.level0_file_num_compaction_trigger = 2;
+  options.level0_slowdown_writes_trigger = 2;
+  options.level0_stop_writes_trigger = 100;
+  options.delayed_write_rate = 1 << 20;
+  Reopen(&options);
+
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.actual-delayed-write-rate", &property));
+  ASSERT_EQ("0", property);
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-micros", &property));
+  ASSERT_EQ("0", property);
+
+  // Keep compactions from running while level-0 files pile up.  The LOW
+  // pool has its single default thread.
+  BlockingBackgroundTask blocker;
+  env_->Schedule(&BlockingBackgroundTask::Run, &blocker, Env::LOW);
+
+  // The first two tables are pushed below level-0; the rest overlap them.
+  for (int i = 0; i < 5; i++) {
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("z", "vz"));
+    dbfull()->TEST_CompactMemTable();
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(0), 3);
+
+  // Three level-0 files are two steps of slowdown.
+  ASSERT_TRUE(db_->GetProperty("leveldb.actual-delayed-write-rate", &property));
+  ASSERT_EQ(std::to_string((1 << 20) - (1 << 20) / 5), property);
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &property));
+  ASSERT_NE("0", property);
+
+  // A 100KB write at about 800KB/s is delayed by more than 100ms.
+  ASSERT_OK(Put("k", std::string(100000, 'v')));
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-micros", &property));
+  const uint64_t stall_micros = std::stoull(property);
+  ASSERT_GT(stall_micros, 100000);
+
+  // Concurrent writes are grouped, and every byte of a group is charged:
+  // 400KB at about 800KB/s take about 500ms.
+  const int kWriters = 4;
+  DelayedWriter writers[kWriters];
+  for (int id = 0; id < kWriters; id++) {
+    writers[id].db = db_;
+    writers[id].id = id;
+    writers[id].done.store(false, std::memory_order_release);
+    env_->StartThread(&DelayedWriterBody, &writers[id]);
+  }
+  for (int id = 0; id < kWriters; id++) {
+    while (!writers[id].done.load(std::memory_order_acquire)) {
+      DelayMilliseconds(10);
+    }
+  }
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-micros", &property));
+  ASSERT_GT(std::stoull(property) - stall_micros, 400000);
+
+  blocker.Release();
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(0) > 0; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ(NumTableFilesAtLevel(0), 0);
+  ASSERT_TRUE(db_->GetProperty("leveldb.actual-delayed-write-rate", &property));
+  ASSERT_EQ("0", property);
+  ASSERT_EQ("va", Get("a"));
+}
+
+TEST(DBTest, ConcurrentCompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 20000;  // Small write buffer
+  options.max_file_size = 1 << 20;
+  options.max_background_compactions = 4;
+  env_->SetBackgroundThreads(4, Env::LOW);
+  Reopen(&options);
+
+  // Overwrite random keys of several disjoint ranges so that many
+  // compactions are needed, and check the result against a model.
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 20000; i++) {
+    const int k = rnd.Uniform(2000);
+    const std::string key = Key(k);
+    if (rnd.OneIn(10)) {
+      ASSERT_OK(Delete(key));
+      model.erase(key);
+    } else {
+      const std::string value = RandomString(&rnd, 100);
+      ASSERT_OK(Put(key, value));
+      model[key] = value;
+    }
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int k = 0; k < 2000; k++) {
+      const std::string key = Key(k);
+      auto it = model.find(key);
+      ASSERT_EQ(it == model.end() ? "NOT_FOUND" : it->second, Get(key));
+    }
+    Reopen(&options);
+  }
+}
+
 TEST(DBTest, SparseMerge) {
   Options options = CurrentOptions();
   options.compression = kNoCompression;
@@ -1407,126 +1780,794 @@ TEST(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
-TEST(DBTest, OverlapInLevel0) {
+TEST(DBTest, DeleteRange) {
   do {
-    ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
-
-    // Fill levels 1 and 2 to disable the pushing of new memtables to levels >
-    // 0.
-    ASSERT_OK(Put("100", "v100"));
-    ASSERT_OK(Put("999", "v999"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_OK(Delete("100"));
-    ASSERT_OK(Delete("999"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_EQ("0,1,1", FilesPerLevel());
-
-    // Make files spanning the following ranges in level-0:
-    //  files[0]  200 .. 900
-    //  files[1]  300 .. 500
-    // Note that files are sorted by smallest key.
-    ASSERT_OK(Put("300", "v300"));
-    ASSERT_OK(Put("500", "v500"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_OK(Put("200", "v200"));
-    ASSERT_OK(Put("600", "v600"));
-    ASSERT_OK(Put("900", "v900"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_EQ("2,1,1", FilesPerLevel());
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("b", "vb"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Put("d", "vd"));
+    ASSERT_OK(Put("e", "ve"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+    ASSERT_OK(Put("c", "vc2"));
+    ASSERT_TRUE(db_->DeleteRange(WriteOptions(), "d", "b").IsInvalidArgument());
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "e", "e"));
+
+    for (int step = 0; step < 3; step++) {
+      ASSERT_EQ("va", Get("a"));
+      ASSERT_EQ("NOT_FOUND", Get("b"));
+      ASSERT_EQ("vc2", Get("c"));
+      ASSERT_EQ("vd", Get("d"));
+      ASSERT_EQ("ve", Get("e"));
+      ASSERT_EQ("(a->va)(c->vc2)(d->vd)(e->ve)", Contents());
+      ASSERT_EQ("vb", Get("b", snapshot));
+      ASSERT_EQ("vc", Get("c", snapshot));
+      if (step == 0) {
+        ASSERT_OK(dbfull()->TEST_CompactMemTable());
+      } else {
+        db_->CompactRange(nullptr, nullptr);
+      }
+    }
+    // The snapshot keeps the deleted entry alive
+    ASSERT_EQ("[ vb ]", AllEntriesFor("b"));
 
-    // Compact away the placeholder files we created initially
-    dbfull()->TEST_CompactRange(1, nullptr, nullptr);
-    dbfull()->TEST_CompactRange(2, nullptr, nullptr);
-    ASSERT_EQ("2", FilesPerLevel());
+    db_->ReleaseSnapshot(snapshot);
 
-    // Do a memtable compaction.  Before bug-fix, the compaction would
-    // not detect the overlap with level-0 files and would incorrectly place
-    // the deletion in a deeper level.
-    ASSERT_OK(Delete("600"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_EQ("3", FilesPerLevel());
-    ASSERT_EQ("NOT_FOUND", Get("600"));
+    Reopen();
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("(a->va)(c->vc2)(d->vd)(e->ve)", Contents());
   } while (ChangeOptions());
 }
 
-TEST(DBTest, L0_CompactionBug_Issue44_a) {
-  Reopen();
-  ASSERT_OK(Put("b", "v"));
-  Reopen();
-  ASSERT_OK(Delete("b"));
-  ASSERT_OK(Delete("a"));
-  Reopen();
-  ASSERT_OK(Delete("a"));
-  Reopen();
-  ASSERT_OK(Put("a", "v"));
-  Reopen();
-  Reopen();
-  ASSERT_EQ("(a->v)", Contents());
-  DelayMilliseconds(1000);  // Wait for compaction to finish
-  ASSERT_EQ("(a->v)", Contents());
-}
-
-TEST(DBTest, L0_CompactionBug_Issue44_b) {
-  Reopen();
-  Put("", "");
-  Reopen();
-  Delete("e");
-  Put("", "");
-  Reopen();
-  Put("c", "cv");
-  Reopen();
-  Put("", "");
-  Reopen();
-  Put("", "");
-  DelayMilliseconds(1000);  // Wait for compaction to finish
-  Reopen();
-  Put("d", "dv");
-  Reopen();
-  Put("", "");
-  Reopen();
-  Delete("d");
-  Delete("b");
-  Reopen();
-  ASSERT_EQ("(->)(c->cv)", Contents());
-  DelayMilliseconds(1000);  // Wait for compaction to finish
-  ASSERT_EQ("(->)(c->cv)", Contents());
+TEST(DBTest, DeleteRangeAfterLookups) {
+  // Lookups in the memtable use a fragmented copy of its tombstones, which
+  // must not miss the ones added after it was made.
+  for (int i = 0; i < 10; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < 10; i += 2) {
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(i), Key(i + 1)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i)));
+    ASSERT_EQ("v", Get(Key(i + 1)));
+    ASSERT_EQ("v", Get(Key(i), snapshot));
+  }
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(0), Key(10)));
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i)));
+    ASSERT_EQ("v", Get(Key(i), snapshot));
+  }
+  db_->ReleaseSnapshot(snapshot);
 }
 
-TEST(DBTest, Fflush_Issue474) {
-  static const int kNum = 100000;
-  Random rnd(test::RandomSeed());
-  for (int i = 0; i < kNum; i++) {
-    fflush(nullptr);
-    ASSERT_OK(Put(RandomKey(&rnd), RandomString(&rnd, 100)));
+TEST(DBTest, DeleteRangeAcrossLevels) {
+  // Spread the keys over several levels, then delete a range that cuts
+  // through all of them.
+  for (int i = 0; i < 300; i++) {
+    ASSERT_OK(Put(Key(i), "v1"));
   }
-}
+  db_->CompactRange(nullptr, nullptr);
+  for (int i = 0; i < 300; i += 2) {
+    ASSERT_OK(Put(Key(i), "v2"));
+  }
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(100), Key(200)));
+  ASSERT_OK(Put(Key(150), "v3"));
 
-TEST(DBTest, ComparatorCheck) {
-  class NewComparator : public Comparator {
-   public:
-    const char* Name() const override { return "leveldb.NewComparator"; }
-    int Compare(const Slice& a, const Slice& b) const override {
-      return BytewiseComparator()->Compare(a, b);
-    }
-    void FindShortestSeparator(std::string* s, const Slice& l) const override {
-      BytewiseComparator()->FindShortestSeparator(s, l);
+  for (int step = 0; step < 3; step++) {
+    int count = 0;
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      count++;
     }
-    void FindShortSuccessor(std::string* key) const override {
-      BytewiseComparator()->FindShortSuccessor(key);
+    ASSERT_OK(iter->status());
+    delete iter;
+    ASSERT_EQ(201, count);
+    ASSERT_EQ("v2", Get(Key(98)));
+    ASSERT_EQ("v1", Get(Key(99)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(100)));
+    ASSERT_EQ("v3", Get(Key(150)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(199)));
+    ASSERT_EQ("v2", Get(Key(200)));
+    if (step == 0) {
+      ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    } else if (step == 1) {
+      db_->CompactRange(nullptr, nullptr);
     }
-  };
-  NewComparator cmp;
-  Options new_options = CurrentOptions();
-  new_options.comparator = &cmp;
-  Status s = TryReopen(&new_options);
-  ASSERT_TRUE(!s.ok());
-  ASSERT_TRUE(s.ToString().find("comparator") != std::string::npos)
-      << s.ToString();
+  }
+  ASSERT_EQ("[ ]", AllEntriesFor(Key(120)));
 }
 
-TEST(DBTest, CustomComparator) {
-  class NumberComparator : public Comparator {
-   public:
+TEST(DBTest, DeleteRangeDropsCoveredFiles) {
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), std::string(1000, 'x')));
+  }
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_GT(TotalTableFiles(), 0);
+
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), Key(0), Key(100)));
+  ASSERT_EQ("", Contents());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ("NOT_FOUND", Get(Key(50)));
+}
+
+// Write the keys and values in "kvs" to the external table "fname".  An
+// empty value stands for a deletion.
+static Status WriteExternalFile(
+    const Options& options, const std::string& fname,
+    const std::vector<std::pair<std::string, std::string>>& kvs) {
+  SstFileWriter writer(options);
+  Status s = writer.Open(fname);
+  for (size_t i = 0; i < kvs.size() && s.ok(); i++) {
+    if (kvs[i].second.empty()) {
+      s = writer.Delete(kvs[i].first);
+    } else {
+      s = writer.Put(kvs[i].first, kvs[i].second);
+    }
+  }
+  if (s.ok()) {
+    s = writer.Finish();
+  }
+  return s;
+}
+
+TEST(DBTest, IngestExternalFile) {
+  do {
+    const std::string fname = test::TmpDir() + "/db_test_external.sst";
+    ASSERT_OK(Put("a", "va"));
+    ASSERT_OK(Put("c", "vc"));
+    ASSERT_OK(Put("d", "vd"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(WriteExternalFile(CurrentOptions(), fname,
+                                {{"b", "vb2"}, {"c", "vc2"}, {"d", ""}}));
+    ASSERT_OK(db_->IngestExternalFile({fname}, IngestExternalFileOptions()));
+    ASSERT_OK(Put("b", "vb3"));
+
+    for (int step = 0; step < 3; step++) {
+      ASSERT_EQ("va", Get("a"));
+      ASSERT_EQ("vb3", Get("b"));
+      ASSERT_EQ("vc2", Get("c"));
+      ASSERT_EQ("NOT_FOUND", Get("d"));
+      ASSERT_EQ("(a->va)(b->vb3)(c->vc2)", Contents());
+      if (step < 2) {
+        ASSERT_EQ("NOT_FOUND", Get("b", snapshot));
+        ASSERT_EQ("vc", Get("c", snapshot));
+        ASSERT_EQ("vd", Get("d", snapshot));
+      }
+      if (step == 0) {
+        db_->CompactRange(nullptr, nullptr);
+      } else if (step == 1) {
+        db_->ReleaseSnapshot(snapshot);
+        Reopen();
+      }
+    }
+    env_->DeleteFile(fname);
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, IngestExternalFileSyncsDir) {
+  // The names of the ingested files must be durable before the manifest
+  // refers to them
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+  const std::string fname = test::TmpDir() + "/db_test_external.sst";
+  for (bool move_files : {false, true}) {
+    ASSERT_OK(WriteExternalFile(options, fname, {{"a", "va"}}));
+    IngestExternalFileOptions ingest_options;
+    ingest_options.move_files = move_files;
+    env_->dir_sync_counter_.Reset();
+    ASSERT_OK(db_->IngestExternalFile({fname}, ingest_options));
+    ASSERT_EQ(1, env_->dir_sync_counter_.Read());
+  }
+  env_->DeleteFile(fname);
+}
+
+TEST(DBTest, IngestExternalFilePicksDeepestLevel) {
+  const std::string dir = test::TmpDir();
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("c", "vc"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(1, NumTableFilesAtLevel(config::kMaxMemCompactLevel));
+
+  // Nothing overlaps [m,n]: the file goes to the last level
+  ASSERT_OK(WriteExternalFile(CurrentOptions(), dir + "/db_test_external1.sst",
+                              {{"m", "vm"}, {"n", "vn"}}));
+  // [b,bb] overlaps the table holding a and c
+  ASSERT_OK(WriteExternalFile(CurrentOptions(), dir + "/db_test_external2.sst",
+                              {{"b", "vb"}, {"bb", "vbb"}}));
+  IngestExternalFileOptions ingest_options;
+  ingest_options.move_files = true;
+  ASSERT_OK(db_->IngestExternalFile({dir + "/db_test_external1.sst"},
+                                    ingest_options));
+  ASSERT_EQ(1, NumTableFilesAtLevel(config::kNumLevels - 1));
+  ASSERT_TRUE(!env_->FileExists(dir + "/db_test_external1.sst"));
+  ASSERT_OK(db_->IngestExternalFile({dir + "/db_test_external2.sst"},
+                                    ingest_options));
+  ASSERT_EQ(1, NumTableFilesAtLevel(config::kMaxMemCompactLevel - 1));
+  ASSERT_EQ("(a->va)(b->vb)(bb->vbb)(c->vc)(m->vm)(n->vn)", Contents());
+}
+
+TEST(DBTest, IngestExternalFileErrors) {
+  const std::string dir = test::TmpDir();
+  Options options = CurrentOptions();
+  SstFileWriter writer(options);
+  ASSERT_OK(writer.Open(dir + "/db_test_external1.sst"));
+  ASSERT_OK(writer.Put("b", "vb"));
+  ASSERT_TRUE(writer.Put("a", "va").IsInvalidArgument());
+  ASSERT_TRUE(writer.Put("b", "vb").IsInvalidArgument());
+  ASSERT_OK(writer.Put("c", "vc"));
+  ASSERT_OK(writer.Finish());
+  ASSERT_TRUE(writer.Finish().IsInvalidArgument());
+
+  ASSERT_OK(WriteExternalFile(options, dir + "/db_test_external2.sst",
+                              {{"c", "vc2"}, {"d", "vd2"}}));
+  ASSERT_TRUE(db_->IngestExternalFile({dir + "/db_test_external1.sst",
+                                       dir + "/db_test_external2.sst"},
+                                      IngestExternalFileOptions())
+                  .IsInvalidArgument());
+  ASSERT_TRUE(!db_->IngestExternalFile({dir + "/db_test_missing.sst"},
+                                       IngestExternalFileOptions())
+                   .ok());
+  ASSERT_EQ("", Contents());
+
+  // Tables of the database itself are not external files
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  std::vector<std::string> filenames;
+  ASSERT_OK(env_->GetChildren(dbname_, &filenames));
+  uint64_t number;
+  FileType type;
+  for (const std::string& filename : filenames) {
+    if (ParseFileName(filename, &number, &type) && type == kTableFile) {
+      ASSERT_TRUE(db_->IngestExternalFile({dbname_ + "/" + filename},
+                                          IngestExternalFileOptions())
+                      .IsInvalidArgument());
+    }
+  }
+  ASSERT_EQ("(a->va)", Contents());
+}
+
+// Appends the operands of a key to its value, separated by commas.
+class AppendOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "leveldb.test.Append"; }
+
+  bool FullMerge(const Slice& key, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    new_value->clear();
+    if (existing_value != nullptr) {
+      new_value->assign(existing_value->data(), existing_value->size());
+    }
+    for (const Slice& operand : operands) {
+      if (!new_value->empty()) {
+        new_value->push_back(',');
+      }
+      new_value->append(operand.data(), operand.size());
+    }
+    return true;
+  }
+
+  bool PartialMerge(const Slice& key, const Slice& left, const Slice& right,
+                    std::string* new_value) const override {
+    *new_value = left.ToString() + "," + right.ToString();
+    return true;
+  }
+};
+
+TEST(DBTest, Merge) {
+  AppendOperator merge_operator;
+  do {
+    Options options = CurrentOptions();
+    options.merge_operator = &merge_operator;
+    Reopen(&options);
+    ASSERT_OK(db_->Merge(WriteOptions(), "a", "a1"));
+    ASSERT_OK(Put("b", "b0"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "b", "b1"));
+    ASSERT_OK(Put("c", "c0"));
+    ASSERT_OK(Delete("c"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "c", "c1"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "d", "d1"));
+    ASSERT_OK(db_->DeleteRange(WriteOptions(), "d", "e"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_OK(db_->Merge(WriteOptions(), "b", "b2"));
+    ASSERT_OK(db_->Merge(WriteOptions(), "d", "d2"));
+
+    for (int step = 0; step < 4; step++) {
+      ASSERT_EQ("a1", Get("a"));
+      ASSERT_EQ("b0,b1,b2", Get("b"));
+      ASSERT_EQ("c1", Get("c"));
+      ASSERT_EQ("d2", Get("d"));
+      ASSERT_EQ("(a->a1)(b->b0,b1,b2)(c->c1)(d->d2)", Contents());
+      std::vector<std::string> results = MultiGet({"d", "c", "b", "a", "e"});
+      ASSERT_EQ("d2 c1 b0,b1,b2 a1 NOT_FOUND",
+                results[0] + " " + results[1] + " " + results[2] + " " +
+                    results[3] + " " + results[4]);
+      if (step < 3) {
+        ASSERT_EQ("b0,b1", Get("b", snapshot));
+        ASSERT_EQ("NOT_FOUND", Get("d", snapshot));
+      }
+      if (step == 0) {
+        ASSERT_OK(dbfull()->TEST_CompactMemTable());
+      } else if (step == 1) {
+        db_->CompactRange(nullptr, nullptr);
+      } else if (step == 2) {
+        db_->ReleaseSnapshot(snapshot);
+        Reopen(&options);
+      }
+    }
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, MergeIteration) {
+  AppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(&options);
+  ASSERT_OK(Put("a", "a0"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "b1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "b2"));
+  ASSERT_OK(Put("c", "c0"));
+
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("b");
+  ASSERT_EQ("b->b1,b2", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("a->a0", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("b->b1,b2", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("c->c0", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("b->b1,b2", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("c->c0", IterStatus(iter));
+  iter->SeekToLast();
+  iter->Prev();
+  ASSERT_EQ("b->b1,b2", IterStatus(iter));
+  iter->Prev();
+  ASSERT_EQ("a->a0", IterStatus(iter));
+  delete iter;
+
+  // A merged entry that is the last one of the database
+  ASSERT_OK(db_->Merge(WriteOptions(), "d", "d1"));
+  iter = db_->NewIterator(ReadOptions());
+  iter->Seek("d");
+  ASSERT_EQ("d->d1", IterStatus(iter));
+  iter->Next();
+  ASSERT_EQ("(invalid)", IterStatus(iter));
+  iter->Seek("d");
+  iter->Prev();
+  ASSERT_EQ("c->c0", IterStatus(iter));
+  delete iter;
+}
+
+TEST(DBTest, MergeCollapsedByCompaction) {
+  AppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(&options);
+
+  // Place the value of "b" in level-2, a file that overlaps it in level-1
+  // and its operands in level-0.
+  ASSERT_OK(Put("b", "b0"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("c", "vc"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "b1"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "b", "b2"));
+  ASSERT_OK(db_->Merge(WriteOptions(), "d", "d1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("1,1,1", FilesPerLevel());
+  ASSERT_EQ("[ MERGE(b2), MERGE(b1), b0 ]", AllEntriesFor("b"));
+
+  // The operands of "b" are folded into one, since its value is not part
+  // of the compaction.  Nothing is older than the operand of "d".
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ("[ MERGE(b1,b2), b0 ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ d1 ]", AllEntriesFor("d"));
+  ASSERT_EQ("b0,b1,b2", Get("b"));
+
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ("[ b0,b1,b2 ]", AllEntriesFor("b"));
+  ASSERT_EQ("(a->va)(b->b0,b1,b2)(c->vc)(d->d1)", Contents());
+}
+
+TEST(DBTest, MergeWithoutOperator) {
+  ASSERT_TRUE(db_->Merge(WriteOptions(), "a", "a1").IsNotSupportedError());
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+}
+
+// Removes "expired" values and shortens the ones that start with "shrink".
+class ExpiringFilter : public CompactionFilter {
+ public:
+  ExpiringFilter() : calls_(0) {}
+
+  const char* Name() const override { return "leveldb.test.Expiring"; }
+
+  Decision Filter(int level, const Slice& key, const Slice& value,
+                  std::string* new_value) const override {
+    calls_.fetch_add(1, std::memory_order_relaxed);
+    if (value == "expired") {
+      return kRemove;
+    }
+    if (value.starts_with("shrink")) {
+      *new_value = "s";
+      return kChangeValue;
+    }
+    return kKeep;
+  }
+
+  int calls() const { return calls_.load(std::memory_order_relaxed); }
+
+ private:
+  mutable std::atomic<int> calls_;
+};
+
+TEST(DBTest, CompactionFilter) {
+  ExpiringFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  // An old value of "b" in level-2, a file that overlaps it in level-1
+  // and the new values in level-0.
+  ASSERT_OK(Put("b", "old"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("a", "keep"));
+  ASSERT_OK(Put("c", "shrink-me"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("b", "expired"));
+  ASSERT_OK(Put("d", "expired"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("1,1,1", FilesPerLevel());
+  ASSERT_EQ(0, filter.calls());
+
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(4, filter.calls());
+  ASSERT_EQ("[ DEL, old ]", AllEntriesFor("b"));
+  ASSERT_EQ("[ ]", AllEntriesFor("d"));
+  ASSERT_EQ("(a->keep)(c->s)", Contents());
+
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ("[ ]", AllEntriesFor("b"));
+  ASSERT_EQ("(a->keep)(c->s)", Contents());
+}
+
+TEST(DBTest, CompactionFilterKeepsSnapshotData) {
+  ExpiringFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  ASSERT_OK(Put("a", "old"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("a", "expired"));
+  ASSERT_OK(Put("b", "shrink-me"));
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("c", "expired"));
+  ASSERT_OK(Put("a", "expired"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // Only the entries the snapshot cannot see are filtered
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ("(b->shrink-me)", Contents());
+  ASSERT_EQ("expired", Get("a", snapshot));
+  ASSERT_EQ("shrink-me", Get("b", snapshot));
+  ASSERT_EQ("NOT_FOUND", Get("c", snapshot));
+
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_OK(Put("bb", "v"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ("(b->s)(bb->v)", Contents());
+  ASSERT_EQ("[ ]", AllEntriesFor("a"));
+  ASSERT_EQ("[ ]", AllEntriesFor("c"));
+}
+
+// Runs HIGH priority work in the LOW pool, like an Env without priority
+// pools does.
+class SinglePoolEnv : public EnvWrapper {
+ public:
+  explicit SinglePoolEnv(Env* base) : EnvWrapper(base) {}
+
+  void Schedule(void (*f)(void*), void* a, Priority pri) override {
+    target()->Schedule(f, a, LOW);
+  }
+  bool HasPriorityPools() override { return false; }
+};
+
+// Keeps every value, slowly.
+class SlowFilter : public CompactionFilter {
+ public:
+  SlowFilter() : calls_(0) {}
+
+  const char* Name() const override { return "leveldb.test.Slow"; }
+
+  Decision Filter(int level, const Slice& key, const Slice& value,
+                  std::string* new_value) const override {
+    calls_.fetch_add(1, std::memory_order_relaxed);
+    Env::Default()->SleepForMicroseconds(1000);
+    return kKeep;
+  }
+
+  int calls() const { return calls_.load(std::memory_order_relaxed); }
+
+ private:
+  mutable std::atomic<int> calls_;
+};
+
+TEST(DBTest, FlushDuringCompactionWithoutPriorityPools) {
+  SinglePoolEnv env(Env::Default());
+  SlowFilter filter;
+  Options options = CurrentOptions();
+  options.env = &env;
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  // Overlapping level-0 files, until they set off a compaction
+  const int kKeys = 1000;
+  while (filter.calls() == 0) {
+    for (int i = 0; i < kKeys; i++) {
+      ASSERT_OK(Put(Key(i), "v"));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    DelayMilliseconds(10);
+  }
+
+  // The flush scheduled behind the compaction does not wait for it
+  const int before = filter.calls();
+  ASSERT_OK(Put("x", "v"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LT(filter.calls() - before, kKeys / 2);
+  ASSERT_EQ("v", Get("x"));
+  Close();
+}
+
+// Counts the entries of each type, and stores the counts as a property.
+class CountingCollectorFactory : public TablePropertiesCollectorFactory {
+ public:
+  const char* Name() const override { return "leveldb.test.Counting"; }
+
+  TablePropertiesCollector* NewCollector() const override {
+    return new Collector;
+  }
+
+ private:
+  class Collector : public TablePropertiesCollector {
+   public:
+    const char* Name() const override { return "leveldb.test.Counting"; }
+
+    void AddUserKey(const Slice& key, const Slice& value, EntryType type,
+                    uint64_t seq) override {
+      counts_ += static_cast<char>('0' + type);
+    }
+
+    void Finish(std::map<std::string, std::string>* properties) override {
+      (*properties)["test.types"] = counts_;
+    }
+
+   private:
+    std::string counts_;
+  };
+};
+
+TEST(DBTest, GetPropertiesOfAllTables) {
+  CountingCollectorFactory factory;
+  Options options = CurrentOptions();
+  options.table_properties_collector_factory = &factory;
+  Reopen(&options);
+
+  TablePropertiesCollection props;
+  ASSERT_OK(db_->GetPropertiesOfAllTables(&props));
+  ASSERT_TRUE(props.empty());
+
+  ASSERT_OK(Put("a", "va"));
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_OK(Delete("c"));
+  ASSERT_OK(db_->DeleteRange(WriteOptions(), "x", "z"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("d", std::string(1000, 'd')));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+
+  for (int i = 0; i < 2; i++) {
+    ASSERT_OK(db_->GetPropertiesOfAllTables(&props));
+    ASSERT_EQ(2, props.size());
+    uint64_t entries = 0, deletions = 0, range_deletions = 0;
+    std::string types;
+    for (const auto& p : props) {
+      const TableProperties& t = p.second;
+      entries += t.num_entries;
+      deletions += t.num_deletions;
+      range_deletions += t.num_range_deletions;
+      types += t.user_collected_properties.at("test.types");
+      ASSERT_EQ(1, t.num_data_blocks);
+      ASSERT_GT(t.data_size, 0);
+      ASSERT_GT(t.CompressionRatio(), 0);
+      if (t.num_entries == 3) {
+        ASSERT_EQ("a", t.smallest_key);
+        ASSERT_EQ("c", t.largest_key);
+        ASSERT_EQ(3 * 9, t.raw_key_size);
+        ASSERT_EQ(4, t.raw_value_size);
+      } else {
+        ASSERT_EQ("d", t.smallest_key);
+        ASSERT_EQ("d", t.largest_key);
+        ASSERT_EQ(1000, t.raw_value_size);
+      }
+    }
+    ASSERT_EQ(4, entries);
+    ASSERT_EQ(1, deletions);
+    ASSERT_EQ(1, range_deletions);
+    ASSERT_TRUE(types == "00130" || types == "00013") << types;
+
+    // Properties are stored in the files
+    Reopen(&options);
+  }
+}
+
+TEST(DBTest, DeletionTriggeredCompaction) {
+  for (int step = 0; step < 3; step++) {
+    // Step 1 only enables the compactions when the database is reopened,
+    // so the deletions are found in the MANIFEST.  Step 2 repairs the
+    // database first, which leaves them out of the MANIFEST, so they are
+    // read from the table properties.
+    Options options = CurrentOptions();
+    options.create_if_missing = true;
+    options.deletion_compaction_ratio = (step == 0) ? 0.5 : 0;
+    DestroyAndReopen(&options);
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Put(Key(i), std::string(1000, 'v')));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    for (int i = 0; i < 100; i++) {
+      ASSERT_OK(Delete(Key(i)));
+    }
+    ASSERT_OK(dbfull()->TEST_CompactMemTable());
+    if (step > 0) {
+      ASSERT_EQ("0,1,1", FilesPerLevel());
+      if (step == 2) {
+        Close();
+        ASSERT_OK(RepairDB(dbname_, options));
+      }
+      options.deletion_compaction_ratio = 0.5;
+      Reopen(&options);
+    }
+
+    // Nothing else would ever compact the deletions with the data they
+    // delete, since no more writes reach their key range.
+    for (int i = 0; i < 100 && FilesPerLevel() != ""; i++) {
+      DelayMilliseconds(10);
+    }
+    ASSERT_EQ("", FilesPerLevel());
+    ASSERT_EQ(0, Size("", Key(100)));
+  }
+}
+
+TEST(DBTest, OverlapInLevel0) {
+  do {
+    ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
+
+    // Fill levels 1 and 2 to disable the pushing of new memtables to levels >
+    // 0.
+    ASSERT_OK(Put("100", "v100"));
+    ASSERT_OK(Put("999", "v999"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Delete("100"));
+    ASSERT_OK(Delete("999"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("0,1,1", FilesPerLevel());
+
+    // Make files spanning the following ranges in level-0:
+    //  files[0]  200 .. 900
+    //  files[1]  300 .. 500
+    // Note that files are sorted by smallest key.
+    ASSERT_OK(Put("300", "v300"));
+    ASSERT_OK(Put("500", "v500"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_OK(Put("200", "v200"));
+    ASSERT_OK(Put("600", "v600"));
+    ASSERT_OK(Put("900", "v900"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("2,1,1", FilesPerLevel());
+
+    // Compact away the placeholder files we created initially
+    dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+    dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+    ASSERT_EQ("2", FilesPerLevel());
+
+    // Do a memtable compaction.  Before bug-fix, the compaction would
+    // not detect the overlap with level-0 files and would incorrectly place
+    // the deletion in a deeper level.
+    ASSERT_OK(Delete("600"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("3", FilesPerLevel());
+    ASSERT_EQ("NOT_FOUND", Get("600"));
+  } while (ChangeOptions());
+}
+
+TEST(DBTest, L0_CompactionBug_Issue44_a) {
+  Reopen();
+  ASSERT_OK(Put("b", "v"));
+  Reopen();
+  ASSERT_OK(Delete("b"));
+  ASSERT_OK(Delete("a"));
+  Reopen();
+  ASSERT_OK(Delete("a"));
+  Reopen();
+  ASSERT_OK(Put("a", "v"));
+  Reopen();
+  Reopen();
+  ASSERT_EQ("(a->v)", Contents());
+  DelayMilliseconds(1000);  // Wait for compaction to finish
+  ASSERT_EQ("(a->v)", Contents());
+}
+
+TEST(DBTest, L0_CompactionBug_Issue44_b) {
+  Reopen();
+  Put("", "");
+  Reopen();
+  Delete("e");
+  Put("", "");
+  Reopen();
+  Put("c", "cv");
+  Reopen();
+  Put("", "");
+  Reopen();
+  Put("", "");
+  DelayMilliseconds(1000);  // Wait for compaction to finish
+  Reopen();
+  Put("d", "dv");
+  Reopen();
+  Put("", "");
+  Reopen();
+  Delete("d");
+  Delete("b");
+  Reopen();
+  ASSERT_EQ("(->)(c->cv)", Contents());
+  DelayMilliseconds(1000);  // Wait for compaction to finish
+  ASSERT_EQ("(->)(c->cv)", Contents());
+}
+
+TEST(DBTest, Fflush_Issue474) {
+  static const int kNum = 100000;
+  Random rnd(test::RandomSeed());
+  for (int i = 0; i < kNum; i++) {
+    fflush(nullptr);
+    ASSERT_OK(Put(RandomKey(&rnd), RandomString(&rnd, 100)));
+  }
+}
+
+TEST(DBTest, ComparatorCheck) {
+  class NewComparator : public Comparator {
+   public:
+    const char* Name() const override { return "leveldb.NewComparator"; }
+    int Compare(const Slice& a, const Slice& b) const override {
+      return BytewiseComparator()->Compare(a, b);
+    }
+    void FindShortestSeparator(std::string* s, const Slice& l) const override {
+      BytewiseComparator()->FindShortestSeparator(s, l);
+    }
+    void FindShortSuccessor(std::string* key) const override {
+      BytewiseComparator()->FindShortSuccessor(key);
+    }
+  };
+  NewComparator cmp;
+  Options new_options = CurrentOptions();
+  new_options.comparator = &cmp;
+  Status s = TryReopen(&new_options);
+  ASSERT_TRUE(!s.ok());
+  ASSERT_TRUE(s.ToString().find("comparator") != std::string::npos)
+      << s.ToString();
+}
+
+TEST(DBTest, CustomComparator) {
+  class NumberComparator : public Comparator {
+   public:
     const char* Name() const override { return "test.NumberComparator"; }
     int Compare(const Slice& a, const Slice& b) const override {
       return ToNumber(a) - ToNumber(b);
@@ -1915,6 +2956,428 @@ TEST(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST(DBTest, BinaryFuseFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBinaryFuseFilterPolicy(10);
+  options.filter_block_type = kFullFilter;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d present => %d reads\n", N, reads);
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2 * N / 100);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+static std::string PrefixKey(int prefix, int i) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "p%05d:%04d", prefix, i);
+  return std::string(buf);
+}
+
+// Returns the keys a prefix_same_as_start iterator yields after a Seek()
+// to "target", or the status if the iteration fails.
+static std::string PrefixScan(DB* db, const std::string& target) {
+  ReadOptions options;
+  options.prefix_same_as_start = true;
+  Iterator* iter = db->NewIterator(options);
+  std::string result;
+  int count = 0;
+  for (iter->Seek(target); iter->Valid(); iter->Next()) {
+    if (count++ == 0) result = iter->key().ToString();
+  }
+  if (count > 0) {
+    result.append(" x" + NumberToString(count));
+  }
+  if (!iter->status().ok()) {
+    result = iter->status().ToString();
+  }
+  delete iter;
+  return result;
+}
+
+TEST(DBTest, PrefixSeek) {
+  const FilterBlockType kTypes[] = {kBlockBasedFilter, kFullFilter,
+                                    kPartitionedFilter};
+  for (FilterBlockType type : kTypes) {
+    env_->count_random_reads_ = true;
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.block_cache = NewLRUCache(0);  // Prevent cache hits
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.filter_block_type = type;
+    options.index_partition_size = type == kPartitionedFilter ? 1024 : 0;
+    options.prefix_extractor = NewFixedPrefixTransform(6);
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    // 20 keys for each even prefix, over many blocks
+    const int kPrefixes = 200;
+    for (int p = 0; p < kPrefixes; p += 2) {
+      for (int i = 0; i < 20; i++) {
+        ASSERT_OK(Put(PrefixKey(p, i), std::string(100, 'v')));
+      }
+    }
+    Compact("a", "z");
+    env_->delay_data_sync_.store(true, std::memory_order_release);
+
+    ASSERT_EQ("p00010:0000 x20", PrefixScan(db_, PrefixKey(10, 0)));
+    ASSERT_EQ("p00010:0005 x15", PrefixScan(db_, PrefixKey(10, 5)));
+    ASSERT_EQ("", PrefixScan(db_, PrefixKey(10, 20)));
+    ASSERT_EQ("", PrefixScan(db_, PrefixKey(11, 0)));
+    // Keys without a prefix iterate in total order
+    ASSERT_EQ("p00198:0000 x20", PrefixScan(db_, "p00198"));
+
+    // Missing prefixes are ruled out by the filters, without reading data
+    // blocks.  Partitioned tables read an index and a filter partition.
+    const int partition_reads = type == kPartitionedFilter ? 2 : 0;
+    env_->random_read_counter_.Reset();
+    for (int p = 1; p < kPrefixes; p += 2) {
+      ASSERT_EQ("", PrefixScan(db_, PrefixKey(p, 0)));
+    }
+    int reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "type %d: %d missing prefixes => %d reads\n", type,
+            kPrefixes / 2, reads);
+    ASSERT_LE(reads, (partition_reads + 0.1) * kPrefixes / 2);
+
+    // Entries in the memtable are bounded as well
+    ASSERT_OK(Put(PrefixKey(11, 3), "v"));
+    ASSERT_OK(Put(PrefixKey(12, 25), "v"));
+    ASSERT_EQ("p00011:0003 x1", PrefixScan(db_, PrefixKey(11, 0)));
+    ASSERT_EQ("p00012:0000 x21", PrefixScan(db_, PrefixKey(12, 0)));
+
+    // Reverse iteration is not supported
+    ReadOptions read_options;
+    read_options.prefix_same_as_start = true;
+    Iterator* iter = db_->NewIterator(read_options);
+    iter->Seek(PrefixKey(10, 0));
+    ASSERT_TRUE(iter->Valid());
+    iter->Prev();
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_TRUE(iter->status().IsNotSupportedError());
+    delete iter;
+    iter = db_->NewIterator(read_options);
+    iter->SeekToLast();
+    ASSERT_TRUE(!iter->Valid());
+    ASSERT_TRUE(iter->status().IsNotSupportedError());
+    delete iter;
+
+    // SeekToFirst() is not bounded
+    iter = db_->NewIterator(read_options);
+    int count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+    ASSERT_OK(iter->status());
+    ASSERT_EQ(kPrefixes / 2 * 20 + 2, count);
+    delete iter;
+
+    // Without prefix_same_as_start, a Seek() goes on past the prefix
+    iter = db_->NewIterator(ReadOptions());
+    iter->Seek(PrefixKey(13, 0));
+    ASSERT_EQ(PrefixKey(14, 0), iter->key().ToString());
+    delete iter;
+
+    // The prefixes in the tables are ignored once the extractor changes,
+    // but iteration is still bounded by the new prefixes
+    env_->delay_data_sync_.store(false, std::memory_order_release);
+    delete options.prefix_extractor;
+    options.prefix_extractor = NewFixedPrefixTransform(5);
+    Reopen(&options);
+    ASSERT_EQ("p00010:0000 x102", PrefixScan(db_, PrefixKey(10, 0)));
+    ASSERT_EQ("p00020:0000 x100", PrefixScan(db_, PrefixKey(20, 0)));
+
+    Close();
+    delete options.block_cache;
+    delete options.filter_policy;
+    delete options.prefix_extractor;
+  }
+}
+
+TEST(DBTest, DataBlockHashIndex) {
+  Options options = CurrentOptions();
+  options.data_block_index_type = kDataBlockBinaryAndHash;
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  const int N = 2000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), "v1"));
+  }
+  const Snapshot* snapshot = db_->GetSnapshot();
+  for (int i = 0; i < N; i += 3) {
+    ASSERT_OK(Put(Key(i), "v2"));
+  }
+  for (int i = 1; i < N; i += 3) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  Compact("a", "z");
+
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i % 3 == 0 ? "v2" : (i % 3 == 1 ? "NOT_FOUND" : "v1"),
+              Get(Key(i)));
+    ASSERT_EQ("v1", Get(Key(i), snapshot));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + "x"));
+  }
+  db_->ReleaseSnapshot(snapshot);
+
+  // Tables written without the index stay readable
+  options.data_block_index_type = kDataBlockBinarySearch;
+  Reopen(&options);
+  for (int i = 0; i < N; i += 3) {
+    ASSERT_OK(Put(Key(i), "v3"));
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(i % 3 == 0 ? "v3" : (i % 3 == 1 ? "NOT_FOUND" : "v1"),
+              Get(Key(i)));
+  }
+}
+
+TEST(DBTest, CacheIndexAndFilterBlocks) {
+  const FilterBlockType kTypes[] = {kBlockBasedFilter, kFullFilter,
+                                    kPartitionedFilter};
+  for (FilterBlockType type : kTypes) {
+    // Blocks read from mmap-ed files are not cached: use an Env that
+    // copies them out of the file.
+    Env* env = NewMemEnv(Env::Default());
+    Options options = CurrentOptions();
+    options.env = env;
+    options.block_cache = NewLRUCache(8 << 20);
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.filter_block_type = type;
+    options.cache_index_and_filter_blocks = true;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    const int N = 10000;
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(Put(Key(i), Key(i)));
+    }
+    Compact("a", "z");
+    ASSERT_GT(options.block_cache->TotalCharge(), 0);
+
+    // Evicting the index blocks and filters leaves the tables readable
+    options.block_cache->Prune();
+    ASSERT_EQ(0, options.block_cache->TotalCharge());
+    for (int i = 0; i < N; i += 10) {
+      ASSERT_EQ(Key(i), Get(Key(i)));
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+    ASSERT_GT(options.block_cache->TotalCharge(), 0);
+
+    // The index blocks and filters of level 0 stay in the cache
+    options.pin_l0_filter_and_index_blocks_in_cache = true;
+    Reopen(&options);
+    // The first table is placed below level 0, the second overlaps it
+    for (int pass = 0; pass < 2; pass++) {
+      for (int i = 0; i < N; i += 100) {
+        ASSERT_OK(Put(Key(i), Key(i)));
+      }
+      dbfull()->TEST_CompactMemTable();
+    }
+    ASSERT_EQ(1, NumTableFilesAtLevel(0));
+    options.block_cache->Prune();
+    ASSERT_GT(options.block_cache->TotalCharge(), 0);
+    for (int i = 0; i < N; i += 100) {
+      ASSERT_EQ(Key(i), Get(Key(i)));
+    }
+
+    // Also when the table was first opened without its level
+    Reopen(&options);
+    ASSERT_GT(Size("", Key(N / 2)), 0);
+    options.block_cache->Prune();
+    ASSERT_EQ(0, options.block_cache->TotalCharge());
+    for (int i = 0; i < N; i += 100) {
+      ASSERT_EQ(Key(i), Get(Key(i)));
+    }
+    options.block_cache->Prune();
+    ASSERT_GT(options.block_cache->TotalCharge(), 0);
+
+    Close();  // Releases the pinned entries
+    delete options.block_cache;
+    delete options.filter_policy;
+    delete env;
+  }
+}
+
+TEST(DBTest, SecondaryCache) {
+  // Blocks read from mmap-ed files are not cached: use an Env that copies
+  // them out of the file, and count its reads.
+  Env* mem = NewMemEnv(Env::Default());
+  SpecialEnv env(mem);
+  env.count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = &env;
+  options.block_cache = NewLRUCache(32 << 10);  // A few blocks
+  options.secondary_cache = NewCompressedSecondaryCache(8 << 20);
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), std::string(100, 'a' + i % 26)));
+  }
+  Compact("a", "z");
+
+  // The blocks evicted by the first pass spill to the secondary cache,
+  // which serves the second pass without reading the files
+  for (int pass = 0; pass < 2; pass++) {
+    env.random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(std::string(100, 'a' + i % 26), Get(Key(i)));
+    }
+    if (pass == 0) {
+      ASSERT_GT(env.random_read_counter_.Read(), 0);
+      ASSERT_GT(options.secondary_cache->TotalCharge(), 0);
+    } else {
+      ASSERT_EQ(0, env.random_read_counter_.Read());
+    }
+  }
+
+  Close();
+  delete options.block_cache;  // Spills to the secondary cache
+  delete options.secondary_cache;
+  delete mem;
+}
+
+TEST(DBTest, PersistentSecondaryCache) {
+  Env* mem = NewMemEnv(Env::Default());
+  SpecialEnv env(mem);
+  env.count_random_reads_ = true;
+  const std::string cache_dir = dbname_ + "_cache";
+  Options options = CurrentOptions();
+  options.env = &env;
+  options.block_cache = NewLRUCache(32 << 10);
+  ASSERT_OK(NewPersistentSecondaryCache(mem, cache_dir, 8 << 20,
+                                        &options.secondary_cache));
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), std::string(100, 'a' + i % 26)));
+  }
+  Compact("a", "z");
+
+  // After a restart, the blocks spilled by the first process spare the
+  // second one from reading the files, but for opening the tables
+  for (int pass = 0; pass < 2; pass++) {
+    if (pass == 1) {
+      Close();
+      delete options.block_cache;
+      delete options.secondary_cache;
+      options.block_cache = NewLRUCache(32 << 10);
+      ASSERT_OK(NewPersistentSecondaryCache(mem, cache_dir, 8 << 20,
+                                            &options.secondary_cache));
+      ASSERT_GT(options.secondary_cache->TotalCharge(), 0);
+      Reopen(&options);
+    }
+    env.random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(std::string(100, 'a' + i % 26), Get(Key(i)));
+    }
+    const int reads = env.random_read_counter_.Read();
+    if (pass == 0) {
+      ASSERT_GT(reads, 100);
+    } else {
+      ASSERT_LT(reads, 20);
+    }
+  }
+
+  Close();
+  delete options.block_cache;
+  delete options.secondary_cache;
+  delete mem;
+}
+
+TEST(DBTest, FilterBlockTypes) {
+  const FilterBlockType kTypes[] = {kFullFilter, kPartitionedFilter};
+  for (FilterBlockType type : kTypes) {
+    env_->count_random_reads_ = true;
+    Options options = CurrentOptions();
+    options.env = env_;
+    options.block_cache = NewLRUCache(0);  // Prevent cache hits
+    options.filter_policy = NewBloomFilterPolicy(10);
+    options.filter_block_type = type;
+    options.index_partition_size = 1024;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    // Populate multiple layers
+    const int N = 10000;
+    for (int i = 0; i < N; i++) {
+      ASSERT_OK(Put(Key(i), Key(i)));
+    }
+    Compact("a", "z");
+    for (int i = 0; i < N; i += 100) {
+      ASSERT_OK(Put(Key(i), Key(i)));
+    }
+    dbfull()->TEST_CompactMemTable();
+
+    // Prevent auto compactions triggered by seeks
+    env_->delay_data_sync_.store(true, std::memory_order_release);
+
+    // A full filter is checked without any read, a partition of the
+    // filter with one, for each of the two tables.  A partition of the
+    // index and a data block are then read for the keys that are present.
+    const int filter_reads = (type == kFullFilter) ? 0 : 1;
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(Key(i), Get(Key(i)));
+    }
+    int reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "%d present => %d reads\n", N, reads);
+    ASSERT_GE(reads, 2 * N);
+    ASSERT_LE(reads, N * (2 + 2 * filter_reads) + 3 * N / 100);
+
+    // Missing keys only read the filters
+    env_->random_read_counter_.Reset();
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+    }
+    reads = env_->random_read_counter_.Read();
+    fprintf(stderr, "%d missing => %d reads\n", N, reads);
+    ASSERT_LE(reads, N * 2 * filter_reads + 6 * N / 100);
+
+    env_->delay_data_sync_.store(false, std::memory_order_release);
+    Close();
+    delete options.block_cache;
+    delete options.filter_policy;
+  }
+}
+
 // Multi-threaded test:
 namespace {
 
@@ -2064,6 +3527,12 @@ class ModelDB : public DB {
         (*map_)[key.ToString()] = value.ToString();
       }
       void Delete(const Slice& key) override { map_->erase(key.ToString()); }
+      void DeleteRange(const Slice& begin, const Slice& end) override {
+        if (begin.compare(end) < 0) {
+          map_->erase(map_->lower_bound(begin.ToString()),
+                      map_->lower_bound(end.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -2179,11 +3648,20 @@ TEST(DBTest, Randomized) {
         ASSERT_OK(model.Put(WriteOptions(), k, v));
         ASSERT_OK(db_->Put(WriteOptions(), k, v));
 
-      } else if (p < 90) {  // Delete
+      } else if (p < 88) {  // Delete
         k = RandomKey(&rnd);
         ASSERT_OK(model.Delete(WriteOptions(), k));
         ASSERT_OK(db_->Delete(WriteOptions(), k));
 
+      } else if (p < 90) {  // Delete range
+        k = RandomKey(&rnd);
+        std::string limit = RandomKey(&rnd);
+        if (limit < k) {
+          std::swap(k, limit);
+        }
+        ASSERT_OK(model.DeleteRange(WriteOptions(), k, limit));
+        ASSERT_OK(db_->DeleteRange(WriteOptions(), k, limit));
+
       } else {  // Multi-element batch
         WriteBatch b;
         const int num = rnd.Uniform(8);
@@ -9,6 +9,7 @@
 #include <sstream>
 
 #include "port/port.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -117,6 +118,114 @@ bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
 }
 
+void InternalFilterPolicy::CreateFilterWithPrefixes(const Slice* keys, int n,
+                                                    const Slice* prefixes,
+                                                    int m,
+                                                    std::string* dst) const {
+  Slice* mkey = const_cast<Slice*>(keys);
+  for (int i = 0; i < n; i++) {
+    mkey[i] = ExtractUserKey(keys[i]);
+  }
+  user_policy_->CreateFilterWithPrefixes(keys, n, prefixes, m, dst);
+}
+
+bool InternalFilterPolicy::PrefixMayMatch(const Slice& prefix,
+                                          const Slice& f) const {
+  return user_policy_->PrefixMayMatch(prefix, f);
+}
+
+namespace {
+
+class InternalTablePropertiesCollector : public TablePropertiesCollector {
+ public:
+  explicit InternalTablePropertiesCollector(TablePropertiesCollector* user)
+      : user_collector_(user),
+        num_deletions_(0),
+        num_merge_operands_(0),
+        has_keys_(false) {}
+
+  ~InternalTablePropertiesCollector() override { delete user_collector_; }
+
+  const char* Name() const override {
+    return "leveldb.InternalTablePropertiesCollector";
+  }
+
+  void AddUserKey(const Slice& key, const Slice& value, EntryType type,
+                  uint64_t seq) override {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(key, &ikey)) {
+      if (user_collector_ != nullptr) {
+        user_collector_->AddUserKey(key, value, kEntryOther, 0);
+      }
+      return;
+    }
+    switch (ikey.type) {
+      case kTypeValue:
+        type = kEntryPut;
+        break;
+      case kTypeDeletion:
+        type = kEntryDelete;
+        num_deletions_++;
+        break;
+      case kTypeMerge:
+        type = kEntryMerge;
+        num_merge_operands_++;
+        break;
+      case kTypeRangeDeletion:
+        type = kEntryRangeDeletion;
+        break;
+      default:
+        type = kEntryOther;
+        break;
+    }
+    if (type != kEntryRangeDeletion) {
+      // Entries are added in key order
+      if (!has_keys_) {
+        smallest_key_ = ikey.user_key.ToString();
+        has_keys_ = true;
+      }
+      largest_key_.assign(ikey.user_key.data(), ikey.user_key.size());
+    }
+    if (user_collector_ != nullptr) {
+      user_collector_->AddUserKey(ikey.user_key, value, type, ikey.sequence);
+    }
+  }
+
+  void Finish(std::map<std::string, std::string>* properties) override {
+    if (user_collector_ != nullptr) {
+      user_collector_->Finish(properties);
+    }
+    AddNumberProperty(kNumDeletionsProperty, num_deletions_, properties);
+    AddNumberProperty(kNumMergeOperandsProperty, num_merge_operands_,
+                      properties);
+    if (has_keys_) {
+      (*properties)[kSmallestKeyProperty] = smallest_key_;
+      (*properties)[kLargestKeyProperty] = largest_key_;
+    }
+  }
+
+ private:
+  TablePropertiesCollector* const user_collector_;
+  uint64_t num_deletions_;
+  uint64_t num_merge_operands_;
+  bool has_keys_;
+  std::string smallest_key_;
+  std::string largest_key_;
+};
+
+}  // namespace
+
+const char* InternalTablePropertiesCollectorFactory::Name() const {
+  return user_factory_ != nullptr ? user_factory_->Name()
+                                  : "leveldb.InternalTablePropertiesCollector";
+}
+
+TablePropertiesCollector*
+InternalTablePropertiesCollectorFactory::NewCollector() const {
+  return new InternalTablePropertiesCollector(
+      user_factory_ != nullptr ? user_factory_->NewCollector() : nullptr);
+}
+
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   size_t usize = user_key.size();
   size_t needed = usize + 13;  // A conservative estimate。 13等于下面的5字节（klength最多占5个字节）+8字节。
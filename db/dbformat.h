@@ -13,7 +13,9 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
+#include "leveldb/table_properties.h"
 #include "util/coding.h"
 #include "util/logging.h"
 
@@ -24,18 +26,6 @@ namespace leveldb {
 namespace config {
 static const int kNumLevels = 7;
 
-// Level-0 compaction is started when we hit this many files.
-static const int kL0_CompactionTrigger = 4;
-
-// Soft limit on number of level-0 files.  We slow down writes at this point.
-/* 当用户写入数据的速度始终大于major compaction的速度时，就会导致第0层的文件数量不断上升，用户的读取效率就会降低，所以leveldb规定：
-    当0层文件数量超过kL0_SlowdownWritesTrigger时，写入的速度就减慢
-    当0层文件数量超过kL0_StopWritesTrigger时，写入暂停，直至Major Compaction完成   */
-static const int kL0_SlowdownWritesTrigger = 8;
-
-// Maximum number of level-0 files.  We stop writes at this point.
-static const int kL0_StopWritesTrigger = 12;
-
 // Maximum level to which a new compacted memtable is pushed if it
 // does not create overlap.  We try to push to level 2 to avoid the
 // relatively expensive level 0=>1 compactions and to avoid some
@@ -57,7 +47,19 @@ class InternalKey;
 // data structures.
 
 // User's key(Slice) + ValueType = leveldb's key(InternalKey)
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+//
+// kTypeRangeDeletion entries delete every user key in [user key, value)
+// that is older than them.  They are kept apart from the other entries,
+// in their own skiplist of a memtable and their own block of a table.
+//
+// kTypeMerge entries hold an operand of Options::merge_operator, to be
+// applied to the older entries for the same user key.
+enum ValueType {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  kTypeRangeDeletion = 0x2,
+  kTypeMerge = 0x3
+};
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
@@ -65,7 +67,7 @@ enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
 // internal_key按照user_key递增排列，按照sequence number递减排序，因为越新的键值对的sequence越大，这样有助于得到某个user_key对应的最新的value
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeMerge;
 
 // InternalKey's sequencenumber, every put/delete operation has a SequenceNumber as the unique flag of the global
 typedef uint64_t SequenceNumber;
@@ -110,6 +112,12 @@ inline Slice ExtractUserKey(const Slice& internal_key) {
   return Slice(internal_key.data(), internal_key.size() - 8);
 }
 
+// Returns the sequence number of an internal key.
+inline SequenceNumber ExtractSequenceNumber(const Slice& internal_key) {
+  assert(internal_key.size() >= 8);
+  return DecodeFixed64(internal_key.data() + internal_key.size() - 8) >> 8;
+}
+
 // A comparator for internal keys that uses a specified comparator for
 // the user key portion and breaks ties by decreasing sequence number.
 class InternalKeyComparator : public Comparator {
@@ -123,6 +131,10 @@ class InternalKeyComparator : public Comparator {
   void FindShortestSeparator(std::string* start,
                              const Slice& limit) const override;
   void FindShortSuccessor(std::string* key) const override;
+  // The entries of a user key, whatever their sequence numbers
+  Slice HashKey(const Slice& key) const override {
+    return user_comparator_->HashKey(ExtractUserKey(key));
+  }
 
   const Comparator* user_comparator() const { return user_comparator_; }
 
@@ -139,6 +151,50 @@ class InternalFilterPolicy : public FilterPolicy {
   const char* Name() const override;
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override;
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
+  // The prefixes come from an InternalSliceTransform, and so are prefixes
+  // of user keys already
+  void CreateFilterWithPrefixes(const Slice* keys, int n,
+                                const Slice* prefixes, int m,
+                                std::string* dst) const override;
+  bool PrefixMayMatch(const Slice& prefix, const Slice& filter) const override;
+};
+
+// Applies a user supplied transform to the user key portion of internal
+// keys.  Since the prefix of a user key is a prefix of the internal key as
+// well, the result is a prefix of the internal key, as the tables require.
+class InternalSliceTransform : public SliceTransform {
+ private:
+  const SliceTransform* const user_transform_;
+
+ public:
+  explicit InternalSliceTransform(const SliceTransform* t)
+      : user_transform_(t) {}
+  const char* Name() const override { return user_transform_->Name(); }
+  Slice Transform(const Slice& key) const override {
+    return user_transform_->Transform(ExtractUserKey(key));
+  }
+  bool InDomain(const Slice& key) const override {
+    return user_transform_->InDomain(ExtractUserKey(key));
+  }
+
+  const SliceTransform* user_transform() const { return user_transform_; }
+};
+
+// Creates the collectors of the tables of a database.  They count the
+// entries of each type and record the key range of the table in terms of
+// user keys, and pass the user keys to the collectors of "user_factory"
+// if it is non-null.
+class InternalTablePropertiesCollectorFactory
+    : public TablePropertiesCollectorFactory {
+ private:
+  const TablePropertiesCollectorFactory* const user_factory_;
+
+ public:
+  explicit InternalTablePropertiesCollectorFactory(
+      const TablePropertiesCollectorFactory* f)
+      : user_factory_(f) {}
+  const char* Name() const override;
+  TablePropertiesCollector* NewCollector() const override;
 };
 
 // Modules in this directory should keep internal keys wrapped inside
@@ -196,7 +252,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<uint8_t>(kTypeValue));
+  return (c <= static_cast<uint8_t>(kTypeMerge));
 }
 
 // A helper class useful for DBImpl::Get()
@@ -220,6 +276,9 @@ class LookupKey {
   // Return the user key
   Slice user_key() const { return Slice(kstart_, end_ - kstart_ - 8); }
 
+  // Return the sequence number of the snapshot the lookup reads at
+  SequenceNumber sequence() const { return DecodeFixed64(end_ - 8) >> 8; }
+
  private:
   // We construct a char array of the form:
   //    klength  varint32               <-- start_
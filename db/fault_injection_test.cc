@@ -135,6 +135,7 @@ class FaultInjectionTestEnv : public EnvWrapper {
                            WritableFile** result) override;
   Status DeleteFile(const std::string& f) override;
   Status RenameFile(const std::string& s, const std::string& t) override;
+  Status SyncDir(const std::string& d) override;
 
   void WritableFileClosed(const FileState& state);
   Status DropUnsyncedFileData();
@@ -280,6 +281,14 @@ Status FaultInjectionTestEnv::DropUnsyncedFileData() {
   return s;
 }
 
+Status FaultInjectionTestEnv::SyncDir(const std::string& d) {
+  Status s = EnvWrapper::SyncDir(d);
+  if (s.ok()) {
+    DirWasSynced();
+  }
+  return s;
+}
+
 void FaultInjectionTestEnv::DirWasSynced() {
   MutexLock l(&mutex_);
   new_files_since_last_dir_sync_.clear();
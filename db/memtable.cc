@@ -3,11 +3,16 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include "db/memtable.h"
+
+#include <algorithm>
+
 #include "db/dbformat.h"
+#include "db/merge_helper.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "util/coding.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -19,7 +24,11 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 }
 
 MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
+    : comparator_(comparator),
+      refs_(0),
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      range_del_count_(0) {}
 
 MemTable::~MemTable() { assert(refs_ == 0); }
 
@@ -76,8 +85,82 @@ class MemTableIterator : public Iterator {
 
 Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
 
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  Table::Iterator iter(&range_del_table_);
+  iter.SeekToFirst();
+  if (!iter.Valid()) {
+    return nullptr;
+  }
+  return new MemTableIterator(&range_del_table_);
+}
+
+void MemTable::FragmentedRangeTombstones(
+    std::vector<std::shared_ptr<RangeTombstoneList>>* lists) {
+  MutexLock l(&range_del_mutex_);
+  if (!range_del_pending_.empty()) {
+    const Comparator* ucmp = comparator_.comparator.user_comparator();
+    std::shared_ptr<RangeTombstoneList> list(new RangeTombstoneList(ucmp));
+    for (const char* entry : range_del_pending_) {
+      const Slice internal_key = GetLengthPrefixedSlice(entry);
+      ParsedInternalKey ikey;
+      const bool ok = ParseInternalKey(internal_key, &ikey);
+      assert(ok);
+      (void)ok;
+      list->Add(ikey.user_key,
+                GetLengthPrefixedSlice(internal_key.data() +
+                                       internal_key.size()),
+                ikey.sequence);
+    }
+    range_del_pending_.clear();
+    list->Finish();
+    range_del_lists_.push_back(list);
+
+    while (range_del_lists_.size() >= 2) {
+      const size_t n = range_del_lists_.size();
+      const RangeTombstoneList& newer = *range_del_lists_[n - 1];
+      const RangeTombstoneList& older = *range_del_lists_[n - 2];
+      if (older.size() > 2 * newer.size()) {
+        break;
+      }
+      std::shared_ptr<RangeTombstoneList> merged(new RangeTombstoneList(ucmp));
+      merged->AddList(older);
+      merged->AddList(newer);
+      merged->Finish();
+      range_del_lists_.pop_back();
+      range_del_lists_.back() = merged;
+    }
+  }
+  *lists = range_del_lists_;
+}
+
+SequenceNumber MemTable::MaxCoveringTombstoneSeq(const Slice& user_key,
+                                                 SequenceNumber snapshot) {
+  if (range_del_count_.load(std::memory_order_acquire) == 0) {
+    return 0;
+  }
+  // Lookups share the lists, which no longer change once built; the lock
+  // only covers fetching them.
+  std::vector<std::shared_ptr<RangeTombstoneList>> lists;
+  FragmentedRangeTombstones(&lists);
+  SequenceNumber result = 0;
+  for (const std::shared_ptr<RangeTombstoneList>& list : lists) {
+    result = std::max(result, list->MaxCoveringSeq(user_key, snapshot));
+  }
+  return result;
+}
+
 void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
                    const Slice& value) {
+  AddEntry(s, type, key, value, false);
+}
+
+void MemTable::AddConcurrently(SequenceNumber s, ValueType type,
+                               const Slice& key, const Slice& value) {
+  AddEntry(s, type, key, value, true);
+}
+
+void MemTable::AddEntry(SequenceNumber s, ValueType type, const Slice& key,
+                        const Slice& value, bool concurrent) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -89,7 +172,8 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   const size_t encoded_len = VarintLength(internal_key_size) +
                              internal_key_size + VarintLength(val_size) +
                              val_size;
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = concurrent ? arena_.AllocateConcurrently(encoded_len)
+                         : arena_.Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size); // A: userkey.size + 8 变长编码
   memcpy(p, key.data(), key_size);                  // B: userkey         
   p += key_size;
@@ -98,18 +182,32 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);                   // value_size 变长编码
   memcpy(p, value.data(), val_size);                 // value
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  Table* table = (type == kTypeRangeDeletion) ? &range_del_table_ : &table_;
+  if (concurrent) {
+    table->InsertConcurrently(buf);
+  } else {
+    table->Insert(buf);
+  }
+  if (type == kTypeRangeDeletion) {
+    MutexLock l(&range_del_mutex_);
+    range_del_pending_.push_back(buf);
+    range_del_count_.fetch_add(1, std::memory_order_release);
+  }
 
   // memtable_key = A + B + C
   // internal_key = B + C
   // user_key = B
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   MergeContext* merge) {
+  const SequenceNumber tombstone_seq =
+      MaxCoveringTombstoneSeq(key.user_key(), key.sequence());
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  // Entries for the key follow each other from the newest to the oldest.
+  // Only merge operands send the lookup on to the next one.
+  for (iter.Seek(memkey.data()); iter.Valid(); iter.Next()) {
     // memtable_中存储的entry格式
     // entry format is:
     //    klength  varint32
@@ -128,21 +226,36 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length); 
     //用用户提供的键比较器(默认BytewiseComparator)比较用户键，因为SkipList的Seek不是准确定位
     if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
-          return true;
-        }
-        // 如果是删除的对象，那么返回的就是没有找到的状态
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
-      }
+            Slice(key_ptr, key_length - 8), key.user_key()) != 0) {
+      break;
     }
+    // Correct user key
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    if ((tag >> 8) < tombstone_seq) {
+      // Deleted by a newer range tombstone
+      break;
+    }
+    Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
+    switch (static_cast<ValueType>(tag & 0xff)) {
+      case kTypeValue:
+        *s = merge->Finish(key.user_key(), &v, value);
+        return true;
+      // 如果是删除的对象，那么返回的就是没有找到的状态
+      case kTypeDeletion:
+        *s = merge->Finish(key.user_key(), nullptr, value);
+        return true;
+      case kTypeMerge:
+        merge->AddOperand(v);
+        break;
+      default:
+        break;
+    }
+  }
+  if (tombstone_seq > 0) {
+    // Older memtables and tables only hold entries that are older than
+    // the tombstone.
+    *s = merge->Finish(key.user_key(), nullptr, value);
+    return true;
   }
   return false;
 }
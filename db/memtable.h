@@ -5,16 +5,23 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
+#include "db/range_tombstone.h"
 #include "db/skiplist.h"
 #include "leveldb/db.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
 #include "util/arena.h"
 
 namespace leveldb {
 
 class InternalKeyComparator;
+class MergeContext;
 class MemTableIterator;
 
 class MemTable {
@@ -52,18 +59,39 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator over the range tombstones of the memtable, in the
+  // format described in db/range_tombstone.h, or nullptr if there are none.
+  // The same lifetime rules as for NewIterator() apply.
+  Iterator* NewRangeTombstoneIterator();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  For
+  // type==kTypeRangeDeletion, value is the end of the deleted range.
   // memtable中插入的条目的格式为：internal_key_size + internal_key + value_size + value
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Same as Add(), but may be called from several threads at once.
+  // REQUIRES: no concurrent call to Add().
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, or a range tombstone that
+  // covers it, store a NotFound() error in *status and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  //
+  // Merge operands for key are added to *merge, and the lookup goes on
+  // with older entries.  Once the lookup is done, *value and *status are
+  // set by merge->Finish().
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           MergeContext* merge);
+
+  // Return the sequence number of the newest range tombstone that covers
+  // "user_key" and is visible at "snapshot", or zero if there is none.
+  SequenceNumber MaxCoveringTombstoneSeq(const Slice& user_key,
+                                         SequenceNumber snapshot);
 
  private:
   friend class MemTableIterator;
@@ -80,10 +108,30 @@ class MemTable {
 
   ~MemTable();  // Private since only Unref() should be used to delete it
 
+  void AddEntry(SequenceNumber seq, ValueType type, const Slice& key,
+                const Slice& value, bool concurrent);
+
+  // Store in *lists the range tombstones of range_del_table_, fragmented,
+  // after adding the pending ones to range_del_lists_.
+  void FragmentedRangeTombstones(
+      std::vector<std::shared_ptr<RangeTombstoneList>>* lists);
+
   KeyComparator comparator_;
   int refs_;
   Arena arena_;// 内存分配器
   Table table_;
+  Table range_del_table_;  // Range tombstones, kept apart from table_
+  std::atomic<int> range_del_count_;  // Entries in range_del_table_
+
+  port::Mutex range_del_mutex_;
+  // Entries of range_del_table_ that range_del_lists_ does not hold yet
+  std::vector<const char*> range_del_pending_ GUARDED_BY(range_del_mutex_);
+  // The fragmented tombstones, split into lists that each hold more than
+  // twice as many as the next one.  New tombstones get a list of their own,
+  // which merges with the lists it outgrows, so that every tombstone is
+  // fragmented again only a logarithmic number of times.
+  std::vector<std::shared_ptr<RangeTombstoneList>> range_del_lists_
+      GUARDED_BY(range_del_mutex_);
 };
 
 }  // namespace leveldb
@@ -0,0 +1,46 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_helper.h"
+
+namespace leveldb {
+
+MergeOperator::~MergeOperator() = default;
+
+bool MergeOperator::PartialMerge(const Slice& key, const Slice& left,
+                                 const Slice& right,
+                                 std::string* new_value) const {
+  return false;
+}
+
+Status FullMerge(const MergeOperator* merge_operator, const Slice& user_key,
+                 const Slice* base, const std::vector<std::string>& operands,
+                 std::string* result) {
+  if (merge_operator == nullptr) {
+    return Status::NotSupported("no merge operator for ", user_key);
+  }
+  std::vector<Slice> ordered(operands.rbegin(), operands.rend());
+  std::string merged;
+  if (!merge_operator->FullMerge(user_key, base, ordered, &merged)) {
+    return Status::Corruption("merge operator failed for ", user_key);
+  }
+  result->swap(merged);
+  return Status::OK();
+}
+
+Status MergeContext::Finish(const Slice& user_key, const Slice* base,
+                            std::string* value) {
+  if (!operands_.empty()) {
+    return FullMerge(merge_operator_, user_key, base, operands_, value);
+  }
+  if (base == nullptr) {
+    return Status::NotFound(Slice());
+  }
+  if (base->data() != value->data()) {
+    value->assign(base->data(), base->size());
+  }
+  return Status::OK();
+}
+
+}  // namespace leveldb
@@ -0,0 +1,51 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+#define STORAGE_LEVELDB_DB_MERGE_HELPER_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/merge_operator.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+// Apply "operands", ordered from the newest to the oldest, to "base", the
+// value of "user_key" before them (nullptr if it had none), and store the
+// result in *result.  "base" may point into *result.
+Status FullMerge(const MergeOperator* merge_operator, const Slice& user_key,
+                 const Slice* base, const std::vector<std::string>& operands,
+                 std::string* result);
+
+// The merge operands met by a point lookup on its way from the newest
+// entries to the oldest ones, until it finds the value they apply to.
+class MergeContext {
+ public:
+  explicit MergeContext(const MergeOperator* merge_operator)
+      : merge_operator_(merge_operator) {}
+
+  MergeContext(const MergeContext&) = delete;
+  MergeContext& operator=(const MergeContext&) = delete;
+
+  void AddOperand(const Slice& operand) {
+    operands_.push_back(operand.ToString());
+  }
+
+  // Finish the lookup of "user_key", which found "base" (nullptr if the
+  // key has no value: it was deleted or never written).  Returns OK and
+  // stores the value of the key in *value, or returns NotFound.  "base"
+  // may point into *value.
+  Status Finish(const Slice& user_key, const Slice* base, std::string* value);
+
+ private:
+  const MergeOperator* const merge_operator_;
+  std::vector<std::string> operands_;  // Newest first
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_HELPER_H_
@@ -0,0 +1,265 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <algorithm>
+#include <functional>
+
+#include "leveldb/comparator.h"
+
+namespace leveldb {
+
+RangeTombstoneList::RangeTombstoneList(const Comparator* user_comparator)
+    : ucmp_(user_comparator), fragmented_(true) {}
+
+void RangeTombstoneList::Add(const Slice& start, const Slice& end,
+                             SequenceNumber seq) {
+  if (ucmp_->Compare(start, end) >= 0) {
+    return;
+  }
+  tombstones_.push_back(RangeTombstone(start, end, seq));
+  fragmented_ = false;
+}
+
+Status RangeTombstoneList::AddAll(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("corrupted range tombstone");
+    }
+    Add(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  return iter->status();
+}
+
+void RangeTombstoneList::AddList(const RangeTombstoneList& other) {
+  if (other.empty()) {
+    return;
+  }
+  tombstones_.insert(tombstones_.end(), other.tombstones_.begin(),
+                     other.tombstones_.end());
+  fragmented_ = false;
+}
+
+void RangeTombstoneList::BuildFragments() {
+  fragments_.clear();
+  fragmented_ = true;
+  if (tombstones_.empty()) {
+    return;
+  }
+  const Comparator* ucmp = ucmp_;
+  auto less = [ucmp](const std::string& a, const std::string& b) {
+    return ucmp->Compare(a, b) < 0;
+  };
+
+  // Fragments lie between consecutive tombstone boundaries
+  std::vector<std::string> bounds;
+  bounds.reserve(2 * tombstones_.size());
+  for (const RangeTombstone& t : tombstones_) {
+    bounds.push_back(t.start);
+    bounds.push_back(t.end);
+  }
+  std::sort(bounds.begin(), bounds.end(), less);
+  bounds.erase(std::unique(bounds.begin(), bounds.end(),
+                           [ucmp](const std::string& a, const std::string& b) {
+                             return ucmp->Compare(a, b) == 0;
+                           }),
+               bounds.end());
+
+  std::vector<const RangeTombstone*> by_start;
+  by_start.reserve(tombstones_.size());
+  for (const RangeTombstone& t : tombstones_) {
+    by_start.push_back(&t);
+  }
+  std::sort(by_start.begin(), by_start.end(),
+            [ucmp](const RangeTombstone* a, const RangeTombstone* b) {
+              return ucmp->Compare(a->start, b->start) < 0;
+            });
+
+  // Sweep the boundaries, keeping the tombstones that cover the range
+  // starting at the current one.
+  std::vector<const RangeTombstone*> active;
+  std::vector<SequenceNumber> seqs;
+  size_t next = 0;
+  for (size_t i = 0; i + 1 < bounds.size(); i++) {
+    const std::string& bound = bounds[i];
+    active.erase(std::remove_if(active.begin(), active.end(),
+                                [ucmp, &bound](const RangeTombstone* t) {
+                                  return ucmp->Compare(t->end, bound) <= 0;
+                                }),
+                 active.end());
+    while (next < by_start.size() &&
+           ucmp->Compare(by_start[next]->start, bound) <= 0) {
+      active.push_back(by_start[next++]);
+    }
+    if (active.empty()) {
+      continue;
+    }
+
+    seqs.clear();
+    for (const RangeTombstone* t : active) {
+      seqs.push_back(t->seq);
+    }
+    std::sort(seqs.begin(), seqs.end(), std::greater<SequenceNumber>());
+    seqs.erase(std::unique(seqs.begin(), seqs.end()), seqs.end());
+
+    if (!fragments_.empty() && fragments_.back().seqs == seqs &&
+        ucmp->Compare(fragments_.back().end, bound) == 0) {
+      // Same tombstones as the adjacent fragment: extend it
+      fragments_.back().end = bounds[i + 1];
+    } else {
+      Fragment f;
+      f.start = bound;
+      f.end = bounds[i + 1];
+      f.seqs = seqs;
+      fragments_.push_back(f);
+    }
+  }
+}
+
+int RangeTombstoneList::FindFragment(const Slice& user_key) const {
+  // Find the last fragment that starts at or before user_key
+  int left = 0;
+  int right = static_cast<int>(fragments_.size());
+  while (left < right) {
+    int mid = (left + right) / 2;
+    if (ucmp_->Compare(fragments_[mid].start, user_key) <= 0) {
+      left = mid + 1;
+    } else {
+      right = mid;
+    }
+  }
+  int index = left - 1;
+  if (index < 0 || ucmp_->Compare(user_key, fragments_[index].end) >= 0) {
+    return -1;
+  }
+  return index;
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSeq(const Slice& user_key,
+                                                  SequenceNumber snapshot) {
+  if (!fragmented_) {
+    BuildFragments();
+  }
+  int index = FindFragment(user_key);
+  if (index >= 0) {
+    for (SequenceNumber seq : fragments_[index].seqs) {
+      if (seq <= snapshot) {
+        return seq;
+      }
+    }
+  }
+  return 0;
+}
+
+bool RangeTombstoneList::CoversRange(const Slice& smallest,
+                                     const Slice& largest, SequenceNumber seq,
+                                     SequenceNumber snapshot) {
+  if (!fragmented_) {
+    BuildFragments();
+  }
+  int index = FindFragment(smallest);
+  if (index < 0) {
+    return false;
+  }
+  while (true) {
+    const Fragment& f = fragments_[index];
+    SequenceNumber newest = 0;
+    for (SequenceNumber s : f.seqs) {
+      if (s <= snapshot) {
+        newest = s;
+        break;
+      }
+    }
+    if (newest <= seq) {
+      return false;
+    }
+    if (ucmp_->Compare(largest, f.end) < 0) {
+      return true;
+    }
+    // The rest of the range must be covered by the adjacent fragment
+    index++;
+    if (index == static_cast<int>(fragments_.size()) ||
+        ucmp_->Compare(fragments_[index].start, f.end) != 0) {
+      return false;
+    }
+  }
+}
+
+void RangeTombstoneList::GetFragments(const Slice* lower, const Slice* upper,
+                                      SequenceNumber oldest_snapshot,
+                                      std::vector<RangeTombstone>* result) {
+  if (!fragmented_) {
+    BuildFragments();
+  }
+  for (const Fragment& f : fragments_) {
+    Slice start = f.start;
+    Slice end = f.end;
+    if (lower != nullptr && ucmp_->Compare(start, *lower) < 0) {
+      start = *lower;
+    }
+    if (upper != nullptr && ucmp_->Compare(end, *upper) > 0) {
+      end = *upper;
+    }
+    if (ucmp_->Compare(start, end) >= 0) {
+      continue;
+    }
+    for (SequenceNumber seq : f.seqs) {
+      result->push_back(RangeTombstone(start, end, seq));
+      if (seq <= oldest_snapshot) {
+        break;
+      }
+    }
+  }
+}
+
+SequenceNumber MaxCoveringTombstoneSeq(Iterator* iter,
+                                       const Comparator* user_comparator,
+                                       const Slice& user_key,
+                                       SequenceNumber snapshot) {
+  InternalKey target(user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  iter->Seek(target.Encode());
+  ParsedInternalKey ikey;
+  if (iter->Valid() && ParseInternalKey(iter->key(), &ikey) &&
+      user_comparator->Compare(ikey.user_key, user_key) == 0) {
+    // A fragment starts at user_key.  Its tombstones are newest first.
+    for (; iter->Valid(); iter->Next()) {
+      if (!ParseInternalKey(iter->key(), &ikey) ||
+          user_comparator->Compare(ikey.user_key, user_key) != 0) {
+        break;
+      }
+      if (ikey.sequence <= snapshot) {
+        return ikey.sequence;
+      }
+    }
+    return 0;
+  }
+
+  // Otherwise only the fragment that starts last before user_key can
+  // cover it.  Walk its tombstones from the oldest to the newest.
+  if (iter->Valid()) {
+    iter->Prev();
+  } else {
+    iter->SeekToLast();
+  }
+  if (!iter->Valid() || !ParseInternalKey(iter->key(), &ikey) ||
+      user_comparator->Compare(user_key, iter->value()) >= 0) {
+    return 0;
+  }
+  const std::string start = ikey.user_key.ToString();
+  SequenceNumber result = 0;
+  for (; iter->Valid(); iter->Prev()) {
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        user_comparator->Compare(ikey.user_key, start) != 0 ||
+        ikey.sequence > snapshot) {
+      break;
+    }
+    result = ikey.sequence;
+  }
+  return result;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,114 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone deletes every user key in [start, end) whose entries
+// are older than the tombstone.  Memtables and tables store a tombstone as
+// an entry whose internal key is (start, seq, kTypeRangeDeletion) and whose
+// value is end.  Tables hold them split into non-overlapping fragments, so
+// that the tombstones covering a key can be found with a single seek.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/iterator.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+struct RangeTombstone {
+  RangeTombstone() : seq(0) {}
+  RangeTombstone(const Slice& s, const Slice& e, SequenceNumber sq)
+      : start(s.ToString()), end(e.ToString()), seq(sq) {}
+
+  std::string start;
+  std::string end;  // Exclusive
+  SequenceNumber seq;
+};
+
+// A set of range tombstones that answers which of them cover a user key.
+// Not thread-safe, but see Finish().
+class RangeTombstoneList {
+ public:
+  explicit RangeTombstoneList(const Comparator* user_comparator);
+
+  // Add the tombstone [start, end)@seq.  Empty ranges are ignored.
+  void Add(const Slice& start, const Slice& end, SequenceNumber seq);
+
+  // Add every tombstone that "iter" yields, in the format tables and
+  // memtables store them in.  Does not take ownership of "iter".
+  Status AddAll(Iterator* iter);
+
+  // Add every tombstone of "other".
+  void AddList(const RangeTombstoneList& other);
+
+  bool empty() const { return tombstones_.empty(); }
+  size_t size() const { return tombstones_.size(); }
+
+  // Fragment the tombstones now rather than on the next lookup.  Until the
+  // next Add(), lookups then leave the list unchanged, so several threads
+  // may run them at the same time.
+  void Finish() {
+    if (!fragmented_) {
+      BuildFragments();
+    }
+  }
+
+  // Return the sequence number of the newest tombstone that covers
+  // "user_key" and is visible at "snapshot", or zero if there is none.
+  SequenceNumber MaxCoveringSeq(const Slice& user_key, SequenceNumber snapshot);
+
+  // Return true iff "key" is deleted by a tombstone that is visible at
+  // "snapshot".
+  bool ShouldDelete(const ParsedInternalKey& key, SequenceNumber snapshot) {
+    return MaxCoveringSeq(key.user_key, snapshot) > key.sequence;
+  }
+
+  // Return true iff every key in [smallest, largest] is covered by a
+  // tombstone newer than "seq" that is visible at "snapshot".
+  bool CoversRange(const Slice& smallest, const Slice& largest,
+                   SequenceNumber seq, SequenceNumber snapshot);
+
+  // Append to *result the fragments of the tombstones that lie within
+  // [*lower, *upper), in the order tables store them.  A null bound leaves
+  // that side of the range open.  Of the tombstones of a fragment that are
+  // visible at "oldest_snapshot", only the newest is returned, since it
+  // hides the others from every snapshot.
+  void GetFragments(const Slice* lower, const Slice* upper,
+                    SequenceNumber oldest_snapshot,
+                    std::vector<RangeTombstone>* result);
+
+ private:
+  // A range covered by the same tombstones, newest first.
+  struct Fragment {
+    std::string start;
+    std::string end;
+    std::vector<SequenceNumber> seqs;
+  };
+
+  void BuildFragments();
+
+  // Index of the fragment that contains "user_key", or -1.
+  int FindFragment(const Slice& user_key) const;
+
+  const Comparator* ucmp_;
+  std::vector<RangeTombstone> tombstones_;
+  std::vector<Fragment> fragments_;  // Sorted by start; disjoint
+  bool fragmented_;
+};
+
+// Return the sequence number of the newest tombstone in "iter" that covers
+// "user_key" and is visible at "snapshot", or zero if there is none.
+// "iter" must yield fragmented tombstones, as tables store them.
+SequenceNumber MaxCoveringTombstoneSeq(Iterator* iter,
+                                       const Comparator* user_comparator,
+                                       const Slice& user_key,
+                                       SequenceNumber snapshot);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
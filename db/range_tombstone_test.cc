@@ -0,0 +1,133 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include "leveldb/comparator.h"
+#include "leveldb/options.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "util/logging.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static std::string Print(const std::vector<RangeTombstone>& tombstones) {
+  std::string result;
+  for (const RangeTombstone& t : tombstones) {
+    result += "[" + t.start + "," + t.end + ")@" + NumberToString(t.seq) + " ";
+  }
+  return result;
+}
+
+class RangeTombstoneTest {
+ public:
+  RangeTombstoneTest() : list_(BytewiseComparator()) {
+    list_.Add("a", "e", 10);
+    list_.Add("c", "g", 20);
+    list_.Add("x", "z", 5);
+  }
+
+  RangeTombstoneList list_;
+};
+
+TEST(RangeTombstoneTest, Empty) {
+  RangeTombstoneList list(BytewiseComparator());
+  ASSERT_TRUE(list.empty());
+  list.Add("b", "b", 10);
+  list.Add("c", "a", 10);
+  ASSERT_TRUE(list.empty());
+  ASSERT_EQ(0, list.MaxCoveringSeq("b", kMaxSequenceNumber));
+}
+
+TEST(RangeTombstoneTest, MaxCoveringSeq) {
+  ASSERT_EQ(0, list_.MaxCoveringSeq("0", 100));
+  ASSERT_EQ(10, list_.MaxCoveringSeq("a", 100));
+  ASSERT_EQ(10, list_.MaxCoveringSeq("b", 100));
+  ASSERT_EQ(20, list_.MaxCoveringSeq("c", 100));
+  ASSERT_EQ(10, list_.MaxCoveringSeq("c", 15));
+  ASSERT_EQ(0, list_.MaxCoveringSeq("c", 9));
+  ASSERT_EQ(20, list_.MaxCoveringSeq("e", 100));
+  ASSERT_EQ(0, list_.MaxCoveringSeq("g", 100));
+  ASSERT_EQ(5, list_.MaxCoveringSeq("y", 100));
+  ASSERT_EQ(0, list_.MaxCoveringSeq("z", 100));
+
+  ASSERT_TRUE(list_.ShouldDelete(ParsedInternalKey("d", 19, kTypeValue), 100));
+  ASSERT_TRUE(
+      !list_.ShouldDelete(ParsedInternalKey("d", 20, kTypeValue), 100));
+}
+
+TEST(RangeTombstoneTest, AddList) {
+  RangeTombstoneList merged(BytewiseComparator());
+  merged.Add("d", "y", 15);
+  ASSERT_EQ(15, merged.MaxCoveringSeq("e", 100));
+  merged.AddList(list_);
+  ASSERT_EQ(4, merged.size());
+  ASSERT_EQ(10, merged.MaxCoveringSeq("b", 100));
+  ASSERT_EQ(20, merged.MaxCoveringSeq("e", 100));
+  ASSERT_EQ(15, merged.MaxCoveringSeq("h", 100));
+  ASSERT_EQ(15, merged.MaxCoveringSeq("x", 100));
+  ASSERT_EQ(5, merged.MaxCoveringSeq("y", 100));
+}
+
+TEST(RangeTombstoneTest, CoversRange) {
+  ASSERT_TRUE(list_.CoversRange("a", "f", 5, 100));
+  ASSERT_TRUE(!list_.CoversRange("a", "f", 10, 100));
+  ASSERT_TRUE(list_.CoversRange("c", "f", 10, 100));
+  ASSERT_TRUE(!list_.CoversRange("a", "g", 5, 100));
+  ASSERT_TRUE(!list_.CoversRange("a", "y", 1, 100));
+  ASSERT_TRUE(!list_.CoversRange("c", "f", 10, 15));
+}
+
+TEST(RangeTombstoneTest, GetFragments) {
+  std::vector<RangeTombstone> fragments;
+  list_.GetFragments(nullptr, nullptr, 0, &fragments);
+  ASSERT_EQ("[a,c)@10 [c,e)@20 [c,e)@10 [e,g)@20 [x,z)@5 ", Print(fragments));
+
+  // Only the newest tombstone visible to every snapshot is kept
+  fragments.clear();
+  list_.GetFragments(nullptr, nullptr, 100, &fragments);
+  ASSERT_EQ("[a,c)@10 [c,e)@20 [e,g)@20 [x,z)@5 ", Print(fragments));
+
+  fragments.clear();
+  Slice lower("b"), upper("d");
+  list_.GetFragments(&lower, &upper, 15, &fragments);
+  ASSERT_EQ("[b,c)@10 [c,d)@20 [c,d)@10 ", Print(fragments));
+}
+
+TEST(RangeTombstoneTest, FragmentedIterator) {
+  // Store the fragments the way tables do and look keys up in them
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options;
+  options.comparator = &icmp;
+  options.block_restart_interval = 1;
+  BlockBuilder builder(&options, false);
+  std::vector<RangeTombstone> fragments;
+  list_.GetFragments(nullptr, nullptr, 0, &fragments);
+  for (const RangeTombstone& t : fragments) {
+    InternalKey key(t.start, t.seq, kTypeRangeDeletion);
+    builder.Add(key.Encode(), t.end);
+  }
+  BlockContents contents;
+  contents.data = builder.Finish();
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  const char* keys[] = {"0", "a", "b", "c", "d", "e", "f", "g", "x", "y", "z"};
+  for (const char* key : keys) {
+    for (SequenceNumber snapshot : {100, 15, 9}) {
+      Iterator* iter = block.NewIterator(&icmp);
+      ASSERT_EQ(list_.MaxCoveringSeq(key, snapshot),
+                MaxCoveringTombstoneSeq(iter, BytewiseComparator(), key,
+                                        snapshot));
+      delete iter;
+    }
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
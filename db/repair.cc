@@ -31,6 +31,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
@@ -49,7 +50,10 @@ class Repairer {
         env_(options.env),
         icmp_(options.comparator),
         ipolicy_(options.filter_policy),
-        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
+        ifactory_(options.table_properties_collector_factory),
+        iprefix_(options.prefix_extractor),
+        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, &ifactory_,
+                                 &iprefix_, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
         next_file_number_(1) {
@@ -203,7 +207,16 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    RangeTombstoneList range_del(icmp_.user_comparator());
+    Iterator* del_iter = mem->NewRangeTombstoneIterator();
+    if (del_iter != nullptr) {
+      status = range_del.AddAll(del_iter);
+      delete del_iter;
+    }
+    if (status.ok()) {
+      status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                          &range_del, &meta);
+    }
     delete iter;
     mem->Unref();
     mem = nullptr;
@@ -281,6 +294,23 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // Widen the key range to cover the range tombstones of the table
+    t.meta.largest_seqno = t.max_sequence;
+    Iterator* del_iter =
+        table_cache_->NewRangeTombstoneIterator(number, t.meta.file_size);
+    if (del_iter != nullptr) {
+      RangeTombstoneList range_del(icmp_.user_comparator());
+      Status s = range_del.AddAll(del_iter);
+      delete del_iter;
+      std::vector<RangeTombstone> tombstones;
+      range_del.GetFragments(nullptr, nullptr, 0, &tombstones);
+      AddRangeTombstonesToTable(&icmp_, tombstones, !empty, nullptr, &t.meta);
+      t.max_sequence = t.meta.largest_seqno;
+      if (status.ok()) {
+        status = s;
+      }
+    }
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
@@ -312,6 +342,15 @@ class Repairer {
       counter++;
     }
     delete iter;
+    iter = table_cache_->NewRangeTombstoneIterator(t.meta.number,
+                                                   t.meta.file_size);
+    if (iter != nullptr) {
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        builder->AddRangeTombstone(iter->key(), iter->value());
+        counter++;
+      }
+      delete iter;
+    }
 
     ArchiveFile(src);
     if (counter == 0) {
@@ -368,8 +407,7 @@ class Repairer {
     for (size_t i = 0; i < tables_.size(); i++) {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
-      edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+      edit_.AddFile(0, t.meta);
     }
 
     // fprintf(stderr, "NewDescriptor:\n%s\n", edit_.DebugString().c_str());
@@ -428,6 +466,8 @@ class Repairer {
   Env* const env_;
   InternalKeyComparator const icmp_;
   InternalFilterPolicy const ipolicy_;
+  InternalTablePropertiesCollectorFactory const ifactory_;
+  InternalSliceTransform const iprefix_;
   const Options options_;
   bool owns_info_log_;
   bool owns_cache_;
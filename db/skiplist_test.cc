@@ -376,6 +376,74 @@ static void RunConcurrent(int run) {
   }
 }
 
+// Several threads inserting disjoint keys with InsertConcurrently().
+namespace {
+
+struct ConcurrentInsertState {
+  SkipList<Key, Comparator>* list;
+  int num_threads;
+  int keys_per_thread;
+  std::atomic<int> done;
+};
+
+struct ConcurrentInserter {
+  ConcurrentInsertState* state;
+  int id;
+};
+
+static void ConcurrentInsertBody(void* arg) {
+  ConcurrentInserter* t = reinterpret_cast<ConcurrentInserter*>(arg);
+  ConcurrentInsertState* state = t->state;
+  for (int i = 0; i < state->keys_per_thread; i++) {
+    state->list->InsertConcurrently(
+        static_cast<Key>(i) * state->num_threads + t->id);
+  }
+  state->done.fetch_add(1, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST(SkipTest, InsertConcurrently) {
+  const int kThreads = 8;
+  const int kKeysPerThread = 20000;
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+
+  ConcurrentInsertState state;
+  state.list = &list;
+  state.num_threads = kThreads;
+  state.keys_per_thread = kKeysPerThread;
+  state.done.store(0, std::memory_order_release);
+  ConcurrentInserter threads[kThreads];
+  for (int id = 0; id < kThreads; id++) {
+    threads[id].state = &state;
+    threads[id].id = id;
+    Env::Default()->StartThread(ConcurrentInsertBody, &threads[id]);
+  }
+  while (state.done.load(std::memory_order_acquire) < kThreads) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+
+  // Every key must be present exactly once and in order.
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (Key k = 0; k < static_cast<Key>(kThreads) * kKeysPerThread; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+
+  // Seeks go through the upper levels as well.
+  for (Key k = 0; k < static_cast<Key>(kThreads) * kKeysPerThread; k += 97) {
+    ASSERT_TRUE(list.Contains(k));
+    iter.Seek(k);
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+  }
+}
+
 TEST(SkipTest, Concurrent1) { RunConcurrent(1); }
 TEST(SkipTest, Concurrent2) { RunConcurrent(2); }
 TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
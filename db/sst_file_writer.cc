@@ -0,0 +1,127 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/sst_file_writer.h"
+
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+namespace leveldb {
+
+// Entries are stored as internal keys with sequence number zero.  The
+// database assigns the file a sequence number when it is ingested.
+struct SstFileWriter::Rep {
+  explicit Rep(const Options& opt)
+      : user_options(opt),
+        internal_comparator(opt.comparator),
+        internal_filter_policy(opt.filter_policy),
+        internal_collector_factory(opt.table_properties_collector_factory),
+        internal_prefix_extractor(opt.prefix_extractor),
+        file(nullptr),
+        builder(nullptr),
+        file_size(0) {
+    options = opt;
+    options.comparator = &internal_comparator;
+    if (opt.filter_policy != nullptr) {
+      options.filter_policy = &internal_filter_policy;
+    }
+    options.table_properties_collector_factory = &internal_collector_factory;
+    if (opt.prefix_extractor != nullptr) {
+      options.prefix_extractor = &internal_prefix_extractor;
+    }
+  }
+
+  const Options user_options;
+  const InternalKeyComparator internal_comparator;
+  const InternalFilterPolicy internal_filter_policy;
+  const InternalTablePropertiesCollectorFactory internal_collector_factory;
+  const InternalSliceTransform internal_prefix_extractor;
+  Options options;  // Options for the table, in terms of internal keys
+  WritableFile* file;
+  TableBuilder* builder;
+  std::string last_key;  // Last user key added, if builder->NumEntries() > 0
+  uint64_t file_size;
+};
+
+SstFileWriter::SstFileWriter(const Options& options)
+    : rep_(new Rep(options)) {}
+
+SstFileWriter::~SstFileWriter() {
+  if (rep_->builder != nullptr) {
+    rep_->builder->Abandon();
+    delete rep_->builder;
+  }
+  delete rep_->file;
+  delete rep_;
+}
+
+Status SstFileWriter::Open(const std::string& fname) {
+  if (rep_->file != nullptr) {
+    return Status::InvalidArgument("SstFileWriter is already open");
+  }
+  Status s = rep_->options.env->NewWritableFile(fname, &rep_->file);
+  if (s.ok()) {
+    rep_->builder = new TableBuilder(rep_->options, rep_->file);
+  }
+  return s;
+}
+
+Status SstFileWriter::Put(const Slice& key, const Slice& value) {
+  return Add(key, value, false);
+}
+
+Status SstFileWriter::Delete(const Slice& key) {
+  return Add(key, Slice(), true);
+}
+
+Status SstFileWriter::Add(const Slice& key, const Slice& value,
+                          bool deletion) {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("SstFileWriter is not open");
+  }
+  if (r->builder->NumEntries() > 0 &&
+      r->user_options.comparator->Compare(key, r->last_key) <= 0) {
+    return Status::InvalidArgument("keys must be added in strictly "
+                                   "increasing order");
+  }
+  std::string ikey;
+  AppendInternalKey(&ikey, ParsedInternalKey(
+                               key, 0, deletion ? kTypeDeletion : kTypeValue));
+  r->builder->Add(ikey, value);
+  r->last_key.assign(key.data(), key.size());
+  r->file_size = r->builder->FileSize();
+  return r->builder->status();
+}
+
+Status SstFileWriter::Finish() {
+  Rep* r = rep_;
+  if (r->builder == nullptr) {
+    return Status::InvalidArgument("SstFileWriter is not open");
+  }
+  Status s;
+  if (r->builder->NumEntries() == 0) {
+    r->builder->Abandon();
+    s = Status::InvalidArgument("cannot create a file with no entries");
+  } else {
+    s = r->builder->Finish();
+    r->file_size = r->builder->FileSize();
+  }
+  delete r->builder;
+  r->builder = nullptr;
+  if (s.ok()) {
+    s = r->file->Sync();
+  }
+  if (s.ok()) {
+    s = r->file->Close();
+  }
+  delete r->file;
+  r->file = nullptr;
+  return s;
+}
+
+uint64_t SstFileWriter::FileSize() const { return rep_->file_size; }
+
+}  // namespace leveldb
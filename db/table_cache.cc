@@ -29,6 +29,71 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
+namespace {
+
+// Yields the entries of an ingested table, which are stored with sequence
+// number zero, with the sequence number the table was assigned instead.
+class GlobalSeqnoIterator : public Iterator {
+ public:
+  GlobalSeqnoIterator(const Comparator* icmp, Iterator* iter,
+                      SequenceNumber seq)
+      : icmp_(icmp), iter_(iter), seq_(seq) {}
+
+  ~GlobalSeqnoIterator() override { delete iter_; }
+
+  bool Valid() const override { return iter_->Valid(); }
+  Slice key() const override { return key_; }
+  Slice value() const override { return iter_->value(); }
+  Status status() const override { return iter_->status(); }
+
+  void Seek(const Slice& target) override {
+    iter_->Seek(target);
+    UpdateKey();
+    // The entry for the target's user key sorts before the target if it
+    // is newer than the target.
+    if (iter_->Valid() && icmp_->Compare(key_, target) < 0) {
+      iter_->Next();
+      UpdateKey();
+    }
+  }
+  void SeekToFirst() override {
+    iter_->SeekToFirst();
+    UpdateKey();
+  }
+  void SeekToLast() override {
+    iter_->SeekToLast();
+    UpdateKey();
+  }
+  void Next() override {
+    iter_->Next();
+    UpdateKey();
+  }
+  void Prev() override {
+    iter_->Prev();
+    UpdateKey();
+  }
+
+ private:
+  void UpdateKey() {
+    if (!iter_->Valid()) {
+      return;
+    }
+    const Slice key = iter_->key();
+    key_.assign(key.data(), key.size());
+    if (key.size() >= 8) {
+      const uint64_t type = DecodeFixed64(key.data() + key.size() - 8) & 0xff;
+      EncodeFixed64(&key_[key.size() - 8], (seq_ << 8) | type);
+    }
+  }
+
+  const Comparator* const icmp_;
+  Iterator* const iter_;
+  const SequenceNumber seq_;
+  std::string key_;
+};
+
+}  // namespace
+
 TableCache::TableCache(const std::string& dbname, const Options& options,
                        int entries)
     : env_(options.env),
@@ -38,8 +103,30 @@ TableCache::TableCache(const std::string& dbname, const Options& options,
 
 TableCache::~TableCache() { delete cache_; }
 
+Status TableCache::OpenTable(uint64_t file_number, uint64_t file_size,
+                             RandomAccessFile** file, Table** table) {
+  std::string fname = TableFileName(dbname_, file_number);
+  Status s = env_->NewRandomAccessFile(fname, file);
+  if (!s.ok()) {
+    std::string old_fname = SSTTableFileName(dbname_, file_number);
+    if (env_->NewRandomAccessFile(old_fname, file).ok()) {
+      s = Status::OK();
+    }
+  }
+  if (s.ok()) {
+    // 将.sst文件映射到table，Table类用于解析.sst文件
+    s = Table::Open(options_, *file, file_size, table);
+    if (!s.ok()) {
+      assert(*table == nullptr);
+      delete *file;
+      *file = nullptr;
+    }
+  }
+  return s;
+}
+
 Status TableCache::FindTable(uint64_t file_number,
-                             uint64_t file_size,
+                             uint64_t file_size, int level,
                              Cache::Handle** handle) {
   Status s;
   char buf[sizeof(file_number)];
@@ -50,24 +137,11 @@ Status TableCache::FindTable(uint64_t file_number,
 
   // 如果指定文件不存在，则打开文件并添加至缓存
   if (*handle == nullptr) {
-    std::string fname = TableFileName(dbname_, file_number);
     RandomAccessFile* file = nullptr;
     Table* table = nullptr;
-    s = env_->NewRandomAccessFile(fname, &file);
-    if (!s.ok()) {
-      std::string old_fname = SSTTableFileName(dbname_, file_number);
-      if (env_->NewRandomAccessFile(old_fname, &file).ok()) {
-        s = Status::OK();
-      }
-    }
-    if (s.ok()) {
-      // 将.sst文件映射到table，Table类用于解析.sst文件
-      s = Table::Open(options_, file, file_size, &table);
-    }
+    s = OpenTable(file_number, file_size, &file, &table);
 
     if (!s.ok()) {
-      assert(table == nullptr);
-      delete file;
       // We do not cache error results so that if the error is transient,
       // or somebody repairs the file, we recover automatically.
     } else {
@@ -79,19 +153,27 @@ Status TableCache::FindTable(uint64_t file_number,
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
+  // The table may have been opened by a caller that did not know its
+  // level, e.g. after a reopen.  Pinning a pinned table is cheap.
+  if (s.ok() && level == 0 &&
+      options_.pin_l0_filter_and_index_blocks_in_cache) {
+    reinterpret_cast<TableAndFile*>(cache_->Value(*handle))
+        ->table->PinIndexAndFilter();
+  }
   return s;
 }
 
 Iterator* TableCache::NewIterator(const ReadOptions& options,
                                   uint64_t file_number,
                                   uint64_t file_size,
-                                  Table** tableptr) {
+                                  Table** tableptr,
+                                  SequenceNumber global_seqno, int level) {
   if (tableptr != nullptr) {
     *tableptr = nullptr;
   }
 
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);// handle将会指向file_number对应的那个entry
+  Status s = FindTable(file_number, file_size, level, &handle);// handle将会指向file_number对应的那个entry
   if (!s.ok()) {
     return NewErrorIterator(s);
   }
@@ -103,6 +185,9 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
   if (tableptr != nullptr) {
     *tableptr = table;
   }
+  if (global_seqno != 0) {
+    result = new GlobalSeqnoIterator(options_.comparator, result, global_seqno);
+  }
   return result;
 }
 
@@ -112,9 +197,10 @@ Status TableCache::Get(const ReadOptions& options,
                        const Slice& k,
                        void* arg,
                        void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
+                                             const Slice&),
+                       int level) {
   Cache::Handle* handle = nullptr;
-  Status s = FindTable(file_number, file_size, &handle);
+  Status s = FindTable(file_number, file_size, level, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
     s = t->InternalGet(options, k, arg, handle_result);
@@ -123,6 +209,91 @@ Status TableCache::Get(const ReadOptions& options,
   return s;
 }
 
+Status TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                            uint64_t file_size, int n, const Slice* keys,
+                            void* const* args,
+                            void (*handle_result)(void*, const Slice&,
+                                                  const Slice&),
+                            int level) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, level, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    s = t->InternalMultiGet(options, n, keys, args, handle_result);
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Iterator* TableCache::NewRangeTombstoneIterator(uint64_t file_number,
+                                                uint64_t file_size,
+                                                int level) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, level, &handle);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
+  }
+
+  Table* table = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+  Iterator* result = table->NewRangeTombstoneIterator();
+  if (result == nullptr) {
+    cache_->Release(handle);
+  } else {
+    result->RegisterCleanup(&UnrefEntry, cache_, handle);
+  }
+  return result;
+}
+
+static Status CopyProperties(const Table* table, TableProperties* props) {
+  const TableProperties* table_props = table->GetProperties();
+  if (table_props == nullptr) {
+    return Status::NotFound("table has no properties");
+  }
+  *props = *table_props;
+  return Status::OK();
+}
+
+Status TableCache::GetProperties(uint64_t file_number, uint64_t file_size,
+                                 TableProperties* props, bool fill_cache) {
+  Cache::Handle* handle = nullptr;
+  Status s;
+  if (fill_cache) {
+    s = FindTable(file_number, file_size, -1, &handle);
+  } else {
+    char buf[sizeof(file_number)];
+    EncodeFixed64(buf, file_number);
+    handle = cache_->Lookup(Slice(buf, sizeof(buf)));
+    if (handle == nullptr) {
+      // Read the properties from a table of its own, which leaves the
+      // tables in the cache in place.
+      RandomAccessFile* file = nullptr;
+      Table* table = nullptr;
+      s = OpenTable(file_number, file_size, &file, &table);
+      if (s.ok()) {
+        s = CopyProperties(table, props);
+        delete table;
+        delete file;
+      }
+      return s;
+    }
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  s = CopyProperties(
+      reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table, props);
+  cache_->Release(handle);
+  return s;
+}
+
+void TableCache::LoadFileStats(FileMetaData* f) {
+  TableProperties props;
+  if (GetProperties(f->number, f->file_size, &props).ok()) {
+    f->num_entries = props.num_entries + props.num_range_deletions;
+    f->num_deletions = props.num_deletions + props.num_range_deletions;
+  }
+}
+
 void TableCache::Evict(uint64_t file_number) {
   char buf[sizeof(file_number)];
   EncodeFixed64(buf, file_number);
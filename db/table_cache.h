@@ -12,6 +12,7 @@
 #include <string>
 
 #include "db/dbformat.h"
+#include "db/version_edit.h"
 #include "leveldb/cache.h"
 #include "leveldb/table.h"
 #include "port/port.h"
@@ -41,16 +42,23 @@ class TableCache {
   TableCache(const std::string& dbname, const Options& options, int entries);
   ~TableCache();
 
+  // The "level" arguments below are the level of the file, or -1 if it is
+  // not known.  With Options::pin_l0_filter_and_index_blocks_in_cache set,
+  // a table keeps its index and filter pinned in the block cache from its
+  // first use at level 0 on.
+
   // Return an iterator for the specified file number (the corresponding
   // file length must be exactly "file_size" bytes).  If "tableptr" is
   // non-null, also sets "*tableptr" to point to the Table object
   // underlying the returned iterator, or to nullptr if no Table object
   // underlies the returned iterator.  The returned "*tableptr" object is owned
   // by the cache and should not be deleted, and is valid for as long as the
-  // returned iterator is live.
+  // returned iterator is live.  A non-zero "global_seqno" replaces the
+  // sequence number of every entry of an ingested file.
   // 为一个文件创建一个迭代器，这个迭代器是一个二级迭代器，根据这个迭代器可以遍历文件的所有键值对
   Iterator* NewIterator(const ReadOptions& options, uint64_t file_number,
-                        uint64_t file_size, Table** tableptr = nullptr);
+                        uint64_t file_size, Table** tableptr = nullptr,
+                        SequenceNumber global_seqno = 0, int level = -1);
 
   // If a seek to internal key "k" in specified file finds an entry, call (*handle_result)(arg, found_key, found_value).
   Status Get(const ReadOptions& options,
@@ -58,13 +66,44 @@ class TableCache {
              uint64_t file_size,
              const Slice& k,
              void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             int level = -1);
+
+  // Like Get() for each of the "n" sorted internal keys in "keys[]",
+  // calling (*handle_result)(args[i], found_key, found_value) for keys[i].
+  // The table is looked up in the cache only once.
+  Status MultiGet(const ReadOptions& options, uint64_t file_number,
+                  uint64_t file_size, int n, const Slice* keys,
+                  void* const* args,
+                  void (*handle_result)(void*, const Slice&, const Slice&),
+                  int level = -1);
+
+  // Return an iterator over the range tombstones of the specified file, or
+  // nullptr if it has none.
+  Iterator* NewRangeTombstoneIterator(uint64_t file_number,
+                                      uint64_t file_size, int level = -1);
+
+  // Store the properties of the specified file in *props.  Returns
+  // NotFound if the table was written without properties.  If
+  // "fill_cache" is false, a table that is not in the cache is opened
+  // without being added to it.
+  Status GetProperties(uint64_t file_number, uint64_t file_size,
+                       TableProperties* props, bool fill_cache = true);
+
+  // Set the entry counts of "*f" from the properties of its table.  Leaves
+  // them unchanged if they cannot be read.
+  void LoadFileStats(FileMetaData* f);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
  private:
-  Status FindTable(uint64_t file_number, uint64_t file_size, Cache::Handle**);
+  // Open the table of the specified file.  On success, the caller owns
+  // *file and *table.
+  Status OpenTable(uint64_t file_number, uint64_t file_size,
+                   RandomAccessFile** file, Table** table);
+  Status FindTable(uint64_t file_number, uint64_t file_size, int level,
+                   Cache::Handle**);
 
   Env* const env_;
   const std::string dbname_;
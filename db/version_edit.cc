@@ -20,7 +20,17 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  kNewFile2 = 10  // kNewFile, followed by largest_seqno and flags
+};
+
+// Flags of a kNewFile2 entry.  kHasGlobalSeqno is followed by the
+// global sequence number of the file, then kHasFileStats by its entry
+// and deletion counts.
+enum NewFileFlags {
+  kHasRangeTombstones = 0x1,
+  kHasGlobalSeqno = 0x2,
+  kHasFileStats = 0x4
 };
 
 void VersionEdit::Clear() {
@@ -74,12 +84,25 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    PutVarint32(dst, kNewFile2);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    PutVarint64(dst, f.largest_seqno);
+    uint32_t flags = 0;
+    if (f.has_range_tombstones) flags |= kHasRangeTombstones;
+    if (f.global_seqno != 0) flags |= kHasGlobalSeqno;
+    if (f.num_entries != 0) flags |= kHasFileStats;
+    PutVarint32(dst, flags);
+    if (f.global_seqno != 0) {
+      PutVarint64(dst, f.global_seqno);
+    }
+    if (f.num_entries != 0) {
+      PutVarint64(dst, f.num_entries);
+      PutVarint64(dst, f.num_deletions);
+    }
   }
 }
 
@@ -107,6 +130,7 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
   Slice input = src;
   const char* msg = nullptr;
   uint32_t tag;
+  uint32_t flags;
 
   // Temporary storage for parsing
   int level;
@@ -179,6 +203,37 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.largest_seqno = kMaxSequenceNumber;
+          f.has_range_tombstones = false;
+          f.global_seqno = 0;
+          f.num_entries = 0;
+          f.num_deletions = 0;
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-file entry";
+        }
+        break;
+
+      case kNewFile2:
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint64(&input, &f.largest_seqno) &&
+            GetVarint32(&input, &flags) &&
+            ((flags & kHasGlobalSeqno) == 0 ||
+             GetVarint64(&input, &f.global_seqno)) &&
+            ((flags & kHasFileStats) == 0 ||
+             (GetVarint64(&input, &f.num_entries) &&
+              GetVarint64(&input, &f.num_deletions)))) {
+          f.has_range_tombstones = (flags & kHasRangeTombstones) != 0;
+          if ((flags & kHasGlobalSeqno) == 0) {
+            f.global_seqno = 0;
+          }
+          if ((flags & kHasFileStats) == 0) {
+            f.num_entries = 0;
+            f.num_deletions = 0;
+          }
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
@@ -249,6 +304,20 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.has_range_tombstones) {
+      r.append(" (range tombstones)");
+    }
+    if (f.global_seqno != 0) {
+      r.append(" @");
+      AppendNumberTo(&r, f.global_seqno);
+    }
+    if (f.num_entries != 0) {
+      r.append(" (");
+      AppendNumberTo(&r, f.num_deletions);
+      r.append(" of ");
+      AppendNumberTo(&r, f.num_entries);
+      r.append(" deleted)");
+    }
   }
   r.append("\n}\n");
   return r;
@@ -17,7 +17,16 @@ class VersionSet;
 
 // 每个文件（table）都有一个这个结构体
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        largest_seqno(kMaxSequenceNumber),
+        has_range_tombstones(false),
+        global_seqno(0),
+        num_entries(0),
+        num_deletions(0),
+        being_compacted(false) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction 如果一个文件的seek miss次数超过阈值，则会触发Seek Compaction
@@ -26,6 +35,17 @@ struct FileMetaData {
                          // smallest 和 largest是用来快速判断某个key是否在这个文件里的依据，加速查找的过程
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+  SequenceNumber largest_seqno;  // kMaxSequenceNumber if unknown
+  bool has_range_tombstones;
+  // Non-zero for an ingested table, whose entries are stored with sequence
+  // number zero: the sequence number that all of them are read with.
+  SequenceNumber global_seqno;
+  // From the table properties, or zero if they have not been loaded: all
+  // the entries, range tombstones included, and the deletions among them.
+  // Recorded in the MANIFEST along with the file.
+  uint64_t num_entries;
+  uint64_t num_deletions;
+  bool being_compacted;  // Is an ongoing compaction reading this file?
 };
 
 // 记录在某个版本上做了哪些修改
@@ -73,6 +93,16 @@ class VersionEdit {
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add the file described by "f" at the specified level.
+  void AddFile(int level, const FileMetaData& f) {
+    AddFile(level, f.number, f.file_size, f.smallest, f.largest);
+    new_files_.back().second.largest_seqno = f.largest_seqno;
+    new_files_.back().second.has_range_tombstones = f.has_range_tombstones;
+    new_files_.back().second.global_seqno = f.global_seqno;
+    new_files_.back().second.num_entries = f.num_entries;
+    new_files_.back().second.num_deletions = f.num_deletions;
+  }
+
   // Delete the specified "file" from the specified "level".
   void DeleteFile(int level, uint64_t file) {
     deleted_files_.insert(std::make_pair(level, file));
@@ -39,6 +39,70 @@ TEST(VersionEditTest, EncodeDecode) {
   TestEncodeDecode(edit);
 }
 
+TEST(VersionEditTest, RangeTombstoneFile) {
+  FileMetaData f;
+  f.number = 7;
+  f.file_size = 1000;
+  f.smallest = InternalKey("a", 5, kTypeRangeDeletion);
+  f.largest = InternalKey("m", kMaxSequenceNumber, kTypeRangeDeletion);
+  f.largest_seqno = 9;
+  f.has_range_tombstones = true;
+
+  VersionEdit edit;
+  edit.AddFile(2, f);
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  ASSERT_TRUE(parsed.DebugString().find("(range tombstones)") !=
+              std::string::npos);
+}
+
+TEST(VersionEditTest, FileStats) {
+  FileMetaData f;
+  f.number = 9;
+  f.file_size = 3000;
+  f.smallest = InternalKey("c", 50, kTypeValue);
+  f.largest = InternalKey("q", 60, kTypeDeletion);
+  f.largest_seqno = 60;
+  f.global_seqno = 60;
+  f.num_entries = 1000;
+  f.num_deletions = 400;
+
+  VersionEdit edit;
+  edit.AddFile(1, f);
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  ASSERT_TRUE(parsed.DebugString().find(" @60 (400 of 1000 deleted)") !=
+              std::string::npos);
+}
+
+TEST(VersionEditTest, IngestedFile) {
+  FileMetaData f;
+  f.number = 8;
+  f.file_size = 2000;
+  f.smallest = InternalKey("b", 42, kTypeValue);
+  f.largest = InternalKey("k", 42, kTypeDeletion);
+  f.largest_seqno = 42;
+  f.global_seqno = 42;
+
+  VersionEdit edit;
+  edit.AddFile(5, f);
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  ASSERT_TRUE(parsed.DebugString().find(" @42") != std::string::npos);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
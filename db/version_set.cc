@@ -12,6 +12,8 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_helper.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "leveldb/env.h"
 #include "leveldb/table_builder.h"
@@ -196,6 +198,7 @@ class Version::LevelFileNumIterator : public Iterator {
     assert(Valid());
     EncodeFixed64(value_buf_, (*flist_)[index_]->number);
     EncodeFixed64(value_buf_ + 8, (*flist_)[index_]->file_size);
+    EncodeFixed64(value_buf_ + 16, (*flist_)[index_]->global_seqno);
     return Slice(value_buf_, sizeof(value_buf_));
   }
   Status status() const override { return Status::OK(); }
@@ -205,24 +208,34 @@ class Version::LevelFileNumIterator : public Iterator {
   const std::vector<FileMetaData*>* const flist_;
   uint32_t index_;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16];
+  // Backing store for value().  Holds the file number, size and global
+  // sequence number.
+  mutable char value_buf_[24];
 };
 
 static Iterator* GetFileIterator(void* arg, const ReadOptions& options,
                                  const Slice& file_value) {
   TableCache* cache = reinterpret_cast<TableCache*>(arg);
-  if (file_value.size() != 16) {
+  if (file_value.size() != 24) {
     return NewErrorIterator(
         Status::Corruption("FileReader invoked with unexpected value"));
   } else {
     return cache->NewIterator(options, DecodeFixed64(file_value.data()),
-                              DecodeFixed64(file_value.data() + 8));
+                              DecodeFixed64(file_value.data() + 8), nullptr,
+                              DecodeFixed64(file_value.data() + 16));
   }
 }
 
 Iterator* Version::NewConcatenatingIterator(const ReadOptions& options,
                                             int level) const {
+  if (options.prefix_same_as_start) {
+    // Stop at the first file past the prefix.  The tables filter their
+    // blocks themselves.
+    return NewTwoLevelIterator(
+        new LevelFileNumIterator(vset_->icmp_, &files_[level]),
+        &GetFileIterator, vset_->table_cache_, options,
+        vset_->options_->prefix_extractor, nullptr);
+  }
   return NewTwoLevelIterator(
       new LevelFileNumIterator(vset_->icmp_, &files_[level]), &GetFileIterator,
       vset_->table_cache_, options);
@@ -233,7 +246,8 @@ void Version::AddIterators(const ReadOptions& options,
   // Merge all level zero files together since they may overlap
   for (size_t i = 0; i < files_[0].size(); i++) {
     iters->push_back(vset_->table_cache_->NewIterator(
-        options, files_[0][i]->number, files_[0][i]->file_size));
+        options, files_[0][i]->number, files_[0][i]->file_size, nullptr,
+        files_[0][i]->global_seqno, 0));
   }
 
   // For levels > 0, we can use a concatenating iterator that sequentially
@@ -246,6 +260,34 @@ void Version::AddIterators(const ReadOptions& options,
   }
 }
 
+// Add the range tombstones of "f", of "level", if any, to *list.
+static Status AddFileRangeTombstones(TableCache* table_cache, int level,
+                                     FileMetaData* f,
+                                     RangeTombstoneList* list) {
+  if (!f->has_range_tombstones) {
+    return Status::OK();
+  }
+  Iterator* iter =
+      table_cache->NewRangeTombstoneIterator(f->number, f->file_size, level);
+  Status s;
+  if (iter != nullptr) {
+    s = list->AddAll(iter);
+    delete iter;
+  }
+  return s;
+}
+
+Status Version::AddRangeTombstones(RangeTombstoneList* list) {
+  Status s;
+  for (int level = 0; level < config::kNumLevels && s.ok(); level++) {
+    for (size_t i = 0; i < files_[level].size() && s.ok(); i++) {
+      s = AddFileRangeTombstones(vset_->table_cache_, level, files_[level][i],
+                                 list);
+    }
+  }
+  return s;
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -253,12 +295,18 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerge,
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
   std::string* value;
+  MergeContext* merge;
+  // Newest range tombstone of the file that covers user_key, or zero
+  SequenceNumber tombstone_seq;
+  // Sequence number of the last merge operand found, if state == kMerge
+  SequenceNumber merge_seq;
 };
 }  // namespace
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -268,14 +316,61 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
-      if (s->state == kFound) {
+      if (parsed_key.sequence < s->tombstone_seq) {
+        s->state = kDeleted;
+      } else if (parsed_key.type == kTypeValue) {
+        s->state = kFound;
         s->value->assign(v.data(), v.size());
+      } else if (parsed_key.type == kTypeMerge) {
+        s->state = kMerge;
+        s->merge->AddOperand(v);
+        s->merge_seq = parsed_key.sequence;
+      } else {
+        s->state = kDeleted;
       }
     }
   }
 }
 
+// Called when the lookup of "k" in "f" stopped at a merge operand: look
+// the key up again in "f", below the operand, until an entry that is not
+// an operand is found.  Leaves saver->state set to anything but kMerge.
+static Status FollowMergeOperands(TableCache* table_cache,
+                                  const ReadOptions& options, FileMetaData* f,
+                                  const LookupKey& k, Saver* saver) {
+  Status s;
+  while (s.ok() && saver->state == kMerge) {
+    saver->state = kNotFound;
+    if (saver->merge_seq == 0) {
+      break;  // Nothing older in this file
+    }
+    LookupKey older(k.user_key(), saver->merge_seq - 1);
+    s = table_cache->Get(options, f->number, f->file_size,
+                         older.internal_key(), saver, SaveValue);
+  }
+  return s;
+}
+
+// Set saver->tombstone_seq for a lookup of "k" in "f", of "level".
+static Status FindCoveringTombstone(TableCache* table_cache, int level,
+                                    FileMetaData* f, const LookupKey& k,
+                                    Saver* saver) {
+  saver->tombstone_seq = 0;
+  if (!f->has_range_tombstones) {
+    return Status::OK();
+  }
+  Iterator* iter =
+      table_cache->NewRangeTombstoneIterator(f->number, f->file_size, level);
+  Status s;
+  if (iter != nullptr) {
+    saver->tombstone_seq = MaxCoveringTombstoneSeq(
+        iter, saver->ucmp, k.user_key(), k.sequence());
+    s = iter->status();
+    delete iter;
+  }
+  return s;
+}
+
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
   return a->number > b->number;
 }
@@ -330,7 +425,7 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
 
 //对于没有数据重叠的文件，遍历一个sstable文件就可以了。因此，leveldb设计compaction的目的之一就是为了提高读取数据的效率
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    std::string* value, GetStats* stats, MergeContext* merge) {
   Slice ikey = k.internal_key();
   Slice user_key = k.user_key();
   const Comparator* ucmp = vset_->icmp_.user_comparator();
@@ -397,6 +492,10 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       }
 
       FileMetaData* f = files[i];
+      if (f->global_seqno > k.sequence()) {
+        // Ingested after the snapshot that is read
+        continue;
+      }
       last_file_read = f;
       last_file_read_level = level;
 
@@ -405,19 +504,32 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       saver.ucmp = ucmp;
       saver.user_key = user_key;
       saver.value = value;
-      s = vset_->table_cache_->Get(options, f->number, f->file_size, ikey,
-                                   &saver, SaveValue);
+      saver.merge = merge;
+      s = FindCoveringTombstone(vset_->table_cache_, level, f, k, &saver);
+      if (s.ok()) {
+        s = vset_->table_cache_->Get(options, f->number, f->file_size, ikey,
+                                     &saver, SaveValue, level);
+      }
+      if (s.ok()) {
+        s = FollowMergeOperands(vset_->table_cache_, options, f, k, &saver);
+      }
       if (!s.ok()) {
         return s;
       }
+      if (saver.state == kNotFound && saver.tombstone_seq > 0) {
+        // Older files only hold entries that are older than the tombstone
+        saver.state = kDeleted;
+      }
       switch (saver.state) {
         case kNotFound:
+        case kMerge:
           break;  // Keep searching in other files
-        case kFound:
-          return s;
+        case kFound: {
+          const Slice base(*value);
+          return merge->Finish(user_key, &base, value);
+        }
         case kDeleted:
-          s = Status::NotFound(Slice());  // Use empty error message for speed
-          return s;
+          return merge->Finish(user_key, nullptr, value);
         case kCorrupt:
           s = Status::Corruption("corrupted key for ", user_key);
           return s;
@@ -425,7 +537,211 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
     }
   }// for
 
-  return Status::NotFound(Slice());  // Use an empty error message for speed
+  return merge->Finish(user_key, nullptr, value);
+}
+
+namespace {
+// State shared by the per-file lookups of one Version::MultiGet() call.
+struct MultiGetState {
+  const LookupKey* const* keys;
+  Status* statuses;
+  std::vector<Saver> savers;
+  std::vector<bool> done;
+  std::vector<FileMetaData*> last_file_read;
+  std::vector<int> last_file_read_level;
+  Version::GetStats* stats;
+};
+}  // namespace
+
+// Look up the keys with the given indices in file "f" of "level".
+static void MultiGetFromFile(TableCache* table_cache,
+                             const ReadOptions& options, int level,
+                             FileMetaData* f, const std::vector<int>& batch,
+                             MultiGetState* state) {
+  if (batch.empty() ||
+      f->global_seqno > state->keys[batch[0]]->sequence()) {
+    // Nothing to look up, or ingested after the snapshot that is read
+    return;
+  }
+  std::vector<Slice> ikeys;
+  std::vector<void*> args;
+  ikeys.reserve(batch.size());
+  args.reserve(batch.size());
+  for (int i : batch) {
+    if (state->last_file_read[i] != nullptr &&
+        state->stats->seek_file == nullptr) {
+      // We have had more than one seek for this key.  Charge the 1st file.
+      state->stats->seek_file = state->last_file_read[i];
+      state->stats->seek_file_level = state->last_file_read_level[i];
+    }
+    state->last_file_read[i] = f;
+    state->last_file_read_level[i] = level;
+    ikeys.push_back(state->keys[i]->internal_key());
+    args.push_back(&state->savers[i]);
+  }
+
+  Status s;
+  for (int i : batch) {
+    if (s.ok()) {
+      s = FindCoveringTombstone(table_cache, level, f, *state->keys[i],
+                                &state->savers[i]);
+    }
+  }
+  if (s.ok()) {
+    s = table_cache->MultiGet(options, f->number, f->file_size,
+                              static_cast<int>(batch.size()), ikeys.data(),
+                              args.data(), SaveValue, level);
+  }
+  for (int i : batch) {
+    Saver& saver = state->savers[i];
+    if (s.ok()) {
+      s = FollowMergeOperands(table_cache, options, f, *state->keys[i],
+                              &saver);
+    }
+    if (!s.ok()) {
+      state->statuses[i] = s;
+      state->done[i] = true;
+      continue;
+    }
+    if (saver.state == kNotFound && saver.tombstone_seq > 0) {
+      // Older files only hold entries that are older than the tombstone
+      saver.state = kDeleted;
+    }
+    switch (saver.state) {
+      case kNotFound:
+      case kMerge:
+        break;  // Keep searching in other files
+      case kFound: {
+        const Slice base(*saver.value);
+        state->statuses[i] =
+            saver.merge->Finish(saver.user_key, &base, saver.value);
+        state->done[i] = true;
+        break;
+      }
+      case kDeleted:
+        state->statuses[i] =
+            saver.merge->Finish(saver.user_key, nullptr, saver.value);
+        state->done[i] = true;
+        break;
+      case kCorrupt:
+        state->statuses[i] =
+            Status::Corruption("corrupted key for ", saver.user_key);
+        state->done[i] = true;
+        break;
+    }
+  }
+}
+
+void Version::MultiGet(const ReadOptions& options, int n,
+                       const LookupKey* const* keys, std::string* const* vals,
+                       MergeContext* const* merges, Status* statuses,
+                       GetStats* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  stats->seek_file = nullptr;
+  stats->seek_file_level = -1;
+
+  MultiGetState state;
+  state.keys = keys;
+  state.statuses = statuses;
+  state.savers.resize(n);
+  state.done.resize(n, false);
+  state.last_file_read.resize(n, nullptr);
+  state.last_file_read_level.resize(n, -1);
+  state.stats = stats;
+
+  // Indices of the keys that have not been found yet, in key order
+  std::vector<int> pending;
+  pending.reserve(n);
+  for (int i = 0; i < n; i++) {
+    Saver* saver = &state.savers[i];
+    saver->state = kNotFound;
+    saver->ucmp = ucmp;
+    saver->user_key = keys[i]->user_key();
+    saver->value = vals[i];
+    saver->merge = merges[i];
+    pending.push_back(i);
+  }
+
+  // As in Get(), search level-by-level; a key found in a smaller level
+  // is not looked up in later ones.
+  std::vector<FileMetaData*> tmp;
+  std::vector<int> batch;
+  for (int level = 0; level < config::kNumLevels && !pending.empty();
+       level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) continue;
+
+    if (level == 0) {
+      // Level-0 files may overlap each other.  Visit the files that
+      // overlap the pending keys from newest to oldest, passing each one
+      // the keys it may contain that were not found in a newer file.
+      const Slice smallest = keys[pending.front()]->user_key();
+      const Slice largest = keys[pending.back()]->user_key();
+      tmp.clear();
+      for (FileMetaData* f : files) {
+        if (ucmp->Compare(largest, f->smallest.user_key()) >= 0 &&
+            ucmp->Compare(smallest, f->largest.user_key()) <= 0) {
+          tmp.push_back(f);
+        }
+      }
+      std::sort(tmp.begin(), tmp.end(), NewestFirst);
+      for (FileMetaData* f : tmp) {
+        batch.clear();
+        for (int i : pending) {
+          const Slice user_key = keys[i]->user_key();
+          if (!state.done[i] &&
+              ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+              ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+            batch.push_back(i);
+          }
+        }
+        MultiGetFromFile(vset_->table_cache_, options, level, f, batch,
+                         &state);
+      }
+    } else {
+      // Files do not overlap, so the pending keys split into runs that
+      // each fall into a single file.
+      size_t p = 0;
+      while (p < pending.size()) {
+        // Binary search to find earliest index whose largest key >= ikey.
+        uint32_t index =
+            FindFile(vset_->icmp_, files, keys[pending[p]]->internal_key());
+        if (index >= files.size()) {
+          break;  // This key and all later ones are past the last file
+        }
+        FileMetaData* f = files[index];
+        batch.clear();
+        while (p < pending.size() &&
+               vset_->icmp_.Compare(keys[pending[p]]->internal_key(),
+                                    f->largest.Encode()) <= 0) {
+          const int i = pending[p];
+          if (ucmp->Compare(keys[i]->user_key(), f->smallest.user_key()) >=
+              0) {
+            batch.push_back(i);
+          }
+          p++;
+        }
+        MultiGetFromFile(vset_->table_cache_, options, level, f, batch,
+                         &state);
+      }
+    }
+
+    // Drop the keys that were resolved at this level
+    size_t remaining = 0;
+    for (int i : pending) {
+      if (!state.done[i]) {
+        pending[remaining++] = i;
+      }
+    }
+    pending.resize(remaining);
+  }
+
+  // Keys that reached the last level without finding their value
+  for (int i = 0; i < n; i++) {
+    if (!state.done[i]) {
+      statuses[i] = merges[i]->Finish(keys[i]->user_key(), nullptr, vals[i]);
+    }
+  }
 }
 
 // 更新统计信息时，直接将记录的文件的 leveldb::FileMetaData 的 allowed_seeks 减一
@@ -532,6 +848,30 @@ int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
   return level;
 }
 
+static bool AnyBeingCompacted(const std::vector<FileMetaData*>& files) {
+  for (size_t i = 0; i < files.size(); i++) {
+    if (files[i]->being_compacted) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int Version::PickLevelForExternalFile(const Slice& smallest_user_key,
+                                      const Slice& largest_user_key) {
+  int level = 0;
+  if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
+    // A compaction out of "level" may write files that overlap the range
+    // into the next level.
+    while (level + 1 < config::kNumLevels &&
+           !AnyBeingCompacted(files_[level]) &&
+           !OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
+      level++;
+    }
+  }
+  return level;
+}
+
 // Store in "*inputs" all files in "level" that overlap [begin,end]
 void Version::GetOverlappingInputs(int level, const InternalKey* begin,
                                    const InternalKey* end,
@@ -576,6 +916,22 @@ void Version::GetOverlappingInputs(int level, const InternalKey* begin,
   }
 }
 
+Status Version::GetPropertiesOfAllTables(TablePropertiesCollection* props) {
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const FileMetaData* f : files_[level]) {
+      TableProperties table_props;
+      Status s = vset_->table_cache_->GetProperties(f->number, f->file_size,
+                                                    &table_props);
+      if (s.ok()) {
+        (*props)[TableFileName(vset_->dbname_, f->number)] = table_props;
+      } else if (!s.IsNotFound()) {
+        return s;
+      }
+    }
+  }
+  return Status::OK();
+}
+
 std::string Version::DebugString() const {
   std::string r;
   for (int level = 0; level < config::kNumLevels; level++) {
@@ -1073,6 +1429,58 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
   }
 }
 
+bool VersionSet::HasFilesWithoutStats() const {
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (const FileMetaData* f : current_->files_[level]) {
+      if (f->num_entries == 0) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void VersionSet::LoadFileStats(port::Mutex* mu) {
+  mu->AssertHeld();
+  // The version keeps its files alive while *mu is released
+  Version* v = current_;
+  v->Ref();
+  std::vector<FileMetaData*> files;
+  for (int level = 0; level < config::kNumLevels; level++) {
+    for (FileMetaData* f : v->files_[level]) {
+      if (f->num_entries == 0) {
+        files.push_back(f);
+      }
+    }
+  }
+  if (files.empty()) {
+    v->Unref();
+    return;
+  }
+
+  std::vector<TableProperties> props(files.size());
+  std::vector<bool> found(files.size());
+  mu->Unlock();
+  for (size_t i = 0; i < files.size(); i++) {
+    found[i] = table_cache_
+                   ->GetProperties(files[i]->number, files[i]->file_size,
+                                   &props[i], false)
+                   .ok();
+  }
+  mu->Lock();
+
+  for (size_t i = 0; i < files.size(); i++) {
+    if (found[i]) {
+      files[i]->num_entries =
+          props[i].num_entries + props[i].num_range_deletions;
+      files[i]->num_deletions =
+          props[i].num_deletions + props[i].num_range_deletions;
+    }
+  }
+  v->Unref();
+  Finalize(current_);
+}
+
 // levelDB会计算每个level的总的文件大小，并根据此计算出一个score，最后会根据这个score来选择合适level和文件进行Compact.
 void VersionSet::Finalize(Version* v) {
   // Precomputed best level for next compaction
@@ -1093,8 +1501,9 @@ void VersionSet::Finalize(Version* v) {
       // file size is small (perhaps because of a small write-buffer
       // setting, or very high compression ratios, or lots of
       // overwrites/deletions).
-      score = v->files_[level].size() /
-              static_cast<double>(config::kL0_CompactionTrigger);
+      score =
+          v->files_[level].size() /
+          static_cast<double>(options_->level0_file_num_compaction_trigger);
     } else {
       // Compute the ratio of current size to size limit.
       const uint64_t level_bytes = TotalFileSize(v->files_[level]);
@@ -1102,6 +1511,7 @@ void VersionSet::Finalize(Version* v) {
           static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
     }
 
+    v->compaction_scores_[level] = score;
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1110,6 +1520,52 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  // Files that are mostly deletions are compacted even if their level is
+  // small enough, so that the space of the data they delete is reclaimed.
+  v->deletion_compaction_file_ = nullptr;
+  v->deletion_compaction_level_ = -1;
+  if (options_->deletion_compaction_ratio > 0) {
+    double best_ratio = 0;
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      for (FileMetaData* f : v->files_[level]) {
+        if (f->num_entries == 0) {
+          continue;  // Not known
+        }
+        const double ratio =
+            static_cast<double>(f->num_deletions) / f->num_entries;
+        if (ratio >= options_->deletion_compaction_ratio &&
+            ratio > best_ratio) {
+          best_ratio = ratio;
+          v->deletion_compaction_file_ = f;
+          v->deletion_compaction_level_ = level;
+        }
+      }
+    }
+  }
+
+  // Level-0 is compacted in full into level-1.  Data beyond the target
+  // size of a deeper level is merged with the overlapping data of the
+  // next level, which is about as much bigger as the next level is.
+  uint64_t pending_bytes = 0;
+  if (v->files_[0].size() >=
+      static_cast<size_t>(options_->level0_file_num_compaction_trigger)) {
+    pending_bytes += TotalFileSize(v->files_[0]);
+  }
+  for (int level = 1; level < config::kNumLevels - 1; level++) {
+    const uint64_t level_bytes = TotalFileSize(v->files_[level]);
+    const uint64_t max_bytes =
+        static_cast<uint64_t>(MaxBytesForLevel(options_, level));
+    if (level_bytes > max_bytes) {
+      const uint64_t excess = level_bytes - max_bytes;
+      const double next_level_ratio =
+          static_cast<double>(TotalFileSize(v->files_[level + 1])) /
+          level_bytes;
+      pending_bytes +=
+          excess + static_cast<uint64_t>(excess * next_level_ratio);
+    }
+  }
+  v->pending_compaction_bytes_ = pending_bytes;
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1133,7 +1589,7 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *f);
     }
   }
 
@@ -1273,17 +1729,19 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   Iterator** list = new Iterator*[space];
   int num = 0;
   for (int which = 0; which < 2; which++) {
-    if (!c->inputs_[which].empty()) {
+    const std::vector<FileMetaData*>& files =
+        c->skipped_inputs_ ? c->read_inputs_[which] : c->inputs_[which];
+    if (!files.empty()) {
       if (c->level() + which == 0) {
-        const std::vector<FileMetaData*>& files = c->inputs_[which];
         for (size_t i = 0; i < files.size(); i++) {
-          list[num++] = table_cache_->NewIterator(options, files[i]->number,
-                                                  files[i]->file_size);
+          list[num++] = table_cache_->NewIterator(
+              options, files[i]->number, files[i]->file_size, nullptr,
+              files[i]->global_seqno);
         }
       } else {
         // Create concatenating iterator for the files from this level
         list[num++] = NewTwoLevelIterator(
-            new Version::LevelFileNumIterator(icmp_, &c->inputs_[which]),
+            new Version::LevelFileNumIterator(icmp_, &files),
             &GetFileIterator, table_cache_, options);
       }
     }
@@ -1294,44 +1752,97 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   return result;
 }
 
+Status VersionSet::AddRangeTombstones(Compaction* c,
+                                      RangeTombstoneList* list) {
+  Status s;
+  for (int which = 0; which < 2 && s.ok(); which++) {
+    for (size_t i = 0; i < c->inputs_[which].size() && s.ok(); i++) {
+      s = AddFileRangeTombstones(table_cache_, c->level() + which,
+                                 c->inputs_[which][i], list);
+    }
+  }
+  return s;
+}
+
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
+  Compaction* c = nullptr;
 
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {  // 进行size_compaction
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // 查找第一个包含比上次已经compact的最大key大的key的文件
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
-      }
+  // the compactions triggered by seeks.  Levels are tried from the most
+  // to the least urgent, since the best level may be busy with compactions
+  // that are already running.
+  int levels[config::kNumLevels - 1];
+  for (int i = 0; i < config::kNumLevels - 1; i++) {
+    levels[i] = i;
+  }
+  const double* scores = current_->compaction_scores_;
+  std::stable_sort(levels, levels + config::kNumLevels - 1,
+                   [scores](int a, int b) { return scores[a] > scores[b]; });
+  for (int i = 0; i < config::kNumLevels - 1 && c == nullptr; i++) {
+    const int level = levels[i];
+    if (scores[level] < 1) {
+      break;
     }
+    c = PickSizeCompaction(level);
+  }
 
-    // 如果上次已经是最大的key，那么回到第一个文件开始compact
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+  if (c == nullptr && current_->file_to_compact_ != nullptr &&
+      !current_->file_to_compact_->being_compacted) {
+    c = SetupCompaction(current_->file_to_compact_level_,
+                        current_->file_to_compact_);
+  }
+
+  if (c == nullptr && current_->deletion_compaction_file_ != nullptr &&
+      !current_->deletion_compaction_file_->being_compacted) {
+    c = SetupCompaction(current_->deletion_compaction_level_,
+                        current_->deletion_compaction_file_);
+    if (c != nullptr) {
+      c->deletion_triggered_ = true;
+    }
+  }
+
+  if (c != nullptr) {
+    c->MarkInputsBeingCompacted(true);
+  }
+  return c;
+}
+
+Compaction* VersionSet::PickSizeCompaction(int level) {
+  const std::vector<FileMetaData*>& files = current_->files_[level];
+  assert(!files.empty());
+
+  // 查找第一个包含比上次已经compact的最大key大的key的文件
+  // Pick the first file that comes after compact_pointer_[level]
+  size_t start = 0;
+  if (!compact_pointer_[level].empty()) {
+    while (start < files.size() &&
+           icmp_.Compare(files[start]->largest.Encode(),
+                         compact_pointer_[level]) <= 0) {
+      start++;
     }
-  } else if (seek_compaction) { // 进行seek_compaction
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
 
+  // 如果上次已经是最大的key，那么回到第一个文件开始compact
+  // Wrap-around to the beginning of the key space, skipping files that
+  // are used by running compactions.
+  for (size_t i = 0; i < files.size(); i++) {
+    FileMetaData* f = files[(start + i) % files.size()];
+    if (f->being_compacted) {
+      continue;
+    }
+    Compaction* c = SetupCompaction(level, f);
+    if (c != nullptr) {
+      return c;
+    }
+  }
+  return nullptr;
+}
+
+Compaction* VersionSet::SetupCompaction(int level, FileMetaData* f) {
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+  Compaction* c = new Compaction(options_, level);
+  c->inputs_[0].push_back(f);
   c->input_version_ = current_;
   c->input_version_->Ref();
 
@@ -1347,8 +1858,11 @@ Compaction* VersionSet::PickCompaction() {
     assert(!c->inputs_[0].empty());
   }
 
-  SetupOtherInputs(c);  //尝试加入level中新的文件，条件为不再与level+1中新的文件重叠
-
+  //尝试加入level中新的文件，条件为不再与level+1中新的文件重叠
+  if (!SetupOtherInputs(c)) {
+    delete c;
+    return nullptr;
+  }
   return c;
 }
 
@@ -1436,7 +1950,7 @@ void AddBoundaryInputs(const InternalKeyComparator& icmp,
 //      在第level + 1 层中找到和begin至end重叠的文件，并根据这些文件中设置第level + 1 层的begin_和end_
 //      在第level层中找到和begin_至end_重叠的文件，并根据这些文件刷新第level层的begin和end
 //      在第level + 1 层中找到和begin至end重叠的文件，并根据这些文件刷新第level + 1 层的begin_和end_
-void VersionSet::SetupOtherInputs(Compaction* c) {
+bool VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
 
@@ -1448,6 +1962,9 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // 根据重新计算出来的begin和end，去获取根level n+1有重叠的sst文件列表，存入inputs_[1]。
   current_->GetOverlappingInputs(level + 1, &smallest, &largest,
                                  &c->inputs_[1]);
+  if (AnyBeingCompacted(c->inputs_[0]) || AnyBeingCompacted(c->inputs_[1])) {
+    return false;
+  }
 
   // 获取compation涉及的所有数据范围。
   // Get entire range covered by compaction
@@ -1468,7 +1985,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     //level中有新文件加入，且总大小不大于阈值
     if (expanded0.size() > c->inputs_[0].size() &&
         inputs1_size + expanded0_size <
-            ExpandedCompactionByteSizeLimit(options_)) {
+            ExpandedCompactionByteSizeLimit(options_) &&
+        !AnyBeingCompacted(expanded0)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
@@ -1476,7 +1994,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
       current_->GetOverlappingInputs(level + 1, &new_start, &new_limit,
                                      &expanded1);
       //如果level+1中无新的文件加入，设置为新的inputs和范围
-      if (expanded1.size() == c->inputs_[1].size()) {
+      if (expanded1.size() == c->inputs_[1].size() &&
+          !AnyBeingCompacted(expanded1)) {
         Log(options_->info_log,
             "Expanding@%d %d+%d (%ld+%ld bytes) to %d+%d (%ld+%ld bytes)\n",
             level, int(c->inputs_[0].size()), int(c->inputs_[1].size()),
@@ -1506,6 +2025,7 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // key range next time.
   compact_pointer_[level] = largest.Encode().ToString();
   c->edit_.SetCompactPointer(level, largest);
+  return true;
 }
 
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
@@ -1539,7 +2059,10 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   c->input_version_ = current_;
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
-  SetupOtherInputs(c);
+  const bool ok = SetupOtherInputs(c);
+  assert(ok);
+  (void)ok;
+  c->MarkInputsBeingCompacted(true);
   return c;
 }
 
@@ -1547,6 +2070,9 @@ Compaction::Compaction(const Options* options, int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
+      inputs_marked_(false),
+      deletion_triggered_(false),
+      skipped_inputs_(false),
       grandparent_index_(0),
       seen_key_(false),
       overlapped_bytes_(0) {
@@ -1555,11 +2081,7 @@ Compaction::Compaction(const Options* options, int level)
   }
 }
 
-Compaction::~Compaction() {
-  if (input_version_ != nullptr) {
-    input_version_->Unref();
-  }
-}
+Compaction::~Compaction() { ReleaseInputs(); }
 
 //level中的输入文件与level+1中无重叠，
 //且与level + 2中重叠不大于MaxGrandParentOverlapBytes = 10 * kTargetFileSize,直接将文件移到level+1中，这是为了保证下次compaction level L+1的时候不会选择太多的 level L+2中的文件
@@ -1569,7 +2091,8 @@ bool Compaction::IsTrivialMove() const {
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
   // 第level层上要compaction的文件数为1
-  return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
+  return (!deletion_triggered_ && num_input_files(0) == 1 &&
+          num_input_files(1) == 0 &&
           TotalFileSize(grandparents_) <=
               MaxGrandParentOverlapBytes(vset->options_));
 }
@@ -1603,6 +2126,34 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+bool Compaction::IsBaseLevelForRange(const Slice& begin, const Slice& end) {
+  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int Compaction::SkipCoveredInputs(RangeTombstoneList* range_del,
+                                  SequenceNumber snapshot) {
+  int skipped = 0;
+  for (int which = 0; which < 2; which++) {
+    read_inputs_[which].clear();
+    for (FileMetaData* f : inputs_[which]) {
+      if (range_del->CoversRange(f->smallest.user_key(),
+                                 f->largest.user_key(), f->largest_seqno,
+                                 snapshot)) {
+        skipped++;
+      } else {
+        read_inputs_[which].push_back(f);
+      }
+    }
+  }
+  skipped_inputs_ = (skipped > 0);
+  return skipped;
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
@@ -1627,8 +2178,95 @@ bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   }
 }
 
+void Compaction::GetSubcompactionBoundaries(
+    int n, std::vector<std::string>* boundaries) {
+  const VersionSet* vset = input_version_->vset_;
+  const InternalKeyComparator& icmp = vset->icmp_;
+  const Comparator* user_cmp = icmp.user_comparator();
+
+  // Candidate boundaries are the largest user keys of the input files.
+  std::vector<Slice> candidates;
+  uint64_t total_bytes = 0;
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      candidates.push_back(inputs_[which][i]->largest.user_key());
+      total_bytes += inputs_[which][i]->file_size;
+    }
+  }
+  const uint64_t max_ranges = total_bytes / max_output_file_size_;
+  if (max_ranges < static_cast<uint64_t>(n)) {
+    n = static_cast<int>(max_ranges);
+  }
+  if (n <= 1) {
+    return;
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [user_cmp](const Slice& a, const Slice& b) {
+              return user_cmp->Compare(a, b) < 0;
+            });
+
+  int next_range = 1;
+  for (size_t k = 0; k + 1 < candidates.size() && next_range < n; k++) {
+    if (!boundaries->empty() &&
+        user_cmp->Compare(candidates[k], boundaries->back()) == 0) {
+      continue;
+    }
+
+    // Approximate number of input bytes before the candidate.
+    InternalKey ikey(candidates[k], kMaxSequenceNumber, kValueTypeForSeek);
+    uint64_t offset = 0;
+    for (int which = 0; which < 2; which++) {
+      for (size_t i = 0; i < inputs_[which].size(); i++) {
+        FileMetaData* f = inputs_[which][i];
+        if (icmp.Compare(f->largest, ikey) <= 0) {
+          offset += f->file_size;
+        } else if (icmp.Compare(f->smallest, ikey) < 0) {
+          Table* tableptr;
+          Iterator* iter = vset->table_cache_->NewIterator(
+              ReadOptions(), f->number, f->file_size, &tableptr);
+          if (tableptr != nullptr) {
+            offset += tableptr->ApproximateOffsetOf(ikey.Encode());
+          }
+          delete iter;
+        }
+      }
+    }
+
+    if (offset >= total_bytes * next_range / n) {
+      boundaries->push_back(candidates[k].ToString());
+      while (next_range < n && offset >= total_bytes * next_range / n) {
+        next_range++;
+      }
+    }
+  }
+}
+
+Compaction* Compaction::NewSubcompaction() {
+  Compaction* c = new Compaction(input_version_->vset_->options_, level_);
+  c->input_version_ = input_version_;
+  c->input_version_->Ref();
+  c->inputs_[0] = inputs_[0];
+  c->inputs_[1] = inputs_[1];
+  c->grandparents_ = grandparents_;
+  return c;
+}
+
+void Compaction::MarkInputsBeingCompacted(bool value) {
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      assert(inputs_[which][i]->being_compacted != value);
+      inputs_[which][i]->being_compacted = value;
+    }
+  }
+  inputs_marked_ = value;
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != nullptr) {
+    // The input files may be freed once the input version is unreferenced.
+    if (inputs_marked_) {
+      MarkInputsBeingCompacted(false);
+    }
     input_version_->Unref();
     input_version_ = nullptr;
   }
@@ -33,6 +33,8 @@ class Writer;
 class Compaction;
 class Iterator;
 class MemTable;
+class MergeContext;
+class RangeTombstoneList;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -89,8 +91,23 @@ class Version {
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Add the range tombstones of every file of this Version to *list.
+  Status AddRangeTombstones(RangeTombstoneList* list);
+
+  // The lookup goes on past the merge operands for key, which are added
+  // to *merge; the result is then set by merge->Finish().
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, MergeContext* merge);
+
+  // Like Get() for each of the "n" keys in "keys[]", which must be sorted
+  // by user key.  Stores the result for keys[i] in *vals[i] and
+  // statuses[i], collecting its merge operands in *merges[i].  Keys that
+  // may live in the same file are looked up in that file together.
+  // Fills *stats.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, int n, const LookupKey* const* keys,
+                std::string* const* vals, MergeContext* const* merges,
+                Status* statuses, GetStats* stats);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -121,6 +138,13 @@ class Version {
   bool OverlapInLevel(int level, const Slice* smallest_user_key,
                       const Slice* largest_user_key);
 
+  // Return the deepest level at which an ingested file that covers the
+  // range [smallest_user_key,largest_user_key] can be placed: no file in
+  // that level or above overlaps the range, and no running compaction
+  // writes into one of them.
+  int PickLevelForExternalFile(const Slice& smallest_user_key,
+                               const Slice& largest_user_key);
+
   // Return the level at which we should place a new memtable compaction
   // result that covers the range [smallest_user_key,largest_user_key].
   int PickLevelForMemTableOutput(const Slice& smallest_user_key,
@@ -128,6 +152,10 @@ class Version {
 
   int NumFiles(int level) const { return files_[level].size(); }
 
+  // Store in *props the properties of every table of this version, by
+  // file name.  Tables written without properties are left out.
+  Status GetPropertiesOfAllTables(TablePropertiesCollection* props);
+
   // Return a human readable string that describes this version's contents.
   std::string DebugString() const;
 
@@ -144,8 +172,15 @@ class Version {
         refs_(0),
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
+        deletion_compaction_file_(nullptr),
+        deletion_compaction_level_(-1),
         compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_level_(-1),
+        pending_compaction_bytes_(0) {
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      compaction_scores_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -174,12 +209,25 @@ class Version {
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
+  // The file with the largest share of deletions, if it reaches
+  // options.deletion_compaction_ratio.  Initialized by Finalize().
+  FileMetaData* deletion_compaction_file_;
+  int deletion_compaction_level_;
+
   // Level that should be compacted next and its compaction score.
   // Score < 1 means compaction is not strictly needed.  These fields
   // are initialized by Finalize().
   // 用于size_compation
   double compaction_score_;
   int compaction_level_;
+
+  // Compaction score of every level that can be compacted.  Used to find
+  // another level to compact when the best one is busy.
+  double compaction_scores_[config::kNumLevels - 1];
+
+  // Estimate of the bytes that compactions have to rewrite to bring every
+  // level within its target size.  Initialized by Finalize().
+  uint64_t pending_compaction_bytes_;
 };
 
 // 生成新的版本时，旧版本不能扔掉，因为旧版本可能还在提供读服务。新的版本会被添加到双向链表的末尾，当旧的版本不再服务读请求之后，就会从循环双向链表中移除
@@ -251,12 +299,17 @@ class VersionSet {
   // Returns nullptr if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
+  //
+  // Several compactions may run at once: files used by a compaction that
+  // has not been deleted yet are never picked as inputs again.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
   // the result.
+  //
+  // REQUIRES: no other compaction is running.
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
 
@@ -268,11 +321,32 @@ class VersionSet {
   // The caller should delete the iterator when no longer needed.
   Iterator* MakeInputIterator(Compaction* c);
 
+  // Add the range tombstones of the input files of "*c" to *list.
+  Status AddRangeTombstones(Compaction* c, RangeTombstoneList* list);
+
   // Returns true iff some level needs a compaction.
   // 检查是否需要进行seek compaction 或者 size compaction
   bool NeedsCompaction() const {
     Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
+    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr) ||
+           (v->deletion_compaction_file_ != nullptr);
+  }
+
+  // Load the entry counts of the files of the current version that do not
+  // have them, i.e. that were added to the MANIFEST before it recorded
+  // them, from the table properties.  They are used to find files that
+  // hold mostly deletions.  Releases *mu while reading the tables, which
+  // does not fill the table cache.
+  void LoadFileStats(port::Mutex* mu) EXCLUSIVE_LOCKS_REQUIRED(mu);
+
+  // Are there files in the current version whose entry counts are not
+  // known?
+  bool HasFilesWithoutStats() const;
+
+  // Return an estimate of the bytes that compactions have to rewrite to
+  // bring every level of the current version within its target size.
+  uint64_t EstimatedPendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
   }
 
   // Add all files listed in any live version to *live.
@@ -308,7 +382,18 @@ class VersionSet {
                  const std::vector<FileMetaData*>& inputs2,
                  InternalKey* smallest, InternalKey* largest);
 
-  void SetupOtherInputs(Compaction* c);
+  // Pick a size compaction of "level", starting with the first file after
+  // compact_pointer_[level] that no running compaction is using.  Returns
+  // nullptr if every candidate would share files with a running compaction.
+  Compaction* PickSizeCompaction(int level);
+
+  // Build a compaction of "level" that starts with "f".  Returns nullptr if
+  // the compaction would share files with a running compaction.
+  Compaction* SetupCompaction(int level, FileMetaData* f);
+
+  // Returns false, without updating compact_pointer_, if the inputs of
+  // "*c" would include a file that is being compacted.
+  bool SetupOtherInputs(Compaction* c);
 
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
@@ -372,12 +457,36 @@ class Compaction {
   // in levels greater than "level+1".
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Like IsBaseLevelForKey() for every key in [begin, end].  Unlike it, may
+  // be called for ranges in any order.
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end);
+
+  // Leave out of the iterator built by MakeInputIterator() the input files
+  // whose entries are all deleted by tombstones in *range_del that every
+  // snapshot at or after "snapshot" sees.  The files are still deleted by
+  // AddInputDeletions().  Returns the number of files left out.
+  int SkipCoveredInputs(RangeTombstoneList* range_del,
+                        SequenceNumber snapshot);
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
 
+  // Split the key range of this compaction into at most "n" ranges that
+  // hold similar amounts of input data, and at least MaxOutputFileSize()
+  // bytes each.  Stores the user keys that start the second and later
+  // ranges in *boundaries, in increasing order.
+  void GetSubcompactionBoundaries(int n, std::vector<std::string>* boundaries);
+
+  // Return a compaction with the same inputs as this one, to be run by one
+  // of several threads that each process part of its key range.  The
+  // result keeps its own output splitting and IsBaseLevelForKey() state.
+  // Caller should delete the result.
+  Compaction* NewSubcompaction();
+
   // Release the input version for the compaction, once the compaction
-  // is successful.
+  // is successful.  Also makes the input files available to other
+  // compactions again.
   void ReleaseInputs();
 
  private:
@@ -386,6 +495,9 @@ class Compaction {
 
   Compaction(const Options* options, int level);
 
+  // Set the being_compacted flag of every input file to "value".
+  void MarkInputsBeingCompacted(bool value);
+
   int level_;
   uint64_t max_output_file_size_;
   Version* input_version_;
@@ -393,6 +505,15 @@ class Compaction {
 
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
+  bool inputs_marked_;  // Are the inputs marked as being compacted?
+
+  // Picked to drop deletions: the inputs must be rewritten, not moved
+  bool deletion_triggered_;
+
+  // The inputs that are read by MakeInputIterator(), if some were left out
+  // by SkipCoveredInputs()
+  std::vector<FileMetaData*> read_inputs_[2];
+  bool skipped_inputs_;
 
   // State used to check for number of overlapping grandparent files
   // (parent == level_ + 1, grandparent == level_ + 2)
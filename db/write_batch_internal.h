@@ -38,6 +38,14 @@ class WriteBatchInternal {
 
   static Status InsertInto(const WriteBatch* batch, MemTable* memtable);
 
+  // Like InsertInto(), but other threads may be inserting other batches
+  // into the same memtable with InsertIntoConcurrently() at the same time.
+  // The entries are numbered from "sequence" rather than from the sequence
+  // number in the header of "batch", which may belong to a caller.
+  static Status InsertIntoConcurrently(const WriteBatch* batch,
+                                       SequenceNumber sequence,
+                                       MemTable* memtable);
+
   static void Append(WriteBatch* dst, const WriteBatch* src);
 };
 
@@ -0,0 +1,31 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+namespace leveldb {
+
+WriteController::WriteController() : rate_(0), refilled_micros_(0) {}
+
+void WriteController::SetDelayedWriteRate(uint64_t bytes_per_second) {
+  if (rate_ == 0) {
+    // Start with a full bucket.
+    refilled_micros_ = 0;
+  }
+  rate_ = bytes_per_second;
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros, uint64_t bytes) {
+  if (rate_ == 0) {
+    return 0;
+  }
+  if (refilled_micros_ + kMaxBurstMicros < now_micros) {
+    // The bucket is full; tokens beyond its capacity are lost.
+    refilled_micros_ = now_micros - kMaxBurstMicros;
+  }
+  refilled_micros_ += bytes * 1000000 / rate_;
+  return refilled_micros_ > now_micros ? refilled_micros_ - now_micros : 0;
+}
+
+}  // namespace leveldb
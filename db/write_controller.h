@@ -0,0 +1,53 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <stdint.h>
+
+namespace leveldb {
+
+// WriteController paces writes while compactions are falling behind.
+// Writes are admitted through a token bucket that refills at the delayed
+// write rate.  A write that finds the bucket empty has to wait until
+// enough tokens have accumulated for it.  Small writes that follow a
+// quiet period are admitted without delay.
+//
+// WriteController is not thread-safe; the DB uses it under its mutex.
+class WriteController {
+ public:
+  WriteController();
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // Set the rate, in bytes per second, at which writes are admitted.
+  // Zero stops delaying writes.
+  void SetDelayedWriteRate(uint64_t bytes_per_second);
+
+  // Return the current rate, or zero if writes are not delayed.
+  uint64_t delayed_write_rate() const { return rate_; }
+
+  bool IsDelayed() const { return rate_ > 0; }
+
+  // Charge a write of "bytes" at time "now_micros" against the bucket and
+  // return the number of microseconds the writer should wait before
+  // applying it.
+  uint64_t GetDelay(uint64_t now_micros, uint64_t bytes);
+
+ private:
+  // Tokens held by a full bucket, measured in microseconds of refill.
+  static const uint64_t kMaxBurstMicros = 1000;
+
+  uint64_t rate_;
+
+  // Time at which the bucket will have refilled the tokens of every write
+  // charged so far.
+  uint64_t refilled_micros_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
@@ -0,0 +1,54 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class WriteControllerTest {};
+
+TEST(WriteControllerTest, NotDelayed) {
+  WriteController controller;
+  ASSERT_TRUE(!controller.IsDelayed());
+  ASSERT_EQ(0, controller.GetDelay(1000000, 1 << 20));
+  ASSERT_EQ(0, controller.GetDelay(1000000, 1 << 20));
+}
+
+TEST(WriteControllerTest, Rate) {
+  WriteController controller;
+  controller.SetDelayedWriteRate(1000000);
+  ASSERT_TRUE(controller.IsDelayed());
+  ASSERT_EQ(1000000, controller.delayed_write_rate());
+
+  // A full bucket admits 1ms worth of writes at once.
+  const uint64_t now = 5000000;
+  ASSERT_EQ(0, controller.GetDelay(now, 1000));
+  ASSERT_EQ(1000, controller.GetDelay(now, 1000));
+  ASSERT_EQ(3000, controller.GetDelay(now, 2000));
+
+  // Waiting as told keeps the writer on schedule.
+  ASSERT_EQ(1000, controller.GetDelay(now + 3000, 1000));
+
+  // The bucket refills while there are no writes.
+  ASSERT_EQ(0, controller.GetDelay(now + 1000000, 1000));
+}
+
+TEST(WriteControllerTest, ChangeRate) {
+  WriteController controller;
+  controller.SetDelayedWriteRate(1000000);
+  const uint64_t now = 5000000;
+  ASSERT_EQ(0, controller.GetDelay(now, 1000));
+  controller.SetDelayedWriteRate(500000);
+  ASSERT_EQ(2000, controller.GetDelay(now, 1000));
+
+  controller.SetDelayedWriteRate(0);
+  ASSERT_TRUE(!controller.IsDelayed());
+  ASSERT_EQ(0, controller.GetDelay(now, 1000));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -333,6 +333,8 @@ class InMemoryEnv : public EnvWrapper {
 
   Status DeleteDir(const std::string& dirname) override { return Status::OK(); }
 
+  Status SyncDir(const std::string& dirname) override { return Status::OK(); }
+
   Status GetFileSize(const std::string& fname, uint64_t* file_size) override {
     MutexLock lock(&mutex_);
     if (file_map_.find(fname) == file_map_.end()) {
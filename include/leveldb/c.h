@@ -97,6 +97,15 @@ LEVELDB_EXPORT char* leveldb_get(leveldb_t* db,
                                  const char* key, size_t keylen, size_t* vallen,
                                  char** errptr);
 
+/* Looks up num_keys keys at once.  For each key i, values_list[i] is set
+   to NULL if the key is not found, or else to a malloc()ed array whose
+   length is stored in values_list_sizes[i].  errs[i] is set to NULL, or
+   to a malloc()ed error message if the lookup of key i failed. */
+LEVELDB_EXPORT void leveldb_multi_get(
+    leveldb_t* db, const leveldb_readoptions_t* options, size_t num_keys,
+    const char* const* keys_list, const size_t* keys_list_sizes,
+    char** values_list, size_t* values_list_sizes, char** errs);
+
 LEVELDB_EXPORT leveldb_iterator_t* leveldb_create_iterator(
     leveldb_t* db, const leveldb_readoptions_t* options);
 
@@ -28,9 +28,35 @@ namespace leveldb {
 class LEVELDB_EXPORT Cache;
 
 // Create a new cache with a fixed size capacity.  This implementation
-// of Cache uses a least-recently-used eviction policy.
+// of Cache uses a least-recently-used eviction policy.  Same as
+// NewLRUCache(capacity, 0.5, false).
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Create a new LRU cache that is resistant to scans.  Up to
+// "high_pri_pool_ratio" of its capacity is a pool for the entries inserted
+// with Cache::Priority::kHigh and for those looked up again after their
+// insertion.  Other entries are inserted in the middle of the LRU list,
+// below the pool, so a scan that reads each entry once only evicts the
+// entries that nobody read twice either.  A ratio of 0 gives plain LRU.
+//
+// If "admission_filter" is true, the cache also estimates how often each
+// key is looked up, and when a new entry of low priority would evict
+// others, it is only cached if its key was looked up more often of late
+// than that of the least recently used entry (TinyLFU).  This keeps
+// entries read once out of the cache entirely, at the cost of a second
+// miss before a newly hot key gets cached.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio,
+                                  bool admission_filter);
+
+// Create a new cache with a fixed size capacity.  This implementation
+// evicts with the CLOCK algorithm, and its Lookup() and Release() take no
+// lock, so it scales better than the LRU cache with many concurrent
+// readers.  Its hash tables are sized for entries with a charge of about
+// "estimated_entry_charge" (e.g. Options::block_size for a block cache),
+// and it evicts before reaching capacity if the entries are much smaller.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity,
+                                   size_t estimated_entry_charge = 4096);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -45,6 +71,11 @@ class LEVELDB_EXPORT Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle {};
 
+  // When the cache is full, entries of low priority are evicted in
+  // preference to those of high priority, e.g. an LRU cache keeps the latter
+  // in its high-priority pool (see NewLRUCache()).
+  enum class Priority { kHigh, kLow };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -59,6 +90,14 @@ class LEVELDB_EXPORT Cache {
                          size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert(), with the given priority instead of Priority::kLow.  The
+  // default implementation ignores the priority.
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
+    return Insert(key, value, charge, deleter);
+  }
+
   // If the cache has no mapping for "key", returns nullptr.
   //
   // Else return a handle that corresponds to the mapping.  The caller
@@ -0,0 +1,47 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A CompactionFilter lets an application drop or rewrite values while
+// compactions are copying them anyway, e.g. to expire entries after a
+// time to live, or to garbage collect data it no longer references,
+// without scanning the database and writing deletions.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT CompactionFilter {
+ public:
+  enum Decision {
+    kKeep,         // Keep the entry unchanged
+    kRemove,       // Delete the key
+    kChangeValue,  // Replace the value by *new_value
+  };
+
+  virtual ~CompactionFilter();
+
+  // The name of the filter.  Used in log messages.
+  virtual const char* Name() const = 0;
+
+  // Called for each value that a compaction of "level" into level+1
+  // copies and that no snapshot can see, so that the decision does not
+  // change what existing snapshots read.  Removed keys read as deleted,
+  // even if older values survive in deeper levels.  Merge operands and
+  // the values compactions build from them are not passed to the filter.
+  //
+  // Compactions run on background threads, several of them at the same
+  // time, so the filter must be thread-safe.
+  virtual Decision Filter(int level, const Slice& key, const Slice& value,
+                          std::string* new_value) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
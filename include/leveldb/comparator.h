@@ -54,6 +54,13 @@ class LEVELDB_EXPORT Comparator {
   // Simple comparator implementations may return with *key unchanged,
   // i.e., an implementation of this method that does nothing is correct.
   virtual void FindShortSuccessor(std::string* key) const = 0;
+
+  // Returns the part of "key" that the hash index of data blocks is built
+  // on (see Options::data_block_index_type).  Point lookups in a table only
+  // look for entries whose HashKey() equals that of the lookup key, so the
+  // keys with a given HashKey() must be contiguous, and keys that compare
+  // equal must have identical hash keys.  Returns "key" by default.
+  virtual Slice HashKey(const Slice& key) const;
 };
 
 // Return a builtin comparator that uses lexicographic byte-wise
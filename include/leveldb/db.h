@@ -8,9 +8,13 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <string>
+#include <vector>
+
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/table_properties.h"
 
 namespace leveldb {
 
@@ -72,11 +76,42 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for all keys in the range
+  // ["begin", "end").  Returns OK on success, and a non-OK status on error.
+  // Nothing is removed if "begin" equals "end"; it is an error if "end"
+  // sorts before "begin".  The cost of the call does not depend on the
+  // number of keys in the range: the range is recorded as a single entry,
+  // and the data it hides is dropped by later compactions.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options, const Slice& begin,
+                             const Slice& end);
+
+  // Combine "value" with the current value of "key", using
+  // Options::merge_operator, without reading it first.  Returns OK on
+  // success, and a non-OK status on error; NotSupported if the database
+  // has no merge operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options, const Slice& key,
+                       const Slice& value);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
   virtual Status Write(const WriteOptions& options, WriteBatch* updates) = 0;
 
+  // Add the table files named in "files", built with SstFileWriter, to the
+  // database in a single atomic step.  The files may not overlap each
+  // other.  All of their entries are given the same new sequence number,
+  // which makes them newer than every earlier write.  Each file is placed
+  // at the deepest level where nothing above it overlaps its key range, so
+  // it is not rewritten by the compactions that regular writes go through.
+  //
+  // The files are copied into the database directory, or moved there if
+  // options.move_files is set.  Returns OK on success, and a non-OK status
+  // on error, in which case the database is left unchanged.
+  virtual Status IngestExternalFile(const std::vector<std::string>& files,
+                                    const IngestExternalFileOptions& options);
+
   // If the database contains an entry for "key" store the
   // corresponding value in *value and return OK.
   //
@@ -87,6 +122,16 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Look up the "n" keys in "keys[]" as of a single point in time.  For
+  // each i, statuses[i] and values[i] are set as Get(options, keys[i],
+  // &values[i]) would set them.
+  //
+  // This is cheaper than n separate calls to Get(): the DB state is
+  // acquired once, and keys that fall into the same table file are
+  // looked up together.
+  virtual void MultiGet(const ReadOptions& options, int n, const Slice* keys,
+                        std::string* values, Status* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -121,6 +166,15 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.estimate-pending-compaction-bytes" - returns the estimated
+  //     number of bytes compactions have to rewrite to bring every level
+  //     within its target size.
+  //  "leveldb.actual-delayed-write-rate" - returns the rate, in bytes per
+  //     second, at which writes are currently admitted, or 0 if writes are
+  //     not slowed down.
+  //  "leveldb.write-stall-micros" - returns the total number of
+  //     microseconds writes have been delayed or stopped waiting for
+  //     flushes and compactions.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -134,6 +188,12 @@ class LEVELDB_EXPORT DB {
   virtual void GetApproximateSizes(const Range* range, int n,
                                    uint64_t* sizes) = 0;
 
+  // Store in *props the properties of every table file of the database,
+  // by file name, as of a single point in time.  Returns OK on success,
+  // and a non-OK status on error.  Tables written by versions that did not
+  // store properties are left out.
+  virtual Status GetPropertiesOfAllTables(TablePropertiesCollection* props);
+
   // Compact the underlying storage for the key range [*begin,*end].
   // In particular, deleted and overwritten versions are discarded,
   // and the data is rearranged to reduce the cost of operations
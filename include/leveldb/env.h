@@ -54,6 +54,10 @@ class WritableFile;
 
 class LEVELDB_EXPORT Env {
  public:
+  // Background work is run by separate thread pools for each priority, so
+  // that HIGH priority work never waits behind LOW priority work.
+  enum Priority { LOW, HIGH };
+
   Env() = default;
 
   Env(const Env&) = delete;
@@ -134,6 +138,12 @@ class LEVELDB_EXPORT Env {
   // Delete the specified directory.
   virtual Status DeleteDir(const std::string& dirname) = 0;
 
+  // Make the files created in, or renamed into, the specified directory
+  // durable, so that their names survive a crash.
+  //
+  // The default implementation does nothing and returns OK.
+  virtual Status SyncDir(const std::string& dirname);
+
   // Store the size of fname in *file_size.
   virtual Status GetFileSize(const std::string& fname, uint64_t* file_size) = 0;
 
@@ -170,6 +180,25 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Like Schedule(function, arg), but runs "(*function)(arg)" in the
+  // thread pool for "pri".  Schedule(function, arg) uses the LOW pool.
+  //
+  // The default implementation ignores "pri" and calls
+  // Schedule(function, arg).
+  virtual void Schedule(void (*function)(void* arg), void* arg, Priority pri);
+
+  // Set the number of threads in the background thread pool for "pri".
+  // Each pool starts out with one thread.
+  //
+  // The default implementation does nothing.
+  virtual void SetBackgroundThreads(int number, Priority pri);
+
+  // Return true if work scheduled for the HIGH pool runs apart from the
+  // work of the LOW pool, i.e. never waits for LOW work to finish.
+  //
+  // The default implementation returns false.
+  virtual bool HasPriorityPools();
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -344,6 +373,9 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   Status DeleteDir(const std::string& d) override {
     return target_->DeleteDir(d);
   }
+  Status SyncDir(const std::string& d) override {
+    return target_->SyncDir(d);
+  }
   Status GetFileSize(const std::string& f, uint64_t* s) override {
     return target_->GetFileSize(f, s);
   }
@@ -357,6 +389,13 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void Schedule(void (*f)(void*), void* a, Priority pri) override {
+    return target_->Schedule(f, a, pri);
+  }
+  void SetBackgroundThreads(int number, Priority pri) override {
+    return target_->SetBackgroundThreads(number, pri);
+  }
+  bool HasPriorityPools() override { return target_->HasPriorityPools(); }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
@@ -50,6 +50,20 @@ class LEVELDB_EXPORT FilterPolicy {
   // This method may return true or false if the key was not on the
   // list, but it should aim to return false with a high probability.
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const = 0;
+
+  // Like CreateFilter(), for a filter that must in addition match the
+  // prefixes[0,m-1] of the keys (see Options::prefix_extractor) when they
+  // are passed to PrefixMayMatch().  The default implementation adds the
+  // prefixes to the filter as if they were keys.
+  virtual void CreateFilterWithPrefixes(const Slice* keys, int n,
+                                        const Slice* prefixes, int m,
+                                        std::string* dst) const;
+
+  // "filter" contains the data appended by a preceding call to
+  // CreateFilterWithPrefixes().  This method must return true if "prefix"
+  // was in the list of prefixes passed to it.  The default implementation
+  // calls KeyMayMatch(prefix, filter).
+  virtual bool PrefixMayMatch(const Slice& prefix, const Slice& filter) const;
 };
 
 // Return a new filter policy that uses a bloom filter with approximately
@@ -68,6 +82,30 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Like NewBloomFilterPolicy(), but each key is looked up in a single
+// 64-byte block of the filter instead of all over it, so a lookup costs
+// one cache miss instead of up to one per probe.  The false positive rate
+// is slightly higher for the same number of bits per key.  The probes are
+// computed with AVX2 when the library is built for it.
+//
+// The filters of both policies have the same name and each policy reads
+// the filters of the other, so a database can switch from one to the
+// other without losing the filters of its existing tables.
+//
+// The same caveats as for NewBloomFilterPolicy() apply.
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(
+    int bits_per_key);
+
+// Return a new filter policy that uses binary fuse filters, which have about
+// the false positive rate of a bloom filter with "bits_per_key" bits per key
+// but take ~20-30% less space.  A lookup reads three places in the filter
+// and does not depend on the number of bits.  Building a filter costs more
+// than building a bloom filter.  Its filters are not readable by the bloom
+// filter policies, and vice versa.
+//
+// The same caveats as for NewBloomFilterPolicy() apply.
+LEVELDB_EXPORT const FilterPolicy* NewBinaryFuseFilterPolicy(int bits_per_key);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
@@ -0,0 +1,51 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator turns read-modify-write sequences, such as incrementing
+// a counter or appending to a list, into blind writes.  DB::Merge() stores
+// an operand for a key without reading it.  The operands are combined
+// with the value they apply to when the key is read, and during
+// compactions.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // The name of the operator.  The database does not check it, but it
+  // should identify the encoding of the operands.
+  virtual const char* Name() const = 0;
+
+  // Apply "operands", ordered from the oldest to the newest, to the value
+  // of "key".  "existing_value" is nullptr if the key has no value: it was
+  // never written, or deleted before the first operand.  Store the result
+  // in *new_value and return true, or return false if the operands cannot
+  // be applied, which reads and compactions report as a corruption.
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+
+  // Combine the operands "left" and "right", written in that order, into
+  // a single operand that has the same effect as both of them, and return
+  // true.  Return false if that is not possible.  Compactions use this to
+  // shrink the operands of keys whose value is in another file.
+  //
+  // The default implementation returns false.
+  virtual bool PartialMerge(const Slice& key, const Slice& left,
+                            const Slice& right, std::string* new_value) const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
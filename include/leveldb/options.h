@@ -6,17 +6,23 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include "leveldb/export.h"
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
+class SecondaryCache;
+class SliceTransform;
 class Snapshot;
+class TablePropertiesCollectorFactory;
 
 // DB contents are stored in a set of blocks, each of which holds a
 // sequence of key,value pairs.  Each block may be compressed before
@@ -29,6 +35,33 @@ enum CompressionType {
   kSnappyCompression = 0x1
 };
 
+// How the filters of a table are laid out, if there is a filter policy.
+enum FilterBlockType {
+  // One filter for every 2KB of data blocks.  Finding the filter to check
+  // requires an index lookup, and the whole filter block of a table is
+  // kept in memory.
+  kBlockBasedFilter = 0x0,
+  // A single filter over all the keys of the table, checked before the
+  // index.  Kept in memory.
+  kFullFilter = 0x1,
+  // One filter per index partition, under a small top-level index.  Only
+  // the top-level index is kept in memory; the partitions are read on
+  // demand through the block cache.  Behaves like kFullFilter if
+  // index_partition_size is zero.
+  kPartitionedFilter = 0x2
+};
+
+// How point lookups find their entry within a data block.
+enum DataBlockIndexType {
+  // Binary search over the restart points of the block
+  kDataBlockBinarySearch = 0x0,
+  // A hash index of the keys of the block, appended after its restart
+  // points, maps each key to its restart point.  Falls back to binary
+  // search for keys that share a bucket, and for blocks with more than
+  // 253 restart points, which get no index.
+  kDataBlockBinaryAndHash = 0x1
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct LEVELDB_EXPORT Options {
   // Create an Options object with default values for all fields.
@@ -75,13 +108,26 @@ struct LEVELDB_EXPORT Options {
   // on disk) before converting to a sorted on-disk file.
   //
   // Larger values increase performance, especially during bulk loads.
-  // Up to two write buffers may be held in memory at the same time,
-  // so you may wish to adjust this parameter to control memory usage.
+  // Up to max_write_buffer_number write buffers may be held in memory at
+  // the same time, so you may wish to adjust this parameter to control
+  // memory usage.
   // Also, a larger write buffer will result in a longer recovery time 即缓存空间越大，那么就会越晚储满，自然就会越晚刷新到磁盘上
   // the next time the database is opened.
   // 内存中任意时刻都有两个table，一个是可读可写的mutable memtable，另一个是只可读的immutable memtable。一旦mutable memtable的大小超过write_buffer_size时，就会转化为immutable memtable，启动保存到磁盘，并开启另外一个table当做新的mutable memtable
   size_t write_buffer_size = 4 * 1024 * 1024;
 
+  // Maximum number of write buffers held in memory, counting the one that
+  // is being written to.  Full write buffers wait in memory until they are
+  // flushed to disk; writes stop only when all of them are full.  Larger
+  // values absorb longer bursts of writes without stalls.
+  int max_write_buffer_number = 2;
+
+  // Minimum number of full write buffers that are flushed together.  Full
+  // write buffers are merged into a single level-0 table, so a value above
+  // one produces fewer, larger level-0 files at the cost of memory.
+  // Must be less than max_write_buffer_number.
+  int min_write_buffer_number_to_merge = 1;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -96,6 +142,15 @@ struct LEVELDB_EXPORT Options {
   // 每个table都有一个block_cache
   Cache* block_cache = nullptr;
 
+  // If non-null, data blocks evicted from block_cache spill to this cache,
+  // e.g. one that holds them compressed (NewCompressedSecondaryCache()),
+  // and reads that miss block_cache look for them there before reading the
+  // table file.  Blocks still in block_cache when it is deleted spill as
+  // well, so the secondary cache must outlive block_cache.
+  //
+  // Default: nullptr
+  SecondaryCache* secondary_cache = nullptr;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -108,6 +163,47 @@ struct LEVELDB_EXPORT Options {
   // leave this parameter alone.
   int block_restart_interval = 16;
 
+  // Index type of the data blocks written from now on.  A hash index
+  // speeds up Get() on cached blocks, for about a byte per key.  Blocks
+  // are read correctly whatever their index type.
+  //
+  // The hash index matches keys byte for byte (see Comparator::HashKey()),
+  // so it must not be used with a comparator that considers keys with
+  // different bytes equal.
+  //
+  // Default: kDataBlockBinarySearch
+  DataBlockIndexType data_block_index_type = kDataBlockBinarySearch;
+
+  // Keys per bucket of the hash index of data blocks.  Lower ratios mean
+  // fewer keys share a bucket, and larger indexes.
+  double data_block_hash_table_util_ratio = 0.75;
+
+  // If non-zero, the index of each table is split into partitions of
+  // approximately this many bytes (uncompressed), under a small top-level
+  // index.  Only the top-level index stays in memory while a table is
+  // open; the partitions are read on demand and kept in the block cache
+  // like data blocks.  Worth setting for large tables with small blocks,
+  // whose index would otherwise be held in memory in full.
+  //
+  // Default: 0 (a single index block per table)
+  size_t index_partition_size = 0;
+
+  // If true, the index block (the top-level index, if partitioned) and the
+  // filter of each table are held by block_cache, with high priority,
+  // rather than in memory for as long as the table is open.  Their memory
+  // is then bounded by the capacity of the cache, at the cost of reading
+  // them again once evicted.
+  //
+  // Default: false
+  bool cache_index_and_filter_blocks = false;
+
+  // If true, along with cache_index_and_filter_blocks, the index blocks and
+  // filters of the tables of level 0, which every read probes, are pinned
+  // in block_cache for as long as the tables are open.
+  //
+  // Default: false
+  bool pin_l0_filter_and_index_blocks_in_cache = false;
+
   // Leveldb will write up to this amount of bytes to a file before
   // switching to a new one.
   // Most clients should leave this parameter alone.  However if your
@@ -144,6 +240,101 @@ struct LEVELDB_EXPORT Options {
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // Layout of the filters built with filter_policy.  Tables are read with
+  // the layout they were written with, whatever the value of this option.
+  FilterBlockType filter_block_type = kBlockBasedFilter;
+
+  // If non-null, iterators created with ReadOptions::prefix_same_as_start
+  // stop at the end of the keys that share the prefix of their Seek()
+  // target, as extracted by this transform from user keys.  With a
+  // filter_policy, the prefixes of the keys are added to the filters as
+  // well, so that such iterators skip the tables and blocks with no key
+  // of the prefix.  Tables written with another transform, or none, are
+  // read without prefix filtering.
+  const SliceTransform* prefix_extractor = nullptr;
+
+  // If non-null, use the specified merge operator to combine the operands
+  // written by DB::Merge() with the values they apply to.  Merge() is not
+  // supported without one.
+  //
+  // REQUIRES: a database that holds merge operands must be opened with a
+  // merge operator that understands them.
+  const MergeOperator* merge_operator = nullptr;
+
+  // If non-null, compactions pass the values they copy to this filter,
+  // which can drop them or change them.  See compaction_filter.h.
+  const CompactionFilter* compaction_filter = nullptr;
+
+  // If non-null, a collector created by this factory is given the entries
+  // of each table as it is built, and can store properties of its own
+  // along with the built-in ones.  See table_properties.h.
+  const TablePropertiesCollectorFactory* table_properties_collector_factory =
+      nullptr;
+
+  // If true, writes go through a two stage pipeline: the log record for
+  // the next group of writes can be appended while the previous group is
+  // still being inserted into the memtable.  This can improve write
+  // throughput when both log I/O and memtable inserts are significant.
+  // Writes still become visible to readers in sequence number order.
+  bool enable_pipelined_write = false;
+
+  // If true, every writer in a group of concurrent writes inserts its own
+  // batch into the memtable in parallel, instead of the group leader
+  // inserting all of them alone.  The log record is still written once
+  // for the whole group.  Useful when many threads write at once.
+  bool allow_concurrent_memtable_write = false;
+
+  // Maximum number of major compactions that may run at the same time.
+  // Compactions that run together never share input files, so they work
+  // on disjoint key ranges or levels.  Compactions run in the LOW priority
+  // thread pool of "env", which has a single thread unless raised with
+  // Env::SetBackgroundThreads().
+  int max_background_compactions = 1;
+
+  // Maximum number of threads that a single compaction is split across.
+  // A large compaction is divided into key ranges that are compacted in
+  // parallel and installed together.  The ranges run on the thread of the
+  // compaction and on the threads of the LOW pool of "env" that are free
+  // (see max_background_compactions).
+  // Ranges hold at least max_file_size bytes of input each.
+  int max_subcompactions = 1;
+
+  // Level-0 compaction is started when level-0 has this many files.
+  int level0_file_num_compaction_trigger = 4;
+
+  // A table in which at least this fraction of the entries are deletion
+  // markers or range tombstones is compacted into the next level when no
+  // other compaction is needed.  This reclaims the space of deleted data
+  // in key ranges that no longer receive writes, which would otherwise
+  // wait for a compaction forever.  Zero, the default, disables these
+  // compactions; 0.5 suits most workloads that delete whole key ranges.
+  double deletion_compaction_ratio = 0;
+
+  // Soft limit on the number of level-0 files.  Writes are slowed down to
+  // delayed_write_rate when level-0 reaches it, and slowed down further
+  // for every additional file.
+  int level0_slowdown_writes_trigger = 8;
+
+  // Maximum number of level-0 files.  Writes stop at this point until
+  // compactions catch up.
+  int level0_stop_writes_trigger = 12;
+
+  // Writes are slowed down when compactions are estimated to have to
+  // rewrite this many bytes to bring every level within its target size,
+  // and slowed down further as the estimate approaches
+  // hard_pending_compaction_bytes_limit.  Zero disables the limit.
+  uint64_t soft_pending_compaction_bytes_limit = 64ull << 30;
+
+  // Writes stop when compactions are estimated to have to rewrite this
+  // many bytes.  Zero disables the limit.
+  uint64_t hard_pending_compaction_bytes_limit = 256ull << 30;
+
+  // Rate, in bytes per second, at which writes are admitted once they are
+  // slowed down.  Every further step of slowdown reduces the rate by a
+  // fifth.  Slowing writes down gradually, instead of stopping them at a
+  // hard limit, avoids long stalls of individual writes.
+  uint64_t delayed_write_rate = 16 << 20;
 };
 
 // Options that control read operations
@@ -163,6 +354,14 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If true and the database has a prefix_extractor, an iterator becomes
+  // invalid after Seek(target) once it moves past the keys that share the
+  // prefix of target, and skips the tables and blocks whose filters show
+  // they have no such key.  Seek() to a key outside the domain of the
+  // extractor, and SeekToFirst(), iterate in total order as usual.
+  // Prev() and SeekToLast() are not supported by such iterators.
+  bool prefix_same_as_start = false;
 };
 
 // Options that control write operations
@@ -186,6 +385,16 @@ struct LEVELDB_EXPORT WriteOptions {
   bool sync = false;
 };
 
+// Options that control DB::IngestExternalFile()
+struct LEVELDB_EXPORT IngestExternalFileOptions {
+  IngestExternalFileOptions() = default;
+
+  // If true, the files are renamed into the database directory instead of
+  // being copied, which is faster but requires them to be on the same
+  // file system.  Files that cannot be renamed are copied.
+  bool move_files = false;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
@@ -0,0 +1,101 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SecondaryCache is a second tier below Options::block_cache.  Data
+// blocks that the block cache evicts spill to it, in a cheaper form than
+// the Block objects of the block cache, and a read that misses the block
+// cache looks for the block there before reading the table file.  A block
+// found there moves back to the block cache, and whether it also stays in
+// the secondary cache is up to the implementation.
+//
+// Implementations must be safe for concurrent use by multiple threads.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SECONDARY_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_SECONDARY_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+
+class LEVELDB_EXPORT SecondaryCache {
+ public:
+  SecondaryCache() = default;
+
+  SecondaryCache(const SecondaryCache&) = delete;
+  SecondaryCache& operator=(const SecondaryCache&) = delete;
+
+  virtual ~SecondaryCache();
+
+  // The name of the implementation.  Used in log messages.
+  virtual const char* Name() const = 0;
+
+  // Store "contents", the uncompressed contents of a block, under "key",
+  // replacing any contents stored under it.  The cache may drop the block
+  // at any time, e.g. to make room for others.  The tables never store
+  // different contents under the same key, so a cache that holds "key"
+  // already may ignore the call.
+  virtual void Insert(const Slice& key, const Slice& contents) = 0;
+
+  // If the cache holds the block of "key", store its contents in *contents
+  // and return true.  Else return false.  The contents are in an array
+  // allocated with new[] that the caller owns and must delete[], so that
+  // the block cache can take them over as they are.  "promote" is true if
+  // the caller moves the block up to the block cache, in which case the
+  // cache may drop it.
+  virtual bool Lookup(const Slice& key, bool promote, Slice* contents) = 0;
+
+  // If the cache holds the block of "key", drop it.
+  virtual void Erase(const Slice& key) = 0;
+
+  // Return a new numeric id.  The tables that share the cache prepend
+  // their own id to the keys of their blocks, as they do for the block
+  // cache with Cache::NewId().
+  virtual uint64_t NewId() = 0;
+
+  // Return an estimate of the memory or disk space used by the blocks held
+  // in the cache.
+  virtual size_t TotalCharge() const = 0;
+};
+
+// Create a new secondary cache that holds blocks in memory, compressed
+// with "compression", up to "capacity" bytes of compressed contents.
+// Blocks that do not compress well are held as they are.  The least
+// recently used blocks are dropped first, and promoted blocks at once, so
+// that a block takes memory in one cache only.
+LEVELDB_EXPORT SecondaryCache* NewCompressedSecondaryCache(
+    size_t capacity, CompressionType compression = kSnappyCompression);
+
+// Open a secondary cache that holds blocks in the files of the directory
+// "dirname", e.g. on a local SSD, through "env", up to about "capacity"
+// bytes of files.  Blocks are appended to a log of fixed-size files, and
+// the oldest file is dropped when the log outgrows the capacity.  An index
+// of the blocks is kept in memory.
+//
+// The blocks survive a restart: a cache opened on the directory of an
+// earlier one serves the blocks it held, bar those spilled just before a
+// crash.  That holds for the blocks of the tables that carry a unique id
+// (TableProperties::unique_id), whose keys are the same in every process.
+//
+// Stores a pointer to the cache in *result and returns OK on success.
+// Stores nullptr in *result and returns a non-OK status on error, e.g. if
+// another cache is open on "dirname".  The caller should delete *result
+// when it is no longer needed.
+LEVELDB_EXPORT Status NewPersistentSecondaryCache(Env* env,
+                                                  const std::string& dirname,
+                                                  size_t capacity,
+                                                  SecondaryCache** result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SECONDARY_CACHE_H_
@@ -0,0 +1,66 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps keys to their prefix.  A database configured with
+// Options::prefix_extractor adds the prefixes of its keys to its filters,
+// and iterators created with ReadOptions::prefix_same_as_start use them to
+// skip the tables and blocks that have no key with the prefix of the
+// target of Seek().
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <stddef.h>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Slice;
+
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // The name of the transform.  It is stored in the tables whose filters
+  // hold the prefixes it extracted, and the prefixes in a table are only
+  // used when its name matches that of the transform of the database.  So
+  // if the prefix of a key changes, the name must change as well.
+  virtual const char* Name() const = 0;
+
+  // Returns the prefix of "key", which must be a prefix of "key" itself.
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Returns true if "key" has a prefix.  Keys outside the domain are only
+  // added to the filters as whole keys, and a Seek() to such a key is not
+  // bounded by prefix.
+  //
+  // The keys that start with a prefix must be contiguous in comparator
+  // order, as they are with the bytewise comparator, and
+  // InDomain(Transform(key)) must hold for every key in the domain.
+  virtual bool InDomain(const Slice& key) const = 0;
+};
+
+// Return a new transform whose prefix is the first "prefix_len" bytes of
+// the key.  Shorter keys have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_len);
+
+// Return a new transform whose prefix runs up to and including the
+// "count"-th occurrence of "delimiter" in the key.  For example, with '|'
+// and 2, the prefix of "tenant|entity|ts" is "tenant|entity|".  Keys with
+// fewer delimiters have no prefix.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewDelimitedPrefixTransform(
+    char delimiter, int count);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -0,0 +1,72 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// SstFileWriter builds a table file outside of any database, which can
+// then be added to a database with DB::IngestExternalFile().  Bulk loads
+// that go through it skip the log, the memtable and most compactions.
+//
+// An SstFileWriter must not be used by several threads at the same time
+// without external synchronization.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+#define STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
+
+#include <stdint.h>
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/options.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SstFileWriter {
+ public:
+  // "options.comparator" must be the comparator of the database the file
+  // will be ingested into.  The file is written with options.env, and
+  // laid out according to the block size, compression and filter policy
+  // of "options".
+  explicit SstFileWriter(const Options& options);
+
+  SstFileWriter(const SstFileWriter&) = delete;
+  SstFileWriter& operator=(const SstFileWriter&) = delete;
+
+  // Abandons the file if Finish() has not been called.
+  ~SstFileWriter();
+
+  // Create the file named "fname" and start writing to it.
+  Status Open(const std::string& fname);
+
+  // Add an entry that sets "key" to "value".
+  // REQUIRES: Open() succeeded and Finish() has not been called.
+  // REQUIRES: "key" is after any previously added key according to the
+  // comparator.
+  Status Put(const Slice& key, const Slice& value);
+
+  // Add an entry that deletes "key" from the database the file is
+  // ingested into.
+  // REQUIRES: same as Put().
+  Status Delete(const Slice& key);
+
+  // Finish writing the file and close it.  It is an error to finish a
+  // file that has no entries.
+  // REQUIRES: Open() succeeded and Finish() has not been called.
+  Status Finish();
+
+  // Size of the file written so far.
+  uint64_t FileSize() const;
+
+ private:
+  struct Rep;
+
+  Status Add(const Slice& key, const Slice& value, bool deletion);
+
+  Rep* rep_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SST_FILE_WRITER_H_
@@ -7,8 +7,10 @@
 
 #include <stdint.h>
 
+#include "leveldb/cache.h"
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
+#include "leveldb/options.h"
 
 namespace leveldb {
 
@@ -19,6 +21,8 @@ struct Options;
 class RandomAccessFile;
 struct ReadOptions;
 class TableCache;
+struct TableFilter;
+struct TableProperties;
 
 // A Table is a sorted map from strings to strings.  Tables are
 // immutable and persistent.  A Table may be safely accessed from
@@ -57,23 +61,83 @@ class LEVELDB_EXPORT Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Returns the properties stored in the table, or nullptr if it has
+  // none, e.g. because it was written by an older version.  The result
+  // is owned by the table.
+  const TableProperties* GetProperties() const;
+
  private:
   friend class TableCache;
   struct Rep;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
+
+  // Returns an iterator over the data block of "index_value", read
+  // through the block cache, where it is inserted with "priority".  If
+  // "get_target" is non-null, the iterator is positioned for a point
+  // lookup of *get_target (see Block::NewIteratorForGet()).
+  Iterator* NewBlockIterator(const ReadOptions&, const Slice& index_value,
+                             const Slice* get_target,
+                             Cache::Priority priority) const;
+
+  // Returns false if the filters of the table say that the data block of
+  // the index entry "index_key", "index_value" has no key with "prefix".
+  static bool PrefixMayMatch(void* arg, const ReadOptions&,
+                             const Slice& prefix, const Slice& index_key,
+                             const Slice& index_value);
+
+  // Returns an iterator over the index entries of the data blocks, which
+  // reads the index partitions it needs if the index is partitioned.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
+  // Returns false if "filter", the filter of the table, says "key" is not
+  // in the table, from the filter of the whole table or of the partition
+  // "key" falls in.  Always true if the filters are block-based or
+  // "filter" is nullptr.
+  bool KeyMayMatch(const ReadOptions&, const TableFilter* filter,
+                   const Slice& key) const;
+
+  // Probes the filter of the whole table, or of the partition "key" falls
+  // in, for "entry", which is a key or, if "prefix" is true, a prefix.
+  bool FilterMayMatch(const ReadOptions&, const TableFilter* filter,
+                      const Slice& key, const Slice& entry,
+                      bool prefix) const;
+
+  // Pins the index block and the filter in the block cache for as long as
+  // the table is open, if Options::cache_index_and_filter_blocks is set.
+  // Safe to call again, from several threads at once, while the table is
+  // in use.
+  void PinIndexAndFilter();
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
   // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // that key is not present, or if the hash index of the data block says
+  // no entry has the Comparator::HashKey() of key.
   Status InternalGet(const ReadOptions&,
                      const Slice& key, void* arg,
                      void (*handle_result)(void* arg, const Slice& k,const Slice& v));
 
-  void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+  // Like InternalGet() for each of the "n" keys in "keys[]", which must be
+  // sorted in ascending order, calling (*handle_result)(args[i], ...) for
+  // keys[i].  The index block is walked once and each data block is read
+  // at most once for the whole batch.
+  Status InternalMultiGet(const ReadOptions&, int n, const Slice* keys,
+                          void* const* args,
+                          void (*handle_result)(void* arg, const Slice& k,
+                                                const Slice& v));
+
+  // Returns an iterator over the range tombstones of the table, or nullptr
+  // if it has none.
+  Iterator* NewRangeTombstoneIterator() const;
+
+  Status ReadMeta(const Footer& footer);
+  void ReadFilter(const Slice& filter_handle_value, FilterBlockType type);
+  void ReadProperties(const Slice& properties_handle_value);
+  Status ReadRangeDelBlock(const Slice& range_del_handle_value);
 
   Rep* const rep_;
 };
@@ -52,6 +52,14 @@ class LEVELDB_EXPORT TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Add(const Slice& key, const Slice& value);
 
+  // Add a range tombstone to the table.  Range tombstones are stored in a
+  // meta block of their own, apart from the entries passed to Add(), and
+  // are not counted by NumEntries().
+  // REQUIRES: key is after any previously added range tombstone key
+  // according to comparator.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void AddRangeTombstone(const Slice& key, const Slice& value);
+
   // Advanced operation: flush any buffered key/value pairs to file.
   // Can be used to ensure that two adjacent entries never live in
   // the same data block.  Most clients should not need to use this method.
@@ -81,6 +89,7 @@ class LEVELDB_EXPORT TableBuilder {
  private:
   bool ok() const { return status().ok(); }
   void WriteBlock(BlockBuilder* block, BlockHandle* handle);// handle是用来保存值的
+  void CompressAndWriteBlock(const Slice& raw, BlockHandle* handle);
   void WriteRawBlock(const Slice& data, CompressionType, BlockHandle* handle);//handle是用来保存值的， data包括restart point和restart point个数
 
   struct Rep;
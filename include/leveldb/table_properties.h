@@ -0,0 +1,109 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Every table carries a small block of properties that describe its
+// contents: entry counts, sizes and key range.  Reading them is much
+// cheaper than scanning the table.  Applications can store properties of
+// their own by installing a TablePropertiesCollectorFactory.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
+#define STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+struct LEVELDB_EXPORT TableProperties {
+  uint64_t num_entries = 0;          // Entries added with TableBuilder::Add()
+  uint64_t num_deletions = 0;        // Deletion markers among the entries
+  uint64_t num_merge_operands = 0;   // Merge operands among the entries
+  uint64_t num_range_deletions = 0;  // Range tombstones
+  uint64_t raw_key_size = 0;         // Total size of the keys
+  uint64_t raw_value_size = 0;       // Total size of the values
+  uint64_t data_size = 0;            // Size of the data blocks in the file
+  uint64_t num_data_blocks = 0;
+  uint64_t index_size = 0;   // Approximate size of the index
+  uint64_t filter_size = 0;  // Size of the filter block
+  uint64_t num_index_partitions = 0;  // 0 if the index is not partitioned
+
+  // Smallest and largest keys of the table.  User keys for the tables of
+  // a database.
+  std::string smallest_key;
+  std::string largest_key;
+
+  // Name of the SliceTransform whose prefixes were added to the filters,
+  // or empty if there was none
+  std::string prefix_extractor_name;
+
+  // Random bytes drawn when the table was built, which tell it apart from
+  // any other table, e.g. to key its blocks in a persistent cache.  Empty
+  // if the table was built by an older version.
+  std::string unique_id;
+
+  // Properties added by a TablePropertiesCollector
+  std::map<std::string, std::string> user_collected_properties;
+
+  // Ratio of the size of the keys and values to the size of the data
+  // blocks that store them, or 0 if the table has no data.
+  double CompressionRatio() const;
+
+  // A human readable description of the properties
+  std::string ToString() const;
+};
+
+// Properties of the tables of a database, by file name
+typedef std::map<std::string, TableProperties> TablePropertiesCollection;
+
+// The kind of an entry passed to a TablePropertiesCollector
+enum EntryType {
+  kEntryPut,
+  kEntryDelete,
+  kEntryMerge,
+  kEntryRangeDeletion,
+  kEntryOther,
+};
+
+// Gathers application-defined properties of a table while it is built.
+class LEVELDB_EXPORT TablePropertiesCollector {
+ public:
+  virtual ~TablePropertiesCollector();
+
+  // The name of the collector.  Used in log messages.
+  virtual const char* Name() const = 0;
+
+  // Called for each entry added to the table, in key order, and for each
+  // range tombstone.  For the tables of a database, "key" is the user key
+  // and "type" and "seq" describe the entry.  For tables built directly
+  // with a TableBuilder, "key" is the key as added, "type" is kEntryPut,
+  // or kEntryRangeDeletion, and "seq" is zero.
+  virtual void AddUserKey(const Slice& key, const Slice& value,
+                          EntryType type, uint64_t seq) = 0;
+
+  // Called once the table is complete.  Add the collected properties to
+  // *properties.  Names starting with "leveldb." are reserved.
+  virtual void Finish(std::map<std::string, std::string>* properties) = 0;
+};
+
+// Creates a TablePropertiesCollector for each table that is built.
+class LEVELDB_EXPORT TablePropertiesCollectorFactory {
+ public:
+  virtual ~TablePropertiesCollectorFactory();
+
+  // The name of the factory.  Used in log messages.
+  virtual const char* Name() const = 0;
+
+  // Return a new collector for a single table.  Tables are built by
+  // several threads at the same time, so this must be thread-safe.
+  virtual TablePropertiesCollector* NewCollector() const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_TABLE_PROPERTIES_H_
@@ -37,6 +37,10 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // The default implementation ignores range deletions.
+    virtual void DeleteRange(const Slice& begin, const Slice& end);
+    // The default implementation ignores merge operands.
+    virtual void Merge(const Slice& key, const Slice& value);
   };
 
   WriteBatch();
@@ -53,6 +57,14 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase every mapping whose key is in the range ["begin", "end").  Nothing
+  // is erased if "end" is not after "begin".
+  void DeleteRange(const Slice& begin, const Slice& end);
+
+  // Combine "value" with the current value of "key", using the merge
+  // operator of the database.
+  void Merge(const Slice& key, const Slice& value);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
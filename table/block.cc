@@ -13,29 +13,47 @@
 #include "leveldb/comparator.h"
 #include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 #include "util/logging.h"
 
 namespace leveldb {
 
-inline uint32_t Block::NumRestarts() const {
-  assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
-}
-
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      restart_offset_(0),
+      num_restarts_(0),
+      hash_offset_(0),
+      num_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+  num_restarts_ = DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  size_t limit = size_ - sizeof(uint32_t);  // End of the restart array
+  if (num_restarts_ & kHashIndexFlag) {
+    num_restarts_ &= ~kHashIndexFlag;
+    if (limit < sizeof(uint32_t)) {
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
+    }
+    num_buckets_ = DecodeFixed32(data_ + limit - sizeof(uint32_t));
+    limit -= sizeof(uint32_t);
+    if (num_buckets_ == 0 || num_buckets_ > limit) {
+      // The size is too small for num_buckets_
+      size_ = 0;
+      return;
     }
+    limit -= num_buckets_;
+    hash_offset_ = limit;
+  }
+  size_t max_restarts_allowed = limit / sizeof(uint32_t);
+  if (num_restarts_ > max_restarts_allowed) {
+    // The size is too small for num_restarts_
+    size_ = 0;
+  } else {
+    restart_offset_ = limit - num_restarts_ * sizeof(uint32_t);
   }
 }
 
@@ -219,6 +237,27 @@ class Block::Iter : public Iterator {
     }
   }
 
+  // Seek(target) starting from restart point "index", which must be at or
+  // before the first key >= target.  The iterator is left invalid if the
+  // key it stops at does not have the hash key of "target".
+  void SeekForGet(const Slice& target, uint32_t index) {
+    if (index >= num_restarts_) {
+      CorruptionError();
+      return;
+    }
+    SeekToRestartPoint(index);
+    while (ParseNextKey()) {
+      if (Compare(key_, target) >= 0) {
+        if (comparator_->HashKey(key_) != comparator_->HashKey(target)) {
+          // Another key in the bucket of target
+          current_ = restarts_;
+          restart_index_ = num_restarts_;
+        }
+        return;
+      }
+    }
+  }
+
   void SeekToFirst() override {
     SeekToRestartPoint(0);
     ParseNextKey();
@@ -274,12 +313,38 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
-  const uint32_t num_restarts = NumRestarts();
-  if (num_restarts == 0) {
+  if (num_restarts_ == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    return new Iter(comparator, data_, restart_offset_, num_restarts_);
+  }
+}
+
+Iterator* Block::NewIteratorForGet(const Comparator* comparator,
+                                   const Slice& target) {
+  if (size_ < sizeof(uint32_t)) {
+    return NewErrorIterator(Status::Corruption("bad block contents"));
+  }
+  if (num_restarts_ == 0) {
+    return NewEmptyIterator();
+  }
+  Iter* iter = new Iter(comparator, data_, restart_offset_, num_restarts_);
+  if (num_buckets_ == 0) {
+    iter->Seek(target);
+    return iter;
+  }
+  const Slice hash_key = comparator->HashKey(target);
+  const uint32_t h = Hash(hash_key.data(), hash_key.size(), kHashIndexSeed);
+  const uint8_t bucket =
+      static_cast<uint8_t>(data_[hash_offset_ + h % num_buckets_]);
+  if (bucket == kHashBucketEmpty) {
+    // No entry has the hash key: leave the iterator invalid
+  } else if (bucket == kHashBucketCollision) {
+    iter->Seek(target);
+  } else {
+    iter->SeekForGet(target, bucket);
   }
+  return iter;
 }
 
 }  // namespace leveldb
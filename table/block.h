@@ -26,16 +26,26 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
+  // The contents the block was initialized with
+  Slice contents() const { return Slice(data_, size_); }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Returns an iterator on which Seek(target) was called, except that it
+  // may be left invalid if the block has no entry with the same
+  // Comparator::HashKey() as "target".  The hash index of the block, if it
+  // has one, saves the binary search over the restart points.
+  Iterator* NewIteratorForGet(const Comparator* comparator,
+                              const Slice& target);
+
  private:
   class Iter;
 
-  uint32_t NumRestarts() const;
-
   const char* data_;// 不包含一字节的type和四字节的crc
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
+  uint32_t num_restarts_;
+  uint32_t hash_offset_;     // Offset in data_ of the hash buckets
+  uint32_t num_buckets_;     // 0 if the block has no hash index
   bool owned_;               // Block owns data_[]
 };
 
@@ -26,6 +26,17 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// Data blocks built with kDataBlockBinaryAndHash and at most 253 restart
+// points have a hash index between the restarts and num_restarts, whose
+// high bit (kHashIndexFlag) is set:
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+// The bucket of a key is the hash of its Comparator::HashKey() modulo
+// num_buckets, and holds the index of the restart point before the first
+// entry with that hash key, kHashBucketEmpty if no hash key falls in the
+// bucket, or kHashBucketCollision if hash keys at different restart
+// points do.
 
 // Block结构：<entry1><entry2><...><entryn><restart1><restart...><restartm><restarts_num>
 
@@ -38,12 +49,18 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/format.h"
 #include "util/coding.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
-BlockBuilder::BlockBuilder(const Options* options)
-    : options_(options), restarts_(), counter_(0), finished_(false) {
+BlockBuilder::BlockBuilder(const Options* options, bool data_block)
+    : options_(options),
+      data_block_(data_block),
+      restarts_(),
+      counter_(0),
+      finished_(false) {
   assert(options->block_restart_interval >= 1);
   restarts_.push_back(0);  // First restart point is at offset 0
 }
@@ -55,11 +72,30 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hash_entries_.clear();
+}
+
+bool BlockBuilder::WritesHashIndex() const {
+  return !hash_entries_.empty() && restarts_.size() <= kHashIndexMaxRestarts;
+}
+
+size_t BlockBuilder::HashIndexBuckets() const {
+  const double ratio = options_->data_block_hash_table_util_ratio;
+  size_t buckets = hash_entries_.size();
+  if (ratio > 0) {
+    buckets = static_cast<size_t>(buckets / ratio);
+  }
+  return std::max<size_t>(buckets, 1);
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
+  size_t hash_index_size = 0;
+  if (WritesHashIndex()) {
+    hash_index_size = HashIndexBuckets() + sizeof(uint32_t);
+  }
   return (buffer_.size() +                       // Raw data buffer
           restarts_.size() * sizeof(uint32_t) +  // Restart array
+          hash_index_size +                      // Hash index
           sizeof(uint32_t));                     // Restart array length
 }
 
@@ -68,7 +104,24 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  uint32_t num_restarts = restarts_.size();
+  if (WritesHashIndex()) {
+    const size_t num_buckets = HashIndexBuckets();
+    std::string buckets(num_buckets, static_cast<char>(kHashBucketEmpty));
+    for (const auto& entry : hash_entries_) {
+      char& bucket = buckets[entry.first % num_buckets];
+      const uint8_t restart = static_cast<uint8_t>(entry.second);
+      if (static_cast<uint8_t>(bucket) == kHashBucketEmpty) {
+        bucket = static_cast<char>(restart);
+      } else if (static_cast<uint8_t>(bucket) != restart) {
+        bucket = static_cast<char>(kHashBucketCollision);
+      }
+    }
+    buffer_.append(buckets);
+    PutFixed32(&buffer_, num_buckets);
+    num_restarts |= kHashIndexFlag;
+  }
+  PutFixed32(&buffer_, num_restarts);
   finished_ = true;
   return Slice(buffer_);
 }
@@ -93,6 +146,17 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   }
   const size_t non_shared = key.size() - shared;
 
+  if (HashIndexed()) {
+    // Keys with the same hash key are adjacent: index the first one
+    const Comparator* cmp = options_->comparator;
+    const Slice hash_key = cmp->HashKey(key);
+    if (buffer_.empty() || hash_key != cmp->HashKey(last_key_piece)) {
+      hash_entries_.emplace_back(
+          Hash(hash_key.data(), hash_key.size(), kHashIndexSeed),
+          restarts_.size() - 1);
+    }
+  }
+
   // Add "<shared><non_shared><value_size>" to buffer_
   PutVarint32(&buffer_, shared);
   PutVarint32(&buffer_, non_shared);
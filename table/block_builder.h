@@ -9,15 +9,16 @@
 
 #include <vector>
 
+#include "leveldb/options.h"
 #include "leveldb/slice.h"
 
 namespace leveldb {
 
-struct Options;
-
 class BlockBuilder {
  public:
-  explicit BlockBuilder(const Options* options);
+  // "data_block" tells whether the block holds table entries, which get a
+  // hash index if options->data_block_index_type asks for one.
+  BlockBuilder(const Options* options, bool data_block);
 
   BlockBuilder(const BlockBuilder&) = delete;
   BlockBuilder& operator=(const BlockBuilder&) = delete;
@@ -43,12 +44,26 @@ class BlockBuilder {
   bool empty() const { return buffer_.empty(); }
 
  private:
+  // Whether a hash index of the keys is being built
+  bool HashIndexed() const {
+    return data_block_ &&
+           options_->data_block_index_type == kDataBlockBinaryAndHash;
+  }
+  // Whether Finish() will write a hash index, which it does not for blocks
+  // with more restart points than the buckets can refer to
+  bool WritesHashIndex() const;
+  size_t HashIndexBuckets() const;
+
   const Options* options_;
+  const bool data_block_;
   std::string buffer_;              // Destination buffer. buffer_存储当前数据块的数据部分，不包含restart point和restart point的数目
   std::vector<uint32_t> restarts_;  // Restart points
   int counter_;                     // Number of entries emitted since restart
   bool finished_;                   // Has Finish() been called?
   std::string last_key_;    // 记录最后Add的key。用于获取shared_bytes的大小。
+  // Hash and restart point of the first entry of each hash key, if
+  // HashIndexed()
+  std::vector<std::pair<uint32_t, uint32_t>> hash_entries_;
 };
 
 }  // namespace leveldb
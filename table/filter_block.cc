@@ -5,6 +5,7 @@
 #include "table/filter_block.h"
 
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -15,8 +16,60 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {}
+FilterKeys::FilterKeys(const SliceTransform* prefix_extractor)
+    : prefix_extractor_(prefix_extractor) {}
+
+void FilterKeys::Add(const Slice& key) {
+  start_.push_back(keys_.size());
+  keys_.append(key.data(), key.size());
+  if (prefix_extractor_ != nullptr && prefix_extractor_->InDomain(key)) {
+    // Keys arrive in order, so equal prefixes are adjacent
+    const Slice prefix = prefix_extractor_->Transform(key);
+    if (prefix_start_.empty() ||
+        prefix != Slice(prefixes_.data() + prefix_start_.back(),
+                        prefixes_.size() - prefix_start_.back())) {
+      prefix_start_.push_back(prefixes_.size());
+      prefixes_.append(prefix.data(), prefix.size());
+    }
+  }
+}
+
+static void Unflatten(const std::string& flat, std::vector<size_t>* start,
+                      std::vector<Slice>* result) {
+  const size_t num = start->size();
+  start->push_back(flat.size());  // Simplify length computation
+  result->resize(num);
+  for (size_t i = 0; i < num; i++) {
+    const char* base = flat.data() + (*start)[i];
+    size_t length = (*start)[i + 1] - (*start)[i];
+    (*result)[i] = Slice(base, length);
+  }
+}
+
+void FilterKeys::CreateFilter(const FilterPolicy* policy, std::string* dst) {
+  assert(!empty());
+  Unflatten(keys_, &start_, &tmp_keys_);
+  if (prefix_extractor_ == nullptr) {
+    policy->CreateFilter(&tmp_keys_[0], static_cast<int>(tmp_keys_.size()),
+                         dst);
+  } else {
+    Unflatten(prefixes_, &prefix_start_, &tmp_prefixes_);
+    policy->CreateFilterWithPrefixes(
+        &tmp_keys_[0], static_cast<int>(tmp_keys_.size()),
+        tmp_prefixes_.data(), static_cast<int>(tmp_prefixes_.size()), dst);
+  }
+
+  tmp_keys_.clear();
+  tmp_prefixes_.clear();
+  keys_.clear();
+  start_.clear();
+  prefixes_.clear();
+  prefix_start_.clear();
+}
+
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy,
+                                       const SliceTransform* prefix_extractor)
+    : policy_(policy), keys_(prefix_extractor) {}
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
   uint64_t filter_index = (block_offset / kFilterBase);
@@ -26,14 +79,10 @@ void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
   }
 }
 
-void FilterBlockBuilder::AddKey(const Slice& key) {
-  Slice k = key;
-  start_.push_back(keys_.size());
-  keys_.append(k.data(), k.size());
-}
+void FilterBlockBuilder::AddKey(const Slice& key) { keys_.Add(key); }
 
 Slice FilterBlockBuilder::Finish() {
-  if (!start_.empty()) {
+  if (!keys_.empty()) {
     GenerateFilter();
   }
 
@@ -49,29 +98,29 @@ Slice FilterBlockBuilder::Finish() {
 }
 
 void FilterBlockBuilder::GenerateFilter() {
-  const size_t num_keys = start_.size();
-  if (num_keys == 0) {
+  if (keys_.empty()) {
     // Fast path if there are no keys for this filter
     filter_offsets_.push_back(result_.size());
     return;
   }
 
-  // Make list of keys from flattened key structure
-  start_.push_back(keys_.size());  // Simplify length computation
-  tmp_keys_.resize(num_keys);
-  for (size_t i = 0; i < num_keys; i++) {
-    const char* base = keys_.data() + start_[i];
-    size_t length = start_[i + 1] - start_[i];
-    tmp_keys_[i] = Slice(base, length);
-  }
-
   // Generate filter for current set of keys and append to result_.
   filter_offsets_.push_back(result_.size());
-  policy_->CreateFilter(&tmp_keys_[0], static_cast<int>(num_keys), &result_);
+  keys_.CreateFilter(policy_, &result_);
+}
 
-  tmp_keys_.clear();
-  keys_.clear();
-  start_.clear();
+FullFilterBlockBuilder::FullFilterBlockBuilder(
+    const FilterPolicy* policy, const SliceTransform* prefix_extractor)
+    : policy_(policy), keys_(prefix_extractor) {}
+
+void FullFilterBlockBuilder::AddKey(const Slice& key) { keys_.Add(key); }
+
+Slice FullFilterBlockBuilder::Finish() {
+  result_.clear();
+  if (!keys_.empty()) {
+    keys_.CreateFilter(policy_, &result_);
+  }
+  return Slice(result_);
 }
 
 FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
@@ -87,20 +136,38 @@ FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
   num_ = (n - 5 - last_word) / 4;
 }
 
-bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+bool FilterBlockReader::GetFilter(uint64_t block_offset, Slice* filter) const {
   uint64_t index = block_offset >> base_lg_;
   if (index < num_) {
     uint32_t start = DecodeFixed32(offset_ + index * 4);
     uint32_t limit = DecodeFixed32(offset_ + index * 4 + 4);
     if (start <= limit && limit <= static_cast<size_t>(offset_ - data_)) {
-      Slice filter = Slice(data_ + start, limit - start);
-      return policy_->KeyMayMatch(key, filter);
+      *filter = Slice(data_ + start, limit - start);
+      return true;
     } else if (start == limit) {
       // Empty filters do not match any keys
-      return false;
+      *filter = Slice();
+      return true;
     }
   }
-  return true;  // Errors are treated as potential matches
+  return false;  // Errors are treated as potential matches
+}
+
+bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+  Slice filter;
+  if (!GetFilter(block_offset, &filter)) {
+    return true;
+  }
+  return !filter.empty() && policy_->KeyMayMatch(key, filter);
+}
+
+bool FilterBlockReader::PrefixMayMatch(uint64_t block_offset,
+                                       const Slice& prefix) {
+  Slice filter;
+  if (!GetFilter(block_offset, &filter)) {
+    return true;
+  }
+  return !filter.empty() && policy_->PrefixMayMatch(prefix, filter);
 }
 
 }  // namespace leveldb
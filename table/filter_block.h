@@ -4,7 +4,9 @@
 //
 // A filter block is stored near the end of a Table file.  It contains
 // filters (e.g., bloom filters) for all data blocks in the table combined
-// into a single filter block.
+// into a single filter block.  Tables may instead have a single filter
+// over all their keys, or one per index partition (see
+// Options::filter_block_type).
 
 #ifndef STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
 #define STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -21,6 +23,34 @@
 namespace leveldb {
 
 class FilterPolicy;
+class SliceTransform;
+
+// The keys of a filter being built, and their distinct prefixes if there
+// is a prefix extractor
+class FilterKeys {
+ public:
+  explicit FilterKeys(const SliceTransform* prefix_extractor);
+
+  FilterKeys(const FilterKeys&) = delete;
+  FilterKeys& operator=(const FilterKeys&) = delete;
+
+  void Add(const Slice& key);
+  bool empty() const { return start_.empty(); }
+
+  // Append the filter of "policy" over the keys added since the last call
+  // to *dst, and forget them.
+  // REQUIRES: !empty()
+  void CreateFilter(const FilterPolicy* policy, std::string* dst);
+
+ private:
+  const SliceTransform* const prefix_extractor_;
+  std::string keys_;                   // Flattened key contents
+  std::vector<size_t> start_;          // Starting index in keys_ of each key
+  std::string prefixes_;               // Flattened prefix contents
+  std::vector<size_t> prefix_start_;   // Starting index in prefixes_
+  std::vector<Slice> tmp_keys_;        // policy->CreateFilter() argument
+  std::vector<Slice> tmp_prefixes_;
+};
 
 // A FilterBlockBuilder is used to construct all of the filters for a
 // particular Table.  It generates a single string which is stored as
@@ -30,7 +60,10 @@ class FilterPolicy;
 //      (StartBlock AddKey*)* Finish
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  // Adds the prefixes of the keys extracted with "prefix_extractor" to the
+  // filters as well, if it is non-null.
+  FilterBlockBuilder(const FilterPolicy*,
+                     const SliceTransform* prefix_extractor);
 
   FilterBlockBuilder(const FilterBlockBuilder&) = delete;
   FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
@@ -43,20 +76,51 @@ class FilterBlockBuilder {
   void GenerateFilter();
 
   const FilterPolicy* policy_;
-  std::string keys_;             // Flattened key contents
-  std::vector<size_t> start_;    // Starting index in keys_ of each key
+  FilterKeys keys_;              // Keys of the filter being built
   std::string result_;           // Filter data computed so far
-  std::vector<Slice> tmp_keys_;  // policy_->CreateFilter() argument
   std::vector<uint32_t> filter_offsets_;
 };
 
+// A FullFilterBlockBuilder builds a single filter over all the keys added
+// since the last call to Finish().  Its output is the raw output of the
+// filter policy, which is checked with FilterPolicy::KeyMayMatch().
+class FullFilterBlockBuilder {
+ public:
+  FullFilterBlockBuilder(const FilterPolicy*,
+                         const SliceTransform* prefix_extractor);
+
+  FullFilterBlockBuilder(const FullFilterBlockBuilder&) = delete;
+  FullFilterBlockBuilder& operator=(const FullFilterBlockBuilder&) = delete;
+
+  void AddKey(const Slice& key);
+
+  // Returns the filter over the keys added since the last call, which is
+  // empty if there were none.  The result stays valid until the next call
+  // to AddKey() or Finish().
+  Slice Finish();
+
+ private:
+  const FilterPolicy* policy_;
+  FilterKeys keys_;     // Keys added since the last Finish()
+  std::string result_;  // Filter data of the last Finish()
+};
+
 class FilterBlockReader {
  public:
   // REQUIRES: "contents" and *policy must stay live while *this is live.
   FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
   bool KeyMayMatch(uint64_t block_offset, const Slice& key);
 
+  // Returns false if no key with "prefix" was added to the filter of the
+  // block at "block_offset".  Only meaningful for filters built with a
+  // prefix extractor that produced "prefix".
+  bool PrefixMayMatch(uint64_t block_offset, const Slice& prefix);
+
  private:
+  // The filter of the block at "block_offset".  Returns false if it cannot
+  // be found, which is treated as a potential match.
+  bool GetFilter(uint64_t block_offset, Slice* filter) const;
+
   const FilterPolicy* policy_;
   const char* data_;    // Pointer to filter data (at block-start)
   const char* offset_;  // Pointer to beginning of offset array (at block-end)
@@ -5,6 +5,7 @@
 #include "table/filter_block.h"
 
 #include "leveldb/filter_policy.h"
+#include "leveldb/slice_transform.h"
 #include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
@@ -42,7 +43,7 @@ class FilterBlockTest {
 };
 
 TEST(FilterBlockTest, EmptyBuilder) {
-  FilterBlockBuilder builder(&policy_);
+  FilterBlockBuilder builder(&policy_, nullptr);
   Slice block = builder.Finish();
   ASSERT_EQ("\\x00\\x00\\x00\\x00\\x0b", EscapeString(block));
   FilterBlockReader reader(&policy_, block);
@@ -51,7 +52,7 @@ TEST(FilterBlockTest, EmptyBuilder) {
 }
 
 TEST(FilterBlockTest, SingleChunk) {
-  FilterBlockBuilder builder(&policy_);
+  FilterBlockBuilder builder(&policy_, nullptr);
   builder.StartBlock(100);
   builder.AddKey("foo");
   builder.AddKey("bar");
@@ -72,7 +73,7 @@ TEST(FilterBlockTest, SingleChunk) {
 }
 
 TEST(FilterBlockTest, MultiChunk) {
-  FilterBlockBuilder builder(&policy_);
+  FilterBlockBuilder builder(&policy_, nullptr);
 
   // First filter
   builder.StartBlock(0);
@@ -119,6 +120,82 @@ TEST(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST(FilterBlockTest, FullFilterEmpty) {
+  FullFilterBlockBuilder builder(&policy_, nullptr);
+  ASSERT_EQ("", EscapeString(builder.Finish()));
+}
+
+TEST(FilterBlockTest, FullFilterPartitions) {
+  FullFilterBlockBuilder builder(&policy_, nullptr);
+
+  // First partition
+  builder.AddKey("foo");
+  builder.AddKey("bar");
+  std::string first = builder.Finish().ToString();
+
+  // Second partition
+  builder.AddKey("box");
+  builder.AddKey("hello");
+  std::string second = builder.Finish().ToString();
+
+  ASSERT_TRUE(policy_.KeyMayMatch("foo", first));
+  ASSERT_TRUE(policy_.KeyMayMatch("bar", first));
+  ASSERT_TRUE(!policy_.KeyMayMatch("box", first));
+  ASSERT_TRUE(!policy_.KeyMayMatch("hello", first));
+
+  ASSERT_TRUE(policy_.KeyMayMatch("box", second));
+  ASSERT_TRUE(policy_.KeyMayMatch("hello", second));
+  ASSERT_TRUE(!policy_.KeyMayMatch("foo", second));
+  ASSERT_TRUE(!policy_.KeyMayMatch("bar", second));
+}
+
+TEST(FilterBlockTest, PrefixesInBlockFilters) {
+  const SliceTransform* prefix_extractor = NewFixedPrefixTransform(2);
+  FilterBlockBuilder builder(&policy_, prefix_extractor);
+  builder.StartBlock(100);
+  builder.AddKey("a");  // Too short to have a prefix
+  builder.AddKey("foo");
+  builder.AddKey("fox");
+  builder.StartBlock(3100);
+  builder.AddKey("hello");
+  Slice block = builder.Finish();
+  FilterBlockReader reader(&policy_, block);
+
+  ASSERT_TRUE(reader.KeyMayMatch(100, "foo"));
+  ASSERT_TRUE(reader.PrefixMayMatch(100, "fo"));
+  ASSERT_TRUE(!reader.PrefixMayMatch(100, "he"));
+  ASSERT_TRUE(!reader.PrefixMayMatch(100, "fa"));
+  ASSERT_TRUE(reader.PrefixMayMatch(3100, "he"));
+  ASSERT_TRUE(!reader.PrefixMayMatch(3100, "fo"));
+  delete prefix_extractor;
+}
+
+TEST(FilterBlockTest, PrefixesInFullFilter) {
+  const SliceTransform* prefix_extractor = NewDelimitedPrefixTransform('|', 2);
+  FullFilterBlockBuilder builder(&policy_, prefix_extractor);
+  builder.AddKey("t1|e1|1");
+  builder.AddKey("t1|e1|2");
+  builder.AddKey("t1|e2|1");
+  builder.AddKey("t2");  // No prefix
+  std::string filter = builder.Finish().ToString();
+
+  // One hash for each key, and each distinct prefix
+  ASSERT_EQ(6 * 4, filter.size());
+  ASSERT_TRUE(policy_.PrefixMayMatch("t1|e1|", filter));
+  ASSERT_TRUE(policy_.PrefixMayMatch("t1|e2|", filter));
+  ASSERT_TRUE(!policy_.PrefixMayMatch("t1|e3|", filter));
+  ASSERT_TRUE(!policy_.PrefixMayMatch("t1|", filter));
+  ASSERT_TRUE(policy_.KeyMayMatch("t2", filter));
+
+  // Prefixes do not carry over to the next filter
+  builder.AddKey("t3|e1|1");
+  filter = builder.Finish().ToString();
+  ASSERT_EQ(2 * 4, filter.size());
+  ASSERT_TRUE(!policy_.PrefixMayMatch("t1|e1|", filter));
+  ASSERT_TRUE(policy_.PrefixMayMatch("t3|e1|", filter));
+  delete prefix_extractor;
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
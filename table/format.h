@@ -7,11 +7,13 @@
 
 #include <stdint.h>
 
+#include <map>
 #include <string>
 
 #include "leveldb/slice.h"
 #include "leveldb/status.h"
 #include "leveldb/table_builder.h"
+#include "leveldb/table_properties.h"
 
 namespace leveldb {
 
@@ -82,9 +84,63 @@ class Footer {
 // and taking the leading 64 bits.
 static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 
+// Name of the metaindex entry that points at the block of range tombstones
+static const char kRangeDelBlockName[] = "leveldb.range_del";
+
+// Prefixes of the names of the metaindex entries that point at the filters
+// of a table, by FilterBlockType.  The name of the filter policy follows.
+static const char kBlockBasedFilterPrefix[] = "filter.";
+static const char kFullFilterPrefix[] = "fullfilter.";
+static const char kPartitionedFilterPrefix[] = "partitionedfilter.";
+
+// Name of the metaindex entry present in tables whose index is partitioned.
+// The index block named by the footer then maps keys to the handles of
+// index partitions instead of data blocks.
+static const char kPartitionedIndexName[] = "leveldb.index.partitioned";
+
+// Name of the metaindex entry that points at the block of table properties
+static const char kPropertiesBlockName[] = "leveldb.properties";
+
+// Names under which the fields of TableProperties are stored in the
+// properties block.  Numbers are stored as varint64.
+static const char kNumEntriesProperty[] = "leveldb.num.entries";
+static const char kNumDeletionsProperty[] = "leveldb.num.deletions";
+static const char kNumMergeOperandsProperty[] = "leveldb.num.merge.operands";
+static const char kNumRangeDeletionsProperty[] = "leveldb.num.range.deletions";
+static const char kRawKeySizeProperty[] = "leveldb.raw.key.size";
+static const char kRawValueSizeProperty[] = "leveldb.raw.value.size";
+static const char kDataSizeProperty[] = "leveldb.data.size";
+static const char kNumDataBlocksProperty[] = "leveldb.num.data.blocks";
+static const char kIndexSizeProperty[] = "leveldb.index.size";
+static const char kFilterSizeProperty[] = "leveldb.filter.size";
+static const char kNumIndexPartitionsProperty[] =
+    "leveldb.num.index.partitions";
+static const char kSmallestKeyProperty[] = "leveldb.smallest.key";
+static const char kLargestKeyProperty[] = "leveldb.largest.key";
+static const char kPrefixExtractorNameProperty[] =
+    "leveldb.prefix.extractor.name";
+static const char kUniqueIdProperty[] = "leveldb.unique.id";
+
+// Store the number "value" in (*properties)[name].
+void AddNumberProperty(const char* name, uint64_t value,
+                       std::map<std::string, std::string>* properties);
+
+// Set the field of *props named "name", read from the properties block,
+// or add it to props->user_collected_properties if it is not a field.
+void SetTableProperty(const Slice& name, const Slice& value,
+                      TableProperties* props);
+
 // 1-byte type + 32-bit crc 每个数据块都分为数据部分、压缩类型、CRC签名
 static const size_t kBlockTrailerSize = 5;
 
+// The hash index of a data block (see block_builder.cc).  Bucket values
+// below kHashBucketCollision are restart point indexes.
+static const uint32_t kHashIndexFlag = 0x80000000u;  // In num_restarts
+static const uint32_t kHashIndexMaxRestarts = 253;
+static const uint8_t kHashBucketCollision = 254;
+static const uint8_t kHashBucketEmpty = 255;
+static const uint32_t kHashIndexSeed = 0x6b7a2f13;
+
 // BlockContents不包含一字节的type和四字节的crc，包含restart
 struct BlockContents {
   Slice data;           // Actual contents of data
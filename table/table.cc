@@ -4,11 +4,16 @@
 
 #include "leveldb/table.h"
 
+#include <atomic>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/secondary_cache.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/table_properties.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -17,22 +22,191 @@
 
 namespace leveldb {
 
+// The filter of a table, in any of the layouts of FilterBlockType
+struct TableFilter {
+  TableFilter(const FilterPolicy* policy, FilterBlockType type,
+              const BlockContents& contents)
+      : type(type),
+        data(contents.data),
+        owned(contents.heap_allocated),
+        reader(nullptr),
+        index(nullptr) {
+    if (type == kPartitionedFilter) {
+      index = new Block(contents);  // Takes ownership of the contents
+      owned = false;
+    } else if (type == kBlockBasedFilter) {
+      reader = new FilterBlockReader(policy, data);
+    }
+  }
+
+  ~TableFilter() {
+    delete reader;
+    delete index;
+    if (owned) {
+      delete[] data.data();
+    }
+  }
+
+  FilterBlockType type;
+  Slice data;  // The filter block
+  bool owned;  // Whether data is heap allocated
+  FilterBlockReader* reader;  // If the filters are block-based
+  Block* index;  // Index of the filter partitions, if partitioned
+};
+
+static void DeleteCachedBlock(const Slice& key, void* value);
+
+static void DeleteCachedFilter(const Slice& key, void* value) {
+  delete reinterpret_cast<TableFilter*>(value);
+}
+
 struct Table::Rep {
   ~Rep() {
+    Release(index_pin.load(std::memory_order_relaxed));
+    Release(filter_pin.load(std::memory_order_relaxed));
     delete filter;
-    delete[] filter_data;
     delete index_block;
+    delete range_del_block;
+    delete properties;
+  }
+
+  ReadOptions MetaReadOptions() const {
+    ReadOptions opt;
+    if (options.paranoid_checks) {
+      opt.verify_checksums = true;
+    }
+    return opt;
+  }
+
+  // The key of the block at "handle" in the secondary cache
+  std::string SecondaryKey(const BlockHandle& handle) const {
+    std::string key = secondary_key_prefix;
+    PutFixed64(&key, handle.offset());
+    return key;
+  }
+
+  // The key of the block at "handle" in the block cache
+  Slice CacheKey(const BlockHandle& handle, char* buffer) const {
+    EncodeFixed64(buffer, cache_id);
+    EncodeFixed64(buffer + 8, handle.offset());
+    return Slice(buffer, 16);
+  }
+
+  // Hands "value", the index block or filter read from "handle" when the
+  // table was opened, over to the block cache if cache_meta_blocks is
+  // set.  Returns false if the table must keep it instead.
+  bool InsertMetaBlock(const BlockHandle& handle, bool cachable, void* value,
+                       size_t charge,
+                       void (*deleter)(const Slice& key, void* value)) {
+    if (!cache_meta_blocks || !cachable) {
+      return false;
+    }
+    char buffer[16];
+    Cache* cache = options.block_cache;
+    cache->Release(cache->Insert(CacheKey(handle, buffer), value, charge,
+                                 deleter, Cache::Priority::kHigh));
+    return true;
+  }
+
+  // Return the index block, reading it back into the block cache if it
+  // was evicted.  Sets *cache_handle to the handle to release once done
+  // with the block, or to nullptr if there is none.
+  Block* IndexBlock(Cache::Handle** cache_handle, Status* s) {
+    *cache_handle = nullptr;
+    if (index_block != nullptr) {
+      return index_block;
+    }
+    Cache* cache = options.block_cache;
+    Cache::Handle* pin = index_pin.load(std::memory_order_acquire);
+    if (pin != nullptr) {
+      return reinterpret_cast<Block*>(cache->Value(pin));
+    }
+    char buffer[16];
+    Slice key = CacheKey(index_handle, buffer);
+    Cache::Handle* h = cache->Lookup(key);
+    if (h == nullptr) {
+      BlockContents contents;
+      *s = ReadBlock(file, MetaReadOptions(), index_handle, &contents);
+      if (!s->ok()) {
+        return nullptr;
+      }
+      Block* block = new Block(contents);
+      h = cache->Insert(key, block, block->size(), &DeleteCachedBlock,
+                        Cache::Priority::kHigh);
+    }
+    *cache_handle = h;
+    return reinterpret_cast<Block*>(cache->Value(h));
+  }
+
+  // Like IndexBlock() for the filter.  Returns nullptr if the table has no
+  // filter, or if it cannot be read back.
+  const TableFilter* Filter(Cache::Handle** cache_handle) {
+    *cache_handle = nullptr;
+    if (filter != nullptr || !has_filter) {
+      return filter;
+    }
+    Cache* cache = options.block_cache;
+    Cache::Handle* pin = filter_pin.load(std::memory_order_acquire);
+    if (pin != nullptr) {
+      return reinterpret_cast<TableFilter*>(cache->Value(pin));
+    }
+    char buffer[16];
+    Slice key = CacheKey(filter_handle, buffer);
+    Cache::Handle* h = cache->Lookup(key);
+    if (h == nullptr) {
+      BlockContents contents;
+      if (!ReadBlock(file, MetaReadOptions(), filter_handle, &contents).ok()) {
+        return nullptr;
+      }
+      TableFilter* f =
+          new TableFilter(options.filter_policy, filter_type, contents);
+      h = cache->Insert(key, f, f->data.size(), &DeleteCachedFilter,
+                        Cache::Priority::kHigh);
+    }
+    *cache_handle = h;
+    return reinterpret_cast<TableFilter*>(cache->Value(h));
+  }
+
+  void Release(Cache::Handle* cache_handle) {
+    if (cache_handle != nullptr) {
+      options.block_cache->Release(cache_handle);
+    }
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id; //block cache的ID，用于组建options.block_cache结点的key，为了多线程访问，尽可能快速，减少锁开销，ShardedLRUCache内部有16个LRUCache。一个table占有一个cache，即block_cache
-  FilterBlockReader* filter;
-  const char* filter_data;
+
+  // Whether the index block and the filter are held by the block cache
+  // (see Options::cache_index_and_filter_blocks) rather than by index_block
+  // and filter, which are then nullptr.  Pinned entries of the cache are
+  // held in index_pin and filter_pin for as long as the table is open.
+  // They are set at most once, while lookups may read them.
+  bool cache_meta_blocks;
+  // options.secondary_cache if there is a block cache, else nullptr
+  SecondaryCache* secondary_cache;
+  // The unique id of the table, which keeps its keys in secondary_cache
+  // valid from one process to the next, or else an id from
+  // SecondaryCache::NewId()
+  std::string secondary_key_prefix;
+  TableFilter* filter;
+  bool has_filter;
+  FilterBlockType filter_type;
+  BlockHandle filter_handle;
+  std::atomic<Cache::Handle*> filter_pin;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
+  BlockHandle index_handle;
   Block* index_block;
+  std::atomic<Cache::Handle*> index_pin;
+  bool index_partitioned;  // Whether index_block indexes index partitions
+  Block* range_del_block;  // Range tombstones, or nullptr if there are none
+  TableProperties* properties;  // nullptr if the table has none
+
+  // Whether the filters hold the prefixes options.prefix_extractor
+  // extracts
+  bool prefix_filtering;
 };
 
 Status Table::Open(const Options& options, RandomAccessFile* file,
@@ -70,22 +244,46 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
     rep->options = options;
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
-    rep->index_block = index_block;
+    rep->index_handle = footer.index_handle();
+    rep->index_pin = nullptr;
+    rep->index_partitioned = false;
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
-    rep->filter_data = nullptr;
+    rep->cache_meta_blocks = options.cache_index_and_filter_blocks &&
+                             options.block_cache != nullptr;
+    rep->secondary_cache =
+        options.block_cache ? options.secondary_cache : nullptr;
+    rep->index_block = nullptr;
+    if (!rep->InsertMetaBlock(footer.index_handle(),
+                              index_block_contents.cachable, index_block,
+                              index_block->size(), &DeleteCachedBlock)) {
+      rep->index_block = index_block;
+    }
     rep->filter = nullptr;
+    rep->has_filter = false;
+    rep->filter_pin = nullptr;
+    rep->range_del_block = nullptr;
+    rep->properties = nullptr;
+    rep->prefix_filtering = false;
     *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    s = (*table)->ReadMeta(footer);
+    if (rep->secondary_cache != nullptr) {
+      if (rep->properties != nullptr && !rep->properties->unique_id.empty()) {
+        rep->secondary_key_prefix = rep->properties->unique_id;
+      } else {
+        PutFixed64(&rep->secondary_key_prefix,
+                   rep->secondary_cache->NewId());
+      }
+    }
+    if (!s.ok()) {
+      delete *table;
+      *table = nullptr;
+    }
   }
 
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
-  }
-
+Status Table::ReadMeta(const Footer& footer) {
   // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
   // it is an empty block.
   ReadOptions opt;
@@ -93,24 +291,59 @@ void Table::ReadMeta(const Footer& footer) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
-    return;
+  Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+  if (!s.ok()) {
+    // The metaindex tells how to read the index, so it cannot be skipped
+    return s;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != nullptr) {
+    // Use the filters of whichever layout the table was written with
+    static const struct {
+      const char* prefix;
+      FilterBlockType type;
+    } kFilterLayouts[] = {
+        {kBlockBasedFilterPrefix, kBlockBasedFilter},
+        {kFullFilterPrefix, kFullFilter},
+        {kPartitionedFilterPrefix, kPartitionedFilter},
+    };
+    for (const auto& layout : kFilterLayouts) {
+      std::string key = layout.prefix;
+      key.append(rep_->options.filter_policy->Name());
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilter(iter->value(), layout.type);
+        break;
+      }
+    }
+  }
+  iter->Seek(kPartitionedIndexName);
+  if (iter->Valid() && iter->key() == Slice(kPartitionedIndexName)) {
+    rep_->index_partitioned = true;
+  }
+  iter->Seek(kPropertiesBlockName);
+  if (iter->Valid() && iter->key() == Slice(kPropertiesBlockName)) {
+    ReadProperties(iter->value());
+  }
+  // Range tombstones are needed for correct reads, unlike the filter
+  iter->Seek(kRangeDelBlockName);
+  if (iter->Valid() && iter->key() == Slice(kRangeDelBlockName)) {
+    s = ReadRangeDelBlock(iter->value());
   }
+  const SliceTransform* prefix_extractor = rep_->options.prefix_extractor;
+  rep_->prefix_filtering =
+      prefix_extractor != nullptr && rep_->properties != nullptr &&
+      rep_->properties->prefix_extractor_name == prefix_extractor->Name() &&
+      rep_->has_filter;
   delete iter;
   delete meta;
+  return s;
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value,
+                       FilterBlockType type) {
   // filter_handle_value是MetaIndexBlock的value
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
@@ -120,22 +353,104 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
 
   // We might want to unify with ReadBlock() if we start
   // requiring checksum verification in Table::Open.
+  BlockContents block;
+  if (!ReadBlock(rep_->file, rep_->MetaReadOptions(), filter_handle, &block)
+           .ok()) {
+    return;
+  }
+  rep_->has_filter = true;
+  rep_->filter_type = type;
+  rep_->filter_handle = filter_handle;
+  // Only the index of the partitions is kept, if partitioned
+  TableFilter* filter =
+      new TableFilter(rep_->options.filter_policy, type, block);
+  if (!rep_->InsertMetaBlock(filter_handle, block.cachable, filter,
+                             filter->data.size(), &DeleteCachedFilter)) {
+    rep_->filter = filter;
+  }
+}
+
+void Table::PinIndexAndFilter() {
+  if (!rep_->cache_meta_blocks) {
+    return;
+  }
+  // Threads that pin the table at the same time both get a handle; the
+  // first one stored stays, and the others are released.
+  Cache::Handle* handle;
+  Cache::Handle* expected = nullptr;
+  if (rep_->index_pin.load(std::memory_order_acquire) == nullptr) {
+    Status s;
+    rep_->IndexBlock(&handle, &s);
+    if (handle != nullptr &&
+        !rep_->index_pin.compare_exchange_strong(expected, handle,
+                                                 std::memory_order_acq_rel)) {
+      rep_->Release(handle);
+    }
+  }
+  expected = nullptr;
+  if (rep_->filter_pin.load(std::memory_order_acquire) == nullptr) {
+    rep_->Filter(&handle);
+    if (handle != nullptr &&
+        !rep_->filter_pin.compare_exchange_strong(expected, handle,
+                                                  std::memory_order_acq_rel)) {
+      rep_->Release(handle);
+    }
+  }
+}
+
+void Table::ReadProperties(const Slice& properties_handle_value) {
+  Slice v = properties_handle_value;
+  BlockHandle properties_handle;
+  if (!properties_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
   }
-  BlockContents block;
-  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+  BlockContents contents;
+  if (!ReadBlock(rep_->file, opt, properties_handle, &contents).ok()) {
     return;
   }
-  if (block.heap_allocated) {
-    rep_->filter_data = block.data.data();  // Will need to delete later
+  Block block(contents);
+  TableProperties* props = new TableProperties;
+  Iterator* iter = block.NewIterator(BytewiseComparator());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    SetTableProperty(iter->key(), iter->value(), props);
+  }
+  if (iter->status().ok()) {
+    rep_->properties = props;
+  } else {
+    delete props;
+  }
+  delete iter;
+}
+
+Status Table::ReadRangeDelBlock(const Slice& range_del_handle_value) {
+  Slice v = range_del_handle_value;
+  BlockHandle range_del_handle;
+  Status s = range_del_handle.DecodeFrom(&v);
+  if (!s.ok()) {
+    return s;
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents block;
+  s = ReadBlock(rep_->file, opt, range_del_handle, &block);
+  if (s.ok()) {
+    rep_->range_del_block = new Block(block);
+  }
+  return s;
 }
 
 Table::~Table() { delete rep_; }
 
+const TableProperties* Table::GetProperties() const {
+  return rep_->properties;
+}
+
 static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
 }
@@ -146,12 +461,135 @@ static void DeleteCachedBlock(const Slice& key, void* value) {
   delete block;
 }
 
+// A data block in the block cache of a table that has a secondary cache,
+// which it spills to when the block cache lets go of it
+struct SpillingBlock {
+  SpillingBlock(const BlockContents& contents, SecondaryCache* cache,
+                const std::string& key)
+      : block(contents), secondary_cache(cache), secondary_key(key) {}
+
+  Block block;
+  SecondaryCache* const secondary_cache;
+  const std::string secondary_key;
+};
+
+// Spills every block the block cache lets go of, not only evicted ones:
+//  - An entry replaced by the Insert() of a reader that missed the block
+//    cache at the same time spills a block the block cache still holds.
+//    That takes two readers racing on the same block, and only costs the
+//    secondary cache a copy it would have taken on eviction anyway.
+//  - Deleting the block cache spills every block left in it, which keeps
+//    them for the next process with a persistent secondary cache, and is
+//    why the secondary cache must outlive the block cache.
+static void DeleteSpillingBlock(const Slice& key, void* value) {
+  SpillingBlock* spilling = reinterpret_cast<SpillingBlock*>(value);
+  if (spilling->block.size() > 0) {  // Not corrupted
+    spilling->secondary_cache->Insert(spilling->secondary_key,
+                                      spilling->block.contents());
+  }
+  delete spilling;
+}
+
 static void ReleaseBlock(void* arg, void* h) {
   Cache* cache = reinterpret_cast<Cache*>(arg);
   Cache::Handle* handle = reinterpret_cast<Cache::Handle*>(h);
   cache->Release(handle);
 }
 
+namespace {
+
+// A filter partition, as held in the block cache
+struct FilterPartition {
+  explicit FilterPartition(const BlockContents& contents)
+      : data(contents.data), owned(contents.heap_allocated) {}
+  ~FilterPartition() {
+    if (owned) {
+      delete[] data.data();
+    }
+  }
+
+  Slice data;
+  bool owned;
+};
+
+}  // namespace
+
+static void DeleteCachedFilterPartition(const Slice& key, void* value) {
+  delete reinterpret_cast<FilterPartition*>(value);
+}
+
+// Probes "filter" for "entry", a key or a prefix
+static bool PolicyMayMatch(const FilterPolicy* policy, const Slice& entry,
+                           bool prefix, const Slice& filter) {
+  return prefix ? policy->PrefixMayMatch(entry, filter)
+                : policy->KeyMayMatch(entry, filter);
+}
+
+bool Table::KeyMayMatch(const ReadOptions& options, const TableFilter* filter,
+                        const Slice& key) const {
+  return FilterMayMatch(options, filter, key, key, false);
+}
+
+bool Table::FilterMayMatch(const ReadOptions& options,
+                           const TableFilter* filter, const Slice& key,
+                           const Slice& entry, bool prefix) const {
+  const FilterPolicy* policy = rep_->options.filter_policy;
+  if (filter == nullptr || filter->type == kBlockBasedFilter) {
+    return true;
+  }
+  if (filter->type == kFullFilter) {
+    return PolicyMayMatch(policy, entry, prefix, filter->data);
+  }
+
+  Iterator* iter = filter->index->NewIterator(rep_->options.comparator);
+  iter->Seek(key);
+  if (!iter->Valid()) {
+    // key is past the last key of the table, unless there was an error
+    bool may_match = !iter->status().ok();
+    delete iter;
+    return may_match;
+  }
+  Slice input = iter->value();
+  BlockHandle handle;
+  Status s = handle.DecodeFrom(&input);
+  delete iter;
+  if (!s.ok()) {
+    return true;  // Errors are treated as potential matches
+  }
+
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  if (block_cache != nullptr) {
+    Cache::Handle* cache_handle = block_cache->Lookup(cache_key);
+    if (cache_handle != nullptr) {
+      FilterPartition* partition =
+          reinterpret_cast<FilterPartition*>(block_cache->Value(cache_handle));
+      bool result = PolicyMayMatch(policy, entry, prefix, partition->data);
+      block_cache->Release(cache_handle);
+      return result;
+    }
+  }
+
+  BlockContents contents;
+  if (!ReadBlock(rep_->file, options, handle, &contents).ok()) {
+    return true;
+  }
+  FilterPartition* partition = new FilterPartition(contents);
+  bool result = PolicyMayMatch(policy, entry, prefix, partition->data);
+  if (block_cache != nullptr && contents.cachable && options.fill_cache) {
+    // Partitions are filter blocks as well
+    block_cache->Release(block_cache->Insert(
+        cache_key, partition, partition->data.size(),
+        &DeleteCachedFilterPartition, Cache::Priority::kHigh));
+  } else {
+    delete partition;
+  }
+  return result;
+}
+
 // Convert an index iterator value (i.e., an encoded BlockHandle)
 // into an iterator over the contents of the corresponding block.
 // 返回由arg指定的table的某个data block的迭代器
@@ -160,7 +598,22 @@ Iterator* Table::BlockReader(void* arg,
                              const ReadOptions& options,
                              const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
+  return table->NewBlockIterator(options, index_value, nullptr,
+                                 Cache::Priority::kLow);
+}
+
+Iterator* Table::IndexPartitionReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  return table->NewBlockIterator(options, index_value, nullptr,
+                                 Cache::Priority::kHigh);
+}
+
+Iterator* Table::NewBlockIterator(const ReadOptions& options,
+                                  const Slice& index_value,
+                                  const Slice* get_target,
+                                  Cache::Priority priority) const {
+  Cache* block_cache = rep_->options.block_cache;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
 
@@ -174,23 +627,52 @@ Iterator* Table::BlockReader(void* arg,
     BlockContents contents;
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
+      EncodeFixed64(cache_key_buffer, rep_->cache_id);
       EncodeFixed64(cache_key_buffer + 8, handle.offset());
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
       cache_handle = block_cache->Lookup(key);
+      SecondaryCache* secondary_cache = rep_->secondary_cache;
       if (cache_handle != nullptr) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
-      } else {// 在table的block_cache中找不到key为cache_id，handle.offset()的entry，那么直接从SST文件里面找，并且根据找到的block往block_cache中插入key-block
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        void* value = block_cache->Value(cache_handle);
+        block = secondary_cache == nullptr
+                    ? reinterpret_cast<Block*>(value)
+                    : &reinterpret_cast<SpillingBlock*>(value)->block;
+      } else if (secondary_cache == nullptr) {// 在table的block_cache中找不到key为cache_id，handle.offset()的entry，那么直接从SST文件里面找，并且根据找到的block往block_cache中插入key-block
+        s = ReadBlock(rep_->file, options, handle, &contents);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(key, block, block->size(), &DeleteCachedBlock);
+            cache_handle = block_cache->Insert(key, block, block->size(),
+                                               &DeleteCachedBlock, priority);
+          }
+        }
+      } else {
+        // Blocks evicted from the block cache may be in the secondary cache,
+        // which is much cheaper to read from than the file.
+        const std::string secondary_key = rep_->SecondaryKey(handle);
+        const bool in_secondary = secondary_cache->Lookup(
+            secondary_key, options.fill_cache, &contents.data);
+        if (in_secondary) {
+          contents.cachable = true;
+          contents.heap_allocated = true;
+        } else {
+          s = ReadBlock(rep_->file, options, handle, &contents);
+        }
+        if (s.ok()) {
+          if (contents.cachable && options.fill_cache) {
+            SpillingBlock* spilling =
+                new SpillingBlock(contents, secondary_cache, secondary_key);
+            block = &spilling->block;
+            cache_handle =
+                block_cache->Insert(key, spilling, block->size(),
+                                    &DeleteSpillingBlock, priority);
+          } else {
+            block = new Block(contents);
           }
         }
       }
     } else {// table的block_cache为空，则从SST文件中找
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(rep_->file, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -199,7 +681,10 @@ Iterator* Table::BlockReader(void* arg,
 
   Iterator* iter;
   if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    const Comparator* comparator = rep_->options.comparator;
+    iter = get_target == nullptr
+               ? block->NewIterator(comparator)
+               : block->NewIteratorForGet(comparator, *get_target);
     if (cache_handle == nullptr) {
       iter->RegisterCleanup(&DeleteBlock, block, nullptr);// block没在cache中，所以迭代器被析构时要直接删除这个块
     } else {
@@ -211,29 +696,89 @@ Iterator* Table::BlockReader(void* arg,
   return iter;
 }
 
+bool Table::PrefixMayMatch(void* arg, const ReadOptions& options,
+                           const Slice& prefix, const Slice& index_key,
+                           const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  Rep* rep = table->rep_;
+  if (!rep->prefix_filtering) {
+    return true;
+  }
+  Cache::Handle* filter_handle;
+  const TableFilter* filter = rep->Filter(&filter_handle);
+  bool result;
+  if (filter != nullptr && filter->reader != nullptr) {
+    Slice input = index_value;
+    BlockHandle handle;
+    result = !handle.DecodeFrom(&input).ok() ||
+             filter->reader->PrefixMayMatch(handle.offset(), prefix);
+  } else {
+    // index_key is >= the keys of the block and < those of the next, so
+    // it falls in the filter partition of the block
+    result = table->FilterMayMatch(options, filter, index_key, prefix, true);
+  }
+  rep->Release(filter_handle);
+  return result;
+}
+
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Cache::Handle* cache_handle;
+  Status s;
+  Block* index_block = rep_->IndexBlock(&cache_handle, &s);
+  if (index_block == nullptr) {
+    return NewErrorIterator(s);
+  }
+  Iterator* iter = index_block->NewIterator(rep_->options.comparator);
+  if (cache_handle != nullptr) {
+    iter->RegisterCleanup(&ReleaseBlock, rep_->options.block_cache,
+                          cache_handle);
+  }
+  if (rep_->index_partitioned) {
+    // Index partitions are blocks of index entries, read and cached the
+    // same way as data blocks, but at high priority.
+    iter = NewTwoLevelIterator(iter, &Table::IndexPartitionReader,
+                               const_cast<Table*>(this), options);
+  }
+  return iter;
+}
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  if (options.prefix_same_as_start &&
+      rep_->options.prefix_extractor != nullptr) {
+    return NewTwoLevelIterator(NewIndexIterator(options), &Table::BlockReader,
+                               const_cast<Table*>(this), options,
+                               rep_->options.prefix_extractor,
+                               &Table::PrefixMayMatch);
+  }
+  return NewTwoLevelIterator(NewIndexIterator(options), &Table::BlockReader,
+                             const_cast<Table*>(this), options);
 }
 
 Status Table::InternalGet(const ReadOptions& options,
                           const Slice& k,
                           void* arg,
                           void (*handle_result)(void*, const Slice&, const Slice&)) {
+  Cache::Handle* filter_handle;
+  const TableFilter* filter = rep_->Filter(&filter_handle);
+  if (!KeyMayMatch(options, filter, k)) {
+    rep_->Release(filter_handle);
+    return Status::OK();  // Not found, without reading the index
+  }
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter = NewIndexIterator(options);
   iiter->Seek(k);// 从index_block中找到包含key的data_block
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
-        !filter->KeyMayMatch(handle.offset(), k)) {
+    if (filter != nullptr && filter->reader != nullptr &&
+        handle.DecodeFrom(&handle_value).ok() &&
+        !filter->reader->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
+      // Data blocks enter the cache at low priority, whether a scan or a
+      // point lookup reads them; those read again move up to high.
+      Iterator* block_iter = NewBlockIterator(options, iiter->value(), &k,
+                                              Cache::Priority::kLow);
       if (block_iter->Valid()) {
         (*handle_result)(arg, block_iter->key(), block_iter->value());
       }
@@ -245,12 +790,74 @@ Status Table::InternalGet(const ReadOptions& options,
     s = iiter->status();
   }
   delete iiter;
+  rep_->Release(filter_handle);
   return s;
 }
 
+Status Table::InternalMultiGet(const ReadOptions& options, int n,
+                               const Slice* keys, void* const* args,
+                               void (*handle_result)(void*, const Slice&,
+                                                     const Slice&)) {
+  Status s;
+  const Comparator* cmp = rep_->options.comparator;
+  Cache::Handle* filter_handle;
+  const TableFilter* filter = rep_->Filter(&filter_handle);
+  Iterator* iiter = NewIndexIterator(options);
+  Iterator* block_iter = nullptr;
+  uint64_t block_offset = 0;
+  for (int i = 0; i < n && s.ok(); i++) {
+    const Slice& k = keys[i];
+    if (!KeyMayMatch(options, filter, k)) {
+      continue;  // Not found
+    }
+    // Keys are sorted, so the index entry found for the previous key is
+    // still the right one as long as it is not before k.
+    if (i == 0 || !iiter->Valid() || cmp->Compare(iiter->key(), k) < 0) {
+      iiter->Seek(k);
+    }
+    if (!iiter->Valid()) {
+      // k and every key after it are past the end of the table
+      break;
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    s = handle.DecodeFrom(&handle_value);
+    if (!s.ok()) {
+      break;
+    }
+    if (filter != nullptr && filter->reader != nullptr &&
+        !filter->reader->KeyMayMatch(handle.offset(), k)) {
+      continue;  // Not found
+    }
+    if (block_iter == nullptr || block_offset != handle.offset()) {
+      delete block_iter;
+      block_iter = BlockReader(this, options, iiter->value());
+      block_offset = handle.offset();
+    }
+    block_iter->Seek(k);
+    if (block_iter->Valid()) {
+      (*handle_result)(args[i], block_iter->key(), block_iter->value());
+    }
+    s = block_iter->status();
+  }
+  delete block_iter;
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  rep_->Release(filter_handle);
+  return s;
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (rep_->range_del_block == nullptr) {
+    return nullptr;
+  }
+  return rep_->range_del_block->NewIterator(rep_->options.comparator);
+}
+
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
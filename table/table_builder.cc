@@ -6,10 +6,16 @@
 
 #include <assert.h>
 
+#include <map>
+#include <random>
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
+#include "leveldb/table_properties.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -24,28 +30,67 @@ struct TableBuilder::Rep {
         index_block_options(opt),
         file(f),
         offset(0),
-        data_block(&options),
-        index_block(&index_block_options),
+        data_block(&options, true),
+        index_block(&index_block_options, false),
+        range_del_block(&index_block_options, false),
         num_entries(0),
         closed(false),
-        filter_block(opt.filter_policy == nullptr
+        filter_block(opt.filter_policy == nullptr ||
+                             opt.filter_block_type != kBlockBasedFilter
                          ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
+                         : new FilterBlockBuilder(opt.filter_policy,
+                                                  opt.prefix_extractor)),
+        full_filter_block(opt.filter_policy == nullptr ||
+                                  opt.filter_block_type == kBlockBasedFilter
+                              ? nullptr
+                              : new FullFilterBlockBuilder(
+                                    opt.filter_policy, opt.prefix_extractor)),
+        partition_filters(full_filter_block != nullptr &&
+                          opt.filter_block_type == kPartitionedFilter &&
+                          opt.index_partition_size > 0),
+        collector(opt.table_properties_collector_factory == nullptr
+                      ? nullptr
+                      : opt.table_properties_collector_factory
+                            ->NewCollector()),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
   }
 
+  // Move the current index partition, whose last key is "key", to
+  // index_partitions, and its filter to filter_partitions if filters are
+  // partitioned.
+  void CutIndexPartition(const Slice& key) {
+    index_partitions.push_back(index_block.Finish().ToString());
+    index_partition_keys.push_back(key.ToString());
+    index_block.Reset();
+    if (partition_filters) {
+      filter_partitions.push_back(full_filter_block->Finish().ToString());
+    }
+  }
+
   Options options;
   Options index_block_options;
   WritableFile* file;  //要生成的.sst文件 
   uint64_t offset; //累加每个Data Block的偏移量
   Status status;
   BlockBuilder data_block;
-  BlockBuilder index_block;
+  BlockBuilder index_block;  // The current partition if partitioned
+  BlockBuilder range_del_block;
   std::string last_key; //上一个插入的key值，新插入的key必须比它大，保证.sst文件中的key是从小到大排列的
   int64_t num_entries; //.sst文件中存储的所有记录总数。
   bool closed;  // Either Finish() or Abandon() has been called.
-  FilterBlockBuilder* filter_block;
+  FilterBlockBuilder* filter_block;           // If kBlockBasedFilter
+  FullFilterBlockBuilder* full_filter_block;  // Otherwise
+  const bool partition_filters;  // One filter per index partition
+  TablePropertiesCollector* collector;
+  TableProperties props;  // Gathered while the table is built
+
+  // Finished index partitions, and the last key of each.  They are
+  // written in Finish(), after the data blocks, so that the offsets the
+  // filter block was built with stay valid.
+  std::vector<std::string> index_partitions;
+  std::vector<std::string> index_partition_keys;
+  std::vector<std::string> filter_partitions;  // If partition_filters
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -72,6 +117,8 @@ TableBuilder::TableBuilder(const Options& options, WritableFile* file)
 TableBuilder::~TableBuilder() {
   assert(rep_->closed);  // Catch errors where caller forgot to call Finish()
   delete rep_->filter_block;
+  delete rep_->full_filter_block;
+  delete rep_->collector;
   delete rep_;
 }
 
@@ -82,6 +129,18 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if ((options.index_partition_size == 0) !=
+      (rep_->options.index_partition_size == 0)) {
+    return Status::InvalidArgument(
+        "changing index partitioning while building table");
+  }
+  if (options.filter_block_type != rep_->options.filter_block_type) {
+    return Status::InvalidArgument("changing filter type while building table");
+  }
+  if (options.prefix_extractor != rep_->options.prefix_extractor) {
+    return Status::InvalidArgument(
+        "changing prefix extractor while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
@@ -113,17 +172,33 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    if (r->options.index_partition_size > 0 &&
+        r->index_block.CurrentSizeEstimate() >=
+            r->options.index_partition_size) {
+      r->CutIndexPartition(r->last_key);
+    }
   }
 
   // 2. 构建过滤器
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(key);
   }
+  if (r->full_filter_block != nullptr) {
+    r->full_filter_block->AddKey(key);
+  }
 
   // 3. 记录数据
+  if (r->num_entries == 0) {
+    r->props.smallest_key.assign(key.data(), key.size());
+  }
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
   r->data_block.Add(key, value);
+  r->props.raw_key_size += key.size();
+  r->props.raw_value_size += value.size();
+  if (r->collector != nullptr) {
+    r->collector->AddUserKey(key, value, kEntryPut, 0);
+  }
 
   //4. 数据块(Data Block)大小已达上限，写入文件
   // 如果Data Block的block_data字段大小满足要求，准备写入到磁盘
@@ -133,6 +208,17 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_del_block.Add(key, value);
+  r->props.num_range_deletions++;
+  if (r->collector != nullptr) {
+    r->collector->AddUserKey(key, value, kEntryRangeDeletion, 0);
+  }
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -141,6 +227,8 @@ void TableBuilder::Flush() {
   assert(!r->pending_index_entry);
   WriteBlock(&r->data_block, &r->pending_handle);
   if (ok()) {
+    r->props.data_size += r->pending_handle.size() + kBlockTrailerSize;
+    r->props.num_data_blocks++;
     r->pending_index_entry = true;
     r->status = r->file->Flush();
   }
@@ -155,9 +243,13 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   //    type: uint8
   //    crc: uint32
   assert(ok());
-  Rep* r = rep_;
-  Slice raw = block->Finish();
+  CompressAndWriteBlock(block->Finish(), handle);
+  block->Reset();
+}
 
+void TableBuilder::CompressAndWriteBlock(const Slice& raw,
+                                         BlockHandle* handle) {
+  Rep* r = rep_;
   Slice block_contents;
   CompressionType type = r->options.compression;
   // TODO(postrelease): Support more compression options: zlib?
@@ -183,7 +275,6 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   }
   WriteRawBlock(block_contents, type, handle);
   r->compressed_output.clear();
-  block->Reset();
 }
 
 void TableBuilder::WriteRawBlock(const Slice& block_contents,
@@ -214,49 +305,178 @@ Status TableBuilder::status() const { return rep_->status; }
 
 // 结构
 // 1.data_block
-// 2.filter_block
-// 3.meta_index_block
-// 4.index_block
-// 5.footer
+// 2.range tombstone block
+// 3.index partitions, if the index is partitioned
+// 4.filter_block (filter partitions and their index if partitioned)
+// 5.properties block
+// 6.meta_index_block (filter, range tombstones and properties)
+// 7.index_block (the top-level index if the index is partitioned)
+// 8.footer
 Status TableBuilder::Finish() {
   Rep* r = rep_;
   Flush(); // 是因为调用Finish的时候，block_data不一定大于等于block_size，所以要调用Flush,将这部分block_data写入到磁盘
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle,
+      range_del_block_handle, properties_block_handle;
+
+  // Write range tombstone block
+  const bool has_range_del = !r->range_del_block.empty();
+  if (ok() && has_range_del) {
+    WriteBlock(&r->range_del_block, &range_del_block_handle);
+  }
+
+  r->props.largest_key = r->last_key;
+
+  // Add the last index entry now, so that the size of the index block is
+  // known when the properties are written.
+  if (ok() && r->pending_index_entry) {
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    std::string handle_encoding;
+    r->pending_handle.EncodeTo(&handle_encoding);
+    r->index_block.Add(r->last_key, Slice(handle_encoding));
+    r->pending_index_entry = false;
+  }
+
+  // Write index partitions.  index_block becomes the top-level index,
+  // mapping the last key of each partition to its handle.
+  const bool partitioned = r->options.index_partition_size > 0;
+  uint64_t index_partitions_size = 0;
+  if (ok() && partitioned) {
+    if (!r->index_block.empty()) {
+      r->CutIndexPartition(r->last_key);
+    }
+    for (size_t i = 0; i < r->index_partitions.size() && ok(); i++) {
+      BlockHandle handle;
+      CompressAndWriteBlock(r->index_partitions[i], &handle);
+      index_partitions_size += handle.size() + kBlockTrailerSize;
+      std::string handle_encoding;
+      handle.EncodeTo(&handle_encoding);
+      r->index_block.Add(r->index_partition_keys[i], handle_encoding);
+    }
+    r->props.num_index_partitions = r->index_partitions.size();
+  }
 
   // Write filter block
   if (ok() && r->filter_block != nullptr) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+    r->props.filter_size = filter_block_handle.size();
+  } else if (ok() && r->partition_filters) {
+    // The filter partitions are indexed by the keys of the index partitions
+    BlockBuilder filter_index(&r->index_block_options, false);
+    for (size_t i = 0; i < r->filter_partitions.size() && ok(); i++) {
+      BlockHandle handle;
+      WriteRawBlock(r->filter_partitions[i], kNoCompression, &handle);
+      r->props.filter_size += handle.size() + kBlockTrailerSize;
+      std::string handle_encoding;
+      handle.EncodeTo(&handle_encoding);
+      filter_index.Add(r->index_partition_keys[i], handle_encoding);
+    }
+    if (ok()) {
+      r->props.filter_size += filter_index.CurrentSizeEstimate();
+      WriteBlock(&filter_index, &filter_block_handle);
+    }
+  } else if (ok() && r->full_filter_block != nullptr) {
+    WriteRawBlock(r->full_filter_block->Finish(), kNoCompression,
+                  &filter_block_handle);
+    r->props.filter_size = filter_block_handle.size();
+  }
+  r->index_partitions.clear();
+  r->index_partition_keys.clear();
+  r->filter_partitions.clear();
+
+  // Write properties block
+  if (ok()) {
+    std::map<std::string, std::string> properties;
+    TableProperties* props = &r->props;
+    AddNumberProperty(kNumEntriesProperty, r->num_entries, &properties);
+    AddNumberProperty(kNumRangeDeletionsProperty, props->num_range_deletions,
+                      &properties);
+    AddNumberProperty(kRawKeySizeProperty, props->raw_key_size, &properties);
+    AddNumberProperty(kRawValueSizeProperty, props->raw_value_size,
+                      &properties);
+    AddNumberProperty(kDataSizeProperty, props->data_size, &properties);
+    AddNumberProperty(kNumDataBlocksProperty, props->num_data_blocks,
+                      &properties);
+    AddNumberProperty(
+        kIndexSizeProperty,
+        index_partitions_size + r->index_block.CurrentSizeEstimate(),
+        &properties);
+    AddNumberProperty(kFilterSizeProperty, props->filter_size, &properties);
+    if (partitioned) {
+      AddNumberProperty(kNumIndexPartitionsProperty,
+                        props->num_index_partitions, &properties);
+    }
+    if (r->num_entries > 0) {
+      properties[kSmallestKeyProperty] = props->smallest_key;
+      properties[kLargestKeyProperty] = props->largest_key;
+    }
+    if (r->options.prefix_extractor != nullptr) {
+      // Readers only trust the prefixes in the filters if they extract
+      // them the same way
+      properties[kPrefixExtractorNameProperty] =
+          r->options.prefix_extractor->Name();
+    }
+    if (r->collector != nullptr) {
+      // May replace the properties above, e.g. with user keys
+      r->collector->Finish(&properties);
+    }
+    std::random_device random;
+    std::string* unique_id = &properties[kUniqueIdProperty];
+    unique_id->clear();
+    for (int i = 0; i < 4; i++) {
+      PutFixed32(unique_id, random());
+    }
+
+    // Properties are looked up by name, whatever the table comparator
+    Options properties_options = r->options;
+    properties_options.comparator = BytewiseComparator();
+    BlockBuilder properties_block(&properties_options, false);
+    for (const auto& property : properties) {
+      properties_block.Add(property.first, property.second);
+    }
+    WriteBlock(&properties_block, &properties_block_handle);
   }
 
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
-    if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+    // Entries are sorted by name before they are added
+    std::map<std::string, std::string> meta;
+    if (r->options.filter_policy != nullptr) {
+      // Add mapping from "<prefix>.Name" to location of filter data
+      std::string key;
+      if (r->filter_block != nullptr) {
+        key = kBlockBasedFilterPrefix;
+      } else if (r->partition_filters) {
+        key = kPartitionedFilterPrefix;
+      } else {
+        key = kFullFilterPrefix;
+      }
       key.append(r->options.filter_policy->Name());
-      std::string handle_encoding;
-      filter_block_handle.EncodeTo(&handle_encoding);
-      meta_index_block.Add(key, handle_encoding);
+      filter_block_handle.EncodeTo(&meta[key]);
+    }
+    if (partitioned) {
+      meta[kPartitionedIndexName] = "";
+    }
+    properties_block_handle.EncodeTo(&meta[kPropertiesBlockName]);
+    if (has_range_del) {
+      range_del_block_handle.EncodeTo(&meta[kRangeDelBlockName]);
     }
 
-    // TODO(postrelease): Add stats and other meta blocks
+    // Like the properties, meta blocks are looked up by name
+    Options meta_index_options = r->options;
+    meta_index_options.comparator = BytewiseComparator();
+    BlockBuilder meta_index_block(&meta_index_options, false);
+    for (const auto& entry : meta) {
+      meta_index_block.Add(entry.first, entry.second);
+    }
     WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
 
   // Write index block
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
-    }
     WriteBlock(&r->index_block, &index_block_handle);
   }
 
@@ -0,0 +1,115 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/table_properties.h"
+
+#include <stdio.h>
+
+#include "table/format.h"
+#include "util/coding.h"
+#include "util/logging.h"
+
+namespace leveldb {
+
+TablePropertiesCollector::~TablePropertiesCollector() {}
+
+TablePropertiesCollectorFactory::~TablePropertiesCollectorFactory() {}
+
+double TableProperties::CompressionRatio() const {
+  if (data_size == 0) {
+    return 0;
+  }
+  return static_cast<double>(raw_key_size + raw_value_size) / data_size;
+}
+
+std::string TableProperties::ToString() const {
+  std::string r;
+  char buf[500];
+  snprintf(
+      buf, sizeof(buf),
+      "# entries: %llu; # deletions: %llu; # merge operands: %llu; "
+      "# range deletions: %llu\n"
+      "raw key size: %llu; raw value size: %llu; data size: %llu; "
+      "# data blocks: %llu; index size: %llu; # index partitions: %llu; "
+      "filter size: %llu; compression ratio: %.2f\n",
+      static_cast<unsigned long long>(num_entries),
+      static_cast<unsigned long long>(num_deletions),
+      static_cast<unsigned long long>(num_merge_operands),
+      static_cast<unsigned long long>(num_range_deletions),
+      static_cast<unsigned long long>(raw_key_size),
+      static_cast<unsigned long long>(raw_value_size),
+      static_cast<unsigned long long>(data_size),
+      static_cast<unsigned long long>(num_data_blocks),
+      static_cast<unsigned long long>(index_size),
+      static_cast<unsigned long long>(num_index_partitions),
+      static_cast<unsigned long long>(filter_size), CompressionRatio());
+  r.append(buf);
+  r.append("key range: '");
+  r.append(EscapeString(smallest_key));
+  r.append("' .. '");
+  r.append(EscapeString(largest_key));
+  r.append("'\n");
+  if (!prefix_extractor_name.empty()) {
+    r.append("prefix extractor: ");
+    r.append(prefix_extractor_name);
+    r.append("\n");
+  }
+  for (const auto& p : user_collected_properties) {
+    r.append(p.first);
+    r.append(": ");
+    r.append(EscapeString(p.second));
+    r.append("\n");
+  }
+  return r;
+}
+
+void AddNumberProperty(const char* name, uint64_t value,
+                       std::map<std::string, std::string>* properties) {
+  std::string* dst = &(*properties)[name];
+  dst->clear();
+  PutVarint64(dst, value);
+}
+
+void SetTableProperty(const Slice& name, const Slice& value,
+                      TableProperties* props) {
+  static const struct {
+    const char* name;
+    uint64_t TableProperties::*field;
+  } kNumbers[] = {
+      {kNumEntriesProperty, &TableProperties::num_entries},
+      {kNumDeletionsProperty, &TableProperties::num_deletions},
+      {kNumMergeOperandsProperty, &TableProperties::num_merge_operands},
+      {kNumRangeDeletionsProperty, &TableProperties::num_range_deletions},
+      {kRawKeySizeProperty, &TableProperties::raw_key_size},
+      {kRawValueSizeProperty, &TableProperties::raw_value_size},
+      {kDataSizeProperty, &TableProperties::data_size},
+      {kNumDataBlocksProperty, &TableProperties::num_data_blocks},
+      {kIndexSizeProperty, &TableProperties::index_size},
+      {kFilterSizeProperty, &TableProperties::filter_size},
+      {kNumIndexPartitionsProperty, &TableProperties::num_index_partitions},
+  };
+  for (const auto& number : kNumbers) {
+    if (name == Slice(number.name)) {
+      Slice input = value;
+      uint64_t v;
+      if (GetVarint64(&input, &v)) {
+        props->*number.field = v;
+      }
+      return;
+    }
+  }
+  if (name == Slice(kSmallestKeyProperty)) {
+    props->smallest_key = value.ToString();
+  } else if (name == Slice(kLargestKeyProperty)) {
+    props->largest_key = value.ToString();
+  } else if (name == Slice(kPrefixExtractorNameProperty)) {
+    props->prefix_extractor_name = value.ToString();
+  } else if (name == Slice(kUniqueIdProperty)) {
+    props->unique_id = value.ToString();
+  } else {
+    props->user_collected_properties[name.ToString()] = value.ToString();
+  }
+}
+
+}  // namespace leveldb
@@ -6,6 +6,7 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/memtable.h"
@@ -14,9 +15,12 @@
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "leveldb/table_builder.h"
+#include "leveldb/table_properties.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "table/merger.h"
+#include "util/hash.h"
 #include "util/random.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
@@ -181,7 +185,7 @@ class BlockConstructor : public Constructor {
   Status FinishImpl(const Options& options, const KVMap& data) override {
     delete block_;
     block_ = nullptr;
-    BlockBuilder builder(&options);
+    BlockBuilder builder(&options, true);
 
     for (const auto& kvp : data) {
       builder.Add(kvp.first, kvp.second);
@@ -207,6 +211,50 @@ class BlockConstructor : public Constructor {
   BlockConstructor();
 };
 
+// Spreads the data over several blocks and reads it back through a
+// merging iterator, the way a DB iterator merges overlapping tables.
+class MergerConstructor : public Constructor {
+ public:
+  explicit MergerConstructor(const Comparator* cmp)
+      : Constructor(cmp), comparator_(cmp) {
+    for (int i = 0; i < kNumChildren; i++) {
+      children_[i] = new BlockConstructor(cmp);
+    }
+  }
+  ~MergerConstructor() override {
+    for (int i = 0; i < kNumChildren; i++) {
+      delete children_[i];
+    }
+  }
+  Status FinishImpl(const Options& options, const KVMap& data) override {
+    std::vector<KVMap> parts(kNumChildren, KVMap(STLLessThan(comparator_)));
+    for (const auto& kvp : data) {
+      const uint32_t h = Hash(kvp.first.data(), kvp.first.size(), 0);
+      parts[h % kNumChildren][kvp.first] = kvp.second;
+    }
+    for (int i = 0; i < kNumChildren; i++) {
+      Status s = children_[i]->FinishImpl(options, parts[i]);
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    return Status::OK();
+  }
+  Iterator* NewIterator() const override {
+    Iterator* list[kNumChildren];
+    for (int i = 0; i < kNumChildren; i++) {
+      list[i] = children_[i]->NewIterator();
+    }
+    return NewMergingIterator(comparator_, list, kNumChildren);
+  }
+
+ private:
+  enum { kNumChildren = 5 };
+
+  const Comparator* const comparator_;
+  BlockConstructor* children_[kNumChildren];
+};
+
 class TableConstructor : public Constructor {
  public:
   TableConstructor(const Comparator* cmp)
@@ -241,6 +289,10 @@ class TableConstructor : public Constructor {
     return table_->ApproximateOffsetOf(key);
   }
 
+  const TableProperties* GetProperties() const {
+    return table_->GetProperties();
+  }
+
  private:
   void Reset() {
     delete table_;
@@ -370,7 +422,14 @@ class DBConstructor : public Constructor {
   DB* db_;
 };
 
-enum TestType { TABLE_TEST, BLOCK_TEST, MEMTABLE_TEST, DB_TEST };
+enum TestType {
+  TABLE_TEST,
+  PARTITIONED_TABLE_TEST,
+  BLOCK_TEST,
+  MERGER_TEST,
+  MEMTABLE_TEST,
+  DB_TEST
+};
 
 struct TestArgs {
   TestType type;
@@ -386,6 +445,10 @@ static const TestArgs kTestArgList[] = {
     {TABLE_TEST, true, 1},
     {TABLE_TEST, true, 1024},
 
+    {PARTITIONED_TABLE_TEST, false, 16},
+    {PARTITIONED_TABLE_TEST, false, 1},
+    {PARTITIONED_TABLE_TEST, true, 16},
+
     {BLOCK_TEST, false, 16},
     {BLOCK_TEST, false, 1},
     {BLOCK_TEST, false, 1024},
@@ -393,6 +456,11 @@ static const TestArgs kTestArgList[] = {
     {BLOCK_TEST, true, 1},
     {BLOCK_TEST, true, 1024},
 
+    {MERGER_TEST, false, 16},
+    {MERGER_TEST, false, 1},
+    {MERGER_TEST, true, 16},
+    {MERGER_TEST, true, 1},
+
     // Restart interval does not matter for memtables
     {MEMTABLE_TEST, false, 16},
     {MEMTABLE_TEST, true, 16},
@@ -423,9 +491,16 @@ class Harness {
       case TABLE_TEST:
         constructor_ = new TableConstructor(options_.comparator);
         break;
+      case PARTITIONED_TABLE_TEST:
+        options_.index_partition_size = 64;
+        constructor_ = new TableConstructor(options_.comparator);
+        break;
       case BLOCK_TEST:
         constructor_ = new BlockConstructor(options_.comparator);
         break;
+      case MERGER_TEST:
+        constructor_ = new MergerConstructor(options_.comparator);
+        break;
       case MEMTABLE_TEST:
         constructor_ = new MemTableConstructor(options_.comparator);
         break;
@@ -747,6 +822,134 @@ TEST(MemTableTest, Simple) {
   memtable->Unref();
 }
 
+class BlockHashIndexTest {
+ public:
+  // Build a block of "num_keys" user keys with versions 1..3 each, with
+  // or without a hash index
+  static std::string BuildBlock(const Comparator* cmp, int num_keys,
+                                int restart_interval, bool hash_index) {
+    Options options;
+    options.comparator = cmp;
+    options.block_restart_interval = restart_interval;
+    options.data_block_index_type =
+        hash_index ? kDataBlockBinaryAndHash : kDataBlockBinarySearch;
+    BlockBuilder builder(&options, true);
+    for (int i = 0; i < num_keys; i++) {
+      for (SequenceNumber seq = 3; seq >= 1; seq--) {
+        InternalKey key(UserKey(i), seq, kTypeValue);
+        builder.Add(key.Encode(), UserKey(i) + "@" + NumberToString(seq));
+      }
+    }
+    return builder.Finish().ToString();
+  }
+
+  // Even numbers are in the blocks, odd ones are not
+  static std::string Number(int n) {
+    char buf[20];
+    snprintf(buf, sizeof(buf), "key%04d", n);
+    return buf;
+  }
+  static std::string UserKey(int i) { return Number(2 * i); }
+
+  // The value found by a point lookup of user key "key" at "seq", or "" if
+  // there is none
+  static std::string Get(Block* block, const Comparator* cmp,
+                         const std::string& key, SequenceNumber seq) {
+    InternalKey target(key, seq, kValueTypeForSeek);
+    Iterator* iter = block->NewIteratorForGet(cmp, target.Encode());
+    std::string result;
+    // Without a hash index the iterator is at the first entry >= target,
+    // which may belong to another user key
+    if (iter->Valid() && ExtractUserKey(iter->key()) == key) {
+      result = iter->value().ToString();
+    }
+    delete iter;
+    return result;
+  }
+
+  static void CheckLookups(const std::string& data, int num_keys) {
+    InternalKeyComparator cmp(BytewiseComparator());
+    BlockContents contents;
+    contents.data = data;
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    Block block(contents);
+    for (int i = 0; i < num_keys; i++) {
+      const std::string key = UserKey(i);
+      ASSERT_EQ(key + "@3", Get(&block, &cmp, key, 100));
+      ASSERT_EQ(key + "@2", Get(&block, &cmp, key, 2));
+      ASSERT_EQ(key + "@1", Get(&block, &cmp, key, 1));
+      // Missing user keys, including one past the last key
+      ASSERT_EQ("", Get(&block, &cmp, Number(2 * i + 1), 5));
+      ASSERT_EQ("", Get(&block, &cmp, key + "x", 5));
+      // A snapshot older than every version of the key
+      ASSERT_EQ("", Get(&block, &cmp, key, 0));
+    }
+  }
+};
+
+TEST(BlockHashIndexTest, Lookups) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  for (int restart_interval : {1, 2, 16}) {
+    const int kKeys = 60;
+    const std::string plain = BuildBlock(&cmp, kKeys, restart_interval, false);
+    const std::string hashed = BuildBlock(&cmp, kKeys, restart_interval, true);
+    // About a byte per user key, plus the bucket count
+    ASSERT_GT(hashed.size(), plain.size() + kKeys);
+    ASSERT_LT(hashed.size(), plain.size() + 2 * kKeys + 4);
+    CheckLookups(plain, kKeys);
+    CheckLookups(hashed, kKeys);
+  }
+}
+
+TEST(BlockHashIndexTest, TooManyRestarts) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  // 300 restart points do not fit the 8-bit buckets, so the block has no
+  // index
+  const int kKeys = 100;
+  const std::string plain = BuildBlock(&cmp, kKeys, 1, false);
+  const std::string hashed = BuildBlock(&cmp, kKeys, 1, true);
+  ASSERT_EQ(plain, hashed);
+  CheckLookups(hashed, kKeys);
+}
+
+TEST(BlockHashIndexTest, SizeEstimate) {
+  // The estimate counts the index only when the block gets one
+  InternalKeyComparator cmp(BytewiseComparator());
+  for (int restart_interval : {1, 16}) {
+    Options options;
+    options.comparator = &cmp;
+    options.block_restart_interval = restart_interval;
+    options.data_block_index_type = kDataBlockBinaryAndHash;
+    BlockBuilder builder(&options, true);
+    for (int i = 0; i < 300; i++) {
+      InternalKey key(UserKey(i), 1, kTypeValue);
+      builder.Add(key.Encode(), "v");
+    }
+    const size_t estimate = builder.CurrentSizeEstimate();
+    ASSERT_EQ(estimate, builder.Finish().size());
+  }
+}
+
+TEST(BlockHashIndexTest, Iteration) {
+  // Blocks with a hash index iterate like any other
+  InternalKeyComparator cmp(BytewiseComparator());
+  const std::string data = BuildBlock(&cmp, 50, 16, true);
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+  Iterator* iter = block.NewIterator(&cmp);
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) count++;
+  ASSERT_EQ(150, count);
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) count--;
+  ASSERT_EQ(0, count);
+  ASSERT_TRUE(iter->status().ok());
+  delete iter;
+}
+
 static bool Between(uint64_t val, uint64_t low, uint64_t high) {
   bool result = (val >= low) && (val <= high);
   if (!result) {
@@ -788,6 +991,102 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
+// Records the total size of the values as a property
+class ValueSizeCollectorFactory : public TablePropertiesCollectorFactory {
+ public:
+  const char* Name() const override { return "leveldb.test.ValueSize"; }
+
+  TablePropertiesCollector* NewCollector() const override {
+    return new Collector;
+  }
+
+ private:
+  class Collector : public TablePropertiesCollector {
+   public:
+    Collector() : size_(0) {}
+
+    const char* Name() const override { return "leveldb.test.ValueSize"; }
+
+    void AddUserKey(const Slice& key, const Slice& value, EntryType type,
+                    uint64_t seq) override {
+      ASSERT_EQ(kEntryPut, type);
+      size_ += value.size();
+    }
+
+    void Finish(std::map<std::string, std::string>* properties) override {
+      (*properties)["test.value.size"] = NumberToString(size_);
+    }
+
+   private:
+    uint64_t size_;
+  };
+};
+
+TEST(TableTest, Properties) {
+  ValueSizeCollectorFactory factory;
+  TableConstructor c(BytewiseComparator());
+  c.Add("k01", "hello");
+  c.Add("k02", std::string(2000, 'x'));
+  c.Add("k03", std::string(3000, 'x'));
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.table_properties_collector_factory = &factory;
+  c.Finish(options, &keys, &kvmap);
+
+  const TableProperties* props = c.GetProperties();
+  ASSERT_TRUE(props != nullptr);
+  ASSERT_EQ(3, props->num_entries);
+  ASSERT_EQ(0, props->num_deletions);
+  ASSERT_EQ(9, props->raw_key_size);
+  ASSERT_EQ(5005, props->raw_value_size);
+  ASSERT_EQ(2, props->num_data_blocks);
+  ASSERT_TRUE(Between(props->data_size, 5014, 5100));
+  ASSERT_GT(props->index_size, 0);
+  ASSERT_EQ(0, props->filter_size);
+  ASSERT_EQ("k01", props->smallest_key);
+  ASSERT_EQ("k03", props->largest_key);
+  ASSERT_LT(props->CompressionRatio(), 1.0);
+  ASSERT_EQ(1, props->user_collected_properties.size());
+  ASSERT_EQ("5005", props->user_collected_properties.at("test.value.size"));
+}
+
+TEST(TableTest, PartitionedIndex) {
+  TableConstructor plain(BytewiseComparator());
+  TableConstructor partitioned(BytewiseComparator());
+  for (int i = 0; i < 1000; i++) {
+    char key[20];
+    snprintf(key, sizeof(key), "k%06d", i);
+    plain.Add(key, std::string(100, 'x'));
+    partitioned.Add(key, std::string(100, 'x'));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  plain.Finish(options, &keys, &kvmap);
+  options.index_partition_size = 256;
+  partitioned.Finish(options, &keys, &kvmap);
+
+  const TableProperties* props = partitioned.GetProperties();
+  ASSERT_TRUE(props != nullptr);
+  ASSERT_GT(props->num_index_partitions, 1);
+  ASSERT_EQ(0, plain.GetProperties()->num_index_partitions);
+  ASSERT_EQ(plain.GetProperties()->num_data_blocks, props->num_data_blocks);
+
+  // The partitions are written after the data blocks, which are laid out
+  // as in the plain table.
+  for (const std::string& key : keys) {
+    ASSERT_EQ(plain.ApproximateOffsetOf(key),
+              partitioned.ApproximateOffsetOf(key));
+  }
+  ASSERT_EQ(plain.ApproximateOffsetOf("k0005005"),
+            partitioned.ApproximateOffsetOf("k0005005"));
+}
+
 static bool SnappyCompressionSupported() {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
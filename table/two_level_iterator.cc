@@ -4,6 +4,7 @@
 
 #include "table/two_level_iterator.h"
 
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
 #include "table/block.h"
 #include "table/format.h"
@@ -20,7 +21,9 @@ class TwoLevelIterator : public Iterator {
   TwoLevelIterator(Iterator* index_iter,
                    BlockFunction block_function,
                    void* arg,
-                   const ReadOptions& options);
+                   const ReadOptions& options,
+                   const SliceTransform* prefix_extractor,
+                   PrefixFunction prefix_may_match);
 
   ~TwoLevelIterator() override;
 
@@ -58,11 +61,25 @@ class TwoLevelIterator : public Iterator {
   void SkipEmptyDataBlocksBackward();
   void SetDataIterator(Iterator* data_iter);
   void InitDataBlock();
+  void PositionDataBlockForward();
+
+  // True if the keys of the block at index_iter_, and all those after it,
+  // are past the keys with prefix_
+  bool PastPrefix() const {
+    return !index_iter_.key().starts_with(prefix_);
+  }
 
   BlockFunction block_function_;
   void* arg_;
   const ReadOptions options_;
+  const SliceTransform* const prefix_extractor_;  // May be nullptr
+  const PrefixFunction prefix_may_match_;        // May be nullptr
   Status status_;
+  // Set by a Seek() to a key with a prefix: the iterator stops after the
+  // keys with prefix_, and positions the blocks after the first at target_.
+  bool prefix_seek_;
+  std::string prefix_;
+  std::string target_;
   IteratorWrapper index_iter_;  //第一层迭代器，Index Block的block_data字段迭代器的代理
   IteratorWrapper data_iter_;  // May be nullptr 第二层迭代器，Data Block的block_data字段迭代器的代理
   // If data_iter_ is non-null, then "data_block_handle_" holds the
@@ -72,16 +89,28 @@ class TwoLevelIterator : public Iterator {
 
 TwoLevelIterator::TwoLevelIterator(Iterator* index_iter,
                                    BlockFunction block_function, void* arg,
-                                   const ReadOptions& options)
+                                   const ReadOptions& options,
+                                   const SliceTransform* prefix_extractor,
+                                   PrefixFunction prefix_may_match)
     : block_function_(block_function),
       arg_(arg),
       options_(options),
+      prefix_extractor_(prefix_extractor),
+      prefix_may_match_(prefix_may_match),
+      prefix_seek_(false),
       index_iter_(index_iter),
       data_iter_(nullptr) {}
 
 TwoLevelIterator::~TwoLevelIterator() = default;
 
 void TwoLevelIterator::Seek(const Slice& target) {
+  prefix_seek_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (prefix_seek_) {
+    const Slice prefix = prefix_extractor_->Transform(target);
+    prefix_.assign(prefix.data(), prefix.size());
+    target_.assign(target.data(), target.size());
+  }
   index_iter_.Seek(target);
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.Seek(target);
@@ -89,6 +118,7 @@ void TwoLevelIterator::Seek(const Slice& target) {
 }
 
 void TwoLevelIterator::SeekToFirst() {
+  prefix_seek_ = false;
   index_iter_.SeekToFirst();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
@@ -96,6 +126,7 @@ void TwoLevelIterator::SeekToFirst() {
 }
 
 void TwoLevelIterator::SeekToLast() {
+  prefix_seek_ = false;
   index_iter_.SeekToLast();
   InitDataBlock();
   if (data_iter_.iter() != nullptr) data_iter_.SeekToLast();
@@ -110,6 +141,8 @@ void TwoLevelIterator::Next() {
 
 void TwoLevelIterator::Prev() {
   assert(Valid());
+  // Going back leaves the range a prefix seek was bounded to
+  prefix_seek_ = false;
   data_iter_.Prev();
   SkipEmptyDataBlocksBackward();
 }
@@ -121,9 +154,26 @@ void TwoLevelIterator::SkipEmptyDataBlocksForward() {
       SetDataIterator(nullptr);
       return;
     }
+    if (prefix_seek_ && PastPrefix()) {
+      SetDataIterator(nullptr);
+      return;
+    }
     index_iter_.Next();
     InitDataBlock();
-    if (data_iter_.iter() != nullptr) data_iter_.SeekToFirst();
+    PositionDataBlockForward();
+  }
+}
+
+void TwoLevelIterator::PositionDataBlockForward() {
+  if (data_iter_.iter() == nullptr) {
+    return;
+  }
+  if (prefix_seek_) {
+    // The block is past target_, but seeking to it lets a block that is
+    // itself a two-level iterator bound and filter its own blocks
+    data_iter_.Seek(target_);
+  } else {
+    data_iter_.SeekToFirst();
   }
 }
 
@@ -148,6 +198,11 @@ void TwoLevelIterator::SetDataIterator(Iterator* data_iter) {
 void TwoLevelIterator::InitDataBlock() {
   if (!index_iter_.Valid()) {
     SetDataIterator(nullptr);
+  } else if (prefix_seek_ && prefix_may_match_ != nullptr &&
+             !(*prefix_may_match_)(arg_, options_, prefix_, index_iter_.key(),
+                                   index_iter_.value())) {
+    // No key of the block has the prefix
+    SetDataIterator(nullptr);
   } else {
     Slice handle = index_iter_.value();
     if (data_iter_.iter() != nullptr &&
@@ -168,7 +223,17 @@ Iterator* NewTwoLevelIterator(Iterator* index_iter,
                               BlockFunction block_function,
                               void* arg,
                               const ReadOptions& options) {
-  return new TwoLevelIterator(index_iter, block_function, arg, options);
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              nullptr, nullptr);
+}
+
+Iterator* NewTwoLevelIterator(Iterator* index_iter,
+                              BlockFunction block_function, void* arg,
+                              const ReadOptions& options,
+                              const SliceTransform* prefix_extractor,
+                              PrefixFunction prefix_may_match) {
+  return new TwoLevelIterator(index_iter, block_function, arg, options,
+                              prefix_extractor, prefix_may_match);
 }
 
 }  // namespace leveldb
@@ -10,6 +10,7 @@
 namespace leveldb {
 
 struct ReadOptions;
+class SliceTransform;
 
 // Return a new two level iterator.  A two-level iterator contains an
 // index iterator whose values point to a sequence of blocks where
@@ -27,6 +28,28 @@ Iterator* NewTwoLevelIterator(
     void* arg,
     const ReadOptions& options);
 
+// Returns false if the block of the index entry "index_key", "index_value"
+// has no key with "prefix".
+typedef bool (*PrefixFunction)(void* arg, const ReadOptions& options,
+                               const Slice& prefix, const Slice& index_key,
+                               const Slice& index_value);
+
+// Like the above, but a Seek() to a key in the domain of
+// "prefix_extractor" only yields the keys that follow the target and share
+// its prefix, after which the iterator becomes invalid.  Blocks for which
+// "prefix_may_match" returns false are skipped without being read; it may
+// be nullptr.  SeekToFirst(), SeekToLast() and Prev() iterate over all
+// keys, as do Next() after them.
+//
+// REQUIRES: the index keys are >= the keys of their blocks, and the keys
+// that start with a prefix are contiguous.
+Iterator* NewTwoLevelIterator(
+    Iterator* index_iter,
+    Iterator* (*block_function)(void* arg, const ReadOptions& options,
+                                const Slice& index_value),
+    void* arg, const ReadOptions& options,
+    const SliceTransform* prefix_extractor, PrefixFunction prefix_may_match);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_TABLE_TWO_LEVEL_ITERATOR_H_
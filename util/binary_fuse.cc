@@ -0,0 +1,301 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Binary fuse filters, as described in "Binary Fuse Filters: Fast and Smaller
+// Than Xor Filters" by Graf and Lemire.  Every key is mapped to three slots
+// of an array of r-bit fingerprints, and the array is filled in so that the
+// XOR of the three slots of every key equals the fingerprint of the key.  A
+// key that was not added matches with probability 2^-r, and the array has
+// about 1.125 slots per key, versus the ~1.44 * log2(1/fpr) bits per key of
+// a bloom filter with the same false positive rate.
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+// A filter is the packed array of fingerprints, followed by
+//    seed:             fixed64
+//    segment_count:    fixed32
+//    segment_length_lg: uint8
+//    fingerprint_bits: uint8
+// Each fingerprint is read with a 4-byte load starting at the byte that holds
+// its first bit, which may run into the trailer but never past it.
+static const size_t kTrailerSize = 8 + 4 + 1 + 1;
+static const int kMaxFingerprintBits = 24;
+static const int kMaxSegmentLengthLg = 18;
+
+// Construction fails when the keys cannot all be peeled (see Populate()),
+// after which it is retried with another seed and, every other attempt, a
+// larger array.
+static const int kMaxAttempts = 64;
+
+static uint64_t FuseHash(const Slice& key) {
+  const uint64_t lo = Hash(key.data(), key.size(), 0xbc9f1d34);
+  const uint64_t hi = Hash(key.data(), key.size(), 0x34dbcf1a);
+  return (hi << 32) | lo;
+}
+
+// Finalizer of MurmurHash3; a bijection, so keys with distinct FuseHash()
+// values keep distinct hashes under every seed.
+static uint64_t Mix(uint64_t h, uint64_t seed) {
+  h += seed;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+// The shape of the array of fingerprints
+struct Layout {
+  uint32_t segment_length;
+  uint32_t segment_count;
+
+  uint32_t array_length() const { return (segment_count + 2) * segment_length; }
+
+  // Store in slots[0..2] the slots of "hash".  The slots fall into three
+  // consecutive segments, the first of which is picked by the high bits.
+  void Slots(uint64_t hash, uint32_t slots[3]) const {
+    const uint64_t range =
+        static_cast<uint64_t>(segment_count) * segment_length;
+    const uint32_t mask = segment_length - 1;
+    slots[0] = static_cast<uint32_t>(((hash >> 32) * range) >> 32);
+    slots[1] = (slots[0] + segment_length) ^ ((hash >> 18) & mask);
+    slots[2] = (slots[0] + 2 * segment_length) ^ (hash & mask);
+  }
+};
+
+// The segment length for "n" keys: half of what the paper suggests for
+// three slots per key, which wastes less of the two extra segments on sets
+// of a few thousand keys and still peels at 1.125 slots per key for large
+// sets
+static int SegmentLengthLg(size_t n) {
+  const double size = static_cast<double>(std::max<size_t>(n, 2));
+  const int lg = static_cast<int>(floor(log(size) / log(3.33) + 1.25));
+  return std::min(std::max(lg, 0), kMaxSegmentLengthLg);
+}
+
+// The smallest layout that holds "slots" slots
+static Layout LayoutFor(int segment_length_lg, double slots) {
+  Layout layout;
+  layout.segment_length = 1u << segment_length_lg;
+  const uint32_t segments = static_cast<uint32_t>(
+      ceil(slots / layout.segment_length));
+  layout.segment_count = segments > 2 ? segments - 2 : 1;
+  return layout;
+}
+
+static uint32_t Fingerprint(uint64_t hash, int bits) {
+  return static_cast<uint32_t>(hash ^ (hash >> 32)) & ((1u << bits) - 1);
+}
+
+// Fill fingerprints[] so that every one of the distinct "hashes" is
+// matched.  Returns false if the hashes cannot be placed with this seed.
+static bool Populate(const std::vector<uint64_t>& hashes, uint64_t seed,
+                     const Layout& layout, int bits,
+                     std::vector<uint32_t>* fingerprints) {
+  const uint32_t array_length = layout.array_length();
+
+  // For each slot, the number of keys that use it (times four) and the XOR
+  // of their hashes.  The low two bits of count hold the XOR of the
+  // positions (0, 1 or 2) the slot has in the keys, so once a single key is
+  // left its position is known.
+  std::vector<uint32_t> count(array_length, 0);
+  std::vector<uint64_t> xor_hash(array_length, 0);
+  uint32_t slots[3];
+  for (uint64_t h : hashes) {
+    const uint64_t hash = Mix(h, seed);
+    layout.Slots(hash, slots);
+    for (uint32_t j = 0; j < 3; j++) {
+      count[slots[j]] += 4;
+      count[slots[j]] ^= j;
+      xor_hash[slots[j]] ^= hash;
+    }
+  }
+
+  // Peel the keys that are alone in one of their slots, which may leave
+  // other keys alone in theirs.  Each peeled key owns the slot it was alone
+  // in.
+  std::vector<uint32_t> alone;
+  for (uint32_t i = 0; i < array_length; i++) {
+    if ((count[i] >> 2) == 1) alone.push_back(i);
+  }
+  std::vector<uint64_t> stack_hash;
+  std::vector<uint8_t> stack_position;
+  stack_hash.reserve(hashes.size());
+  stack_position.reserve(hashes.size());
+  while (!alone.empty()) {
+    const uint32_t index = alone.back();
+    alone.pop_back();
+    if ((count[index] >> 2) != 1) continue;
+    const uint64_t hash = xor_hash[index];
+    const uint32_t position = count[index] & 3;
+    stack_hash.push_back(hash);
+    stack_position.push_back(static_cast<uint8_t>(position));
+    layout.Slots(hash, slots);
+    for (uint32_t j = 0; j < 3; j++) {
+      count[slots[j]] -= 4;
+      count[slots[j]] ^= j;
+      xor_hash[slots[j]] ^= hash;
+      if (j != position && (count[slots[j]] >> 2) == 1) {
+        alone.push_back(slots[j]);
+      }
+    }
+  }
+  if (stack_hash.size() != hashes.size()) {
+    return false;
+  }
+
+  // Assign the slots in the reverse order of peeling: the other two slots
+  // of each key are final by the time its own slot is set.
+  fingerprints->assign(array_length, 0);
+  std::vector<uint32_t>& f = *fingerprints;
+  for (size_t i = stack_hash.size(); i > 0; i--) {
+    const uint64_t hash = stack_hash[i - 1];
+    const uint32_t position = stack_position[i - 1];
+    layout.Slots(hash, slots);
+    f[slots[position]] = Fingerprint(hash, bits) ^
+                         f[slots[(position + 1) % 3]] ^
+                         f[slots[(position + 2) % 3]];
+  }
+  return true;
+}
+
+static uint32_t ReadFingerprint(const char* array, uint32_t index, int bits) {
+  const uint64_t bitpos = static_cast<uint64_t>(index) * bits;
+  return (DecodeFixed32(array + bitpos / 8) >> (bitpos % 8)) &
+         ((1u << bits) - 1);
+}
+
+class BinaryFuseFilterPolicy : public FilterPolicy {
+ public:
+  explicit BinaryFuseFilterPolicy(int bits_per_key) {
+    // A bloom filter with b bits per key has a false positive rate of about
+    // 2^(-b * ln(2)); use as many fingerprint bits.
+    bits_ = static_cast<int>(bits_per_key * 0.69 + 0.5);  // 0.69 =~ ln(2)
+    if (bits_ < 1) bits_ = 1;
+    if (bits_ > kMaxFingerprintBits) bits_ = kMaxFingerprintBits;
+  }
+
+  const char* Name() const override { return "leveldb.BinaryFuseFilter"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    std::vector<uint64_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = FuseHash(keys[i]);
+    }
+    // Peeling never succeeds with the same hash twice in the set
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+    if (hashes.empty()) {
+      // An empty array: nothing matches
+      PutFixed64(dst, 0);
+      PutFixed32(dst, 0);
+      dst->push_back(0);
+      dst->push_back(static_cast<char>(bits_));
+      return;
+    }
+
+    // Start from the 1.125 slots per key large sets need, and make room
+    // for more while construction keeps failing.  Small sets need up to
+    // 0.875 + 0.25 * log(10^6) / log(n) slots per key.
+    const int segment_length_lg = SegmentLengthLg(hashes.size());
+    const double size = static_cast<double>(std::max<size_t>(hashes.size(), 2));
+    const double max_slots =
+        size * std::max(1.125, 0.875 + 0.25 * log(1000000.0) / log(size));
+    double slots = std::min(size * 1.125, max_slots);
+    Layout layout;
+    std::vector<uint32_t> fingerprints;
+    uint64_t seed = 0;
+    bool ok = false;
+    for (int attempt = 0; !ok && attempt < kMaxAttempts; attempt++) {
+      if (attempt > 0 && attempt % 2 == 0) {
+        slots = std::min(slots * 1.03, max_slots);
+      }
+      layout = LayoutFor(segment_length_lg, slots);
+      seed = Mix(attempt, 0x726f6f7475736566ull);
+      ok = Populate(hashes, seed, layout, bits_, &fingerprints);
+    }
+    if (!ok) {
+      // Append a filter with a fingerprint width readers reject, which
+      // they treat as matching every key.
+      PutFixed64(dst, 0);
+      PutFixed32(dst, 0);
+      dst->push_back(0);
+      dst->push_back(0);
+      return;
+    }
+
+    const size_t init_size = dst->size();
+    const size_t bytes =
+        (static_cast<uint64_t>(layout.array_length()) * bits_ + 7) / 8;
+    dst->resize(init_size + bytes, 0);
+    char* array = &(*dst)[init_size];
+    uint64_t bitpos = 0;
+    for (uint32_t f : fingerprints) {
+      for (int b = 0; b < bits_; b++, bitpos++) {
+        if (f & (1u << b)) array[bitpos / 8] |= (1 << (bitpos % 8));
+      }
+    }
+    PutFixed64(dst, seed);
+    PutFixed32(dst, layout.segment_count);
+    dst->push_back(static_cast<char>(segment_length_lg));
+    dst->push_back(static_cast<char>(bits_));
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    const size_t len = filter.size();
+    if (len < kTrailerSize) return false;
+
+    const char* trailer = filter.data() + len - kTrailerSize;
+    const uint64_t seed = DecodeFixed64(trailer);
+    Layout layout;
+    layout.segment_count = DecodeFixed32(trailer + 8);
+    const int segment_length_lg = static_cast<uint8_t>(trailer[12]);
+    const int bits = static_cast<uint8_t>(trailer[13]);
+    if (bits < 1 || bits > kMaxFingerprintBits ||
+        segment_length_lg > kMaxSegmentLengthLg) {
+      return true;  // Not a filter this code wrote.  Consider it a match.
+    }
+    if (layout.segment_count == 0) {
+      return false;  // Filter of an empty set of keys
+    }
+    layout.segment_length = 1u << segment_length_lg;
+    const uint64_t bytes =
+        (static_cast<uint64_t>(layout.array_length()) * bits + 7) / 8;
+    if (bytes + kTrailerSize != len) {
+      return true;
+    }
+
+    const uint64_t hash = Mix(FuseHash(key), seed);
+    uint32_t slots[3];
+    layout.Slots(hash, slots);
+    const char* array = filter.data();
+    return (Fingerprint(hash, bits) ^ ReadFingerprint(array, slots[0], bits) ^
+            ReadFingerprint(array, slots[1], bits) ^
+            ReadFingerprint(array, slots[2], bits)) == 0;
+  }
+
+ private:
+  int bits_;
+};
+}  // namespace
+
+const FilterPolicy* NewBinaryFuseFilterPolicy(int bits_per_key) {
+  return new BinaryFuseFilterPolicy(bits_per_key);
+}
+
+}  // namespace leveldb
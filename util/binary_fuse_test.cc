@@ -0,0 +1,178 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <vector>
+
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "util/coding.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static const int kVerbose = 1;
+
+static Slice Key(int i, char* buffer) {
+  EncodeFixed32(buffer, i);
+  return Slice(buffer, sizeof(uint32_t));
+}
+
+class BinaryFuseTest {
+ public:
+  BinaryFuseTest() : policy_(NewBinaryFuseFilterPolicy(10)) {}
+
+  ~BinaryFuseTest() { delete policy_; }
+
+  void Reset() {
+    keys_.clear();
+    filter_.clear();
+  }
+
+  void Add(const Slice& s) { keys_.push_back(s.ToString()); }
+
+  void Build() {
+    std::vector<Slice> key_slices(keys_.begin(), keys_.end());
+    filter_.clear();
+    policy_->CreateFilter(key_slices.data(),
+                          static_cast<int>(key_slices.size()), &filter_);
+    keys_.clear();
+  }
+
+  size_t FilterSize() const { return filter_.size(); }
+
+  bool Matches(const Slice& s) {
+    if (!keys_.empty()) {
+      Build();
+    }
+    return policy_->KeyMayMatch(s, filter_);
+  }
+
+  double FalsePositiveRate(int probes) {
+    char buffer[sizeof(int)];
+    int result = 0;
+    for (int i = 0; i < probes; i++) {
+      if (Matches(Key(i + 1000000000, buffer))) {
+        result++;
+      }
+    }
+    return result / static_cast<double>(probes);
+  }
+
+ protected:
+  const FilterPolicy* policy_;
+  std::string filter_;
+  std::vector<std::string> keys_;
+};
+
+TEST(BinaryFuseTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST(BinaryFuseTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST(BinaryFuseTest, SingleKey) {
+  Add("hello");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST(BinaryFuseTest, Duplicates) {
+  char buffer[sizeof(int)];
+  for (int i = 0; i < 1000; i++) {
+    Add(Key(i % 100, buffer));
+  }
+  Build();
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(Matches(Key(i, buffer)));
+  }
+  ASSERT_LE(FalsePositiveRate(10000), 0.02);
+}
+
+TEST(BinaryFuseTest, VaryingLengths) {
+  char buffer[sizeof(int)];
+  for (int length = 1; length <= 100000; length = length * 3 / 2 + 1) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // All added keys must match
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    // 7-bit fingerprints: 1/128 of the missing keys match
+    const double rate = FalsePositiveRate(10000);
+    if (kVerbose >= 1) {
+      fprintf(stderr,
+              "False positives: %5.2f%% @ length = %6d ; bits/key = %5.2f\n",
+              rate * 100.0, length, FilterSize() * 8.0 / length);
+    }
+    ASSERT_LE(rate, 0.0125);
+
+    // From a few thousand keys on, the filter is at least 10% smaller than
+    // a bloom filter with 10 bits per key
+    if (length >= 5000) {
+      ASSERT_LE(FilterSize() * 8.0 / length, 9.0) << length;
+    }
+  }
+}
+
+TEST(BinaryFuseTest, ForeignFilters) {
+  char buffer[sizeof(int)];
+  // Too short to hold the trailer
+  ASSERT_TRUE(!policy_->KeyMayMatch("hello", Slice("abc")));
+
+  for (int i = 0; i < 100; i++) {
+    Add(Key(i, buffer));
+  }
+  Build();
+  // A filter whose array does not have the size of its trailer
+  filter_.insert(0, "x");
+  ASSERT_TRUE(Matches("hello"));
+}
+
+// Prints the cost of building a filter over a million keys and of looking up
+// a missing key in it
+TEST(BinaryFuseTest, ProbeCost) {
+  char buffer[sizeof(int)];
+  const int kKeys = 1000000;
+  for (int i = 0; i < kKeys; i++) {
+    Add(Key(i, buffer));
+  }
+  uint64_t start = Env::Default()->NowMicros();
+  Build();
+  const uint64_t build_micros = Env::Default()->NowMicros() - start;
+
+  const int kProbes = 1000000;
+  int matches = 0;
+  start = Env::Default()->NowMicros();
+  for (int i = 0; i < kProbes; i++) {
+    if (policy_->KeyMayMatch(Key(i + kKeys, buffer), filter_)) {
+      matches++;
+    }
+  }
+  const uint64_t micros = Env::Default()->NowMicros() - start;
+  fprintf(stderr,
+          "Binary fuse: build %.1f ns/key, %.1f ns/probe, "
+          "%5.2f%% false positives, %.2f bits/key\n",
+          build_micros * 1000.0 / kKeys, micros * 1000.0 / kProbes,
+          matches * 100.0 / kProbes, FilterSize() * 8.0 / kKeys);
+  ASSERT_LE(matches, kProbes / 100);
+  ASSERT_LE(FilterSize() * 8.0 / kKeys, 8.0);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
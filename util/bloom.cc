@@ -4,6 +4,23 @@
 
 #include "leveldb/filter_policy.h"
 
+// The AVX2 probes are built in when the compiler targets AVX2, and else
+// picked at runtime on x86 CPUs that have it, where GCC and Clang can
+// build functions for instruction sets they do not target.
+#if defined(__AVX2__)
+#define LEVELDB_BLOOM_AVX2 1
+#define LEVELDB_BLOOM_AVX2_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define LEVELDB_BLOOM_AVX2 1
+#define LEVELDB_BLOOM_AVX2_DISPATCH 1
+#define LEVELDB_BLOOM_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+#if defined(LEVELDB_BLOOM_AVX2)
+#include <immintrin.h>
+#endif
+
 #include "leveldb/slice.h"
 #include "util/hash.h"
 
@@ -14,18 +31,104 @@ static uint32_t BloomHash(const Slice& key) {
   return Hash(key.data(), key.size(), 0xbc9f1d34);
 }
 
+// Blocked filters are split into cache lines of kLineBytes bytes, and all
+// the probes for a key fall into a single line.  Such a filter ends with
+// the number of probes and then kBlockedMarker.  Filters in the original
+// layout end with their number of probes, which is at most 30; readers of
+// that layout treat larger values as "may match".
+static const size_t kLineBytes = 64;
+static const size_t kLineBits = kLineBytes * 8;
+static const uint8_t kBlockedMarker = 0xfe;
+
+// Probe j of a blocked filter uses the top 9 bits of h * kProbeMultiplier^j
+static const uint32_t kProbeMultiplier = 0x9e3779b9;  // 2^32 / golden ratio
+
+// The line of a blocked filter with "num_lines" lines that a hash maps to
+static size_t LineIndex(uint32_t h, size_t num_lines) {
+  return static_cast<size_t>((static_cast<uint64_t>(h) * num_lines) >> 32);
+}
+
+static bool PortableLineMayMatch(const char* line, uint32_t h, size_t k) {
+  for (size_t j = 0; j < k; j++) {
+    h *= kProbeMultiplier;
+    const uint32_t bitpos = h >> 23;
+    if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+  }
+  return true;
+}
+
+#if defined(LEVELDB_BLOOM_AVX2)
+
+// Checks eight probes at a time.  The bits of "line" are addressed as
+// little-endian 32-bit words, which matches the byte-wise addressing
+// used when the filter is built on the little-endian x86.
+LEVELDB_BLOOM_AVX2_TARGET
+static bool AVX2LineMayMatch(const char* line, uint32_t h, size_t k) {
+  static const uint32_t kPowers[8] = {0x9e3779b9, 0xe35e67b1, 0x734297e9,
+                                      0x35fbe861, 0xdeb7c719, 0x0448b211,
+                                      0x3459b749, 0xab25f4c1};
+  __m256i powers =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(kPowers));
+  const __m256i step = _mm256_set1_epi32(static_cast<int>(kPowers[7]));
+  const __m256i hash = _mm256_set1_epi32(static_cast<int>(h));
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i ones = _mm256_set1_epi32(1);
+  const __m256i low_bits = _mm256_set1_epi32(31);
+  for (size_t j = 0; j < k; j += 8) {
+    const __m256i bitpos =
+        _mm256_srli_epi32(_mm256_mullo_epi32(hash, powers), 23);
+    const __m256i words = _mm256_i32gather_epi32(
+        reinterpret_cast<const int*>(line), _mm256_srli_epi32(bitpos, 5), 4);
+    const __m256i bits =
+        _mm256_sllv_epi32(ones, _mm256_and_si256(bitpos, low_bits));
+    // Probes j + 8 and above do not exist
+    const __m256i valid = _mm256_cmpgt_epi32(
+        _mm256_set1_epi32(static_cast<int>(k - j)), lanes);
+    const __m256i missing =
+        _mm256_and_si256(_mm256_andnot_si256(words, bits), valid);
+    if (!_mm256_testz_si256(missing, missing)) {
+      return false;
+    }
+    powers = _mm256_mullo_epi32(powers, step);
+  }
+  return true;
+}
+
+#endif  // defined(LEVELDB_BLOOM_AVX2)
+
+static bool LineMayMatch(const char* line, uint32_t h, size_t k) {
+#if defined(LEVELDB_BLOOM_AVX2_DISPATCH)
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2 ? AVX2LineMayMatch(line, h, k)
+                  : PortableLineMayMatch(line, h, k);
+#elif defined(LEVELDB_BLOOM_AVX2)
+  return AVX2LineMayMatch(line, h, k);
+#else
+  return PortableLineMayMatch(line, h, k);
+#endif
+}
+
 class BloomFilterPolicy : public FilterPolicy {
  public:
-  explicit BloomFilterPolicy(int bits_per_key) : bits_per_key_(bits_per_key) {
+  BloomFilterPolicy(int bits_per_key, bool blocked)
+      : bits_per_key_(bits_per_key), blocked_(blocked) {
     // We intentionally round down to reduce probing cost a little bit
     k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
     if (k_ < 1) k_ = 1;
     if (k_ > 30) k_ = 30;
   }
 
+  // Both layouts share the name: KeyMayMatch() tells them apart, so that
+  // tables written with either policy keep using their filters when read
+  // with the other.
   const char* Name() const override { return "leveldb.BuiltinBloomFilter2"; }
 
   void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    if (blocked_) {
+      CreateBlockedFilter(keys, n, dst);
+      return;
+    }
+
     // Compute bloom filter size (in both bits and bytes)
     size_t bits = n * bits_per_key_;
 
@@ -58,6 +161,9 @@ class BloomFilterPolicy : public FilterPolicy {
     if (len < 2) return false;
 
     const char* array = bloom_filter.data();
+    if (static_cast<uint8_t>(array[len - 1]) == kBlockedMarker) {
+      return BlockedKeyMayMatch(key, bloom_filter);
+    }
     const size_t bits = (len - 1) * 8;
 
     // Use the encoded k so that we can read filters generated by
@@ -80,13 +186,51 @@ class BloomFilterPolicy : public FilterPolicy {
   }
 
  private:
+  void CreateBlockedFilter(const Slice* keys, int n, std::string* dst) const {
+    size_t num_lines = (n * bits_per_key_ + kLineBits - 1) / kLineBits;
+    if (num_lines == 0) num_lines = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_lines * kLineBytes, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    dst->push_back(static_cast<char>(kBlockedMarker));
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      uint32_t h = BloomHash(keys[i]);
+      char* line = array + LineIndex(h, num_lines) * kLineBytes;
+      for (size_t j = 0; j < k_; j++) {
+        h *= kProbeMultiplier;
+        const uint32_t bitpos = h >> 23;
+        line[bitpos / 8] |= (1 << (bitpos % 8));
+      }
+    }
+  }
+
+  bool BlockedKeyMayMatch(const Slice& key, const Slice& bloom_filter) const {
+    const size_t len = bloom_filter.size();
+    const size_t k = static_cast<uint8_t>(bloom_filter[len - 2]);
+    if (len < 2 + kLineBytes || (len - 2) % kLineBytes != 0 || k > 30) {
+      return true;  // Not a filter this code wrote.  Consider it a match.
+    }
+    const size_t num_lines = (len - 2) / kLineBytes;
+    const uint32_t h = BloomHash(key);
+    const char* line =
+        bloom_filter.data() + LineIndex(h, num_lines) * kLineBytes;
+    return LineMayMatch(line, h, k);
+  }
+
   size_t bits_per_key_;
   size_t k_;
+  const bool blocked_;
 };
 }  // namespace
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
-  return new BloomFilterPolicy(bits_per_key);
+  return new BloomFilterPolicy(bits_per_key, false);
+}
+
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BloomFilterPolicy(bits_per_key, true);
 }
 
 }  // namespace leveldb
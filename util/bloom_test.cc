@@ -5,6 +5,7 @@
 #include "leveldb/filter_policy.h"
 
 #include "util/coding.h"
+#include "util/hash.h"
 #include "util/logging.h"
 #include "util/testharness.h"
 #include "util/testutil.h"
@@ -18,9 +19,23 @@ static Slice Key(int i, char* buffer) {
   return Slice(buffer, sizeof(uint32_t));
 }
 
+static int NextLength(int length) {
+  if (length < 10) {
+    length += 1;
+  } else if (length < 100) {
+    length += 10;
+  } else if (length < 1000) {
+    length += 100;
+  } else {
+    length += 1000;
+  }
+  return length;
+}
+
 class BloomTest {
  public:
   BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) {}
 
   ~BloomTest() { delete policy_; }
 
@@ -45,6 +60,9 @@ class BloomTest {
 
   size_t FilterSize() const { return filter_.size(); }
 
+  const FilterPolicy* policy() const { return policy_; }
+  const std::string& filter() const { return filter_; }
+
   void DumpFilter() {
     fprintf(stderr, "F(");
     for (size_t i = 0; i + 1 < filter_.size(); i++) {
@@ -74,6 +92,52 @@ class BloomTest {
     return result / 10000.0;
   }
 
+  // Checks filters over 1 to 10000 keys.  "slack" is the number of bytes
+  // a filter may take beyond 10 bits per key.
+  void CheckVaryingLengths(size_t slack) {
+    char buffer[sizeof(int)];
+
+    // Count number of filters that significantly exceed the false positive
+    // rate
+    int mediocre_filters = 0;
+    int good_filters = 0;
+
+    for (int length = 1; length <= 10000; length = NextLength(length)) {
+      Reset();
+      for (int i = 0; i < length; i++) {
+        Add(Key(i, buffer));
+      }
+      Build();
+
+      ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + slack))
+          << length;
+
+      // All added keys must match
+      for (int i = 0; i < length; i++) {
+        ASSERT_TRUE(Matches(Key(i, buffer)))
+            << "Length " << length << "; key " << i;
+      }
+
+      // Check false positive rate
+      double rate = FalsePositiveRate();
+      if (kVerbose >= 1) {
+        fprintf(stderr,
+                "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+                rate * 100.0, length, static_cast<int>(FilterSize()));
+      }
+      ASSERT_LE(rate, 0.02);  // Must not be over 2%
+      if (rate > 0.0125)
+        mediocre_filters++;  // Allowed, but not too often
+      else
+        good_filters++;
+    }
+    if (kVerbose >= 1) {
+      fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
+              mediocre_filters);
+    }
+    ASSERT_LE(mediocre_filters, good_filters / 5);
+  }
+
  private:
   const FilterPolicy* policy_;
   std::string filter_;
@@ -94,59 +158,110 @@ TEST(BloomTest, Small) {
   ASSERT_TRUE(!Matches("foo"));
 }
 
-static int NextLength(int length) {
-  if (length < 10) {
-    length += 1;
-  } else if (length < 100) {
-    length += 10;
-  } else if (length < 1000) {
-    length += 100;
-  } else {
-    length += 1000;
-  }
-  return length;
+TEST(BloomTest, VaryingLengths) { CheckVaryingLengths(40); }
+
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) {}
+};
+
+TEST(BlockedBloomTest, BlockedEmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
 }
 
-TEST(BloomTest, VaryingLengths) {
-  char buffer[sizeof(int)];
+TEST(BlockedBloomTest, BlockedSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
 
-  // Count number of filters that significantly exceed the false positive rate
-  int mediocre_filters = 0;
-  int good_filters = 0;
+// Up to a cache line, plus two bytes of trailer
+TEST(BlockedBloomTest, BlockedVaryingLengths) { CheckVaryingLengths(66); }
 
-  for (int length = 1; length <= 10000; length = NextLength(length)) {
-    Reset();
-    for (int i = 0; i < length; i++) {
-      Add(Key(i, buffer));
-    }
-    Build();
+// Each policy must read the filters of the other
+TEST(BlockedBloomTest, Compatibility) {
+  char buffer[sizeof(int)];
+  const FilterPolicy* legacy = NewBloomFilterPolicy(10);
+  for (int i = 0; i < 1000; i++) {
+    Add(Key(i, buffer));
+  }
+  Build();
+  std::vector<std::string> keys;
+  std::vector<Slice> key_slices;
+  for (int i = 0; i < 1000; i++) {
+    keys.push_back(Key(i, buffer).ToString());
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    key_slices.push_back(keys[i]);
+  }
+  std::string legacy_filter;
+  legacy->CreateFilter(&key_slices[0], static_cast<int>(key_slices.size()),
+                       &legacy_filter);
 
-    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
-        << length;
+  ASSERT_EQ(std::string(legacy->Name()), std::string(policy()->Name()));
+  int blocked_matches = 0;
+  int legacy_matches = 0;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(legacy->KeyMayMatch(Key(i, buffer), filter()));
+    ASSERT_TRUE(policy()->KeyMayMatch(Key(i, buffer), legacy_filter));
+    Slice missing = Key(i + 1000000, buffer);
+    if (legacy->KeyMayMatch(missing, filter())) blocked_matches++;
+    if (policy()->KeyMayMatch(missing, legacy_filter)) legacy_matches++;
+  }
+  // Neither reads the filters of the other as "may match" everything
+  ASSERT_LE(blocked_matches, 30);
+  ASSERT_LE(legacy_matches, 30);
+  delete legacy;
+}
 
-    // All added keys must match
-    for (int i = 0; i < length; i++) {
-      ASSERT_TRUE(Matches(Key(i, buffer)))
-          << "Length " << length << "; key " << i;
-    }
+// The probes of a blocked filter as its layout defines them, one at a time
+static bool ReferenceBlockedMayMatch(const Slice& key,
+                                     const std::string& filter) {
+  const size_t k = static_cast<uint8_t>(filter[filter.size() - 2]);
+  const size_t num_lines = (filter.size() - 2) / 64;
+  uint32_t h = Hash(key.data(), key.size(), 0xbc9f1d34);
+  const char* line =
+      filter.data() + ((static_cast<uint64_t>(h) * num_lines) >> 32) * 64;
+  for (size_t j = 0; j < k; j++) {
+    h *= 0x9e3779b9;
+    const uint32_t bitpos = h >> 23;
+    if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+  }
+  return true;
+}
 
-    // Check false positive rate
-    double rate = FalsePositiveRate();
-    if (kVerbose >= 1) {
-      fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
-              rate * 100.0, length, static_cast<int>(FilterSize()));
+// KeyMayMatch() checks the probes of blocked filters eight at a time with
+// AVX2 on CPUs that have it.  Numbers of probes from 2 to 30 cover partial
+// and several rounds of eight.
+TEST(BlockedBloomTest, ProbesMatchReference) {
+  char buffer[sizeof(int)];
+  for (int bits_per_key : {3, 10, 12, 13, 20, 44}) {
+    const FilterPolicy* policy = NewBlockedBloomFilterPolicy(bits_per_key);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 1000; i++) {
+      keys.push_back(Key(i, buffer).ToString());
     }
-    ASSERT_LE(rate, 0.02);  // Must not be over 2%
-    if (rate > 0.0125)
-      mediocre_filters++;  // Allowed, but not too often
-    else
-      good_filters++;
-  }
-  if (kVerbose >= 1) {
-    fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
-            mediocre_filters);
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::string filter;
+    policy->CreateFilter(&key_slices[0], static_cast<int>(key_slices.size()),
+                         &filter);
+    int matches = 0;
+    for (int i = 0; i < 5000; i++) {
+      const Slice key = Key(i, buffer);
+      const bool expected = ReferenceBlockedMayMatch(key, filter);
+      ASSERT_EQ(expected, policy->KeyMayMatch(key, filter))
+          << bits_per_key << " bits per key, key " << i;
+      if (expected) matches++;
+    }
+    // Some keys that were not added must miss
+    ASSERT_GE(matches, 1000);
+    ASSERT_LT(matches, 5000);
+    delete policy;
   }
-  ASSERT_LE(mediocre_filters, good_filters / 5);
 }
 
 // Different bits-per-byte
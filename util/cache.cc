@@ -6,6 +6,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "leveldb/cache.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -36,6 +39,13 @@ namespace {
 // Elements are moved between these lists by the Ref() and Unref() methods,
 // when they detect an element in the cache acquiring or losing its only
 // external reference.
+//
+// The newest items of the LRU list make up the high-priority pool, which
+// holds the items inserted with Cache::Priority::kHigh and those looked up
+// since they were inserted, up to a fraction of the capacity.  The other
+// items enter the list at its midpoint, below the pool, so an item used
+// only once, e.g. by a scan, is evicted before any item of the pool.  The
+// oldest items of the pool move down to the midpoint when it overflows.
 
 // An entry is a variable length heap-allocated structure.  Entries
 // are kept in a circular doubly linked list ordered by access time.
@@ -49,6 +59,9 @@ struct LRUHandle {
   size_t charge;  // TODO(opt): Only allow uint32_t?  用户指定占用缓存的大小
   size_t key_length;
   bool in_cache;     // Whether entry is in the cache.
+  bool high_priority;     // Whether entry was inserted with kHigh.
+  bool in_high_pri_pool;  // Whether entry is in the high-priority pool.
+  bool hit;               // Whether entry was looked up since inserted.
   uint32_t refs;     // References, including cache reference, if present. 引用计数，如果引用计数为0，会调用deleter释放value对象，并且释放当前LRUhandle
   uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
   char key_data[1];  // Beginning of key
@@ -106,6 +119,8 @@ class HandleTable {
     return result;
   }
 
+  uint32_t size() const { return elems_; }
+
  private:
   // The table consists of an array of buckets where each bucket is
   // a linked list of cache entries that hash into the bucket.
@@ -151,6 +166,85 @@ class HandleTable {
   }
 };// HandleTable
 
+// Estimates how often the keys of a cache were looked up of late, from
+// their hashes, for the admission filter of TinyLFU: a count-min sketch of
+// 4-bit counters, which are all halved whenever the sketch has counted
+// about eight lookups per cached entry, so that keys no longer used lose
+// their frequency.
+class FrequencySketch {
+ public:
+  FrequencySketch() : counters_(kMinCounters), mask_(kMinCounters - 1),
+                      additions_(0) {}
+
+  // Grow the sketch when it gets too small for telling apart the
+  // frequencies of "entries" keys.  A key maps to the counters whose index
+  // has the bits of its old index as low bits, so copying the old counters
+  // keeps the counts.
+  void EnsureCapacity(size_t entries) {
+    if (entries * kCountersPerEntry > counters_.size()) {
+      size_t n = counters_.size();
+      while (n < entries * kCountersPerEntry) {
+        n *= 2;
+      }
+      std::vector<uint8_t> counters(n);
+      for (size_t i = 0; i < n; i++) {
+        counters[i] = counters_[i & mask_];
+      }
+      counters_.swap(counters);
+      mask_ = n - 1;
+    }
+  }
+
+  // Counts a lookup of the key, only incrementing the counters that hold
+  // its estimate (conservative update), which keeps keys that share some
+  // counter with it from looking more frequent than they are.
+  void Increment(uint32_t hash) {
+    const int estimate = Estimate(hash);
+    if (estimate < kMaxCount) {
+      for (int i = 0; i < kDepth; i++) {
+        uint8_t* counter = &counters_[Index(hash, i)];
+        if (*counter == estimate) {
+          (*counter)++;
+        }
+      }
+    }
+    if (++additions_ >= counters_.size() / 2) {
+      for (uint8_t& counter : counters_) {
+        counter >>= 1;
+      }
+      additions_ /= 2;
+    }
+  }
+
+  int Estimate(uint32_t hash) const {
+    int result = kMaxCount;
+    for (int i = 0; i < kDepth; i++) {
+      result = std::min<int>(result, counters_[Index(hash, i)]);
+    }
+    return result;
+  }
+
+ private:
+  static const int kDepth = 4;
+  static const int kMaxCount = 15;
+  // Few enough keys share all their counters with others for the sketch to
+  // tell apart keys read once from keys read twice.
+  static const size_t kCountersPerEntry = 16;
+  static const size_t kMinCounters = 1024;
+
+  // Each row of the sketch hashes with its own odd multiplier.
+  size_t Index(uint32_t hash, int row) const {
+    static const uint32_t kSeeds[kDepth] = {0x97cb3127, 0xab7bd2d5,
+                                            0x2d6e2a5b, 0xc8d5ff3f};
+    const uint32_t h = hash * kSeeds[row];
+    return (h ^ (h >> 16)) & mask_;
+  }
+
+  std::vector<uint8_t> counters_;  // Size is a power of two.
+  size_t mask_;
+  size_t additions_;
+};
+
 // A single shard of sharded cache.
 class LRUCache {
  public:
@@ -158,14 +252,21 @@ class LRUCache {
   ~LRUCache();
 
   // Separate from constructor so caller can easily make an array of LRUCache
-  void SetCapacity(size_t capacity) { capacity_ = capacity; }
+  void SetCapacity(size_t capacity, double high_pri_pool_ratio) {
+    capacity_ = capacity;
+    high_pri_pool_ratio_ = high_pri_pool_ratio;
+    high_pri_pool_capacity_ =
+        static_cast<size_t>(capacity * high_pri_pool_ratio);
+  }
+  void EnableAdmissionFilter() { sketch_ = new FrequencySketch; }
 
   // Like Cache methods, but with an extra "hash" parameter.
   Cache::Handle* Insert(const Slice& key,
                         uint32_t hash,
                         void* value,
                         size_t charge,
-                        void (*deleter)(const Slice& key, void* value));
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
   // 从hashtable中查找
   Cache::Handle* Lookup(const Slice& key, uint32_t hash);
   void Release(Cache::Handle* handle);
@@ -179,25 +280,49 @@ class LRUCache {
  private:
   void LRU_Remove(LRUHandle* e);// 从in_use或者LRU链表中移出LRUhandle，不需要传入in_use或者LRU链表参数，因为已经得到LRUhandle了，自然也就知道它所在的链表了
   void LRU_Append(LRUHandle* list, LRUHandle* e);// 将LRUhandle加入到in_use或者LRU链表的表头上
+  // Insert e into lru_, in the high-priority pool or at the midpoint
+  void LRU_Insert(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Move the oldest entries of the high-priority pool down to the midpoint
+  // until the pool fits in its capacity
+  void MaintainPoolSize() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Whether to cache a new entry that needs "charge" more room
+  bool Admit(uint32_t hash, size_t charge, Cache::Priority priority)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void Ref(LRUHandle* e);
-  void Unref(LRUHandle* e);
+  // Drop a reference to e.  If it was the last one, link e into *deleted
+  // rather than pass it to its deleter, which may do real work, e.g. spill
+  // a block to a secondary cache, and so waits for FreeHandles() once
+  // mutex_ is released.
+  void Unref(LRUHandle* e, LRUHandle** deleted);
   // 将LRUhandle从LRUcache的两张双向循环链表之一中删除
-  bool FinishErase(LRUHandle* e) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  bool FinishErase(LRUHandle* e, LRUHandle** deleted)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Pass the entries of the list linked by Unref() to their deleters
+  static void FreeHandles(LRUHandle* list);
 
   // Initialized before use.
   // LRUcache的容量，LRUcache中的所有LRUhandle的charge之和不能超过这个容量
   size_t capacity_;
+  double high_pri_pool_ratio_;
+  size_t high_pri_pool_capacity_;
+
+  // Estimated key frequencies if the admission filter is enabled, or null
+  FrequencySketch* sketch_;
 
   // mutex_ protects the following state.
   mutable port::Mutex mutex_;
   size_t usage_ GUARDED_BY(mutex_);
+  size_t high_pri_pool_usage_ GUARDED_BY(mutex_);
 
   // Dummy head of LRU list.
   // lru.prev is newest entry, lru.next is oldest entry.
   // Entries have refs==1 and in_cache==true.
-  // cache有两条链表，一条lru，一条in_use
+  // cache有两条链表：lru和in_use
   LRUHandle lru_ GUARDED_BY(mutex_);
 
+  // Newest entry below the high-priority pool of lru_, or &lru_ if none.
+  LRUHandle* lru_low_pri_ GUARDED_BY(mutex_);
+
   // Dummy head of in-use list.
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
@@ -205,51 +330,68 @@ class LRUCache {
   HandleTable table_ GUARDED_BY(mutex_);
 };// LRUCache
 
-LRUCache::LRUCache() : capacity_(0), usage_(0) {
+LRUCache::LRUCache()
+    : capacity_(0),
+      high_pri_pool_ratio_(0),
+      high_pri_pool_capacity_(0),
+      sketch_(nullptr),
+      usage_(0),
+      high_pri_pool_usage_(0) {
   // Make empty circular linked lists.
   lru_.next = &lru_;
   lru_.prev = &lru_;
+  lru_low_pri_ = &lru_;
   in_use_.next = &in_use_;
   in_use_.prev = &in_use_;
 }
 
 LRUCache::~LRUCache() {
   assert(in_use_.next == &in_use_);  // Error if caller has an unreleased handle
+  LRUHandle* deleted = nullptr;
   for (LRUHandle* e = lru_.next; e != &lru_;) {
     LRUHandle* next = e->next;
     assert(e->in_cache);
     e->in_cache = false;
     assert(e->refs == 1);  // Invariant of lru_ list.
-    Unref(e);
+    Unref(e, &deleted);
     e = next;
   }
+  FreeHandles(deleted);
+  delete sketch_;
 }
 
 void LRUCache::Ref(LRUHandle* e) {
-  if (e->refs == 1 && e->in_cache) {  // If on lru_ list, move to in_use_ list.
+  if (e->refs == 1 && e->in_cache) {  // If on an lru list, move to in_use_.
     LRU_Remove(e);
     LRU_Append(&in_use_, e);
   }
   e->refs++;
 }
 
-void LRUCache::Unref(LRUHandle* e) {
+void LRUCache::Unref(LRUHandle* e, LRUHandle** deleted) {
   assert(e->refs > 0);
   e->refs--;
   if (e->refs == 0) {  // Deallocate.
     assert(!e->in_cache);
-    (*e->deleter)(e->key(), e->value);
-    free(e);
+    e->next = *deleted;
+    *deleted = e;
   } else if (e->in_cache && e->refs == 1) {
     // No longer in use; move to lru_ list.
     LRU_Remove(e);
-    LRU_Append(&lru_, e);
+    LRU_Insert(e);
   }
 }
 
 void LRUCache::LRU_Remove(LRUHandle* e) {
+  if (lru_low_pri_ == e) {
+    lru_low_pri_ = e->prev;
+  }
   e->next->prev = e->prev;
   e->prev->next = e->next;
+  if (e->in_high_pri_pool) {
+    e->in_high_pri_pool = false;
+    high_pri_pool_usage_ -= e->charge;
+  }
 }
 
 void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
@@ -260,18 +402,48 @@ void LRUCache::LRU_Append(LRUHandle* list, LRUHandle* e) {
   e->next->prev = e;
 }
 
+void LRUCache::LRU_Insert(LRUHandle* e) {
+  if (high_pri_pool_ratio_ > 0 && (e->high_priority || e->hit)) {
+    LRU_Append(&lru_, e);
+    e->in_high_pri_pool = true;
+    high_pri_pool_usage_ += e->charge;
+    MaintainPoolSize();
+  } else {
+    // Make "e" the newest entry below the high-priority pool
+    LRU_Append(lru_low_pri_->next, e);
+    lru_low_pri_ = e;
+  }
+}
+
+void LRUCache::MaintainPoolSize() {
+  while (high_pri_pool_usage_ > high_pri_pool_capacity_) {
+    lru_low_pri_ = lru_low_pri_->next;
+    assert(lru_low_pri_ != &lru_);
+    lru_low_pri_->in_high_pri_pool = false;
+    high_pri_pool_usage_ -= lru_low_pri_->charge;
+  }
+}
+
 Cache::Handle* LRUCache::Lookup(const Slice& key, uint32_t hash) {
   MutexLock l(&mutex_);
+  if (sketch_ != nullptr) {
+    sketch_->Increment(hash);
+  }
   LRUHandle* e = table_.Lookup(key, hash);
   if (e != nullptr) {
+    e->hit = true;
     Ref(e);
   }
   return reinterpret_cast<Cache::Handle*>(e);
 }
 
 void LRUCache::Release(Cache::Handle* handle) {
-  MutexLock l(&mutex_);
-  Unref(reinterpret_cast<LRUHandle*>(handle));
+  LRUHandle* deleted = nullptr;
+  {
+    MutexLock l(&mutex_);
+    Unref(reinterpret_cast<LRUHandle*>(handle), &deleted);
+  }
+  FreeHandles(deleted);
 }
 
 Cache::Handle* LRUCache::Insert(const Slice& key,
@@ -279,9 +451,8 @@ Cache::Handle* LRUCache::Insert(const Slice& key,
                                 void* value,
                                 size_t charge,
                                 void (*deleter)(const Slice& key,
-                                void* value)) {
-  MutexLock l(&mutex_);
-
+                                void* value),
+                                Cache::Priority priority) {
   LRUHandle* e =
       reinterpret_cast<LRUHandle*>(malloc(sizeof(LRUHandle) - 1 + key.size()));
   e->value = value;
@@ -290,64 +461,115 @@ Cache::Handle* LRUCache::Insert(const Slice& key,
   e->key_length = key.size();
   e->hash = hash;
   e->in_cache = false;
+  e->high_priority = (priority == Cache::Priority::kHigh);
+  e->in_high_pri_pool = false;
+  e->hit = false;
   e->refs = 1;  // for the returned handle.
   memcpy(e->key_data, key.data(), key.size());
 
-  if (capacity_ > 0) {
+  // Entries evicted or replaced by the insertion, passed to their deleters
+  // once mutex_ is released
+  LRUHandle* evicted = nullptr;
+
+  mutex_.Lock();
+  if (sketch_ != nullptr) {
+    sketch_->EnsureCapacity(table_.size() + 1);
+  }
+  if (capacity_ > 0 && Admit(hash, charge, priority)) {
     e->refs++;  // for the cache's reference.
     e->in_cache = true;
     LRU_Append(&in_use_, e);
     usage_ += charge;
     // 如果LRUcache的两张循环双向链表中有LRUhandle的key和hash与要插入的LRUhandle一样，那么就要从链表中删除这个LRUhandle
-    FinishErase(table_.Insert(e));
+    FinishErase(table_.Insert(e), &evicted);
   } else {  // don't cache. (capacity_==0 is supported and turns off caching.)
     // next is read by key() in an assert, so it must be initialized
     e->next = nullptr;
+    // The entry replaces any other one with its key, cached or not
+    FinishErase(table_.Remove(key, hash), &evicted);
   }
 
   // 如果已用容量超过了总容量且头结点lru_还有后继。
   // 删除lru_的后继结点，根据LRUCache规则，这个结点最近用的最少。
-  // 该结点既要从哈希表中移除，也要从双向链表中移除，然后再释放。  
+  // 该结点既要从哈希表中移除，也要从双向链表中移除，然后再释放。
   while (usage_ > capacity_ && lru_.next != &lru_) {
     LRUHandle* old = lru_.next;
     assert(old->refs == 1);
-    bool erased = FinishErase(table_.Remove(old->key(), old->hash));
-    if (!erased) {  // to avoid unused variable when compiled NDEBUG
-      assert(erased);
+    LRUHandle* removed = table_.Remove(old->key(), old->hash);
+    if (removed != old) {  // to avoid unused variable when compiled NDEBUG
+      assert(removed == old);
     }
+    LRU_Remove(old);
+    old->in_cache = false;
+    old->refs = 0;
+    usage_ -= old->charge;
+    old->next = evicted;
+    evicted = old;
   }
+  mutex_.Unlock();
 
+  FreeHandles(evicted);
   return reinterpret_cast<Cache::Handle*>(e);
 }
 
+// The admission filter of TinyLFU: when a new entry of low priority would
+// evict unused entries, it is only cached if its key was looked up more
+// often of late than that of the entry evicted first.  So a key that is
+// read once never displaces one that is read again and again.
+bool LRUCache::Admit(uint32_t hash, size_t charge,
+                     Cache::Priority priority) {
+  if (sketch_ == nullptr || priority == Cache::Priority::kHigh ||
+      usage_ + charge <= capacity_ || lru_.next == &lru_) {
+    return true;
+  }
+  return sketch_->Estimate(hash) > sketch_->Estimate(lru_.next->hash);
+}
+
 // If e != nullptr, finish removing *e from the cache; it has already been
 // removed from the hash table.  Return whether e != nullptr.
-bool LRUCache::FinishErase(LRUHandle* e) {
+bool LRUCache::FinishErase(LRUHandle* e, LRUHandle** deleted) {
   if (e != nullptr) {
     assert(e->in_cache);
     LRU_Remove(e);
     e->in_cache = false;
     usage_ -= e->charge;
-    Unref(e);
+    Unref(e, deleted);
   }
   return e != nullptr;
 }
 
+void LRUCache::FreeHandles(LRUHandle* list) {
+  while (list != nullptr) {
+    LRUHandle* next = list->next;
+    (*list->deleter)(list->key(), list->value);
+    free(list);
+    list = next;
+  }
+}
+
 void LRUCache::Erase(const Slice& key, uint32_t hash) {
-  MutexLock l(&mutex_);
-  FinishErase(table_.Remove(key, hash));
+  LRUHandle* deleted = nullptr;
+  {
+    MutexLock l(&mutex_);
+    FinishErase(table_.Remove(key, hash), &deleted);
+  }
+  FreeHandles(deleted);
 }
 
 void LRUCache::Prune() {
-  MutexLock l(&mutex_);
-  while (lru_.next != &lru_) {
-    LRUHandle* e = lru_.next;
-    assert(e->refs == 1);
-    bool erased = FinishErase(table_.Remove(e->key(), e->hash));
-    if (!erased) {  // to avoid unused variable when compiled NDEBUG
-      assert(erased);
+  LRUHandle* deleted = nullptr;
+  {
+    MutexLock l(&mutex_);
+    while (lru_.next != &lru_) {
+      LRUHandle* e = lru_.next;
+      assert(e->refs == 1);
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash), &deleted);
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
     }
   }
+  FreeHandles(deleted);
 }
 
 //因为levelDB是多线程的，每个线程访问缓冲区的时候都会将缓冲区锁住。
@@ -370,17 +592,28 @@ class ShardedLRUCache : public Cache {
   static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
 
  public:
-  explicit ShardedLRUCache(size_t capacity) : last_id_(0) {
+  ShardedLRUCache(size_t capacity, double high_pri_pool_ratio,
+                  bool admission_filter)
+      : last_id_(0) {
     const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
     for (int s = 0; s < kNumShards; s++) {
-      shard_[s].SetCapacity(per_shard);
+      shard_[s].SetCapacity(per_shard, high_pri_pool_ratio);
+      if (admission_filter) {
+        shard_[s].EnableAdmissionFilter();
+      }
     }
   }
   ~ShardedLRUCache() override {}
   Handle* Insert(const Slice& key, void* value, size_t charge,
                  void (*deleter)(const Slice& key, void* value)) override {
+    return Insert(key, value, charge, deleter, Priority::kLow);
+  }
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value),
+                 Priority priority) override {
     const uint32_t hash = HashSlice(key);
-    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
   }
   Handle* Lookup(const Slice& key) override {
     const uint32_t hash = HashSlice(key);
@@ -417,6 +650,14 @@ class ShardedLRUCache : public Cache {
 
 }  // end anonymous namespace
 
-Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
+Cache* NewLRUCache(size_t capacity) {
+  return NewLRUCache(capacity, 0.5, false);
+}
+
+Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio,
+                   bool admission_filter) {
+  assert(high_pri_pool_ratio >= 0 && high_pri_pool_ratio <= 1);
+  return new ShardedLRUCache(capacity, high_pri_pool_ratio, admission_filter);
+}
 
 }  // namespace leveldb
@@ -150,6 +150,103 @@ TEST(CacheTest, EvictionPolicy) {
   cache_->Release(h);
 }
 
+TEST(CacheTest, HighPriority) {
+  cache_->Release(cache_->Insert(EncodeKey(100), EncodeValue(101), 1,
+                                 &CacheTest::Deleter,
+                                 Cache::Priority::kHigh));
+  Insert(200, 201);
+
+  // Entries of low priority are evicted first, however old the entry of
+  // high priority is
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    Insert(1000 + i, 2000 + i);
+  }
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+
+  // Until entries of high priority overflow their pool
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    cache_->Release(cache_->Insert(EncodeKey(5000 + i), EncodeValue(6000 + i),
+                                   1, &CacheTest::Deleter,
+                                   Cache::Priority::kHigh));
+  }
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(6000 + kCacheSize + 99, Lookup(5000 + kCacheSize + 99));
+}
+
+TEST(CacheTest, ScanResistance) {
+  for (double high_pri_pool_ratio : {0.0, 0.5}) {
+    delete cache_;
+    cache_ = NewLRUCache(kCacheSize, high_pri_pool_ratio, false);
+
+    // A hot working set, read again after it was inserted
+    for (int i = 0; i < 100; i++) {
+      Insert(i, 1000 + i);
+      ASSERT_EQ(1000 + i, Lookup(i));
+    }
+
+    // A scan that reads every entry once
+    for (int i = 0; i < 10 * kCacheSize; i++) {
+      Insert(10000 + i, 20000 + i);
+    }
+
+    int hot = 0;
+    for (int i = 0; i < 100; i++) {
+      if (Lookup(i) == 1000 + i) {
+        hot++;
+      }
+    }
+    if (high_pri_pool_ratio > 0) {
+      // The scan only evicted the entries of the scan
+      ASSERT_EQ(100, hot);
+    } else {
+      ASSERT_EQ(0, hot);
+    }
+  }
+}
+
+TEST(CacheTest, AdmissionFilter) {
+  delete cache_;
+  cache_ = NewLRUCache(kCacheSize, 0.5, true);
+
+  // Fill the cache, reading each key on a miss as a block cache does
+  for (int i = 0; i < kCacheSize; i++) {
+    ASSERT_EQ(-1, Lookup(i));
+    Insert(i, 1000 + i);
+  }
+
+  // A scan of keys read once does not get in
+  for (int i = 0; i < kCacheSize; i++) {
+    ASSERT_EQ(-1, Lookup(10000 + i));
+    Cache::Handle* h = InsertAndReturnHandle(10000 + i, 20000 + i);
+    ASSERT_EQ(20000 + i, DecodeValue(cache_->Value(h)));
+    cache_->Release(h);
+  }
+  int cached = 0;
+  for (int i = 0; i < kCacheSize; i++) {
+    if (Lookup(10000 + i) != -1) {
+      cached++;
+    }
+  }
+  ASSERT_LE(cached, kCacheSize / 20);
+
+  // A key missed twice does
+  ASSERT_EQ(-1, Lookup(50000));
+  ASSERT_EQ(-1, Lookup(50000));
+  Insert(50000, 50001);
+  ASSERT_EQ(50001, Lookup(50000));
+
+  // Entries of high priority are never turned away
+  cache_->Release(cache_->Insert(EncodeKey(60000), EncodeValue(60001), 1,
+                                 &CacheTest::Deleter,
+                                 Cache::Priority::kHigh));
+  ASSERT_EQ(60001, Lookup(60000));
+
+  // An insertion that is turned away still replaces the entry of its key
+  Insert(50000, 50002);
+  ASSERT_NE(50001, Lookup(50000));
+}
+
 TEST(CacheTest, UseExceedsCacheSize) {
   // Overfill the cache, keeping handles on all inserted entries.
   std::vector<Cache::Handle*> h;
@@ -213,6 +310,36 @@ TEST(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
+// Looks its key up again, which deadlocks if the cache still holds the
+// mutex of the shard of the key
+static void ReentrantDeleter(const Slice& key, void* v) {
+  CacheTest::Deleter(key, v);
+  ASSERT_TRUE(CacheTest::current_->cache_->Lookup(key) == nullptr);
+}
+
+TEST(CacheTest, DeletersRunUnlocked) {
+  // Released after an erase
+  Cache::Handle* handle = cache_->Insert(EncodeKey(1), EncodeValue(100), 1,
+                                         &ReentrantDeleter);
+  Erase(1);
+  cache_->Release(handle);
+
+  // Erased
+  cache_->Release(cache_->Insert(EncodeKey(2), EncodeValue(200), 1,
+                                 &ReentrantDeleter));
+  Erase(2);
+
+  // Pruned
+  cache_->Release(cache_->Insert(EncodeKey(3), EncodeValue(300), 1,
+                                 &ReentrantDeleter));
+  cache_->Prune();
+
+  ASSERT_EQ(3, deleted_keys_.size());
+  ASSERT_EQ(1, deleted_keys_[0]);
+  ASSERT_EQ(2, deleted_keys_[1]);
+  ASSERT_EQ(3, deleted_keys_[2]);
+}
+
 TEST(CacheTest, ZeroSizeCache) {
   delete cache_;
   cache_ = NewLRUCache(0);
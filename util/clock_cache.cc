@@ -0,0 +1,562 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A cache with CLOCK eviction whose Lookup() and Release() take no lock.
+//
+// Each shard is an open-addressing hash table of slots with linear probing.
+// The state of a slot, the references clients hold on it and its CLOCK
+// countdown are packed into a single atomic word, so that readers take and
+// drop references with one atomic add, and a slot changes hands with one
+// compare-and-swap.  Insert(), Erase() and Prune() are serialized by a
+// mutex per shard, which also protects the clock hand; they are the only
+// operations that take entries out of the table, except that the last
+// Release() of an erased entry frees it.  The entries they take out are
+// freed, and their deleters run, after the mutex is released.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// Layout of ClockSlot::meta:
+//    refs:  bits 0..29   references held by clients, including the
+//                        transient ones Lookup() takes before it checks
+//                        the key of the slot
+//    clock: bits 30..31  CLOCK countdown; the entry is evicted once the
+//                        clock hand finds it at zero
+//    state: bits 32..33  one of SlotState
+static const uint64_t kOneRef = 1;
+static const uint64_t kRefsMask = (uint64_t{1} << 30) - 1;
+static const int kClockShift = 30;
+static const uint64_t kClockMask = uint64_t{3} << kClockShift;
+static const int kStateShift = 32;
+
+enum SlotState {
+  kEmpty = 0,
+  kConstruction = 1,  // Owned by the thread filling or freeing the slot
+  kVisible = 2,       // Holds an entry of the cache
+  kInvisible = 3,     // Holds an erased entry that is still referenced
+};
+
+// Initial clock of the entries of each priority, and the clock an entry is
+// raised to when it is looked up.  A hit never lowers the clock, nor raises
+// it past kHitClock, so high-priority entries keep their extra sweep.
+static const uint64_t kLowPriorityClock = uint64_t{1} << kClockShift;
+static const uint64_t kHighPriorityClock = uint64_t{3} << kClockShift;
+static const uint64_t kHitClock = uint64_t{2} << kClockShift;
+
+// Entries per slot the tables are sized for, and the most they may hold
+static const double kLoadFactor = 0.7;
+static const double kStrictLoadFactor = 0.84;
+
+static inline SlotState State(uint64_t meta) {
+  return static_cast<SlotState>(meta >> kStateShift);
+}
+
+static inline uint64_t Refs(uint64_t meta) { return meta & kRefsMask; }
+
+static inline uint64_t StateBits(SlotState state) {
+  return static_cast<uint64_t>(state) << kStateShift;
+}
+
+// Keys up to this size are stored in the slot itself
+static const size_t kInlineKeySize = 16;
+
+struct ClockSlot {
+  std::atomic<uint64_t> meta;
+
+  // Number of entries of the table whose probe sequence goes past this
+  // slot.  Lookup() stops at the first empty slot with none.
+  std::atomic<uint32_t> displacements;
+
+  // Read before a reference is taken, to skip the slots of other keys
+  // cheaply.  The other fields are only read with a reference held, or
+  // with the mutex of the shard held while the slot is visible.
+  std::atomic<uint32_t> hash;
+
+  // Whether the entry was not inserted into the table (because the cache
+  // has no capacity, or every slot is in use) and is freed on its last
+  // Release()
+  bool detached;
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  size_t charge;
+  size_t key_length;
+  char* key_data;  // key_buffer, or a heap allocated copy of long keys
+  char key_buffer[kInlineKeySize];
+
+  // Links the slots taken out of the table with the shard mutex held, whose
+  // entries are freed once it is released
+  ClockSlot* next_free;
+
+  Slice key() const { return Slice(key_data, key_length); }
+
+  void SetKey(const Slice& key) {
+    key_length = key.size();
+    key_data = key.size() <= kInlineKeySize ? key_buffer : new char[key.size()];
+    memcpy(key_data, key.data(), key.size());
+  }
+
+  void FreeEntry() {
+    (*deleter)(key(), value);
+    if (key_data != key_buffer) {
+      delete[] key_data;
+    }
+  }
+};
+
+// A single shard of sharded cache.
+class ClockCacheShard {
+ public:
+  ClockCacheShard()
+      : capacity_(0),
+        mask_(0),
+        occupancy_limit_(0),
+        slots_(nullptr),
+        clock_hand_(0),
+        usage_(0),
+        occupancy_(0) {}
+
+  ClockCacheShard(const ClockCacheShard&) = delete;
+  ClockCacheShard& operator=(const ClockCacheShard&) = delete;
+
+  ~ClockCacheShard();
+
+  // Separate from constructor so caller can easily make an array of shards
+  void Init(size_t capacity, size_t estimated_entry_charge);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle) {
+    Unref(reinterpret_cast<ClockSlot*>(handle));
+  }
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    return usage_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  // Drop a reference to *s, freeing its entry if it was erased and this
+  // was the last reference
+  void Unref(ClockSlot* s);
+
+  // Move *s to kConstruction state if it is invisible and unreferenced, and
+  // return whether it did
+  bool StartFree(ClockSlot* s);
+
+  // Free the entry of *s and empty the slot.
+  // REQUIRES: *s is in kConstruction state.
+  void Free(ClockSlot* s);
+
+  // Free every slot of the list linked through next_free.  Called after
+  // mutex_ is released, so that deleters do not run under it.
+  void FreeList(ClockSlot* list) LOCKS_EXCLUDED(mutex_);
+
+  // Return the visible slot of "key", or nullptr.
+  ClockSlot* FindVisible(const Slice& key, uint32_t hash)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Take *s, which is visible, out of the cache.  If nobody references
+  // it, it is added to *freed.
+  void MakeInvisible(ClockSlot* s, ClockSlot** freed)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Move the clock hand until an entry is evicted, and add it to *freed.
+  // Returns false if every entry is in use.
+  bool EvictOne(ClockSlot** freed) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Return a slot of the probe sequence of "hash" claimed for a new entry,
+  // in kConstruction state, or nullptr if there is none.
+  ClockSlot* ClaimSlot(uint32_t hash) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Initialized before use.
+  size_t capacity_;
+  uint32_t mask_;  // Number of slots, minus one
+  size_t occupancy_limit_;
+  ClockSlot* slots_;
+
+  // mutex_ serializes the operations that put entries into the table or
+  // take visible ones out of it
+  port::Mutex mutex_;
+  uint32_t clock_hand_ GUARDED_BY(mutex_);
+
+  // Combined charge of the visible entries
+  std::atomic<size_t> usage_;
+
+  // Number of slots that are not empty
+  std::atomic<size_t> occupancy_;
+};
+
+void ClockCacheShard::Init(size_t capacity, size_t estimated_entry_charge) {
+  capacity_ = capacity;
+  if (estimated_entry_charge == 0) {
+    estimated_entry_charge = 1;
+  }
+  const double entries =
+      static_cast<double>(capacity) / estimated_entry_charge / kLoadFactor;
+  uint32_t slots = 16;
+  while (slots < entries && slots < (uint32_t{1} << 30)) {
+    slots *= 2;
+  }
+  mask_ = slots - 1;
+  occupancy_limit_ = static_cast<size_t>(slots * kStrictLoadFactor);
+  slots_ = new ClockSlot[slots];
+  for (uint32_t i = 0; i < slots; i++) {
+    slots_[i].meta.store(0, std::memory_order_relaxed);
+    slots_[i].displacements.store(0, std::memory_order_relaxed);
+    slots_[i].hash.store(0, std::memory_order_relaxed);
+  }
+}
+
+ClockCacheShard::~ClockCacheShard() {
+  for (uint32_t i = 0; slots_ != nullptr && i <= mask_; i++) {
+    ClockSlot* s = &slots_[i];
+    const uint64_t meta = s->meta.load(std::memory_order_acquire);
+    // Error if caller has an unreleased handle
+    assert(State(meta) == kEmpty || State(meta) == kVisible);
+    assert(Refs(meta) == 0);
+    if (State(meta) == kVisible) {
+      s->FreeEntry();
+    }
+  }
+  delete[] slots_;
+}
+
+Cache::Handle* ClockCacheShard::Lookup(const Slice& key, uint32_t hash) {
+  for (uint32_t i = 0; i <= mask_; i++) {
+    ClockSlot* s = &slots_[(hash + i) & mask_];
+    const uint64_t meta = s->meta.load(std::memory_order_acquire);
+    if (State(meta) == kVisible) {
+      if (s->hash.load(std::memory_order_relaxed) != hash) {
+        continue;
+      }
+      // The slot cannot be emptied and reused while it is referenced
+      const uint64_t old = s->meta.fetch_add(kOneRef, std::memory_order_acq_rel);
+      if (State(old) == kVisible &&
+          s->hash.load(std::memory_order_relaxed) == hash &&
+          s->key() == key) {
+        uint64_t meta = old + kOneRef;
+        while ((meta & kClockMask) < kHitClock &&
+               !s->meta.compare_exchange_weak(
+                   meta, (meta & ~kClockMask) | kHitClock,
+                   std::memory_order_relaxed)) {
+        }
+        return reinterpret_cast<Cache::Handle*>(s);
+      }
+      Unref(s);
+    } else if (State(meta) == kEmpty &&
+               s->displacements.load(std::memory_order_acquire) == 0) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+void ClockCacheShard::Unref(ClockSlot* s) {
+  const uint64_t old = s->meta.fetch_sub(kOneRef, std::memory_order_acq_rel);
+  assert(Refs(old) > 0);
+  if (Refs(old) == 1 && State(old) == kInvisible && StartFree(s)) {
+    Free(s);
+  }
+}
+
+bool ClockCacheShard::StartFree(ClockSlot* s) {
+  uint64_t meta = s->meta.load(std::memory_order_acquire);
+  while (State(meta) == kInvisible && Refs(meta) == 0) {
+    // Fails if a Lookup() took a transient reference, which it will drop
+    // with another call to Unref()
+    if (s->meta.compare_exchange_weak(meta, StateBits(kConstruction),
+                                      std::memory_order_acq_rel)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void ClockCacheShard::Free(ClockSlot* s) {
+  s->FreeEntry();
+  if (s->detached) {
+    delete s;
+    return;
+  }
+  const uint32_t hash = s->hash.load(std::memory_order_relaxed);
+  const uint32_t index = static_cast<uint32_t>(s - slots_);
+  for (uint32_t i = hash & mask_; i != index; i = (i + 1) & mask_) {
+    slots_[i].displacements.fetch_sub(1, std::memory_order_relaxed);
+  }
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+  // Keep the transient references of concurrent lookups
+  s->meta.fetch_sub(StateBits(kConstruction), std::memory_order_release);
+}
+
+void ClockCacheShard::FreeList(ClockSlot* list) {
+  while (list != nullptr) {
+    ClockSlot* next = list->next_free;
+    Free(list);
+    list = next;
+  }
+}
+
+ClockSlot* ClockCacheShard::FindVisible(const Slice& key, uint32_t hash) {
+  for (uint32_t i = 0; i <= mask_; i++) {
+    ClockSlot* s = &slots_[(hash + i) & mask_];
+    const uint64_t meta = s->meta.load(std::memory_order_acquire);
+    if (State(meta) == kVisible) {
+      // Visible slots only leave that state with mutex_ held
+      if (s->hash.load(std::memory_order_relaxed) == hash && s->key() == key) {
+        return s;
+      }
+    } else if (State(meta) == kEmpty &&
+               s->displacements.load(std::memory_order_acquire) == 0) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+void ClockCacheShard::MakeInvisible(ClockSlot* s, ClockSlot** freed) {
+  uint64_t meta = s->meta.load(std::memory_order_relaxed);
+  uint64_t invisible;
+  do {
+    assert(State(meta) == kVisible);
+    invisible = (meta & ~StateBits(kInvisible)) | StateBits(kInvisible);
+  } while (!s->meta.compare_exchange_weak(meta, invisible,
+                                          std::memory_order_acq_rel));
+  usage_.fetch_sub(s->charge, std::memory_order_relaxed);
+  if (Refs(invisible) == 0 && StartFree(s)) {
+    s->next_free = *freed;
+    *freed = s;
+  }
+}
+
+bool ClockCacheShard::EvictOne(ClockSlot** freed) {
+  // Every entry that is not in use reaches zero within three sweeps
+  const uint64_t max_steps = 4 * (uint64_t{mask_} + 1);
+  for (uint64_t step = 0; step < max_steps; step++) {
+    ClockSlot* s = &slots_[clock_hand_++ & mask_];
+    uint64_t meta = s->meta.load(std::memory_order_acquire);
+    if (State(meta) != kVisible || Refs(meta) != 0) {
+      continue;
+    }
+    if ((meta & kClockMask) != 0) {
+      // Fails if the entry was just looked up, which is fine
+      const uint64_t decremented = meta - (uint64_t{1} << kClockShift);
+      s->meta.compare_exchange_strong(meta, decremented,
+                                      std::memory_order_relaxed);
+      continue;
+    }
+    if (s->meta.compare_exchange_strong(meta, StateBits(kConstruction),
+                                        std::memory_order_acq_rel)) {
+      usage_.fetch_sub(s->charge, std::memory_order_relaxed);
+      s->next_free = *freed;
+      *freed = s;
+      return true;
+    }
+  }
+  return false;
+}
+
+ClockSlot* ClockCacheShard::ClaimSlot(uint32_t hash) {
+  for (uint32_t i = 0; i <= mask_; i++) {
+    ClockSlot* s = &slots_[(hash + i) & mask_];
+    uint64_t meta = s->meta.load(std::memory_order_acquire);
+    // A transient reference of a Lookup() makes the slot unavailable for
+    // now
+    if (State(meta) == kEmpty && Refs(meta) == 0 &&
+        s->meta.compare_exchange_strong(meta, StateBits(kConstruction),
+                                        std::memory_order_acq_rel)) {
+      for (uint32_t j = 0; j < i; j++) {
+        slots_[(hash + j) & mask_].displacements.fetch_add(
+            1, std::memory_order_relaxed);
+      }
+      occupancy_.fetch_add(1, std::memory_order_relaxed);
+      return s;
+    }
+  }
+  return nullptr;
+}
+
+Cache::Handle* ClockCacheShard::Insert(
+    const Slice& key, uint32_t hash, void* value, size_t charge,
+    void (*deleter)(const Slice& key, void* value), Cache::Priority priority) {
+  ClockSlot* s = nullptr;
+  if (capacity_ > 0) {
+    ClockSlot* freed = nullptr;
+    {
+      MutexLock l(&mutex_);
+      ClockSlot* old = FindVisible(key, hash);
+      if (old != nullptr) {
+        MakeInvisible(old, &freed);
+      }
+      // The slots of "freed" still count in occupancy_ until they are freed
+      size_t pending = (freed != nullptr) ? 1 : 0;
+      while (usage_.load(std::memory_order_relaxed) + charge > capacity_ ||
+             occupancy_.load(std::memory_order_relaxed) - pending >=
+                 occupancy_limit_) {
+        if (!EvictOne(&freed)) {
+          break;
+        }
+        pending++;
+      }
+      if (occupancy_.load(std::memory_order_relaxed) - pending <
+          occupancy_limit_) {
+        s = ClaimSlot(hash);
+      }
+      if (s != nullptr) {
+        s->detached = false;
+        s->hash.store(hash, std::memory_order_relaxed);
+        s->value = value;
+        s->deleter = deleter;
+        s->charge = charge;
+        s->SetKey(key);
+        usage_.fetch_add(charge, std::memory_order_relaxed);
+        const uint64_t clock = priority == Cache::Priority::kHigh
+                                   ? kHighPriorityClock
+                                   : kLowPriorityClock;
+        // Publish the entry, with a reference for the returned handle
+        s->meta.fetch_add(
+            StateBits(kVisible) - StateBits(kConstruction) + clock + kOneRef,
+            std::memory_order_acq_rel);
+      }
+    }
+    FreeList(freed);
+    if (s != nullptr) {
+      return reinterpret_cast<Cache::Handle*>(s);
+    }
+  }
+
+  // Don't cache: capacity_ == 0 turns off caching, and there is no slot
+  // left once every entry is in use.  The entry is freed on Release().
+  s = new ClockSlot;
+  s->meta.store(StateBits(kInvisible) + kOneRef, std::memory_order_relaxed);
+  s->displacements.store(0, std::memory_order_relaxed);
+  s->hash.store(hash, std::memory_order_relaxed);
+  s->detached = true;
+  s->value = value;
+  s->deleter = deleter;
+  s->charge = charge;
+  s->SetKey(key);
+  return reinterpret_cast<Cache::Handle*>(s);
+}
+
+void ClockCacheShard::Erase(const Slice& key, uint32_t hash) {
+  ClockSlot* freed = nullptr;
+  {
+    MutexLock l(&mutex_);
+    ClockSlot* s = FindVisible(key, hash);
+    if (s != nullptr) {
+      MakeInvisible(s, &freed);
+    }
+  }
+  FreeList(freed);
+}
+
+void ClockCacheShard::Prune() {
+  ClockSlot* freed = nullptr;
+  {
+    MutexLock l(&mutex_);
+    for (uint32_t i = 0; i <= mask_; i++) {
+      ClockSlot* s = &slots_[i];
+      uint64_t meta = s->meta.load(std::memory_order_acquire);
+      if (State(meta) == kVisible && Refs(meta) == 0 &&
+          s->meta.compare_exchange_strong(meta, StateBits(kConstruction),
+                                          std::memory_order_acq_rel)) {
+        usage_.fetch_sub(s->charge, std::memory_order_relaxed);
+        s->next_free = freed;
+        freed = s;
+      }
+    }
+  }
+  FreeList(freed);
+}
+
+static const int kNumShardBits = 4;
+static const int kNumShards = 1 << kNumShardBits;
+
+class ShardedClockCache : public Cache {
+ private:
+  ClockCacheShard shard_[kNumShards];
+  std::atomic<uint64_t> last_id_;
+
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+
+ public:
+  ShardedClockCache(size_t capacity, size_t estimated_entry_charge)
+      : last_id_(0) {
+    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+    for (int s = 0; s < kNumShards; s++) {
+      shard_[s].Init(per_shard, estimated_entry_charge);
+    }
+  }
+  ~ShardedClockCache() override {}
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value)) override {
+    return Insert(key, value, charge, deleter, Priority::kLow);
+  }
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value),
+                 Priority priority) override {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                      priority);
+  }
+  Handle* Lookup(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Lookup(key, hash);
+  }
+  void Release(Handle* handle) override {
+    ClockSlot* s = reinterpret_cast<ClockSlot*>(handle);
+    shard_[Shard(s->hash.load(std::memory_order_relaxed))].Release(handle);
+  }
+  void Erase(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    shard_[Shard(hash)].Erase(key, hash);
+  }
+  void* Value(Handle* handle) override {
+    return reinterpret_cast<ClockSlot*>(handle)->value;
+  }
+  uint64_t NewId() override {
+    return last_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+  void Prune() override {
+    for (int s = 0; s < kNumShards; s++) {
+      shard_[s].Prune();
+    }
+  }
+  size_t TotalCharge() const override {
+    size_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shard_[s].TotalCharge();
+    }
+    return total;
+  }
+};
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity, size_t estimated_entry_charge) {
+  return new ShardedClockCache(capacity, estimated_entry_charge);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,349 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <atomic>
+#include <vector>
+
+#include "leveldb/cache.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+// Conversions between numeric keys/values and the types expected by Cache.
+static std::string EncodeKey(int k) {
+  std::string result;
+  PutFixed32(&result, k);
+  return result;
+}
+static int DecodeKey(const Slice& k) {
+  assert(k.size() == 4);
+  return DecodeFixed32(k.data());
+}
+static void* EncodeValue(uintptr_t v) { return reinterpret_cast<void*>(v); }
+static int DecodeValue(void* v) { return reinterpret_cast<uintptr_t>(v); }
+
+class ClockCacheTest {
+ public:
+  static void Deleter(const Slice& key, void* v) {
+    current_->deleted_keys_.push_back(DecodeKey(key));
+    current_->deleted_values_.push_back(DecodeValue(v));
+  }
+
+  static const int kCacheSize = 1000;
+  std::vector<int> deleted_keys_;
+  std::vector<int> deleted_values_;
+  Cache* cache_;
+
+  // Sized for the charge of 1 most tests use
+  ClockCacheTest() : cache_(NewClockCache(kCacheSize, 1)) { current_ = this; }
+
+  ~ClockCacheTest() { delete cache_; }
+
+  int Lookup(int key) {
+    Cache::Handle* handle = cache_->Lookup(EncodeKey(key));
+    const int r = (handle == nullptr) ? -1 : DecodeValue(cache_->Value(handle));
+    if (handle != nullptr) {
+      cache_->Release(handle);
+    }
+    return r;
+  }
+
+  void Insert(int key, int value, int charge = 1) {
+    cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
+                                   &ClockCacheTest::Deleter));
+  }
+
+  Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
+    return cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
+                          &ClockCacheTest::Deleter);
+  }
+
+  void Erase(int key) { cache_->Erase(EncodeKey(key)); }
+
+  static ClockCacheTest* current_;
+};
+ClockCacheTest* ClockCacheTest::current_;
+
+TEST(ClockCacheTest, HitAndMiss) {
+  ASSERT_EQ(-1, Lookup(100));
+
+  Insert(100, 101);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+
+  Insert(200, 201);
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+
+  Insert(100, 102);
+  ASSERT_EQ(102, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+}
+
+TEST(ClockCacheTest, Erase) {
+  Erase(200);
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  Insert(100, 101);
+  Insert(200, 201);
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(201, Lookup(200));
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(1, deleted_keys_.size());
+}
+
+TEST(ClockCacheTest, EntriesArePinned) {
+  Insert(100, 101);
+  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+  Insert(100, 102);
+  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  cache_->Release(h1);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+
+  cache_->Release(h2);
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST(ClockCacheTest, EvictionPolicy) {
+  Insert(100, 101);
+  Insert(200, 201);
+  Insert(300, 301);
+  Cache::Handle* h = cache_->Lookup(EncodeKey(300));
+
+  // Frequently used entry must be kept around,
+  // as must things that are still in use.
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    Insert(1000 + i, 2000 + i);
+    ASSERT_EQ(2000 + i, Lookup(1000 + i));
+    ASSERT_EQ(101, Lookup(100));
+  }
+  ASSERT_EQ(101, Lookup(100));
+  ASSERT_EQ(-1, Lookup(200));
+  ASSERT_EQ(301, Lookup(300));
+  cache_->Release(h);
+}
+
+TEST(ClockCacheTest, UseExceedsCacheSize) {
+  // Overfill the cache, keeping handles on all inserted entries.
+  std::vector<Cache::Handle*> h;
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    h.push_back(InsertAndReturnHandle(1000 + i, 2000 + i));
+  }
+
+  // Check that all the entries can be found in the cache.
+  for (int i = 0; i < h.size(); i++) {
+    ASSERT_EQ(2000 + i, Lookup(1000 + i));
+  }
+
+  for (int i = 0; i < h.size(); i++) {
+    cache_->Release(h[i]);
+  }
+}
+
+TEST(ClockCacheTest, HeavyEntries) {
+  const int kLight = 1;
+  const int kHeavy = 10;
+  int added = 0;
+  int index = 0;
+  while (added < 2 * kCacheSize) {
+    const int weight = (index & 1) ? kLight : kHeavy;
+    Insert(index, 1000 + index, weight);
+    added += weight;
+    index++;
+  }
+
+  int cached_weight = 0;
+  for (int i = 0; i < index; i++) {
+    const int weight = (i & 1 ? kLight : kHeavy);
+    int r = Lookup(i);
+    if (r >= 0) {
+      cached_weight += weight;
+      ASSERT_EQ(1000 + i, r);
+    }
+  }
+  ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
+  ASSERT_EQ(cached_weight, cache_->TotalCharge());
+}
+
+TEST(ClockCacheTest, Prune) {
+  Insert(1, 100);
+  Insert(2, 200);
+
+  Cache::Handle* handle = cache_->Lookup(EncodeKey(1));
+  ASSERT_TRUE(handle);
+  cache_->Prune();
+  cache_->Release(handle);
+
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(-1, Lookup(2));
+}
+
+// Erases its key, which deadlocks if the cache still holds the mutex of the
+// shard of the key
+static void ReentrantDeleter(const Slice& key, void* v) {
+  ClockCacheTest::Deleter(key, v);
+  ClockCacheTest::current_->cache_->Erase(key);
+}
+
+TEST(ClockCacheTest, DeletersRunUnlocked) {
+  // Replaced, and the deleter erases the replacement
+  cache_->Release(cache_->Insert(EncodeKey(1), EncodeValue(100), 1,
+                                 &ReentrantDeleter));
+  Insert(1, 101);
+  ASSERT_EQ(-1, Lookup(1));
+
+  // Erased
+  cache_->Release(cache_->Insert(EncodeKey(2), EncodeValue(200), 1,
+                                 &ReentrantDeleter));
+  Erase(2);
+
+  // Pruned
+  cache_->Release(cache_->Insert(EncodeKey(3), EncodeValue(300), 1,
+                                 &ReentrantDeleter));
+  cache_->Prune();
+
+  ASSERT_EQ(4, deleted_values_.size());
+  ASSERT_EQ(100, deleted_values_[0]);
+  ASSERT_EQ(101, deleted_values_[1]);
+  ASSERT_EQ(200, deleted_values_[2]);
+  ASSERT_EQ(300, deleted_values_[3]);
+}
+
+TEST(ClockCacheTest, ZeroSizeCache) {
+  delete cache_;
+  cache_ = NewClockCache(0, 1);
+
+  Insert(1, 100);
+  ASSERT_EQ(-1, Lookup(1));
+  ASSERT_EQ(1, deleted_keys_.size());
+}
+
+TEST(ClockCacheTest, SmallEntries) {
+  // Entries much smaller than estimated: the hash tables fill up before the
+  // capacity is reached, and the cache keeps working.
+  delete cache_;
+  cache_ = NewClockCache(kCacheSize, 100);
+  for (int i = 0; i < kCacheSize; i++) {
+    Insert(i, 1000 + i);
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  ASSERT_LT(cache_->TotalCharge(), static_cast<size_t>(kCacheSize));
+  ASSERT_EQ(kCacheSize - cache_->TotalCharge(), deleted_keys_.size());
+}
+
+namespace {
+
+// Shared by the threads of the concurrency tests
+struct ConcurrentState {
+  Cache* cache;
+  int num_keys;
+  int lookups;
+  std::atomic<int> done;
+  std::atomic<int> errors;
+  port::Mutex mu;
+  port::CondVar cv GUARDED_BY(mu);
+
+  ConcurrentState() : done(0), errors(0), cv(&mu) {}
+};
+
+static void CountingDeleter(const Slice& key, void* v) {
+  // Values are keys plus one; a mismatch means an entry was mixed up
+  if (DecodeValue(v) != DecodeKey(key) + 1) {
+    fprintf(stderr, "Deleted entry %d with value %d\n", DecodeKey(key),
+            DecodeValue(v));
+    abort();
+  }
+}
+
+static void ConcurrentReader(void* arg) {
+  ConcurrentState* state = reinterpret_cast<ConcurrentState*>(arg);
+  Random rnd(301 + state->done.load());
+  for (int i = 0; i < state->lookups; i++) {
+    const int key = rnd.Uniform(state->num_keys);
+    const std::string encoded = EncodeKey(key);
+    Cache::Handle* h = state->cache->Lookup(encoded);
+    if (h == nullptr) {
+      h = state->cache->Insert(encoded, EncodeValue(key + 1), 1 + key % 3,
+                               &CountingDeleter);
+    }
+    if (DecodeValue(state->cache->Value(h)) != key + 1) {
+      state->errors.fetch_add(1);
+    }
+    if (rnd.OneIn(100)) {
+      state->cache->Erase(encoded);
+    }
+    state->cache->Release(h);
+  }
+  MutexLock l(&state->mu);
+  state->done.fetch_add(1);
+  state->cv.SignalAll();
+}
+
+// Runs "threads" threads of ConcurrentReader() on "cache"
+static void RunConcurrentReaders(Cache* cache, int threads, int num_keys,
+                                 int lookups) {
+  ConcurrentState state;
+  state.cache = cache;
+  state.num_keys = num_keys;
+  state.lookups = lookups;
+  for (int i = 0; i < threads; i++) {
+    Env::Default()->StartThread(&ConcurrentReader, &state);
+  }
+  {
+    MutexLock l(&state.mu);
+    while (state.done.load() < threads) {
+      state.cv.Wait();
+    }
+  }
+  ASSERT_EQ(0, state.errors.load());
+}
+
+}  // namespace
+
+TEST(ClockCacheTest, Concurrent) {
+  // Small enough that entries are evicted all the time
+  Cache* cache = NewClockCache(500, 2);
+  RunConcurrentReaders(cache, 8, 1000, 100000);
+
+  // Insert() may go over the capacity of a shard while the readers pin its
+  // entries.  Once nothing is pinned, it evicts down to the capacity of the
+  // shard again: 500 is split into 16 shards of 32.
+  for (int key = 1000; key < 2000; key++) {
+    cache->Release(cache->Insert(EncodeKey(key), EncodeValue(key + 1), 1,
+                                 &CountingDeleter));
+  }
+  ASSERT_LE(cache->TotalCharge(), 16 * 32);
+  cache->Prune();
+  ASSERT_EQ(0, cache->TotalCharge());
+  delete cache;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
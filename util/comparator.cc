@@ -17,6 +17,8 @@ namespace leveldb {
 
 Comparator::~Comparator() = default;
 
+Slice Comparator::HashKey(const Slice& key) const { return key; }
+
 namespace {
 class BytewiseComparatorImpl : public Comparator {
  public:
@@ -12,6 +12,16 @@ Status Env::NewAppendableFile(const std::string& fname, WritableFile** result) {
   return Status::NotSupported("NewAppendableFile", fname);
 }
 
+Status Env::SyncDir(const std::string& dirname) { return Status::OK(); }
+
+void Env::Schedule(void (*function)(void* arg), void* arg, Priority pri) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int number, Priority pri) {}
+
+bool Env::HasPriorityPools() { return false; }
+
 SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
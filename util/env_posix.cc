@@ -12,6 +12,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -322,6 +323,19 @@ class PosixWritableFile final : public WritableFile {
     return SyncFd(fd_, filename_);
   }
 
+  // Ensures that the entries of the given directory are durable.
+  static Status SyncDir(const std::string& dirname) {
+    Status status;
+    int fd = ::open(dirname.c_str(), O_RDONLY | kOpenBaseFlags);
+    if (fd < 0) {
+      status = PosixError(dirname, errno);
+    } else {
+      status = SyncFd(fd, dirname);
+      ::close(fd);
+    }
+    return status;
+  }
+
  private:
   Status FlushBuffer() {
     Status status = WriteUnbuffered(buf_, pos_);
@@ -345,19 +359,10 @@ class PosixWritableFile final : public WritableFile {
   }
 
   Status SyncDirIfManifest() {
-    Status status;
     if (!is_manifest_) {
-      return status;
-    }
-
-    int fd = ::open(dirname_.c_str(), O_RDONLY | kOpenBaseFlags);
-    if (fd < 0) {
-      status = PosixError(dirname_, errno);
-    } else {
-      status = SyncFd(fd, dirname_);
-      ::close(fd);
+      return Status::OK();
     }
-    return status;
+    return SyncDir(dirname_);
   }
 
   // Ensures that all the caches associated with the given file descriptor's
@@ -487,6 +492,110 @@ class PosixLockTable {
   std::set<std::string> locked_files_ GUARDED_BY(mu_);
 };
 
+// A pool of detached threads that run background work items in FIFO order.
+//
+// Threads are started lazily, when work is scheduled, up to the configured
+// number.  When the number is lowered, surplus threads exit once they are
+// done with their current work item.
+//
+// Instances are thread-safe because all member data is guarded by a mutex.
+class BackgroundThreadPool {
+ public:
+  BackgroundThreadPool()
+      : background_work_cv_(&background_work_mutex_),
+        max_threads_(1),
+        started_threads_(0) {}
+
+  void Schedule(void (*background_work_function)(void* background_work_arg),
+                void* background_work_arg)
+      LOCKS_EXCLUDED(background_work_mutex_);
+
+  void SetBackgroundThreads(int number) LOCKS_EXCLUDED(background_work_mutex_);
+
+ private:
+  void BackgroundThreadMain() LOCKS_EXCLUDED(background_work_mutex_);
+
+  static void BackgroundThreadEntryPoint(BackgroundThreadPool* pool) {
+    pool->BackgroundThreadMain();
+  }
+
+  // Stores the work item data in a Schedule() call.
+  //
+  // Instances are constructed on the thread calling Schedule() and used on the
+  // background thread.
+  //
+  // This structure is thread-safe beacuse it is immutable.
+  struct BackgroundWorkItem {
+    explicit BackgroundWorkItem(void (*function)(void* arg), void* arg)
+        : function(function), arg(arg) {}
+
+    void (*const function)(void*);
+    void* const arg;
+  };
+
+  port::Mutex background_work_mutex_;
+  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
+  int max_threads_ GUARDED_BY(background_work_mutex_);
+  int started_threads_ GUARDED_BY(background_work_mutex_);
+
+  std::queue<BackgroundWorkItem> background_work_queue_
+      GUARDED_BY(background_work_mutex_);
+};
+
+void BackgroundThreadPool::Schedule(
+    void (*background_work_function)(void* background_work_arg),
+    void* background_work_arg) {
+  background_work_mutex_.Lock();
+
+  // Start another background thread, if we are allowed to.
+  if (started_threads_ < max_threads_) {
+    started_threads_++;
+    std::thread background_thread(
+        BackgroundThreadPool::BackgroundThreadEntryPoint, this);
+    background_thread.detach();
+  }
+
+  background_work_queue_.emplace(background_work_function, background_work_arg);
+  // Wake up one idle thread, if any.  Busy threads check the queue again
+  // when they finish their current work item.
+  background_work_cv_.Signal();
+  background_work_mutex_.Unlock();
+}
+
+void BackgroundThreadPool::SetBackgroundThreads(int number) {
+  background_work_mutex_.Lock();
+  max_threads_ = std::max(number, 1);
+  // Let idle threads notice if they are no longer needed.
+  background_work_cv_.SignalAll();
+  background_work_mutex_.Unlock();
+}
+
+void BackgroundThreadPool::BackgroundThreadMain() {
+  while (true) {
+    background_work_mutex_.Lock();
+
+    // Wait until there is work to be done, unless this thread has become
+    // surplus.
+    while (background_work_queue_.empty() &&
+           started_threads_ <= max_threads_) {
+      background_work_cv_.Wait();
+    }
+    if (started_threads_ > max_threads_) {
+      started_threads_--;
+      background_work_mutex_.Unlock();
+      return;
+    }
+
+    assert(!background_work_queue_.empty());
+    auto background_work_function = background_work_queue_.front().function;
+    void* background_work_arg = background_work_queue_.front().arg;
+    background_work_queue_.pop();
+
+    background_work_mutex_.Unlock();
+    background_work_function(background_work_arg);
+  }
+}
+
 class PosixEnv : public Env {
  public:
   PosixEnv();
@@ -607,6 +716,10 @@ class PosixEnv : public Env {
     return Status::OK();
   }
 
+  Status SyncDir(const std::string& dirname) override {
+    return PosixWritableFile::SyncDir(dirname);
+  }
+
   Status GetFileSize(const std::string& filename, uint64_t* size) override {
     struct ::stat file_stat;
     if (::stat(filename.c_str(), &file_stat) != 0) {
@@ -660,7 +773,20 @@ class PosixEnv : public Env {
   }
 
   void Schedule(void (*background_work_function)(void* background_work_arg),
-                void* background_work_arg) override;
+                void* background_work_arg) override {
+    Schedule(background_work_function, background_work_arg, LOW);
+  }
+
+  void Schedule(void (*background_work_function)(void* background_work_arg),
+                void* background_work_arg, Priority pri) override {
+    thread_pools_[pri].Schedule(background_work_function, background_work_arg);
+  }
+
+  void SetBackgroundThreads(int number, Priority pri) override {
+    thread_pools_[pri].SetBackgroundThreads(number);
+  }
+
+  bool HasPriorityPools() override { return true; }
 
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override;
@@ -711,32 +837,7 @@ class PosixEnv : public Env {
   void SleepForMicroseconds(int micros) override { ::usleep(micros); }
 
  private:
-  void BackgroundThreadMain();
-
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
-  }
-
-  // Stores the work item data in a Schedule() call.
-  //
-  // Instances are constructed on the thread calling Schedule() and used on the
-  // background thread.
-  //
-  // This structure is thread-safe beacuse it is immutable.
-  struct BackgroundWorkItem {
-    explicit BackgroundWorkItem(void (*function)(void* arg), void* arg)
-        : function(function), arg(arg) {}
-
-    void (*const function)(void*);
-    void* const arg;
-  };
-
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
-
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+  BackgroundThreadPool thread_pools_[2];  // Indexed by Priority.
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
@@ -767,50 +868,7 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
-      mmap_limiter_(MaxMmaps()),
-      fd_limiter_(MaxOpenFiles()) {}
-
-void PosixEnv::Schedule(
-    void (*background_work_function)(void* background_work_arg),
-    void* background_work_arg) {
-  background_work_mutex_.Lock();
-
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
-    background_thread.detach();
-  }
-
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
-  }
-
-  background_work_queue_.emplace(background_work_function, background_work_arg);
-  background_work_mutex_.Unlock();
-}
-
-void PosixEnv::BackgroundThreadMain() {
-  while (true) {
-    background_work_mutex_.Lock();
-
-    // Wait until there is work to be done.
-    while (background_work_queue_.empty()) {
-      background_work_cv_.Wait();
-    }
-
-    assert(!background_work_queue_.empty());
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
-
-    background_work_mutex_.Unlock();
-    background_work_function(background_work_arg);
-  }
-}
+    : mmap_limiter_(MaxMmaps()), fd_limiter_(MaxOpenFiles()) {}
 
 namespace {
 
@@ -119,6 +119,89 @@ TEST(EnvTest, RunMany) {
   ASSERT_EQ(4, last_id.load(std::memory_order_relaxed));
 }
 
+TEST(EnvTest, HighPriorityRunsWhileLowPriorityBusy) {
+  std::atomic<bool> low_started(false);
+  std::atomic<bool> high_called(false);
+  std::atomic<bool> low_done(false);
+
+  struct Blocker {
+    std::atomic<bool>* started;
+    std::atomic<bool>* release;
+    std::atomic<bool>* done;
+
+    static void Run(void* arg) {
+      Blocker* blocker = reinterpret_cast<Blocker*>(arg);
+      blocker->started->store(true, std::memory_order_relaxed);
+      while (!blocker->release->load(std::memory_order_relaxed)) {
+        Env::Default()->SleepForMicroseconds(1000);
+      }
+      blocker->done->store(true, std::memory_order_release);
+    }
+  };
+
+  ASSERT_TRUE(env_->HasPriorityPools());
+
+  // The LOW pool's only thread stays busy until the HIGH priority item runs.
+  Blocker blocker = {&low_started, &high_called, &low_done};
+  env_->Schedule(&Blocker::Run, &blocker, Env::LOW);
+  uint64_t deadline = env_->NowMicros() + 10000000;
+  while (!low_started.load(std::memory_order_relaxed) &&
+         env_->NowMicros() < deadline) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_TRUE(low_started.load(std::memory_order_relaxed));
+  env_->Schedule(&SetAtomicBool, &high_called, Env::HIGH);
+  deadline = env_->NowMicros() + 10000000;
+  while (!high_called.load(std::memory_order_relaxed) &&
+         env_->NowMicros() < deadline) {
+    env_->SleepForMicroseconds(1000);
+  }
+  ASSERT_TRUE(high_called.load(std::memory_order_relaxed));
+
+  // The blocker refers to this frame, and must be gone before the next test.
+  while (!low_done.load(std::memory_order_acquire)) {
+    env_->SleepForMicroseconds(1000);
+  }
+}
+
+TEST(EnvTest, SetBackgroundThreads) {
+  // Two LOW priority items that each wait for the other can only finish if
+  // they run in different threads.
+  struct Rendezvous {
+    std::atomic<int> arrived{0};
+    std::atomic<int> met{0};
+    std::atomic<int> finished{0};
+
+    static void Run(void* arg) {
+      Rendezvous* r = reinterpret_cast<Rendezvous*>(arg);
+      r->arrived.fetch_add(1, std::memory_order_relaxed);
+      // Wait long enough for a loaded machine to start the other thread
+      const uint64_t deadline = Env::Default()->NowMicros() + 10000000;
+      while (r->arrived.load(std::memory_order_relaxed) < 2 &&
+             Env::Default()->NowMicros() < deadline) {
+        Env::Default()->SleepForMicroseconds(1000);
+      }
+      if (r->arrived.load(std::memory_order_relaxed) == 2) {
+        r->met.fetch_add(1, std::memory_order_relaxed);
+      }
+      r->finished.fetch_add(1, std::memory_order_relaxed);
+    }
+  };
+
+  Rendezvous rendezvous;
+  env_->SetBackgroundThreads(2, Env::LOW);
+  env_->Schedule(&Rendezvous::Run, &rendezvous, Env::LOW);
+  env_->Schedule(&Rendezvous::Run, &rendezvous, Env::LOW);
+  const uint64_t deadline = env_->NowMicros() + 30000000;
+  while (rendezvous.finished.load(std::memory_order_relaxed) < 2 &&
+         env_->NowMicros() < deadline) {
+    env_->SleepForMicroseconds(1000);
+  }
+  env_->SetBackgroundThreads(1, Env::LOW);
+  ASSERT_EQ(2, rendezvous.finished.load(std::memory_order_relaxed));
+  ASSERT_EQ(2, rendezvous.met.load(std::memory_order_relaxed));
+}
+
 struct State {
   port::Mutex mu;
   int val GUARDED_BY(mu);
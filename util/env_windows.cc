@@ -570,6 +570,7 @@ class WindowsEnv : public Env {
     return result;
   }
 
+  using Env::Schedule;
   void Schedule(void (*function)(void*), void* arg) override;
 
   void StartThread(void (*function)(void* arg), void* arg) override {
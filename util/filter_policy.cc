@@ -4,8 +4,25 @@
 
 #include "leveldb/filter_policy.h"
 
+#include <vector>
+
+#include "leveldb/slice.h"
+
 namespace leveldb {
 
 FilterPolicy::~FilterPolicy() {}
 
+void FilterPolicy::CreateFilterWithPrefixes(const Slice* keys, int n,
+                                            const Slice* prefixes, int m,
+                                            std::string* dst) const {
+  std::vector<Slice> entries(keys, keys + n);
+  entries.insert(entries.end(), prefixes, prefixes + m);
+  CreateFilter(entries.data(), n + m, dst);
+}
+
+bool FilterPolicy::PrefixMayMatch(const Slice& prefix,
+                                  const Slice& filter) const {
+  return KeyMayMatch(prefix, filter);
+}
+
 }  // namespace leveldb
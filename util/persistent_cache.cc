@@ -0,0 +1,472 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "leveldb/secondary_cache.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/hash.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+namespace {
+
+// Bounds of the size of the segments, which is a sixteenth of the capacity
+const size_t kMinSegmentSize = 64 << 10;
+const size_t kMaxSegmentSize = 4 << 20;
+
+struct SliceHash {
+  size_t operator()(const Slice& s) const {
+    return Hash(s.data(), s.size(), 0);
+  }
+};
+
+// The cache appends the blocks it holds to a log made of segments: files
+// named <number>.pcache in its directory, of up to segment_size_ bytes.
+// Each block is a record of the form:
+//
+//    checksum: uint32     // masked crc32c of the rest of the record
+//    key length: varint32
+//    contents length: varint32
+//    key: char[key length]
+//    contents: char[contents length]
+//
+// The newest segment is built in memory, and written out as a whole once
+// full or when the cache is deleted.  The write does not hold the mutex;
+// the records of the segment are read from memory until its file is open.
+// When the log outgrows the capacity, the oldest segment is deleted along
+// with the index entries of its records.  Opening the cache reads back the
+// records of the segments to rebuild the index, later records taking
+// precedence over earlier ones.
+//
+// Promoted blocks stay in the log, where dropping them would not free any
+// room before their segment goes, and are kept for the next process.
+// Erase() only drops the index entry of a block, so the block is back
+// after a restart, which is harmless as the contents of a key never
+// change.
+class PersistentSecondaryCache : public SecondaryCache {
+ public:
+  PersistentSecondaryCache(Env* env, const std::string& dirname,
+                           size_t capacity);
+  ~PersistentSecondaryCache() override;
+
+  // Lock the directory and read back the segments of an earlier cache
+  Status Open();
+
+  const char* Name() const override {
+    return "leveldb.PersistentSecondaryCache";
+  }
+
+  void Insert(const Slice& key, const Slice& contents) override;
+  bool Lookup(const Slice& key, bool promote, Slice* contents) override;
+  void Erase(const Slice& key) override;
+  uint64_t NewId() override;
+  size_t TotalCharge() const override;
+
+ private:
+  struct Segment {
+    uint64_t number;
+    RandomAccessFile* file;  // nullptr while the segment is in memory
+    size_t size;
+    // One reference from the cache while the segment is in segments_, one
+    // from each Lookup() reading the file, and one from SealSegment()
+    // while writing it
+    int refs;
+    // Of the records in the segment, which also serve as the keys of the
+    // index entries pointing at them.  A deque, so that they never move.
+    std::deque<std::string> keys;
+    std::string buffer;  // The records, while the segment is in memory
+  };
+
+  // Where the record of a block is
+  struct Location {
+    Segment* segment;
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  std::string SegmentFileName(uint64_t number) const;
+
+  // Start a new segment in memory, at the end of the log
+  void NewSegment() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Start a new segment, then write the one that was in memory out to its
+  // file.  Releases mutex_ during the write.
+  void SealSegment() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Point the index entry of "key" at its record, of "size" bytes at
+  // "offset" in "segment"
+  void AddRecord(Segment* segment, const Slice& key, size_t offset,
+                 size_t size) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Delete the oldest segments until the log fits in the capacity, or
+  // until the oldest one is still in memory
+  void EvictSegments() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Remove "segment" from the log, dropping the index entries of its
+  // records and deleting its file
+  void DropSegment(Segment* segment) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  void Unref(Segment* segment) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Read back the records of the segment file "number"
+  Status RecoverSegment(uint64_t number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  Env* const env_;
+  const std::string dirname_;
+  const size_t capacity_;
+  const size_t segment_size_;
+  FileLock* lock_;
+
+  mutable port::Mutex mutex_;
+  uint64_t next_segment_number_ GUARDED_BY(mutex_);
+  uint64_t last_id_ GUARDED_BY(mutex_);
+  size_t usage_ GUARDED_BY(mutex_);  // Size of the segments of the log
+  std::deque<Segment*> segments_ GUARDED_BY(mutex_);  // Oldest first
+  Segment* current_ GUARDED_BY(mutex_);  // Newest segment, in memory
+  // Keyed by the copy of the key in location.segment->keys
+  std::unordered_map<Slice, Location, SliceHash> index_ GUARDED_BY(mutex_);
+};
+
+// Build the record of "key" and "contents"
+static void EncodeRecord(const Slice& key, const Slice& contents,
+                         std::string* record) {
+  record->assign(4, '\0');
+  PutVarint32(record, key.size());
+  PutVarint32(record, contents.size());
+  record->append(key.data(), key.size());
+  record->append(contents.data(), contents.size());
+  const uint32_t crc = crc32c::Value(record->data() + 4, record->size() - 4);
+  EncodeFixed32(&(*record)[0], crc32c::Mask(crc));
+}
+
+// Parse the record at the start of "*input" and advance *input past it.
+// Return false if *input does not start with an intact record.
+static bool DecodeRecord(Slice* input, Slice* key, Slice* contents) {
+  if (input->size() < 4) {
+    return false;
+  }
+  const uint32_t crc = crc32c::Unmask(DecodeFixed32(input->data()));
+  Slice rest(input->data() + 4, input->size() - 4);
+  uint32_t key_length, contents_length;
+  if (!GetVarint32(&rest, &key_length) ||
+      !GetVarint32(&rest, &contents_length) ||
+      rest.size() < static_cast<uint64_t>(key_length) + contents_length) {
+    return false;
+  }
+  const char* end = rest.data() + key_length + contents_length;
+  if (crc32c::Value(input->data() + 4, end - input->data() - 4) != crc) {
+    return false;
+  }
+  *key = Slice(rest.data(), key_length);
+  *contents = Slice(rest.data() + key_length, contents_length);
+  input->remove_prefix(end - input->data());
+  return true;
+}
+
+PersistentSecondaryCache::PersistentSecondaryCache(Env* env,
+                                                   const std::string& dirname,
+                                                   size_t capacity)
+    : env_(env),
+      dirname_(dirname),
+      capacity_(capacity),
+      segment_size_(std::min(kMaxSegmentSize,
+                             std::max(kMinSegmentSize, capacity / 16))),
+      lock_(nullptr),
+      next_segment_number_(1),
+      last_id_(0),
+      usage_(0),
+      current_(nullptr) {}
+
+PersistentSecondaryCache::~PersistentSecondaryCache() {
+  MutexLock l(&mutex_);
+  if (current_ != nullptr) {
+    // Keep the blocks in memory for the next process
+    SealSegment();
+    for (Segment* segment : segments_) {
+      Unref(segment);
+    }
+  }
+  if (lock_ != nullptr) {
+    env_->UnlockFile(lock_);
+  }
+}
+
+std::string PersistentSecondaryCache::SegmentFileName(uint64_t number) const {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "/%06llu.pcache",
+           static_cast<unsigned long long>(number));
+  return dirname_ + buf;
+}
+
+Status PersistentSecondaryCache::Open() {
+  env_->CreateDir(dirname_);  // Ignore error, the directory may exist
+  Status s = env_->LockFile(dirname_ + "/LOCK", &lock_);
+  if (!s.ok()) {
+    return s;
+  }
+
+  std::vector<std::string> children;
+  s = env_->GetChildren(dirname_, &children);
+  if (!s.ok()) {
+    return s;
+  }
+  std::vector<uint64_t> numbers;
+  for (const std::string& child : children) {
+    unsigned long long number;
+    char junk;
+    if (sscanf(child.c_str(), "%llu.pcache%c", &number, &junk) == 1) {
+      numbers.push_back(number);
+    }
+  }
+  std::sort(numbers.begin(), numbers.end());
+
+  MutexLock l(&mutex_);
+  for (uint64_t number : numbers) {
+    if (!RecoverSegment(number).ok()) {
+      // Unreadable, so of no use as a cache
+      env_->DeleteFile(SegmentFileName(number));
+    }
+    next_segment_number_ = number + 1;
+  }
+  // Draw the ids of the tables that have no unique id at random, so that
+  // they do not collide with the ids of an earlier process.
+  std::random_device random;
+  last_id_ = (static_cast<uint64_t>(random()) << 32) | random();
+  NewSegment();
+  EvictSegments();
+  return Status::OK();
+}
+
+Status PersistentSecondaryCache::RecoverSegment(uint64_t number) {
+  const std::string fname = SegmentFileName(number);
+  std::string data;
+  Status s = ReadFileToString(env_, fname, &data);
+  RandomAccessFile* file = nullptr;
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &file);
+  }
+  if (!s.ok()) {
+    return s;
+  }
+  Segment* segment = new Segment{number, file, data.size(), 1, {}, {}};
+  segments_.push_back(segment);
+  usage_ += segment->size;
+  // Records past a torn write are lost
+  Slice input = data;
+  Slice key, contents;
+  while (true) {
+    const size_t offset = data.size() - input.size();
+    if (!DecodeRecord(&input, &key, &contents)) {
+      break;
+    }
+    AddRecord(segment, key, offset, data.size() - input.size() - offset);
+  }
+  return Status::OK();
+}
+
+void PersistentSecondaryCache::NewSegment() {
+  current_ = new Segment{next_segment_number_++, nullptr, 0, 1, {}, {}};
+  segments_.push_back(current_);
+}
+
+void PersistentSecondaryCache::SealSegment() {
+  Segment* segment = current_;
+  if (segment->buffer.empty()) {
+    return;
+  }
+  NewSegment();
+  segment->refs++;
+
+  // The buffer of the segment no longer changes, so it can be written
+  // without the mutex, which Insert() and Lookup() need meanwhile
+  mutex_.Unlock();
+  const std::string fname = SegmentFileName(segment->number);
+  RandomAccessFile* file = nullptr;
+  Status s = WriteStringToFile(env_, segment->buffer, fname);
+  if (s.ok()) {
+    s = env_->NewRandomAccessFile(fname, &file);
+  }
+  mutex_.Lock();
+
+  if (s.ok()) {
+    segment->file = file;
+    std::string().swap(segment->buffer);
+  } else {
+    // The blocks are lost, which only costs reads of their tables
+    segments_.erase(std::find(segments_.begin(), segments_.end(), segment));
+    DropSegment(segment);
+  }
+  Unref(segment);
+  EvictSegments();
+}
+
+void PersistentSecondaryCache::AddRecord(Segment* segment, const Slice& key,
+                                         size_t offset, size_t size) {
+  segment->keys.push_back(key.ToString());
+  const Slice stored_key(segment->keys.back());
+  // Drop the entry of an earlier record, whose key goes with its segment
+  index_.erase(stored_key);
+  Location& location = index_[stored_key];
+  location.segment = segment;
+  location.offset = static_cast<uint32_t>(offset);
+  location.size = static_cast<uint32_t>(size);
+}
+
+void PersistentSecondaryCache::EvictSegments() {
+  while (usage_ > capacity_ && segments_.front()->file != nullptr) {
+    Segment* oldest = segments_.front();
+    segments_.pop_front();
+    DropSegment(oldest);
+  }
+}
+
+void PersistentSecondaryCache::DropSegment(Segment* segment) {
+  for (const std::string& key : segment->keys) {
+    auto it = index_.find(Slice(key));
+    if (it != index_.end() && it->second.segment == segment) {
+      index_.erase(it);
+    }
+  }
+  usage_ -= segment->size;
+  env_->DeleteFile(SegmentFileName(segment->number));
+  Unref(segment);
+}
+
+void PersistentSecondaryCache::Unref(Segment* segment) {
+  assert(segment->refs > 0);
+  if (--segment->refs == 0) {
+    delete segment->file;
+    delete segment;
+  }
+}
+
+void PersistentSecondaryCache::Insert(const Slice& key,
+                                      const Slice& contents) {
+  {
+    MutexLock l(&mutex_);
+    if (index_.find(key) != index_.end()) {
+      return;  // The contents of a key never change
+    }
+  }
+
+  std::string record;
+  EncodeRecord(key, contents, &record);
+  if (record.size() > segment_size_) {
+    return;  // Not worth a segment of its own
+  }
+
+  MutexLock l(&mutex_);
+  while (true) {
+    if (index_.find(key) != index_.end()) {
+      return;  // Inserted by another thread meanwhile
+    }
+    if (current_->buffer.size() + record.size() <= segment_size_) {
+      break;
+    }
+    // Releases the mutex, so other threads may fill the new segment, or
+    // insert the key, meanwhile
+    SealSegment();
+  }
+  AddRecord(current_, key, current_->buffer.size(), record.size());
+  current_->buffer.append(record);
+  current_->size += record.size();
+  usage_ += record.size();
+  EvictSegments();
+}
+
+// Store in *contents a copy of "data", allocated with new[]
+static void CopyContents(const Slice& data, Slice* contents) {
+  char* buf = new char[data.size()];
+  memcpy(buf, data.data(), data.size());
+  *contents = Slice(buf, data.size());
+}
+
+bool PersistentSecondaryCache::Lookup(const Slice& key, bool promote,
+                                      Slice* contents) {
+  Location location;
+  {
+    MutexLock l(&mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      return false;
+    }
+    location = it->second;
+    if (location.segment->file == nullptr) {
+      const std::string& buffer = location.segment->buffer;
+      Slice input(buffer.data() + location.offset, location.size);
+      Slice record_key, record_contents;
+      if (!DecodeRecord(&input, &record_key, &record_contents)) {
+        return false;
+      }
+      CopyContents(record_contents, contents);
+      return true;
+    }
+    location.segment->refs++;  // Keep the file open while reading it
+  }
+
+  // Read the record without holding the mutex
+  char* scratch = new char[location.size];
+  Slice input;
+  Slice record_key, record_contents;
+  const bool found =
+      location.segment->file
+          ->Read(location.offset, location.size, &input, scratch)
+          .ok() &&
+      DecodeRecord(&input, &record_key, &record_contents) && record_key == key;
+  if (found) {
+    CopyContents(record_contents, contents);
+  }
+  delete[] scratch;
+
+  MutexLock l(&mutex_);
+  Unref(location.segment);
+  return found;
+}
+
+void PersistentSecondaryCache::Erase(const Slice& key) {
+  MutexLock l(&mutex_);
+  index_.erase(key);
+}
+
+uint64_t PersistentSecondaryCache::NewId() {
+  MutexLock l(&mutex_);
+  return ++last_id_;
+}
+
+size_t PersistentSecondaryCache::TotalCharge() const {
+  MutexLock l(&mutex_);
+  return usage_;
+}
+
+}  // namespace
+
+Status NewPersistentSecondaryCache(Env* env, const std::string& dirname,
+                                   size_t capacity, SecondaryCache** result) {
+  *result = nullptr;
+  PersistentSecondaryCache* cache =
+      new PersistentSecondaryCache(env, dirname, capacity);
+  Status s = cache->Open();
+  if (!s.ok()) {
+    delete cache;
+    return s;
+  }
+  *result = cache;
+  return s;
+}
+
+}  // namespace leveldb
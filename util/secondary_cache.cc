@@ -0,0 +1,105 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/secondary_cache.h"
+
+#include <string.h>
+
+#include "leveldb/cache.h"
+#include "port/port.h"
+
+namespace leveldb {
+
+SecondaryCache::~SecondaryCache() {}
+
+namespace {
+
+// Holds the blocks in an LRU cache, as strings made of a CompressionType
+// byte and the contents compressed with that type.
+class CompressedSecondaryCache : public SecondaryCache {
+ public:
+  CompressedSecondaryCache(size_t capacity, CompressionType compression)
+      : cache_(NewLRUCache(capacity, 0, false)), compression_(compression) {}
+
+  ~CompressedSecondaryCache() override { delete cache_; }
+
+  const char* Name() const override {
+    return "leveldb.CompressedSecondaryCache";
+  }
+
+  void Insert(const Slice& key, const Slice& contents) override {
+    std::string* value = new std::string(1, kNoCompression);
+    std::string compressed;
+    // Like TableBuilder, only keep the compressed form if it saves at least
+    // 12.5%
+    if (compression_ == kSnappyCompression &&
+        port::Snappy_Compress(contents.data(), contents.size(),
+                              &compressed) &&
+        compressed.size() < contents.size() - (contents.size() / 8u)) {
+      (*value)[0] = kSnappyCompression;
+      value->append(compressed);
+    } else {
+      value->append(contents.data(), contents.size());
+    }
+    cache_->Release(
+        cache_->Insert(key, value, value->size(), &DeleteValue));
+  }
+
+  bool Lookup(const Slice& key, bool promote, Slice* contents) override {
+    Cache::Handle* handle = cache_->Lookup(key);
+    if (handle == nullptr) {
+      return false;
+    }
+    const std::string* value =
+        reinterpret_cast<const std::string*>(cache_->Value(handle));
+    const char* data = value->data() + 1;
+    const size_t n = value->size() - 1;
+    bool ok = true;
+    if ((*value)[0] == static_cast<char>(kSnappyCompression)) {
+      size_t ulength = 0;
+      ok = port::Snappy_GetUncompressedLength(data, n, &ulength);
+      if (ok) {
+        char* ubuf = new char[ulength];
+        ok = port::Snappy_Uncompress(data, n, ubuf);
+        if (ok) {
+          *contents = Slice(ubuf, ulength);
+        } else {
+          delete[] ubuf;
+        }
+      }
+    } else {
+      char* buf = new char[n];
+      memcpy(buf, data, n);
+      *contents = Slice(buf, n);
+    }
+    cache_->Release(handle);
+    if (ok && promote) {
+      cache_->Erase(key);
+    }
+    return ok;
+  }
+
+  void Erase(const Slice& key) override { cache_->Erase(key); }
+
+  uint64_t NewId() override { return cache_->NewId(); }
+
+  size_t TotalCharge() const override { return cache_->TotalCharge(); }
+
+ private:
+  static void DeleteValue(const Slice& key, void* value) {
+    delete reinterpret_cast<std::string*>(value);
+  }
+
+  Cache* const cache_;
+  const CompressionType compression_;
+};
+
+}  // namespace
+
+SecondaryCache* NewCompressedSecondaryCache(size_t capacity,
+                                            CompressionType compression) {
+  return new CompressedSecondaryCache(capacity, compression);
+}
+
+}  // namespace leveldb
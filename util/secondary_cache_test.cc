@@ -0,0 +1,346 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/secondary_cache.h"
+
+#include <string>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+#include "util/testharness.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  std::string result;
+  PutFixed64(&result, i);
+  return result;
+}
+
+class CompressedSecondaryCacheTest {
+ public:
+  static const int kCapacity = 64 << 10;
+
+  CompressedSecondaryCacheTest()
+      : cache_(NewCompressedSecondaryCache(kCapacity)) {}
+
+  ~CompressedSecondaryCacheTest() { delete cache_; }
+
+  // Contents of about "n" bytes that compress to about half their size
+  static std::string Contents(int i, int n) {
+    Random rnd(i);
+    std::string result;
+    test::CompressibleString(&rnd, 0.5, n, &result);
+    return result;
+  }
+
+  std::string Lookup(int i) {
+    Slice contents;
+    if (!cache_->Lookup(Key(i), false, &contents)) {
+      return "NOT_FOUND";
+    }
+    std::string result = contents.ToString();
+    delete[] contents.data();
+    return result;
+  }
+
+  SecondaryCache* cache_;
+};
+
+TEST(CompressedSecondaryCacheTest, InsertLookupErase) {
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  const std::string contents = Contents(1, 4096);
+  cache_->Insert(Key(1), contents);
+  ASSERT_EQ(contents, Lookup(1));
+  ASSERT_EQ("NOT_FOUND", Lookup(2));
+
+  cache_->Insert(Key(1), "replaced");
+  ASSERT_EQ("replaced", Lookup(1));
+
+  cache_->Insert(Key(2), "");
+  ASSERT_EQ("", Lookup(2));
+
+  cache_->Erase(Key(1));
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  ASSERT_EQ("", Lookup(2));
+
+  // Promoted blocks are dropped
+  Slice promoted;
+  ASSERT_TRUE(cache_->Lookup(Key(2), true, &promoted));
+  delete[] promoted.data();
+  ASSERT_EQ("NOT_FOUND", Lookup(2));
+}
+
+TEST(CompressedSecondaryCacheTest, Capacity) {
+  const int kBlocks = 100;
+  for (int i = 0; i < kBlocks; i++) {
+    cache_->Insert(Key(i), Contents(i, 4096));
+  }
+  ASSERT_LE(cache_->TotalCharge(), static_cast<size_t>(kCapacity) * 11 / 10);
+
+  // The most recent blocks are still there, intact
+  ASSERT_EQ(Contents(kBlocks - 1, 4096), Lookup(kBlocks - 1));
+  ASSERT_EQ("NOT_FOUND", Lookup(0));
+
+  std::string compressed;
+  if (port::Snappy_Compress("x", 1, &compressed)) {
+    // Compressed, the blocks take about half the room
+    int held = 0;
+    for (int i = 0; i < kBlocks; i++) {
+      if (Lookup(i) != "NOT_FOUND") {
+        held++;
+      }
+    }
+    ASSERT_GE(held, (kCapacity / 4096) * 3 / 2);
+  }
+}
+
+TEST(CompressedSecondaryCacheTest, NoCompression) {
+  delete cache_;
+  cache_ = NewCompressedSecondaryCache(kCapacity, kNoCompression);
+  const std::string contents = Contents(1, 4096);
+  cache_->Insert(Key(1), contents);
+  ASSERT_EQ(contents, Lookup(1));
+  ASSERT_EQ(contents.size() + 1, cache_->TotalCharge());
+}
+
+TEST(CompressedSecondaryCacheTest, NewId) {
+  const uint64_t a = cache_->NewId();
+  const uint64_t b = cache_->NewId();
+  ASSERT_NE(a, b);
+}
+
+class PersistentSecondaryCacheTest {
+ public:
+  static const int kCapacity = 1 << 20;
+
+  PersistentSecondaryCacheTest()
+      : env_(Env::Default()),
+        dirname_(test::TmpDir() + "/persistent_cache_test"),
+        cache_(nullptr) {
+    std::vector<std::string> children;
+    env_->GetChildren(dirname_, &children);
+    for (const std::string& child : children) {
+      env_->DeleteFile(dirname_ + "/" + child);
+    }
+    Reopen(kCapacity);
+  }
+
+  ~PersistentSecondaryCacheTest() { delete cache_; }
+
+  void Reopen(size_t capacity) {
+    delete cache_;
+    cache_ = nullptr;
+    ASSERT_OK(NewPersistentSecondaryCache(env_, dirname_, capacity, &cache_));
+  }
+
+  std::string Lookup(int i) {
+    Slice contents;
+    if (!cache_->Lookup(Key(i), true, &contents)) {
+      return "NOT_FOUND";
+    }
+    std::string result = contents.ToString();
+    delete[] contents.data();
+    return result;
+  }
+
+  static std::string Contents(int i) {
+    Random rnd(i);
+    std::string result;
+    test::RandomString(&rnd, 4000, &result);
+    return result;
+  }
+
+  Env* env_;
+  std::string dirname_;
+  SecondaryCache* cache_;
+};
+
+TEST(PersistentSecondaryCacheTest, Basics) {
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  cache_->Insert(Key(1), Contents(1));
+  cache_->Insert(Key(2), "");
+  ASSERT_EQ(Contents(1), Lookup(1));
+  ASSERT_EQ("", Lookup(2));
+  ASSERT_EQ("NOT_FOUND", Lookup(3));
+  ASSERT_GT(cache_->TotalCharge(), 4000);
+
+  cache_->Erase(Key(1));
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  ASSERT_NE(cache_->NewId(), cache_->NewId());
+}
+
+TEST(PersistentSecondaryCacheTest, SurvivesRestart) {
+  const int kBlocks = 100;  // In several segments
+  for (int i = 0; i < kBlocks; i++) {
+    cache_->Insert(Key(i), Contents(i));
+  }
+  const size_t usage = cache_->TotalCharge();
+  Reopen(kCapacity);
+  ASSERT_EQ(usage, cache_->TotalCharge());
+  for (int i = 0; i < kBlocks; i++) {
+    ASSERT_EQ(Contents(i), Lookup(i));
+  }
+
+  // Another cache may not use the directory at the same time
+  SecondaryCache* other;
+  ASSERT_TRUE(
+      !NewPersistentSecondaryCache(env_, dirname_, kCapacity, &other).ok());
+  ASSERT_TRUE(other == nullptr);
+}
+
+TEST(PersistentSecondaryCacheTest, DropsOldestSegments) {
+  const int kBlocks = 1000;
+  for (int i = 0; i < kBlocks; i++) {
+    cache_->Insert(Key(i), Contents(i));
+    ASSERT_LE(cache_->TotalCharge(), static_cast<size_t>(kCapacity));
+  }
+  ASSERT_EQ("NOT_FOUND", Lookup(0));
+  ASSERT_EQ(Contents(kBlocks - 1), Lookup(kBlocks - 1));
+
+  // A smaller capacity drops the oldest blocks on opening
+  Reopen(kCapacity / 4);
+  ASSERT_LE(cache_->TotalCharge(), static_cast<size_t>(kCapacity / 4));
+  ASSERT_EQ(Contents(kBlocks - 1), Lookup(kBlocks - 1));
+  ASSERT_EQ("NOT_FOUND", Lookup(kBlocks - 200));
+}
+
+// Holds up the writes of segment files until Unblock() is called
+class BlockingSegmentEnv : public EnvWrapper {
+ public:
+  BlockingSegmentEnv()
+      : EnvWrapper(Env::Default()), cv_(&mu_), blocked_(false),
+        unblocked_(false) {}
+
+  Status NewWritableFile(const std::string& fname,
+                         WritableFile** result) override {
+    if (fname.find(".pcache") != std::string::npos) {
+      MutexLock l(&mu_);
+      blocked_ = true;
+      cv_.SignalAll();
+      while (!unblocked_) {
+        cv_.Wait();
+      }
+    }
+    return target()->NewWritableFile(fname, result);
+  }
+
+  void WaitUntilBlocked() {
+    MutexLock l(&mu_);
+    while (!blocked_) {
+      cv_.Wait();
+    }
+  }
+
+  void Unblock() {
+    MutexLock l(&mu_);
+    unblocked_ = true;
+    cv_.SignalAll();
+  }
+
+ private:
+  port::Mutex mu_;
+  port::CondVar cv_ GUARDED_BY(mu_);
+  bool blocked_ GUARDED_BY(mu_);
+  bool unblocked_ GUARDED_BY(mu_);
+};
+
+namespace {
+
+// Shared with the thread of InsertBlocks()
+struct InsertState {
+  SecondaryCache* cache;
+  int blocks;
+  port::Mutex mu;
+  port::CondVar cv GUARDED_BY(mu);
+  bool done GUARDED_BY(mu);
+
+  InsertState() : cv(&mu), done(false) {}
+};
+
+static void InsertBlocks(void* arg) {
+  InsertState* state = reinterpret_cast<InsertState*>(arg);
+  for (int i = 0; i < state->blocks; i++) {
+    state->cache->Insert(Key(i), PersistentSecondaryCacheTest::Contents(i));
+  }
+  MutexLock l(&state->mu);
+  state->done = true;
+  state->cv.SignalAll();
+}
+
+}  // namespace
+
+TEST(PersistentSecondaryCacheTest, LookupWhileSealing) {
+  BlockingSegmentEnv env;
+  delete cache_;
+  cache_ = nullptr;
+  env_ = &env;
+  Reopen(kCapacity);
+
+  // More blocks than fit in a segment, so that the thread blocks writing
+  // the first one out
+  InsertState state;
+  state.cache = cache_;
+  state.blocks = 20;
+  Env::Default()->StartThread(&InsertBlocks, &state);
+  env.WaitUntilBlocked();
+
+  // The blocks of the segment being written, and new ones, are served
+  // meanwhile
+  ASSERT_EQ(Contents(0), Lookup(0));
+  cache_->Insert(Key(100), Contents(100));
+  ASSERT_EQ(Contents(100), Lookup(100));
+
+  env.Unblock();
+  {
+    MutexLock l(&state.mu);
+    while (!state.done) {
+      state.cv.Wait();
+    }
+  }
+  for (int i = 0; i < state.blocks; i++) {
+    ASSERT_EQ(Contents(i), Lookup(i));
+  }
+  delete cache_;
+  cache_ = nullptr;
+  env_ = Env::Default();
+}
+
+TEST(PersistentSecondaryCacheTest, TornSegment) {
+  const int kBlocks = 10;
+  for (int i = 0; i < kBlocks; i++) {
+    cache_->Insert(Key(i), Contents(i));
+  }
+  delete cache_;
+  cache_ = nullptr;
+
+  // Lose the end of the segment, as a crash while writing it would
+  std::vector<std::string> children;
+  ASSERT_OK(env_->GetChildren(dirname_, &children));
+  std::string segment;
+  for (const std::string& child : children) {
+    if (child.find(".pcache") != std::string::npos) {
+      segment = dirname_ + "/" + child;
+    }
+  }
+  std::string data;
+  ASSERT_OK(ReadFileToString(env_, segment, &data));
+  data.resize(data.size() - 100);
+  ASSERT_OK(WriteStringToFile(env_, data, segment));
+
+  Reopen(kCapacity);
+  for (int i = 0; i < kBlocks - 1; i++) {
+    ASSERT_EQ(Contents(i), Lookup(i));
+  }
+  ASSERT_EQ("NOT_FOUND", Lookup(kBlocks - 1));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
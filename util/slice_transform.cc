@@ -0,0 +1,86 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/slice_transform.h"
+
+#include <string>
+
+#include "leveldb/slice.h"
+#include "util/logging.h"
+
+namespace leveldb {
+
+SliceTransform::~SliceTransform() {}
+
+namespace {
+
+class FixedPrefixTransform : public SliceTransform {
+ public:
+  explicit FixedPrefixTransform(size_t prefix_len)
+      : prefix_len_(prefix_len),
+        name_("leveldb.FixedPrefix." + NumberToString(prefix_len)) {}
+
+  const char* Name() const override { return name_.c_str(); }
+
+  Slice Transform(const Slice& key) const override {
+    return Slice(key.data(), prefix_len_);
+  }
+
+  bool InDomain(const Slice& key) const override {
+    return key.size() >= prefix_len_;
+  }
+
+ private:
+  const size_t prefix_len_;
+  const std::string name_;
+};
+
+class DelimitedPrefixTransform : public SliceTransform {
+ public:
+  DelimitedPrefixTransform(char delimiter, int count)
+      : delimiter_(delimiter),
+        count_(count),
+        name_("leveldb.DelimitedPrefix." +
+              NumberToString(static_cast<unsigned char>(delimiter)) + "." +
+              NumberToString(count)) {}
+
+  const char* Name() const override { return name_.c_str(); }
+
+  Slice Transform(const Slice& key) const override {
+    return Slice(key.data(), PrefixLength(key));
+  }
+
+  bool InDomain(const Slice& key) const override {
+    return PrefixLength(key) > 0 || count_ <= 0;
+  }
+
+ private:
+  // The length of the prefix of "key", or 0 if it has fewer delimiters
+  // than count_
+  size_t PrefixLength(const Slice& key) const {
+    int found = 0;
+    for (size_t i = 0; i < key.size() && found < count_; i++) {
+      if (key[i] == delimiter_ && ++found == count_) {
+        return i + 1;
+      }
+    }
+    return 0;
+  }
+
+  const char delimiter_;
+  const int count_;
+  const std::string name_;
+};
+
+}  // namespace
+
+const SliceTransform* NewFixedPrefixTransform(size_t prefix_len) {
+  return new FixedPrefixTransform(prefix_len);
+}
+
+const SliceTransform* NewDelimitedPrefixTransform(char delimiter, int count) {
+  return new DelimitedPrefixTransform(delimiter, count);
+}
+
+}  // namespace leveldb